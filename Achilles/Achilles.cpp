@@ -1,5 +1,6 @@
 #include "Achilles.h"
 #include "shaders/BlinnPhong.h"
+#include "shaders/DepthReduction.h"
 #include "shaders/ShadowMapping.h"
 #include "shaders/Skybox.h"
 #include "shaders/StartupScreen.h"
@@ -365,19 +366,6 @@ void Achilles::UpdateMainRenderTarget()
     UpdateDepthStencilView();
 }
 
-std::shared_ptr<Texture> Achilles::CreateIntermediatePresentTexture()
-{
-    DXGI_SAMPLE_DESC sampleDesc = { 1,0 };
-    CD3DX12_RESOURCE_DESC resDesc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM, clientWidth, clientHeight, 1, 1, sampleDesc.Count, sampleDesc.Quality, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-
-    std::shared_ptr<Texture> tex = std::make_shared<Texture>(resDesc, nullptr, TextureUsage::Generic, L"Intermediate Present Texture");
-    tex->CreateViews();
-
-    ResourceStateTracker::AddGlobalResourceState(tex->GetD3D12Resource().Get(), D3D12_RESOURCE_STATE_COMMON);
-
-    return tex;
-}
-
 void Achilles::UpdatePreLoadedRenderTarget()
 {
     if (preloadedRenderTarget == nullptr)
@@ -407,25 +395,6 @@ void Achilles::UpdatePreLoadedRenderTarget()
     }
 }
 
-void Achilles::UpdateSingleSampledTexture()
-{
-    if (singleSampledTexture == nullptr)
-    {
-        std::shared_ptr<Texture> mainRTTexture = GetCurrentRenderTarget()->GetTexture(AttachmentPoint::Color0);
-        D3D12_RESOURCE_DESC desc = mainRTTexture->GetD3D12ResourceDesc();
-        desc.SampleDesc = { 1,0 };
-        desc.Flags = D3D12_RESOURCE_FLAG_NONE;
-        desc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
-
-        singleSampledTexture = std::make_shared<Texture>(desc, nullptr, TextureUsage::Generic, L"Single Sampled Main Render Texture");
-        ResourceStateTracker::AddGlobalResourceState(singleSampledTexture->GetD3D12Resource().Get(), D3D12_RESOURCE_STATE_COMMON);
-    }
-    else
-    {
-        singleSampledTexture->Resize(clientWidth, clientHeight);
-    }
-}
-
 ComPtr<ID3D12CommandAllocator> Achilles::CreateCommandAllocator(ComPtr<ID3D12Device2> device, D3D12_COMMAND_LIST_TYPE type)
 {
     ComPtr<ID3D12CommandAllocator> commandAllocator;
@@ -458,11 +427,6 @@ std::shared_ptr<RenderTarget> Achilles::GetSwapChainRenderTarget() const
     return swapChainRenderTarget;
 }
 
-std::shared_ptr<Texture> Achilles::GetIntermediatePresentTexture() const
-{
-    return intermediatePresentTexture;
-}
-
 // Stall CPU while we signal and wait
 void Achilles::Flush()
 {
@@ -617,6 +581,7 @@ void Achilles::Present(std::shared_ptr<CommandQueue> commandQueue, std::shared_p
     commandQueue->WaitForFenceValue(fenceValues[currentBackBufferIndex]);
 
     Application::ReleaseStaleDescriptors(frameValues[currentBackBufferIndex]);
+    GeometryArena::ReleaseStaleAllocations(frameValues[currentBackBufferIndex]);
 
     CallPostPresentFunctions();
 }
@@ -648,6 +613,23 @@ void Achilles::UnloadPreLoadedAssets()
 
 void Achilles::LoadInternalContent()
 {
+    // Start compiling every engine shader at once, the Get*Shader calls below and in LoadContent then only wait on their own stages
+    ShaderCompiler::Precompile(L"Skybox", ShaderType::VSPS);
+    ShaderCompiler::Precompile(L"ShadowMapping", ShaderType::VSPS);
+    ShaderCompiler::Precompile(L"ShadowMappingPoint", ShaderType::VSPS);
+    ShaderCompiler::Precompile(L"ZPrePass", ShaderType::VSPS);
+    ShaderCompiler::Precompile(L"BlinnPhong", ShaderType::VSPS);
+    ShaderCompiler::Precompile(L"SpriteUnlit", ShaderType::VSPS);
+    ShaderCompiler::Precompile(L"DebugWireframe", ShaderType::VSPS);
+    ShaderCompiler::Precompile(L"PPBloomExtract", ShaderType::CS);
+    ShaderCompiler::Precompile(L"PPBloomDownsample", ShaderType::CS);
+    ShaderCompiler::Precompile(L"PPBloomApply", ShaderType::CS);
+    ShaderCompiler::Precompile(L"PPBlur", ShaderType::CS);
+    ShaderCompiler::Precompile(L"PPBlurUpsample", ShaderType::CS);
+    ShaderCompiler::Precompile(L"PPToneMapping", ShaderType::CS);
+    ShaderCompiler::Precompile(L"PPGammaCorrection", ShaderType::CS);
+    ShaderCompiler::Precompile(L"DepthReduction", ShaderType::CS);
+
     std::shared_ptr<CommandQueue> commandQueue = GetCommandQueue(D3D12_COMMAND_LIST_TYPE_COPY);
     std::shared_ptr<CommandList> commandList = commandQueue->GetCommandList();
 
@@ -705,30 +687,27 @@ void Achilles::LoadInternalContent()
     commandQueue->ExecuteCommandList(commandList);
 }
 
-std::shared_ptr<Texture> Achilles::ResolveToSingleSampledTexture(std::shared_ptr<CommandList> commandList, std::shared_ptr<Texture> texture)
+RenderGraph::ResourceHandle Achilles::AddResolvePass(RenderGraph& graph, uint32_t segment, RenderGraph::ResourceHandle texture)
 {
-    if (Application::GetMSAA() == MSAA::Off)
-    {
-        //commandList->CopyResource(*singleSampledTexture, *texture);
-        return texture;
-    }
-    else
-    {
-        commandList->ResolveSubresource(*singleSampledTexture, *texture);
-        commandList->TransitionBarrier(*singleSampledTexture, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, true);
-    }
+    D3D12_RESOURCE_DESC desc = graph.GetDesc(texture);
+    desc.SampleDesc = { 1,0 };
+    desc.Flags = D3D12_RESOURCE_FLAG_NONE;
+    desc.Alignment = 0;
+    RenderGraph::ResourceHandle singleSampledTexture = graph.CreateTransientTexture(L"Single Sampled Main Render Texture", desc);
+
+    uint32_t pass = graph.AddPass(L"Resolve", segment, [=](RenderGraph& renderGraph, std::shared_ptr<CommandList> commandList)
+        {
+            commandList->ResolveSubresource(*renderGraph.GetTexture(singleSampledTexture), *renderGraph.GetTexture(texture));
+        });
+    graph.Read(pass, texture, D3D12_RESOURCE_STATE_RESOLVE_SOURCE);
+    graph.Write(pass, singleSampledTexture, D3D12_RESOURCE_STATE_RESOLVE_DEST);
+
     return singleSampledTexture;
 }
 
-void Achilles::ApplyPostProcessing(std::shared_ptr<CommandList> commandList, std::shared_ptr<Texture> texture, std::shared_ptr<Texture> presentTexture)
+void Achilles::AddPostProcessingPasses(RenderGraph& graph, uint32_t segment, RenderGraph::ResourceHandle texture, RenderGraph::ResourceHandle presentTexture)
 {
-    ScopedTimer _prof(L"Post Processing");
-
-    computeCommandQueue->Wait(*directCommandQueue); // Waiting used instead of flushing
-
-    postProcessing->ApplyPostProcessing(texture, presentTexture, postProcessingEnable);
-
-    directCommandQueue->Wait(*computeCommandQueue);
+    postProcessing->AddPasses(graph, segment, texture, presentTexture, postProcessingEnable);
 }
 
 void Achilles::CallPostPresentFunctions()
@@ -786,6 +765,9 @@ void Achilles::Update()
         OnMouse(mouseTracker, mouseData, mouseState, dt);
     OnGamePad(dt);
 
+    TextureStreamer::Update();
+    TextureResidency::Update();
+
     OnUpdate(dt);
 }
 
@@ -793,6 +775,11 @@ void Achilles::Render()
 {
     ScopedTimer _prof(L"Render");
     frameCounter++;
+    // Thetis shows the counts from the frame before
+    Camera::lastContributionCounters.Main = Camera::contributionCounters.Main;
+    Camera::contributionCounters.Main = {};
+    Camera::lastContributionCounters.PrePass = Camera::contributionCounters.PrePass;
+    Camera::contributionCounters.PrePass = {};
     std::chrono::steady_clock::time_point currClock = clock.now();
     std::chrono::duration<long long, std::nano> deltaTime = currClock - prevRenderClock;
     prevRenderClock = currClock;
@@ -826,6 +813,19 @@ void Achilles::Render()
     float dt = deltaTime.count() * 1e-9f;
     OnRender(dt);
     DrawActiveScenes(); // Defer events until DrawQueuedEvents
+    GeometryArena::FlushUploads(directCommandList); // Before any draws, so meshes uploaded this frame are ready
+
+    // The frame's passes are declared up front, then the graph culls what isn't needed and places the barriers between them
+    // Scene passes run on the direct queue, post processing on the compute queue and the copy to the back buffer back on the direct queue
+    RenderGraph graph;
+    uint32_t sceneSegment = graph.AddSegment(D3D12_COMMAND_LIST_TYPE_DIRECT);
+    uint32_t postProcessingSegment = graph.AddSegment(D3D12_COMMAND_LIST_TYPE_COMPUTE);
+    uint32_t presentSegment = graph.AddSegment(D3D12_COMMAND_LIST_TYPE_DIRECT);
+
+    RenderGraph::ResourceHandle color = graph.ImportTexture(L"Main Render Target", rtTexture);
+    std::shared_ptr<Texture> depthTexture = rt->GetTexture(AttachmentPoint::DepthStencil);
+    RenderGraph::ResourceHandle depth = graph.ImportTexture(L"Main Depth", depthTexture);
+    RenderGraph::ResourceHandle shadowAtlas = graph.ImportTexture(L"Shadow Atlas", ShadowAtlas::GetAtlas());
 
     // Shadow rendering
     shadowRateCounter += dt;
@@ -834,35 +834,64 @@ void Achilles::Render()
         updateShadowsNextFrame = false;
         shadowRateCounter = 0.0f;
 
-        DrawShadowScenes(directCommandList, Camera::mainCamera); // Immediately renders the active scene objects from the shadow camera perspectives. Also populates lightData
+        uint32_t pass = graph.AddPass(L"Shadows", sceneSegment, [this](RenderGraph&, std::shared_ptr<CommandList> commandList)
+            {
+                DrawShadowScenes(commandList, Camera::mainCamera); // Immediately renders the active scene objects from the shadow camera perspectives. Also populates lightData
+            });
+        graph.Write(pass, shadowAtlas, D3D12_RESOURCE_STATE_DEPTH_WRITE);
     }
 
-    DrawQueuedEvents(directCommandList); // Rendering deferred events
-    OnPostRender(dt);
-
-    // Transition ready for post processing's compute command list
-    directCommandList->TransitionBarrier(*rtTexture, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, true);
-
-    std::shared_ptr<Texture> singleSampledTexture = ResolveToSingleSampledTexture(directCommandList, rtTexture);
-
+    if (doZPrePass)
     {
-        ScopedTimer _prof(L"Execute Command List");
-        directCommandQueue->ExecuteCommandList(directCommandList);
-    }
-
-    std::shared_ptr<CommandList> presentCommandList = directCommandQueue->GetCommandList();
+        uint32_t pass = graph.AddPass(L"Z-PrePass", sceneSegment, [this](RenderGraph&, std::shared_ptr<CommandList> commandList)
+            {
+                DrawZPrePass(commandList);
+            });
+        graph.Write(pass, depth, D3D12_RESOURCE_STATE_DEPTH_WRITE);
 
-    std::shared_ptr<Texture> intermediatePresentTexture = GetIntermediatePresentTexture();
+        // Read back next frame to fit the directional cascades to what's visible
+        if (Camera::mainCamera != nullptr)
+        {
+            pass = graph.AddPass(L"Depth Reduction", sceneSegment, [depthTexture](RenderGraph&, std::shared_ptr<CommandList> commandList)
+                {
+                    DepthReduction::ReduceDepth(commandList, depthTexture, Camera::mainCamera);
+                });
+            graph.Read(pass, depth, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+        }
+    }
 
-    ApplyPostProcessing(presentCommandList, singleSampledTexture, intermediatePresentTexture);
+    uint32_t scenePass = graph.AddPass(L"Scene", sceneSegment, [this, dt](RenderGraph&, std::shared_ptr<CommandList> commandList)
+        {
+            AssignLights();
+            DrawQueuedEvents(commandList); // Rendering deferred events
+            OnPostRender(dt);
+        });
+    graph.Write(scenePass, color, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    graph.Write(scenePass, depth, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+    graph.Read(scenePass, shadowAtlas, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+
+    RenderGraph::ResourceHandle sceneTexture = color;
+    if (Application::GetMSAA() != MSAA::Off)
+        sceneTexture = AddResolvePass(graph, sceneSegment, color);
+
+    CD3DX12_RESOURCE_DESC presentDesc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM, clientWidth, clientHeight, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    RenderGraph::ResourceHandle intermediatePresentTexture = graph.CreateTransientTexture(L"Intermediate Present Texture", presentDesc);
+    AddPostProcessingPasses(graph, postProcessingSegment, sceneTexture, intermediatePresentTexture);
 
     std::shared_ptr<RenderTarget> presentRT = GetSwapChainRenderTarget();
-    std::shared_ptr<Texture> presentTexture = presentRT->GetTexture(AttachmentPoint::Color0);
+    RenderGraph::ResourceHandle presentTexture = graph.ImportTexture(L"Back Buffer", presentRT->GetTexture(AttachmentPoint::Color0));
+    uint32_t presentPass = graph.AddPass(L"Present Copy", presentSegment, [=](RenderGraph& renderGraph, std::shared_ptr<CommandList> commandList)
+        {
+            commandList->CopyResource(*renderGraph.GetTexture(presentTexture), *renderGraph.GetTexture(intermediatePresentTexture));
+        });
+    graph.Read(presentPass, intermediatePresentTexture, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    graph.Write(presentPass, presentTexture, D3D12_RESOURCE_STATE_COPY_DEST);
 
-    presentCommandList->CopyResource(*presentTexture, *intermediatePresentTexture);
+    graph.Compile();
+    renderGraphStatistics = graph.GetStatistics();
 
-    // Transition back from post processing's compute command list
-    presentCommandList->TransitionBarrier(*presentTexture, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, true);
+    // ImGui is recorded on the returned present command list, which is left open for it
+    std::shared_ptr<CommandList> presentCommandList = graph.Execute(directCommandList);
 
     achillesImGui->Render(presentCommandList, *presentRT);
 
@@ -1007,18 +1036,14 @@ void Achilles::Resize(uint32_t width, uint32_t height)
 
         UpdateMainRenderTarget();
         UpdateRenderTargetViews();
-        GetIntermediatePresentTexture()->Resize(clientWidth, clientHeight);
-        UpdateSingleSampledTexture();
 
         if (isLoading)
             UpdatePreLoadedRenderTarget();
 
         Flush();
 
-        if (postProcessing != nullptr)
-        {
-            postProcessing->Resize(clientWidth, clientHeight);
-        }
+        // Transients placed at the old size would only be evicted once they go unused for long enough
+        RenderGraph::Release();
 
         OnResize(clientWidth, clientHeight);
     }
@@ -1144,9 +1169,6 @@ void Achilles::Initialize()
 
     UpdateRenderTargetViews();
 
-    intermediatePresentTexture = CreateIntermediatePresentTexture();
-    UpdateSingleSampledTexture();
-
     for (int i = 0; i < BufferCount; ++i)
     {
         commandAllocators[i] = CreateCommandAllocator(device, D3D12_COMMAND_LIST_TYPE_DIRECT);
@@ -1165,6 +1187,10 @@ void Achilles::Initialize()
     mainScene = std::make_shared<Scene>(L"Main");
     AddScene(mainScene);
 
+    // Content comes from content.pack when there is one, otherwise from loose files in the content directory
+    if (!ContentPack::IsMounted())
+        ContentPack::Mount(ContentPack::GetDefaultPackPath(), GetContentDirectoryW());
+
     LoadVitalContent();
     isInitialized = true;
     isLoading = true;
@@ -1181,6 +1207,8 @@ void Achilles::Initialize()
             if (isDestroying)
                 return;
 
+            ShaderCompiler::PrintTimings();
+
             // Done so we don't load too fast and cause flashes
             size_t milliseconds = 250;
             for (size_t i = 0; i < (milliseconds / 50); i++)
@@ -1258,8 +1286,17 @@ void Achilles::Destroy()
     if (isInitialized && isLoading && loadContentThread.joinable())
         loadContentThread.join();
 
+    TextureStreamer::Shutdown();
+    ShaderCompiler::Shutdown();
+    ContentPack::Unmount();
+
     EmptyDrawQueue();
     UnloadContent();
+    ShadowAtlas::Release();
+    DepthReduction::Release();
+    ShadowScheduler::Release();
+    VisibilityCache::Release();
+    RenderGraph::Release();
     achillesImGui.reset();
 
     for (int i = 0; i < BufferCount; ++i)
@@ -1319,6 +1356,7 @@ void Achilles::DrawActiveScenes()
     ScopedTimer _prof(L"DrawActiveScenes");
 
     // Pre-scene-render light gathering pass
+    std::vector<std::shared_ptr<Object>> activeObjects;
     for (std::shared_ptr<Scene> scene : scenes)
     {
         if (scene->IsActive())
@@ -1326,9 +1364,17 @@ void Achilles::DrawActiveScenes()
             std::vector<std::shared_ptr<Object>> flattenedScene;
             scene->GetObjectTree()->FlattenActive(flattenedScene);
             ConstructLightPositions(flattenedScene, Camera::mainCamera);
+            activeObjects.insert(activeObjects.end(), flattenedScene.begin(), flattenedScene.end());
         }
     }
 
+    // Occluders are drawn before queuing so the objects they hide are never queued
+    // Not while viewing from a shadow camera, as the objects are queued for that instead
+    if (occlusionCulling && Camera::debugShadowCamera == nullptr)
+        occlusionBuffer.Render(Camera::mainCamera, activeObjects);
+    else
+        occlusionBuffer.Clear();
+
     // Scene drawing
     for (std::shared_ptr<Scene> scene : scenes)
     {
@@ -1340,6 +1386,8 @@ void Achilles::DrawActiveScenes()
 void Achilles::DrawShadowScenes(std::shared_ptr<CommandList> commandList, std::shared_ptr<Camera> camera)
 {
     ScopedTimer _prof(L"DrawShadowScenes");
+    Camera::lastContributionCounters.Shadow = Camera::contributionCounters.Shadow;
+    Camera::contributionCounters.Shadow = {};
     // Get all objects from each active scene
     std::vector<std::shared_ptr<Object>> flattenedScenes = GetEveryActiveObject();
     std::map<LightObject*, std::shared_ptr<ShadowCamera>> lightObjectShadowCameraMap; // added to avoid getting the camera twice, causing ShadowCamera::UpdateMatrix to be called twice
@@ -1402,66 +1450,108 @@ void Achilles::DrawShadowScenes(std::shared_ptr<CommandList> commandList, std::s
     }
 #pragma endregion
 
-    // Sort all lights by rank and if they are a shadow caster
-    std::sort(allLights.begin(), allLights.end(), CombinedLightRankSort);
+    // Pick which shadow casting lights get shadows this update and sort them to the front
+    // Lights are scored from their coverage, distance, intensity and rank rather than rank alone, see ShadowScheduler
+    std::vector<ShadowScheduler::ScheduledShadow> scheduledShadows = ShadowScheduler::Schedule(allLights, camera);
 
     ClearLightData(lightData);
 
     // Populate ShadowCameras
 #pragma region Shadow Camera Population and Drawing
     lightData.ShadowCameras.clear();
-    for (CombinedLight combinedLight : allLights)
+
+    // Size each scheduled light's atlas tiles before updating its matrices, as directional cascades snap to their texel size
+    std::vector<ShadowAtlas::TileRequest> tileRequests;
+    for (const ShadowScheduler::ScheduledShadow& scheduled : scheduledShadows)
     {
-        if (camera == nullptr)
-            break;
+        ShadowAtlas::TileRequest request
+        {
+            .ShadowCamera = scheduled.ShadowCamera,
+            .TileSize = scheduled.TileSize,
+        };
+        tileRequests.push_back(request);
+    }
 
-        LightObject* lightObject = combinedLight.LightObject;
-        if (combinedLight.LightType == LightType::Point)
+    lightData.ShadowAtlasMap = ShadowAtlas::GetAtlas();
+    ShadowAtlas::Allocate(tileRequests);
+
+    for (const ShadowScheduler::ScheduledShadow& scheduled : scheduledShadows)
+    {
+        LightObject* lightObject = scheduled.LightObject;
+        std::shared_ptr<ShadowCamera> sCam = lightObject->GetShadowCamera(scheduled.LightType, camera);
+        if (sCam != nullptr)
         {
-            std::shared_ptr<ShadowCamera> sCam = lightObject->GetShadowCamera(LightType::Point, camera);
-            if (sCam != nullptr)
-            {
-                lightData.ShadowCameras.push_back(sCam);
-                lightObjectShadowCameraMap.emplace(lightObject, sCam);
-            }
+            sCam->ScheduleViews(ShadowAtlas::GetAllocationIndex(), scheduled.UpdateDue);
+            lightData.ShadowCameras.push_back(sCam);
+            lightObjectShadowCameraMap.emplace(lightObject, sCam);
         }
-        else if (combinedLight.LightType == LightType::Spot)
+    }
+
+    // Actual rendering of the shadow scene, once per shadow camera
+    if (ShadowAtlas::CacheStaticShadows)
+    {
+        std::vector<std::shared_ptr<Object>> staticCastingObjects, dynamicCastingObjects;
+        for (std::shared_ptr<Object> object : shadowCastingObjects)
+        {
+            if (object->IsStatic())
+                staticCastingObjects.push_back(object);
+            else
+                dynamicCastingObjects.push_back(object);
+        }
+
+        // Static casters are only redrawn into the cache for lights where something they can see changed
+        std::shared_ptr<ShadowMap> staticCache = ShadowAtlas::GetStaticCache();
+        for (std::shared_ptr<ShadowCamera> shadowCamera : lightData.ShadowCameras)
         {
-            std::shared_ptr<ShadowCamera> sCam = lightObject->GetShadowCamera(LightType::Spot, camera);
-            if (sCam != nullptr)
+            if (shadowCamera == nullptr || !shadowCamera->HasAtlasTiles())
+                continue;
+
+            uint32_t staleViews = 0;
+            for (uint32_t view = 0; view < shadowCamera->GetViewCount(); view++)
             {
-                lightData.ShadowCameras.push_back(sCam);
-                lightObjectShadowCameraMap.emplace(lightObject, sCam);
+                size_t signature = ShadowMapping::GetStaticShadowSignature(shadowCamera, view, staticCastingObjects);
+                if (shadowCamera->UpdateStaticShadowSignature(view, signature, ShadowAtlas::GetAllocationIndex()))
+                    staleViews |= 1u << view;
             }
+
+            if (staleViews != 0)
+                ShadowMapping::RenderShadowScene(commandList, shadowCamera, staticCastingObjects, staticCache, true, staleViews);
         }
-        else if (combinedLight.LightType == LightType::Directional)
+
+        // Depth-stencil textures can only be copied whole, so the cache is copied over the entire atlas before dynamic casters are drawn on top
+        // Dynamic casters are drawn into every view, including cascades that weren't scheduled, with the matrices those tiles were drawn with
+        commandList->CopyResource(*lightData.ShadowAtlasMap, *staticCache);
+        if (!dynamicCastingObjects.empty())
         {
-            std::shared_ptr<ShadowCamera> sCam = lightObject->GetShadowCamera(LightType::Directional, camera);
-            if (sCam != nullptr)
+            for (std::shared_ptr<ShadowCamera> shadowCamera : lightData.ShadowCameras)
             {
-                lightData.ShadowCameras.push_back(sCam);
-                lightObjectShadowCameraMap.emplace(lightObject, sCam);
+                if (shadowCamera == nullptr)
+                    continue;
+
+                ShadowMapping::RenderShadowScene(commandList, shadowCamera, dynamicCastingObjects, lightData.ShadowAtlasMap, false);
             }
         }
     }
-
-    // Actual rendering of the shadow scene, once per shadow camera
-    for (std::shared_ptr<ShadowCamera> shadowCamera : lightData.ShadowCameras)
+    else
     {
-        if (shadowCamera == nullptr)
-            continue;
+        for (std::shared_ptr<ShadowCamera> shadowCamera : lightData.ShadowCameras)
+        {
+            if (shadowCamera == nullptr)
+                continue;
 
-        ShadowMapping::RenderShadowScene(commandList, shadowCamera, shadowCastingObjects);
+            ShadowMapping::RenderShadowScene(commandList, shadowCamera, shadowCastingObjects, nullptr, true, shadowCamera->GetScheduledViewMask());
+        }
     }
 #pragma endregion
 
-    // Clear shadow maps and infos
-    lightData.SortedSpotShadowMaps.clear();
-    lightData.SortedCascadeShadowMaps.clear();
+    // Clear shadow infos
+    lightData.SpotShadowCount = 0;
+    lightData.CascadeShadowCount = 0;
     lightData.SortedCascadeShadowInfos.clear();
-    lightData.SortedPointShadowMaps.clear();
+    lightData.SortedPointShadowInfos.clear();
 
-    // Populate ShadowMaps and finish populating LightInfos of lights
+    // Populate shadow infos and finish populating LightInfos of lights
+    // Lights that didn't fit in the atlas keep an empty AtlasRect, which the shaders treat as unshadowed
     size_t spotCameraIndex = 0;
     size_t cascadeCameraIndex = 0;
     size_t pointCameraIndex = 0;
@@ -1473,6 +1563,7 @@ void Achilles::DrawShadowScenes(std::shared_ptr<CommandList> commandList, std::s
         LightInfo lightInfo
         {
             .ShadowMatrix = Matrix::Identity,
+            .AtlasRect = Vector4(0, 0, 0, 0),
             .IsShadowCaster = lightObject->IsShadowCaster(),
         };
 
@@ -1485,11 +1576,12 @@ void Achilles::DrawShadowScenes(std::shared_ptr<CommandList> commandList, std::s
                 {
                     std::shared_ptr<ShadowCamera> shadowCamera = iter->second;
                     lightInfo.ShadowMatrix = shadowCamera->GetShadowMatrix();
-                    lightData.SortedSpotShadowMaps.push_back(shadowCamera->GetShadowMap());
+                    if (shadowCamera->HasAtlasTiles())
+                        lightInfo.AtlasRect = ShadowAtlas::GetUVRect(shadowCamera->GetAtlasTile());
                     spotCameraIndex++;
                 }
             }
-            // Push cascaded light maps and infos
+            // Push cascade infos
             else if (combinedLight.LightType == LightType::Directional && cascadeCameraIndex < MAX_CASCADED_SHADOW_MAPS)
             {
                 auto iter = lightObjectShadowCameraMap.find(lightObject);
@@ -1501,44 +1593,36 @@ void Achilles::DrawShadowScenes(std::shared_ptr<CommandList> commandList, std::s
 
                     lightInfo.ShadowMatrix = shadowCamera->GetShadowMatrix();
 
+                    bool hasTiles = shadowCamera->HasAtlasTiles();
                     for (uint32_t c = 0; c < MAX_NUM_CASCADES; c++)
                     {
+                        CascadeInfo cascadeInfo;
                         if (shadowCamera->GetNumCascades() == 0)
                         {
-                            CascadeInfo cascadeInfo;
-                            if (c == 0) // If cascades are disabled then only push cascade map 0
+                            if (c == 0) // If cascades are disabled then only cascade 0 is used
                             {
-                                lightData.SortedCascadeShadowMaps.push_back(shadowCamera->GetShadowMap());
                                 cascadeInfo.CascadeMatrix = shadowCamera->GetShadowMatrix();
                                 cascadeInfo.DepthStart = 0.0f;
+                                if (hasTiles)
+                                    cascadeInfo.AtlasRect = ShadowAtlas::GetUVRect(shadowCamera->GetAtlasTile(0));
                             }
-                            else
-                            {
-                                lightData.SortedCascadeShadowMaps.push_back(nullptr);
-                            }
-
-                            lightData.SortedCascadeShadowInfos.push_back(cascadeInfo);
                         }
-                        else
+                        else if (c < shadowCamera->GetNumCascades())
                         {
-                            // It's okay if we push a nullptr shadow map as we need the padding
-                            lightData.SortedCascadeShadowMaps.push_back(shadowCamera->GetShadowMap(c));
-
-                            CascadeInfo cascadeInfo;
-                            if (c < shadowCamera->GetNumCascades())
-                            {
-                                cascadeInfo.CascadeMatrix = shadowCamera->GetCascadeMatrices()[c];
+                            cascadeInfo.CascadeMatrix = shadowCamera->GetCascadeMatrices()[c];
 
-                                if (c == 0)
-                                    cascadeInfo.DepthStart = 0.0f;
-                                else
-                                    cascadeInfo.DepthStart = shadowCamera->GetCascadePartitions()[c - 1] * (camera->farZ - camera->nearZ);
+                            if (c == 0)
+                                cascadeInfo.DepthStart = 0.0f;
+                            else
+                                cascadeInfo.DepthStart = shadowCamera->GetCascadeIntervals()[c].x;
 
-                                cascadeInfo.MinBorderPadding = 1.0f / shadowCamera->cameraWidth;
-                                cascadeInfo.MaxBorderPadding = 1.0f - cascadeInfo.MinBorderPadding;
-                            }
-                            lightData.SortedCascadeShadowInfos.push_back(cascadeInfo);
+                            cascadeInfo.MinBorderPadding = 1.0f / shadowCamera->GetTileSize();
+                            cascadeInfo.MaxBorderPadding = 1.0f - cascadeInfo.MinBorderPadding;
+                            if (hasTiles)
+                                cascadeInfo.AtlasRect = ShadowAtlas::GetUVRect(shadowCamera->GetAtlasTile(c));
                         }
+                        // Unused cascades are still pushed to keep each light's infos MAX_NUM_CASCADES apart
+                        lightData.SortedCascadeShadowInfos.push_back(cascadeInfo);
                     }
                     cascadeCameraIndex++;
                 }
@@ -1550,7 +1634,14 @@ void Achilles::DrawShadowScenes(std::shared_ptr<CommandList> commandList, std::s
                 {
                     std::shared_ptr<ShadowCamera> shadowCamera = iter->second;
 
-                    lightData.SortedPointShadowMaps.push_back(shadowCamera->GetPointCubeShadowMap(commandList));
+                    PointShadowInfo pointShadowInfo;
+                    for (uint32_t face = 0; face < 6; face++)
+                    {
+                        pointShadowInfo.FaceMatrices[face] = ((shadowCamera->GetPointDirectionShadowMatrix(face) * shadowCamera->GetProj()) * ShadowCamera::NDCToTextureTransform).Transpose();
+                        if (shadowCamera->HasAtlasTiles())
+                            pointShadowInfo.FaceRects[face] = ShadowAtlas::GetUVRect(shadowCamera->GetAtlasTile(face));
+                    }
+                    lightData.SortedPointShadowInfos.push_back(pointShadowInfo);
                     pointCameraIndex++;
                 }
             }
@@ -1571,6 +1662,9 @@ void Achilles::DrawShadowScenes(std::shared_ptr<CommandList> commandList, std::s
             lightData.DirectionalLights.push_back(combinedLight.DirectionalLight);
         }
     }
+
+    lightData.SpotShadowCount = (uint32_t)spotCameraIndex;
+    lightData.CascadeShadowCount = (uint32_t)cascadeCameraIndex;
 }
 
 void Achilles::AddScene(std::shared_ptr<Scene> scene)
@@ -1621,6 +1715,12 @@ void Achilles::QueueObjectDraw(std::shared_ptr<Object> object, bool forceTranspa
     if (Camera::debugShadowCamera)
         de.camera = Camera::debugShadowCamera;
 
+    if (occlusionBuffer.GetCamera() == de.camera.get() && occlusionBuffer.IsOccluded(object->GetWorldAABB()))
+        return;
+
+    if (Camera::contributionCulling && de.camera != nullptr && !Camera::PassesScreenSize(object->GetProjectedScreenSize(de.camera), de.camera->minScreenSize, Camera::contributionCounters.Main))
+        return;
+
     de.eventType = DrawEventType::DrawIndexed;
     for (uint32_t i = 0; i < object->GetKnitCount(); i++)
     {
@@ -1746,12 +1846,12 @@ void Achilles::SetRenderShadowsNextFrame()
 
 void Achilles::DrawObjectKnitIndexed(std::shared_ptr<CommandList> commandList, std::shared_ptr<Object> object, uint32_t knitIndex, std::shared_ptr<Camera> camera)
 {
-    if (!object->ShouldDraw(camera->GetFrustum()) && frustumCulling)
+    if (frustumCulling && !VisibilityCache::IsVisible(camera, object))
         return;
 
     ScopedTimer _prof(L"DrawObjectKnitIndexed");
 
-    std::shared_ptr<Mesh> mesh = object->GetMesh(knitIndex);
+    std::shared_ptr<Mesh> mesh = object->GetLODMesh(knitIndex, camera);
     Material& material = object->GetMaterial(knitIndex);
     std::shared_ptr<Shader> shader = material.shader;
     if (mesh == nullptr)
@@ -1759,7 +1859,7 @@ void Achilles::DrawObjectKnitIndexed(std::shared_ptr<CommandList> commandList, s
     if (shader->renderCallback == nullptr)
         throw std::exception("Shader did not have a rendercallback");
 
-    commandList->SetShader(shader);
+    commandList->SetShader(Shader::ResolvePermutation(shader, object, knitIndex, mesh, material));
 
     bool shouldRender = shader->renderCallback(commandList, object, knitIndex, mesh, material, camera, lightData);
 
@@ -1778,7 +1878,7 @@ void Achilles::DrawObjectIndexed(std::shared_ptr<CommandList> commandList, std::
     if (camera.use_count() <= 0)
         throw std::exception("Rendered camera was not available");
 
-    if (!object->ShouldDraw(camera->GetFrustum()) && frustumCulling)
+    if (frustumCulling && !VisibilityCache::IsVisible(camera, object))
         return;
 
     ScopedTimer _prof(L"DrawObjectIndexed");
@@ -1830,11 +1930,15 @@ void Achilles::DrawZPrePassObjectKnitIndexed(std::shared_ptr<CommandList> comman
     if (camera.use_count() <= 0)
         throw std::exception("Rendered camera was not available");
 
-    if (!object->ShouldDraw(camera->GetFrustum()) && frustumCulling)
+    if (frustumCulling && !VisibilityCache::IsVisible(camera, object))
+        return;
+
+    // Small objects hide little behind them, so they're only drawn in the opaque pass
+    if (Camera::contributionCulling && !Camera::PassesScreenSize(object->GetProjectedScreenSize(camera), camera->minPrePassScreenSize, Camera::contributionCounters.PrePass))
         return;
 
     ScopedTimer _prof(L"DrawZPrePassObjectIndexed");
-    std::shared_ptr<Mesh> mesh = object->GetMesh(knitIndex);
+    std::shared_ptr<Mesh> mesh = object->GetLODMesh(knitIndex, camera); // Must match the opaque pass so depth tests equal
     if (mesh == nullptr)
         return; // Mesh did not exist but maybe the knit vector has missing spaces
 
@@ -1846,40 +1950,66 @@ void Achilles::DrawZPrePassObjectKnitIndexed(std::shared_ptr<CommandList> comman
     commandList->DrawMesh(mesh);
 }
 
-void Achilles::DrawQueuedEvents(std::shared_ptr<CommandList> commandList)
+void Achilles::AssignLights()
 {
-    ScopedTimer _prof(L"DrawQueuedEvents");
-    std::shared_ptr<Camera> lastCamera = nullptr;
-
-    std::shared_ptr<RenderTarget> rt = GetCurrentRenderTarget();
+    // Lights are only gathered with the shadows, but the clusters and object lists have to follow the camera and objects every frame
+    if (lightAssignment == LightAssignment::Clustered && Camera::mainCamera != nullptr)
+    {
+        if (lightData.Clusters == nullptr)
+            lightData.Clusters = std::make_shared<LightClusters>();
+        lightData.Clusters->Build(Camera::mainCamera, lightData.PointLights, lightData.SpotLights);
+    }
+    else
+    {
+        lightData.Clusters = nullptr;
+    }
 
-    if (doZPrePass)
+    if (lightAssignment == LightAssignment::PerObject)
+    {
+        if (lightData.ObjectLights == nullptr)
+            lightData.ObjectLights = std::make_shared<ObjectLightLists>();
+        lightData.ObjectLights->Build(lightData.PointLights, lightData.SpotLights, drawEventQueue, drawEventQueueTransparent, frustumCulling);
+    }
+    else
     {
-        ScopedTimer _prof2(L"Z-PrePass");
+        lightData.ObjectLights = nullptr;
+    }
+}
 
-        commandList->SetRenderTargetDepthOnly(*rt);
-        commandList->SetShader(ZPrePass::GetZPrePassShader(device));
+void Achilles::DrawZPrePass(std::shared_ptr<CommandList> commandList)
+{
+    std::shared_ptr<Camera> lastCamera = nullptr;
 
-        for (DrawEvent de : drawEventQueue)
+    commandList->SetRenderTargetDepthOnly(*GetCurrentRenderTarget());
+    commandList->SetShader(ZPrePass::GetZPrePassShader(device));
+
+    for (DrawEvent de : drawEventQueue)
+    {
+        if (de.camera != lastCamera)
         {
-            if (de.camera != lastCamera)
-            {
-                commandList->SetViewport(de.camera->viewport);
-                commandList->SetScissorRect(de.camera->scissorRect);
-                lastCamera = de.camera;
-            }
+            commandList->SetViewport(de.camera->viewport);
+            commandList->SetScissorRect(de.camera->scissorRect);
+            lastCamera = de.camera;
+        }
 
-            switch (de.eventType)
-            {
-            case DrawEventType::Ignore:
-            case DrawEventType::DrawSprite: // Sprites should never be in the opaque queue
-                break;
-            case DrawEventType::DrawIndexed:
-                DrawZPrePassObjectKnitIndexed(commandList, de.object, de.knitIndex, de.camera);
-                break;
-            }
+        switch (de.eventType)
+        {
+        case DrawEventType::Ignore:
+        case DrawEventType::DrawSprite: // Sprites should never be in the opaque queue
+            break;
+        case DrawEventType::DrawIndexed:
+            DrawZPrePassObjectKnitIndexed(commandList, de.object, de.knitIndex, de.camera);
+            break;
         }
     }
+}
+
+void Achilles::DrawQueuedEvents(std::shared_ptr<CommandList> commandList)
+{
+    ScopedTimer _prof(L"DrawQueuedEvents");
+    std::shared_ptr<Camera> lastCamera = nullptr;
+
+    std::shared_ptr<RenderTarget> rt = GetCurrentRenderTarget();
 
     commandList->SetRenderTarget(*rt);
 
@@ -1998,9 +2128,10 @@ void Achilles::LoadTextureFromFile(std::wstring path, std::shared_ptr<CommandLis
 {
     std::wstring filename = std::filesystem::path(path).filename();
 
-    std::shared_ptr<Texture> texture = std::make_shared<Texture>(TextureUsage::Generic, filename);
-    commandList->LoadTextureFromFile(*texture, path, TextureUsage::Generic);
-    Texture::AddCachedTexture(filename, texture);
+    // Shares the load with any model importing the same file. Dropped textures are picked by hand, so they're kept rather than evictable
+    std::shared_ptr<Texture> texture = Texture::GetTextureFromPath(commandList, path, L"", TextureUsage::Generic);
+    if (texture != nullptr)
+        Texture::AddCachedTexture(filename, texture);
 }
 
 std::shared_ptr<Object> Achilles::PickObject(int x, int y)
@@ -2012,12 +2143,102 @@ std::shared_ptr<Object> Achilles::PickObject(int x, int y)
     Ray worldRay = camera->ScreenToWorldRay(x, y);
 
     std::vector<std::shared_ptr<Object>> flattenedScenes = GetEveryActiveObject();
-    std::vector<std::shared_ptr<Object>> aabbIntersectedObjects;
+    std::vector<std::pair<float, std::shared_ptr<Object>>> aabbIntersectedObjects;
 
     float distance = 0;
     for (std::shared_ptr<Object> object : flattenedScenes)
     {
         if (worldRay.Intersects(object->GetWorldAABB(), distance))
+        {
+            aabbIntersectedObjects.emplace_back(distance, object);
+        }
+    }
+
+    if (aabbIntersectedObjects.size() <= 0)
+        return nullptr;
+
+    // Nearest AABBs first, so objects entirely behind a hit can be skipped
+    std::sort(aabbIntersectedObjects.begin(), aabbIntersectedObjects.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    std::shared_ptr<Object> nearestObject;
+    float nearestDistance = INFINITY;
+    for (auto& [aabbDistance, object] : aabbIntersectedObjects)
+    {
+        if (aabbDistance > nearestDistance)
+            break;
+
+        // If object has no meshes, check by default AABB
+        if (object->GetKnitCount() <= 0)
+        {
+            if (aabbDistance < nearestDistance)
+            {
+                nearestObject = object;
+                nearestDistance = aabbDistance;
+            }
+            continue;
+        }
+
+        // Test in the object's local space so each mesh's BVH is reused however the object is transformed
+        // The direction isn't renormalised, so local distances are the same as world distances
+        Matrix inverseWorld = object->GetInverseWorldMatrix();
+        Vector3 localOrigin = Vector3::Transform(worldRay.position, inverseWorld);
+        Vector3 localDirection = Vector3::TransformNormal(worldRay.direction, inverseWorld);
+
+        // Go through each mesh with triangle list topology and check if the triangles are intersected
+        for (uint32_t k = 0; k < object->GetKnitCount(); k++)
+        {
+            std::shared_ptr<Mesh> mesh = object->GetMesh(k);
+            if (mesh == nullptr)
+                continue;
+
+            if (mesh->GetTopology() != D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST)
+                continue;
+
+            std::shared_ptr<MeshBVH> bvh = mesh->GetBVH();
+            if (bvh == nullptr)
+                continue;
+
+            if (bvh->Intersects(localOrigin, localDirection, nearestDistance))
+                nearestObject = object;
+        }
+    }
+
+#if defined(_DEBUG) || defined(_UNOPTIMIZED)
+    if (MeshBVH::ValidatePicking)
+    {
+        float bruteForceDistance = INFINITY;
+        std::shared_ptr<Object> bruteForceObject = PickObjectBruteForce(x, y, bruteForceDistance);
+
+        // Overlapping surfaces can pick either object, so a different object at the same distance isn't a mismatch
+        bool distancesMatch = std::abs(bruteForceDistance - nearestDistance) <= 0.001f * std::max(1.0f, bruteForceDistance);
+        if (bruteForceObject != nearestObject && !(bruteForceObject != nullptr && nearestObject != nullptr && distancesMatch))
+        {
+            OutputDebugStringWFormatted(L"PickObject mismatch at (%d, %d): BVH picked %s at %f, brute force picked %s at %f\n", x, y,
+                nearestObject != nullptr ? nearestObject->GetName().c_str() : L"nothing", nearestDistance,
+                bruteForceObject != nullptr ? bruteForceObject->GetName().c_str() : L"nothing", bruteForceDistance);
+        }
+    }
+#endif
+
+    return nearestObject;
+}
+
+std::shared_ptr<Object> Achilles::PickObjectBruteForce(int x, int y, float& distance)
+{
+    std::shared_ptr<Camera> camera = Camera::mainCamera;
+    if (camera == nullptr)
+        return nullptr;
+
+    Ray worldRay = camera->ScreenToWorldRay(x, y);
+
+    std::vector<std::shared_ptr<Object>> flattenedScenes = GetEveryActiveObject();
+    std::vector<std::shared_ptr<Object>> aabbIntersectedObjects;
+
+    distance = INFINITY;
+    float hitDistance = 0;
+    for (std::shared_ptr<Object> object : flattenedScenes)
+    {
+        if (worldRay.Intersects(object->GetWorldAABB(), hitDistance))
         {
             aabbIntersectedObjects.push_back(object);
         }
@@ -2048,12 +2269,12 @@ std::shared_ptr<Object> Achilles::PickObject(int x, int y)
                 Vector3 tri1 = tris[t + 1];
                 Vector3 tri2 = tris[t + 2];
 
-                if (worldRay.Intersects(tri0, tri1, tri2, distance))
+                if (worldRay.Intersects(tri0, tri1, tri2, hitDistance))
                 {
-                    if (distance < nearestDistance)
+                    if (hitDistance < nearestDistance)
                     {
                         nearestObject = object;
-                        nearestDistance = distance;
+                        nearestDistance = hitDistance;
                     }
                 }
             }
@@ -2061,16 +2282,17 @@ std::shared_ptr<Object> Achilles::PickObject(int x, int y)
         // If object has no meshes, check by default AABB
         if (object->GetKnitCount() <= 0)
         {
-            if (worldRay.Intersects(object->GetWorldAABB(), distance))
+            if (worldRay.Intersects(object->GetWorldAABB(), hitDistance))
             {
-                if (distance < nearestDistance)
+                if (hitDistance < nearestDistance)
                 {
                     nearestObject = object;
-                    nearestDistance = distance;
+                    nearestDistance = hitDistance;
                 }
             }
         }
     }
 
+    distance = nearestDistance;
     return nearestObject;
 }
\ No newline at end of file
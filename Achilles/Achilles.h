@@ -6,16 +6,21 @@
 #include <directxtk12/Mouse.h>
 #include <directxtk12/GamePad.h>
 #include "AchillesDrop.h"
+#include "ContentPack.h"
 #include "Resource.h"
 #include "Texture.h"
+#include "TextureResidency.h"
+#include "TextureStreamer.h"
 #include "Application.h"
 #include "CommandQueue.h"
 #include "CommandList.h"
 #include "ResourceStateTracker.h"
+#include "RenderGraph.h"
 #include "RenderTarget.h"
 #include "Camera.h"
 #include "Material.h"
 #include "Shader.h"
+#include "ShaderCompiler.h"
 #include "Mesh.h"
 #include "DrawEvent.h"
 #include "MouseData.h"
@@ -26,6 +31,12 @@
 #include "Lights.h"
 #include "SpriteObject.h"
 #include "LightObject.h"
+#include "ShadowAtlas.h"
+#include "ShadowScheduler.h"
+#include "LightClusters.h"
+#include "ObjectLightLists.h"
+#include "OcclusionBuffer.h"
+#include "VisibilityCache.h"
 #include "PostProcessing.h"
 
 using Microsoft::WRL::ComPtr;
@@ -59,8 +70,6 @@ protected:
     std::shared_ptr<RenderTarget> renderTarget;
     std::shared_ptr<RenderTarget> swapChainRenderTarget;
     std::shared_ptr<RenderTarget> preloadedRenderTarget;
-    std::shared_ptr<Texture> singleSampledTexture;
-    std::shared_ptr<Texture> intermediatePresentTexture;
 
     std::shared_ptr<CommandQueue> directCommandQueue;
     std::shared_ptr<CommandQueue> computeCommandQueue;
@@ -120,6 +129,9 @@ protected:
 
     // Achilles drawing internals
     bool frustumCulling = true;
+    // Objects hidden behind large occluders in the main camera's view aren't queued
+    bool occlusionCulling = true;
+    OcclusionBuffer occlusionBuffer;
     std::deque<DrawEvent> drawEventQueue{}; // Opaque Draw Queue
     std::deque<DrawEvent> drawEventQueueTransparent{}; // Transparent Draw Queue
     std::shared_ptr<AchillesImGui> achillesImGui;
@@ -132,7 +144,9 @@ protected:
 
     // Drawing states
     LightData lightData{};
+    LightAssignment lightAssignment = LightAssignment::Clustered;
     std::shared_ptr<PostProcessing> postProcessing;
+    RenderGraph::Statistics renderGraphStatistics{}; // From the last frame's render graph
 
     // Shadow Update Rate
     float shadowUpdateRate = 1.0f / 30.0f;
@@ -160,9 +174,7 @@ protected:
     void UpdateDepthStencilView();
     std::shared_ptr<Texture> CreateRenderTargetTexture(std::wstring name = L"Render Target Texture");
     void UpdateMainRenderTarget();
-    std::shared_ptr<Texture> CreateIntermediatePresentTexture();
     void UpdatePreLoadedRenderTarget();
-    void UpdateSingleSampledTexture();
     ComPtr<ID3D12CommandAllocator> CreateCommandAllocator(ComPtr<ID3D12Device2> device, D3D12_COMMAND_LIST_TYPE type);
 
     // Get functions
@@ -170,7 +182,6 @@ protected:
     std::shared_ptr<RenderTarget> GetCurrentRenderTarget() const;
     std::shared_ptr<RenderTarget> GetPreLoadedRenderTarget() const;
     std::shared_ptr<RenderTarget> GetSwapChainRenderTarget() const;
-    std::shared_ptr<Texture> GetIntermediatePresentTexture() const;
 
     // Resource, command queue and command list functions
     void Flush();
@@ -189,8 +200,9 @@ protected:
     virtual DirectX::SimpleMath::Color GetStartupColor() const; // Returns the background color for the startup loading screen
     void virtual UnloadPreLoadedAssets();
     void LoadInternalContent();
-    std::shared_ptr<Texture> ResolveToSingleSampledTexture(std::shared_ptr<CommandList> commandList, std::shared_ptr<Texture> texture);
-    virtual void ApplyPostProcessing(std::shared_ptr<CommandList> commandList, std::shared_ptr<Texture> texture, std::shared_ptr<Texture> presentTexture);
+    // Returns a single sampled transient resolved from texture
+    RenderGraph::ResourceHandle AddResolvePass(RenderGraph& graph, uint32_t segment, RenderGraph::ResourceHandle texture);
+    virtual void AddPostProcessingPasses(RenderGraph& graph, uint32_t segment, RenderGraph::ResourceHandle texture, RenderGraph::ResourceHandle presentTexture);
     virtual void CallPostPresentFunctions();
 
 public:
@@ -250,6 +262,8 @@ protected:
     void DrawObjectIndexed(std::shared_ptr<CommandList> commandList, std::shared_ptr<Object> object, std::shared_ptr<Camera> camera);
     void DrawSpriteIndexed(std::shared_ptr<CommandList> commandList, std::shared_ptr<Object> object, std::shared_ptr<Camera> camera);
     void DrawZPrePassObjectKnitIndexed(std::shared_ptr<CommandList> commandList, std::shared_ptr<Object> object, uint32_t knitIndex, std::shared_ptr<Camera> camera);
+    void AssignLights(); // Builds the light clusters or per object light lists from lightData's lights
+    void DrawZPrePass(std::shared_ptr<CommandList> commandList);
     void DrawQueuedEvents(std::shared_ptr<CommandList> commandList);
     void EmptyDrawQueue();
 
@@ -266,7 +280,8 @@ public:
 
 public:
     // Utility functions
-    std::shared_ptr<Object> PickObject(int x, int y); // Picks nearest object based on AABB
+    std::shared_ptr<Object> PickObject(int x, int y); // Picks the nearest object under the cursor, testing triangles through each mesh's BVH
+    std::shared_ptr<Object> PickObjectBruteForce(int x, int y, float& distance); // Tests every triangle in world space. Reference for PickObject
 };
 
 #define ACHILLES_IF_DESTROYING_RETURN() if (isDestroying) return;
\ No newline at end of file
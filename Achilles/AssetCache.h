@@ -0,0 +1,173 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include "Helpers.h"
+
+// Identifies a loaded asset by the file it came from and how it was loaded
+struct AssetKey
+{
+    std::wstring Path;
+    // Separates loads of the same file, e.g. a texture's usage or a mesh's index and shader
+    std::wstring Variant;
+
+    AssetKey(const std::wstring& path, const std::wstring& variant = L"") : Path(NormalizePath(path)), Variant(variant) {}
+
+    bool operator==(const AssetKey& other) const = default;
+
+    // Absolute, lower case and with forward slashes, so different spellings of the same file share a key
+    static std::wstring NormalizePath(const std::wstring& path)
+    {
+        std::error_code ec;
+        std::filesystem::path normalized = std::filesystem::weakly_canonical(path, ec);
+        if (ec)
+            normalized = std::filesystem::path(path).lexically_normal();
+        return ToLowerWString(normalized.generic_wstring());
+    }
+};
+
+template <>
+struct std::hash<AssetKey>
+{
+    size_t operator()(const AssetKey& key) const noexcept
+    {
+        size_t hash = std::hash<std::wstring>{}(key.Path);
+        return hash ^ (std::hash<std::wstring>{}(key.Variant) + 0x9e3779b9 + (hash << 6) + (hash >> 2));
+    }
+};
+
+// Thread safe cache of loaded assets. Requests for a key that's already loading wait for that load rather than starting their own
+// Loaded assets are held weakly, whatever uses them owns them, so an asset is loaded again once everything has released it
+template <typename T>
+class AssetCache
+{
+public:
+    using Loader = std::function<std::shared_ptr<T>()>;
+
+    // Get the asset for key, calling loader if it isn't loaded or loading. Loads that return nullptr or throw aren't cached
+    std::shared_ptr<T> GetOrLoad(const AssetKey& key, const Loader& loader)
+    {
+        std::shared_future<std::shared_ptr<T>> inFlight;
+        {
+            std::shared_lock<std::shared_mutex> lock(cacheMutex);
+            auto iter = entries.find(key);
+            if (iter != entries.end())
+            {
+                if (std::shared_ptr<T> asset = iter->second.Loaded.lock())
+                    return asset;
+                inFlight = iter->second.InFlight;
+            }
+        }
+        if (inFlight.valid())
+            return inFlight.get();
+
+        std::promise<std::shared_ptr<T>> promise;
+        {
+            std::unique_lock<std::shared_mutex> lock(cacheMutex);
+            Entry& entry = entries[key];
+            if (std::shared_ptr<T> asset = entry.Loaded.lock())
+                return asset;
+
+            // Another thread may have started loading between the locks
+            if (entry.InFlight.valid())
+                inFlight = entry.InFlight;
+            else
+                entry.InFlight = promise.get_future().share();
+        }
+        if (inFlight.valid())
+            return inFlight.get();
+
+        std::shared_ptr<T> asset;
+        try
+        {
+            asset = loader();
+        }
+        catch (...)
+        {
+            Finish(key, nullptr);
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+
+        Finish(key, asset);
+        promise.set_value(asset);
+        return asset;
+    }
+
+    // Get the asset for key if it's loaded, without waiting on one that's loading
+    std::shared_ptr<T> Find(const AssetKey& key)
+    {
+        std::shared_lock<std::shared_mutex> lock(cacheMutex);
+        auto iter = entries.find(key);
+        if (iter == entries.end())
+            return nullptr;
+        return iter->second.Loaded.lock();
+    }
+
+    // Forget a loaded asset so the next request loads it again. Loads in flight are left alone
+    void Remove(const AssetKey& key)
+    {
+        std::unique_lock<std::shared_mutex> lock(cacheMutex);
+        auto iter = entries.find(key);
+        if (iter != entries.end() && !iter->second.InFlight.valid())
+            entries.erase(iter);
+    }
+
+    // Drop the entries of assets that have since been released
+    void Prune()
+    {
+        std::unique_lock<std::shared_mutex> lock(cacheMutex);
+        PruneExpired();
+    }
+
+    size_t GetCount()
+    {
+        std::shared_lock<std::shared_mutex> lock(cacheMutex);
+        return entries.size();
+    }
+
+protected:
+    struct Entry
+    {
+        std::weak_ptr<T> Loaded;
+        // Valid while the asset is loading
+        std::shared_future<std::shared_ptr<T>> InFlight;
+    };
+
+    void Finish(const AssetKey& key, std::shared_ptr<T> asset)
+    {
+        std::unique_lock<std::shared_mutex> lock(cacheMutex);
+        if (asset == nullptr)
+        {
+            entries.erase(key);
+            return;
+        }
+
+        Entry& entry = entries[key];
+        entry.Loaded = asset;
+        entry.InFlight = {};
+
+        // Released assets leave their entries behind, clear them out every so often
+        if (++finishedSinceClean >= CleanInterval)
+        {
+            finishedSinceClean = 0;
+            PruneExpired();
+        }
+    }
+
+    void PruneExpired()
+    {
+        std::erase_if(entries, [](const auto& pair) { return !pair.second.InFlight.valid() && pair.second.Loaded.expired(); });
+    }
+
+    static constexpr uint32_t CleanInterval = 256;
+
+    std::unordered_map<AssetKey, Entry> entries;
+    std::shared_mutex cacheMutex;
+    uint32_t finishedSinceClean = 0;
+};
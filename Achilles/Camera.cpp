@@ -205,6 +205,15 @@ void Camera::ConstructProjection()
     dirtyProjMatrix = false;
 }
 
+bool Camera::PassesScreenSize(float screenSize, float threshold, PassCounters& counters)
+{
+    counters.Tested++;
+    if (screenSize >= threshold)
+        return true;
+
+    counters.Culled++;
+    return false;
+}
 
 void Camera::RotateEuler(Vector3 euler, bool unlockPitch, bool unlockRoll)
 {
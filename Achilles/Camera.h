@@ -17,9 +17,29 @@ class Camera
 {
     friend class Achilles;
 public:
+    // How many draws a pass tested against its camera's screen size threshold and how many were too small
+    struct PassCounters
+    {
+        uint32_t Tested = 0;
+        uint32_t Culled = 0;
+    };
+    // Main counts objects queued, the Z-prepass and shadows count the draws made
+    struct ContributionCounters
+    {
+        PassCounters Main;
+        PassCounters PrePass;
+        PassCounters Shadow;
+    };
+
     // Statics
     inline static std::shared_ptr<Camera> mainCamera{};
     inline static std::shared_ptr<ShadowCamera> debugShadowCamera{};
+    // Skips objects smaller on screen than each camera's minScreenSize and minPrePassScreenSize
+    inline static bool contributionCulling = true;
+    // Summed over every camera, Achilles moves them into lastContributionCounters as each frame or shadow update begins
+    inline static ContributionCounters contributionCounters{};
+    // Main and PrePass from the last frame and Shadow from the last shadow update
+    inline static ContributionCounters lastContributionCounters{};
 public:
     // Members
     std::wstring name;
@@ -30,6 +50,10 @@ public:
     CD3DX12_RECT scissorRect{ 0, 0, LONG_MAX, LONG_MAX };
     CD3DX12_VIEWPORT viewport;
     float orthographicSize = 1.0f;
+    // Objects whose bounding sphere covers less than this fraction of the view height aren't drawn from this camera. 0 draws everything
+    float minScreenSize = 0.002f;
+    // Only objects covering at least this fraction of the view height are drawn into the Z-prepass, the rest are left to the opaque pass
+    float minPrePassScreenSize = 0.05f;
 
 protected:
     Vector3 position;
@@ -87,6 +111,9 @@ public:
     void ConstructView();
     void ConstructProjection();
 
+    // Whether something with this projected screen size is worth drawing in a pass, counting the result in counters
+    static bool PassesScreenSize(float screenSize, float threshold, PassCounters& counters);
+
     void RotateEuler(Vector3 euler, bool unlockPitch = false, bool unlockRoll = false);
     void MoveRelative(Vector3 direction);
 
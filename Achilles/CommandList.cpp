@@ -3,6 +3,7 @@
 #include "Application.h"
 #include "ByteAddressBuffer.h"
 #include "ConstantBuffer.h"
+#include "ContentPack.h"
 #include "CommandQueue.h"
 #include "DynamicDescriptorHeap.h"
 #include "IndexBuffer.h"
@@ -14,6 +15,8 @@
 #include "RootSignature.h"
 #include "StructuredBuffer.h"
 #include "Texture.h"
+#include "TextureCooker.h"
+#include "TextureResidency.h"
 #include "UploadBuffer.h"
 #include "VertexBuffer.h"
 #include "ShaderResourceView.h"
@@ -27,6 +30,7 @@ using Microsoft::WRL::ComPtr;
 CommandList::CommandList(D3D12_COMMAND_LIST_TYPE type) : d3d12CommandListType(type)
 {
     auto device = Application::GetD3D12Device();
+    recordingId = nextRecordingId++;
 
     ThrowIfFailed(device->CreateCommandAllocator(d3d12CommandListType, IID_PPV_ARGS(&d3d12CommandAllocator)));
 
@@ -107,6 +111,18 @@ void CommandList::CopyResource(Resource& dstRes, const Resource& srcRes)
     TrackResource(srcRes);
 }
 
+void CommandList::CopyBufferToReadback(ComPtr<ID3D12Resource> readbackBuffer, const Resource& srcRes, uint64_t numBytes)
+{
+    TransitionBarrier(srcRes, D3D12_RESOURCE_STATE_COPY_SOURCE);
+
+    FlushResourceBarriers();
+
+    d3d12CommandList->CopyBufferRegion(readbackBuffer.Get(), 0, srcRes.GetD3D12Resource().Get(), 0, numBytes);
+
+    TrackResource(srcRes);
+    TrackObject(readbackBuffer);
+}
+
 void CommandList::ResolveSubresource(Resource& dstRes, const Resource& srcRes, uint32_t dstSubresource, uint32_t srcSubresource)
 {
     TransitionBarrier(dstRes, D3D12_RESOURCE_STATE_RESOLVE_DEST, dstSubresource);
@@ -186,6 +202,52 @@ void CommandList::CopyIndexBuffer(IndexBuffer& indexBuffer, size_t numIndicies,
     CopyBuffer(indexBuffer, numIndicies, indexSizeInBytes, indexBufferData);
 }
 
+void CommandList::UpdateBufferRegion(Buffer& buffer, size_t byteOffset, size_t byteSize, const void* bufferData)
+{
+    if (bufferData == nullptr || byteSize == 0)
+        return;
+    if (!buffer.IsValid())
+        throw std::exception("Buffer was invalid");
+
+    auto device = Application::GetD3D12Device();
+
+    // Create an upload resource to use as an intermediate buffer to copy the region
+    ComPtr<ID3D12Resource> uploadResource;
+    CD3DX12_HEAP_PROPERTIES hp = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+    CD3DX12_RESOURCE_DESC rd = CD3DX12_RESOURCE_DESC::Buffer(byteSize);
+    ThrowIfFailed(device->CreateCommittedResource(&hp, D3D12_HEAP_FLAG_NONE, &rd, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&uploadResource)));
+
+    void* mappedData = nullptr;
+    CD3DX12_RANGE readRange(0, 0);
+    ThrowIfFailed(uploadResource->Map(0, &readRange, &mappedData));
+    memcpy(mappedData, bufferData, byteSize);
+    uploadResource->Unmap(0, nullptr);
+
+    UpdateBufferRegion(buffer, byteOffset, byteSize, uploadResource);
+}
+
+void CommandList::UpdateBufferRegion(Buffer& buffer, size_t byteOffset, size_t byteSize, ComPtr<ID3D12Resource> uploadResource, size_t uploadOffset)
+{
+    if (uploadResource == nullptr || byteSize == 0)
+        return;
+    if (!buffer.IsValid())
+        throw std::exception("Buffer was invalid");
+
+    TransitionBarrier(buffer, D3D12_RESOURCE_STATE_COPY_DEST);
+    FlushResourceBarriers();
+
+    d3d12CommandList->CopyBufferRegion(buffer.GetD3D12Resource().Get(), byteOffset, uploadResource.Get(), uploadOffset, byteSize);
+
+    // The buffer is no longer in a bindable state, so SetMesh has to bind and transition it again
+    if (&buffer == static_cast<const Buffer*>(boundVertexBuffer))
+        boundVertexBuffer = nullptr;
+    if (&buffer == static_cast<const Buffer*>(boundIndexBuffer))
+        boundIndexBuffer = nullptr;
+
+    TrackObject(uploadResource);
+    TrackResource(buffer);
+}
+
 void CommandList::CopyByteAddressBuffer(ByteAddressBuffer& byteAddressBuffer, size_t bufferSize, const void* bufferData)
 {
     CopyBuffer(byteAddressBuffer, 1, bufferSize, bufferData, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
@@ -203,109 +265,128 @@ void CommandList::SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY primitiveTopology)
 
 void CommandList::LoadTextureFromFile(Texture& texture, const std::wstring& fileName, TextureUsage textureUsage)
 {
-    auto device = Application::GetD3D12Device();
-
-    auto iter = textureCache.find(fileName);
-    if (iter != textureCache.end())
-    {
-        texture.SetTextureUsage(textureUsage);
-        texture.SetD3D12Resource(iter->second.Resource);
-        texture.SetTransparent(iter->second.IsTransparent);
-        texture.CreateViews();
-        texture.SetName(fileName);
-    }
-    else
+    if (!GetTextureFromCache(texture, fileName, textureUsage))
     {
-        std::filesystem::path filePath(fileName);
-        if (!std::filesystem::exists(filePath))
-        {
-            throw std::exception("File not found.");
-        }
         TexMetadata metadata;
         ScratchImage scratchImage;
-        ComPtr<ID3D12Resource> textureResource;
+        bool isTransparent = false;
+        TextureCooker::LoadTexture(fileName, textureUsage, metadata, scratchImage, isTransparent);
+
+        UploadDecodedTexture(texture, fileName, metadata, scratchImage, isTransparent, textureUsage);
+
+        // Add the texture resource to the texture cache.
+        AddTextureToCache(fileName, textureUsage, texture.GetD3D12Resource(), texture.IsTransparent());
+    }
+}
+
+void CommandList::DecodeTextureFile(const std::wstring& fileName, TexMetadata& metadata, ScratchImage& scratchImage)
+{
+    std::filesystem::path filePath(fileName);
 
+    ContentPack::File packedFile;
+    if (ContentPack::Read(fileName, packedFile))
+    {
         if (filePath.extension() == ".dds")
-        {
-            // Use DDS texture loader.
-            ThrowIfFailed(LoadFromDDSFile(fileName.c_str(), DDS_FLAGS_FORCE_RGB, &metadata, scratchImage));
-        }
+            ThrowIfFailed(LoadFromDDSMemory(packedFile.Data, packedFile.Size, DDS_FLAGS_FORCE_RGB, &metadata, scratchImage));
         else if (filePath.extension() == ".hdr")
-        {
-            ThrowIfFailed(LoadFromHDRFile(fileName.c_str(), &metadata, scratchImage));
-        }
+            ThrowIfFailed(LoadFromHDRMemory(packedFile.Data, packedFile.Size, &metadata, scratchImage));
         else if (filePath.extension() == ".tga")
-        {
-            ThrowIfFailed(LoadFromTGAFile(fileName.c_str(), &metadata, scratchImage));
-        }
+            ThrowIfFailed(LoadFromTGAMemory(packedFile.Data, packedFile.Size, &metadata, scratchImage));
         else
-        {
-            ThrowIfFailed(LoadFromWICFile(fileName.c_str(), WIC_FLAGS_FORCE_RGB, &metadata, scratchImage));
-        }
+            ThrowIfFailed(LoadFromWICMemory(packedFile.Data, packedFile.Size, WIC_FLAGS_FORCE_RGB, &metadata, scratchImage));
+        return;
+    }
 
-        if (textureUsage == TextureUsage::sRGB)
-        {
-            metadata.format = MakeSRGB(metadata.format);
-        }
+    if (!std::filesystem::exists(filePath))
+    {
+        throw std::exception("File not found.");
+    }
 
-        D3D12_RESOURCE_DESC textureDesc = {};
-        switch (metadata.dimension)
-        {
-        case TEX_DIMENSION_TEXTURE1D:
-            textureDesc = CD3DX12_RESOURCE_DESC::Tex1D(metadata.format, static_cast<UINT64>(metadata.width), static_cast<UINT16>(metadata.arraySize));
-            break;
-        case TEX_DIMENSION_TEXTURE2D:
-            textureDesc = CD3DX12_RESOURCE_DESC::Tex2D(metadata.format, static_cast<UINT64>(metadata.width), static_cast<UINT>(metadata.height), static_cast<UINT16>(metadata.arraySize));
-            break;
-        case TEX_DIMENSION_TEXTURE3D:
-            textureDesc = CD3DX12_RESOURCE_DESC::Tex3D(metadata.format, static_cast<UINT64>(metadata.width), static_cast<UINT>(metadata.height), static_cast<UINT16>(metadata.depth));
-            break;
-        default:
-            throw std::exception("Invalid texture dimension.");
-            break;
-        }
+    if (filePath.extension() == ".dds")
+    {
+        // Use DDS texture loader.
+        ThrowIfFailed(LoadFromDDSFile(fileName.c_str(), DDS_FLAGS_FORCE_RGB, &metadata, scratchImage));
+    }
+    else if (filePath.extension() == ".hdr")
+    {
+        ThrowIfFailed(LoadFromHDRFile(fileName.c_str(), &metadata, scratchImage));
+    }
+    else if (filePath.extension() == ".tga")
+    {
+        ThrowIfFailed(LoadFromTGAFile(fileName.c_str(), &metadata, scratchImage));
+    }
+    else
+    {
+        ThrowIfFailed(LoadFromWICFile(fileName.c_str(), WIC_FLAGS_FORCE_RGB, &metadata, scratchImage));
+    }
+}
 
-        CD3DX12_HEAP_PROPERTIES heapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
-        ThrowIfFailed(device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &textureDesc, D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&textureResource)));
+void CommandList::UploadDecodedTexture(Texture& texture, const std::wstring& fileName, TexMetadata metadata, const ScratchImage& scratchImage, bool isTransparent, TextureUsage textureUsage)
+{
+    auto device = Application::GetD3D12Device();
+    ComPtr<ID3D12Resource> textureResource;
 
-        // Update the global state tracker.
-        ResourceStateTracker::AddGlobalResourceState(textureResource.Get(), D3D12_RESOURCE_STATE_COMMON);
+    if (textureUsage == TextureUsage::sRGB)
+    {
+        metadata.format = MakeSRGB(metadata.format);
+    }
 
-        texture.SetTextureUsage(textureUsage);
-        texture.SetD3D12Resource(textureResource);
-        texture.CreateViews();
-        texture.SetName(fileName);
-        texture.SetTransparent(!scratchImage.IsAlphaAllOpaque());
+    D3D12_RESOURCE_DESC textureDesc = {};
+    switch (metadata.dimension)
+    {
+    case TEX_DIMENSION_TEXTURE1D:
+        textureDesc = CD3DX12_RESOURCE_DESC::Tex1D(metadata.format, static_cast<UINT64>(metadata.width), static_cast<UINT16>(metadata.arraySize));
+        break;
+    case TEX_DIMENSION_TEXTURE2D:
+        textureDesc = CD3DX12_RESOURCE_DESC::Tex2D(metadata.format, static_cast<UINT64>(metadata.width), static_cast<UINT>(metadata.height), static_cast<UINT16>(metadata.arraySize));
+        break;
+    case TEX_DIMENSION_TEXTURE3D:
+        textureDesc = CD3DX12_RESOURCE_DESC::Tex3D(metadata.format, static_cast<UINT64>(metadata.width), static_cast<UINT>(metadata.height), static_cast<UINT16>(metadata.depth));
+        break;
+    default:
+        throw std::exception("Invalid texture dimension.");
+        break;
+    }
 
-        std::vector<D3D12_SUBRESOURCE_DATA> subresources(scratchImage.GetImageCount());
-        const Image* pImages = scratchImage.GetImages();
-        for (int i = 0; i < scratchImage.GetImageCount(); ++i)
-        {
-            auto& subresource = subresources[i];
-            subresource.RowPitch = pImages[i].rowPitch;
-            subresource.SlicePitch = pImages[i].slicePitch;
-            subresource.pData = pImages[i].pixels;
-        }
+    CD3DX12_HEAP_PROPERTIES heapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+    ThrowIfFailed(device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &textureDesc, D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&textureResource)));
 
-        CopyTextureSubresource(texture, 0, static_cast<uint32_t>(subresources.size()), subresources.data());
+    // Update the global state tracker.
+    ResourceStateTracker::AddGlobalResourceState(textureResource.Get(), D3D12_RESOURCE_STATE_COMMON);
 
-        if (subresources.size() < textureResource->GetDesc().MipLevels)
-        {
-            GenerateMips(texture);
-        }
+    texture.SetTextureUsage(textureUsage);
+    texture.SetD3D12Resource(textureResource);
+    texture.CreateViews();
+    texture.SetName(fileName);
+    texture.SetTransparent(isTransparent);
 
-        // Add the texture resource to the texture cache.
-        std::lock_guard<std::mutex> lock(textureCacheMutex);
-        textureCache[fileName] = CachedTexture
-        {
-            .Resource = textureResource.Get(),
-            .IsTransparent = texture.IsTransparent()
-        };
+    std::vector<D3D12_SUBRESOURCE_DATA> subresources(scratchImage.GetImageCount());
+    const Image* pImages = scratchImage.GetImages();
+    for (int i = 0; i < scratchImage.GetImageCount(); ++i)
+    {
+        auto& subresource = subresources[i];
+        subresource.RowPitch = pImages[i].rowPitch;
+        subresource.SlicePitch = pImages[i].slicePitch;
+        subresource.pData = pImages[i].pixels;
+    }
+
+    CopyTextureSubresource(texture, 0, static_cast<uint32_t>(subresources.size()), subresources.data());
+
+    if (subresources.size() < textureResource->GetDesc().MipLevels)
+    {
+        GenerateMips(texture);
     }
 }
 
 void CommandList::LoadTextureFromContent(Texture& texture, const std::wstring& fileName, TextureUsage _textureUsage)
 {
+    std::wstring packedPath = ContentPack::FindByName(L"textures/", fileName);
+    if (!packedPath.empty())
+    {
+        LoadTextureFromFile(texture, packedPath, _textureUsage);
+        return;
+    }
+
     std::wstring fileNameLower = ToLowerWString(fileName);
     for (auto file : std::filesystem::directory_iterator(GetContentDirectoryW() + L"textures/"))
     {
@@ -326,33 +407,41 @@ void CommandList::LoadTextureFromContent(Texture& texture, const std::wstring& f
 
 bool CommandList::GetTextureFromCache(Texture& texture, std::wstring identifierName, TextureUsage textureUsage)
 {
-    auto iter = textureCache.find(identifierName);
-    if (iter != textureCache.end())
+    CachedTexture cachedTexture;
     {
-        texture.SetTextureUsage(textureUsage);
-        texture.SetD3D12Resource(iter->second.Resource);
-        texture.CreateViews();
-        texture.SetName(identifierName);
-        texture.SetTransparent(iter->second.IsTransparent);
-        return true;
+        std::lock_guard<std::mutex> lock(textureCacheMutex);
+        auto iter = textureCache.find({ identifierName, textureUsage });
+        if (iter == textureCache.end())
+            return false;
+        iter->second.LastUsedFrame = Application::GetGlobalFrameCounter();
+        cachedTexture = iter->second;
     }
-    return false;
+
+    texture.SetTextureUsage(textureUsage);
+    texture.SetD3D12Resource(cachedTexture.Resource);
+    texture.CreateViews();
+    texture.SetName(identifierName);
+    texture.SetTransparent(cachedTexture.IsTransparent);
+    return true;
+}
+
+void CommandList::AddTextureToCache(const std::wstring& identifierName, TextureUsage textureUsage, ComPtr<ID3D12Resource> resource, bool isTransparent)
+{
+    std::lock_guard<std::mutex> lock(textureCacheMutex);
+    textureCache[{ identifierName, textureUsage }] = CachedTexture
+    {
+        .Resource = resource,
+        .IsTransparent = isTransparent,
+        .SizeInBytes = TextureResidency::GetResourceSize(resource.Get()),
+        .LastUsedFrame = Application::GetGlobalFrameCounter()
+    };
 }
 
 void CommandList::CreateTextureFromMemory(Texture& texture, std::wstring identifierName, std::vector<uint32_t> pixels, UINT64 width, UINT64 height, TextureUsage textureUsage, bool createMipmaps, bool isTransparent)
 {
     auto device = Application::GetD3D12Device();
 
-    auto iter = textureCache.find(identifierName);
-    if (iter != textureCache.end())
-    {
-        texture.SetTextureUsage(textureUsage);
-        texture.SetD3D12Resource(iter->second.Resource);
-        texture.CreateViews();
-        texture.SetName(identifierName);
-        texture.SetTransparent(iter->second.IsTransparent);
-    }
-    else
+    if (!GetTextureFromCache(texture, identifierName, textureUsage))
     {
         ComPtr<ID3D12Resource> textureResource;
         D3D12_RESOURCE_DESC textureDesc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM, static_cast<UINT64>(width), static_cast<UINT>(height), static_cast<UINT16>(1));
@@ -388,12 +477,7 @@ void CommandList::CreateTextureFromMemory(Texture& texture, std::wstring identif
         }
 
         // Add the texture resource to the texture cache.
-        std::lock_guard<std::mutex> lock(textureCacheMutex);
-        textureCache[identifierName] = CachedTexture
-        {
-            .Resource = textureResource.Get(),
-            .IsTransparent = isTransparent
-        };
+        AddTextureToCache(identifierName, textureUsage, textureResource, isTransparent);
     }
 }
 
@@ -815,10 +899,10 @@ void CommandList::ClearTexture(const Texture& texture, const float clearColor[4]
     TrackResource(texture);
 }
 
-void CommandList::ClearDepthStencilTexture(const Texture& texture, D3D12_CLEAR_FLAGS clearFlags, float depth, uint8_t stencil)
+void CommandList::ClearDepthStencilTexture(const Texture& texture, D3D12_CLEAR_FLAGS clearFlags, float depth, uint8_t stencil, const D3D12_RECT* rect)
 {
     TransitionBarrier(texture, D3D12_RESOURCE_STATE_DEPTH_WRITE);
-    d3d12CommandList->ClearDepthStencilView(texture.GetDepthStencilView(), clearFlags, depth, stencil, 0, nullptr);
+    d3d12CommandList->ClearDepthStencilView(texture.GetDepthStencilView(), clearFlags, depth, stencil, rect != nullptr ? 1 : 0, rect);
 
     TrackResource(texture);
 }
@@ -960,6 +1044,9 @@ void CommandList::SetVertexBuffer(uint32_t slot, const VertexBuffer& vertexBuffe
 
     d3d12CommandList->IASetVertexBuffers(slot, 1, &vertexBufferView);
 
+    if (slot == 0)
+        boundVertexBuffer = &vertexBuffer;
+
     TrackResource(vertexBuffer);
 }
 
@@ -976,6 +1063,9 @@ void CommandList::SetDynamicVertexBuffer(uint32_t slot, size_t numVertices, size
     vertexBufferView.StrideInBytes = static_cast<UINT>(vertexSize);
 
     d3d12CommandList->IASetVertexBuffers(slot, 1, &vertexBufferView);
+
+    if (slot == 0)
+        boundVertexBuffer = nullptr;
 }
 
 void CommandList::SetIndexBuffer(const IndexBuffer& indexBuffer)
@@ -986,6 +1076,8 @@ void CommandList::SetIndexBuffer(const IndexBuffer& indexBuffer)
 
     d3d12CommandList->IASetIndexBuffer(&indexBufferView);
 
+    boundIndexBuffer = &indexBuffer;
+
     TrackResource(indexBuffer);
 }
 
@@ -1003,6 +1095,8 @@ void CommandList::SetDynamicIndexBuffer(size_t numIndicies, DXGI_FORMAT indexFor
     indexBufferView.Format = indexFormat;
 
     d3d12CommandList->IASetIndexBuffer(&indexBufferView);
+
+    boundIndexBuffer = nullptr;
 }
 
 void CommandList::SetGraphicsDynamicStructuredBuffer(uint32_t slot, size_t numElements, size_t elementSize, const void* bufferData)
@@ -1015,6 +1109,22 @@ void CommandList::SetGraphicsDynamicStructuredBuffer(uint32_t slot, size_t numEl
 
     d3d12CommandList->SetGraphicsRootShaderResourceView(slot, heapAllocation.GPU);
 }
+
+D3D12_GPU_VIRTUAL_ADDRESS CommandList::CopyDynamicStructuredBuffer(size_t numElements, size_t elementSize, const void* bufferData)
+{
+    size_t bufferSize = numElements * elementSize;
+
+    auto heapAllocation = uploadBuffer->Allocate(bufferSize, elementSize);
+
+    memcpy(heapAllocation.CPU, bufferData, bufferSize);
+
+    return heapAllocation.GPU;
+}
+
+void CommandList::SetGraphicsShaderResourceView(uint32_t slot, D3D12_GPU_VIRTUAL_ADDRESS address)
+{
+    d3d12CommandList->SetGraphicsRootShaderResourceView(slot, address);
+}
 void CommandList::SetViewport(const D3D12_VIEWPORT& viewport)
 {
     SetViewports({ viewport });
@@ -1303,6 +1413,7 @@ void CommandList::Reset()
 {
     ThrowIfFailed(d3d12CommandAllocator->Reset());
     ThrowIfFailed(d3d12CommandList->Reset(d3d12CommandAllocator.Get(), nullptr));
+    recordingId = nextRecordingId++;
 
     resourceStateTracker->Reset();
     uploadBuffer->Reset();
@@ -1316,6 +1427,8 @@ void CommandList::Reset()
     }
 
     rootSignature = nullptr;
+    boundVertexBuffer = nullptr;
+    boundIndexBuffer = nullptr;
     computeCommandList = nullptr;
 }
 
@@ -1337,8 +1450,16 @@ void CommandList::SetMesh(std::shared_ptr<Mesh> mesh)
         throw std::exception("Mesh was invalid");
 
     SetPrimitiveTopology(mesh->GetTopology());
-    SetVertexBuffer(0, *mesh->GetVertexBuffer());
-    SetIndexBuffer(*mesh->GetIndexBuffer());
+
+    std::shared_ptr<VertexBuffer> vertexBuffer = mesh->GetVertexBuffer();
+    std::shared_ptr<IndexBuffer> indexBuffer = mesh->GetIndexBuffer();
+    if (vertexBuffer == nullptr || indexBuffer == nullptr)
+        throw std::exception("Mesh had no geometry");
+
+    if (vertexBuffer.get() != boundVertexBuffer)
+        SetVertexBuffer(0, *vertexBuffer);
+    if (indexBuffer.get() != boundIndexBuffer)
+        SetIndexBuffer(*indexBuffer);
 }
 
 void CommandList::DrawMesh(std::shared_ptr<Mesh> mesh, uint32_t instances)
@@ -1346,7 +1467,12 @@ void CommandList::DrawMesh(std::shared_ptr<Mesh> mesh, uint32_t instances)
     if (mesh == nullptr)
         throw std::exception("Mesh was invalid");
 
-    DrawIndexed(mesh->GetNumIndices(), instances, 0, 0, 0);
+    DrawIndexed(mesh->GetNumIndices(), instances, mesh->GetStartIndex(), mesh->GetBaseVertex(), 0);
+}
+
+void CommandList::AddOnExecutedFunction(std::function<void(void)> function)
+{
+    onExecutedFunctions.push_back(function);
 }
 
 void CommandList::TrackObject(ComPtr<ID3D12Object> object)
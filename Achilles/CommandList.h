@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <functional>
 #include <mutex>
+#include <atomic>
 #include <map>
 #include <string>
 #include <d3d12.h>
@@ -38,9 +39,17 @@ class ShaderResourceView;
 class Shader;
 class Mesh;
 
+namespace DirectX
+{
+    struct TexMetadata;
+    class ScratchImage;
+}
+
 class CommandList
 {
     friend class CommandQueue;
+    friend class TextureResidency;
+    friend class RenderGraph;
 public:
     CommandList(D3D12_COMMAND_LIST_TYPE type);
     virtual ~CommandList();
@@ -51,6 +60,12 @@ public:
         return d3d12CommandListType;
     }
 
+    // Changes every time the list is reset, so it identifies one recording even when the list or its address is reused
+    uint64_t GetRecordingId() const
+    {
+        return recordingId;
+    }
+
     // Get direct access to the ID3D12GraphicsCommandList2 interface
     ComPtr<ID3D12GraphicsCommandList2> GetGraphicsCommandList() const
     {
@@ -83,6 +98,8 @@ public:
 
     // Copy resources
     void CopyResource(Resource& dstRes, const Resource& srcRes);
+    // Copy the start of a buffer into a buffer in a readback heap, which always stays in the copy dest state
+    void CopyBufferToReadback(ComPtr<ID3D12Resource> readbackBuffer, const Resource& srcRes, uint64_t numBytes);
 
 
     // Resolve a multisampled resource into a non-multisampled resource
@@ -110,6 +127,12 @@ public:
     }
 
 
+    // Copy the contents of a CPU buffer into part of an existing GPU buffer, leaving the rest of the buffer as it was
+    void UpdateBufferRegion(Buffer& buffer, size_t byteOffset, size_t byteSize, const void* bufferData);
+    // Copy part of an already filled upload resource, from uploadOffset on, into part of an existing GPU buffer
+    void UpdateBufferRegion(Buffer& buffer, size_t byteOffset, size_t byteSize, ComPtr<ID3D12Resource> uploadResource, size_t uploadOffset = 0);
+
+
     // Copy the contents to a byte address buffer in GPU memory
     void CopyByteAddressBuffer(ByteAddressBuffer& byteAddressBuffer, size_t bufferSize, const void* bufferData);
     template<typename T>
@@ -135,11 +158,20 @@ public:
     // Load a texture by a filename.
     void LoadTextureFromFile(Texture& texture, const std::wstring& fileName, TextureUsage _textureUsage = TextureUsage::Generic);
 
+    // Decode a texture file into CPU memory as it is on disk. Doesn't touch the GPU, so it can be called from any thread. See TextureCooker::LoadTexture for the cooked version
+    static void DecodeTextureFile(const std::wstring& fileName, DirectX::TexMetadata& metadata, DirectX::ScratchImage& scratchImage);
+
+    // Create the texture's resource from decoded data and record its upload. The result isn't added to the texture cache
+    void UploadDecodedTexture(Texture& texture, const std::wstring& fileName, DirectX::TexMetadata metadata, const DirectX::ScratchImage& scratchImage, bool isTransparent, TextureUsage _textureUsage = TextureUsage::Generic);
+
     // Load a texture by filename (no extension) from content directory. Automatically deducts the file extension
     void LoadTextureFromContent(Texture& texture, const std::wstring& fileName, TextureUsage _textureUsage = TextureUsage::Generic);
 
     // Loads a texture from the texture cache. Ensure it is already created/loaded. Returns whether the texture was in cache or not
-    bool GetTextureFromCache(Texture& texture, std::wstring identifierName, TextureUsage textureUsage = TextureUsage::Generic);
+    static bool GetTextureFromCache(Texture& texture, std::wstring identifierName, TextureUsage textureUsage = TextureUsage::Generic);
+
+    // Add a resource to the texture cache, so later loads of identifierName with the same usage reuse it
+    static void AddTextureToCache(const std::wstring& identifierName, TextureUsage textureUsage, ComPtr<ID3D12Resource> resource, bool isTransparent);
 
     // Create a texture from the provided pixels
     void CreateTextureFromMemory(Texture& texture, std::wstring identifierName, std::vector<uint32_t> pixels, UINT64 width, UINT64 height, TextureUsage textureUsage = TextureUsage::Generic, bool createMipmaps = false, bool isTransparent = false);
@@ -149,7 +181,7 @@ public:
 
 
     // Clear depth/stencil texture
-    void ClearDepthStencilTexture(const Texture& texture, D3D12_CLEAR_FLAGS clearFlags, float depth = 1.0f, uint8_t stencil = 0);
+    void ClearDepthStencilTexture(const Texture& texture, D3D12_CLEAR_FLAGS clearFlags, float depth = 1.0f, uint8_t stencil = 0, const D3D12_RECT* rect = nullptr);
 
 
     // Generate mips for the texture
@@ -235,6 +267,15 @@ public:
     {
         SetGraphicsDynamicStructuredBuffer(slot, bufferData.size(), sizeof(T), bufferData.data());
     }
+    // Copy a structured buffer to upload memory once so it can be bound to many draws with SetGraphicsShaderResourceView
+    // The address is valid until the command list is reset
+    D3D12_GPU_VIRTUAL_ADDRESS CopyDynamicStructuredBuffer(size_t numElements, size_t elementSize, const void* bufferData);
+    template<typename T>
+    D3D12_GPU_VIRTUAL_ADDRESS CopyDynamicStructuredBuffer(const std::vector<T>& bufferData)
+    {
+        return CopyDynamicStructuredBuffer(bufferData.size(), sizeof(T), bufferData.data());
+    }
+    void SetGraphicsShaderResourceView(uint32_t slot, D3D12_GPU_VIRTUAL_ADDRESS address);
 
 
     // Set viewports
@@ -318,9 +359,13 @@ public:
     // Sets shader pipeline state and root signature
     void SetShader(std::shared_ptr<Shader> shader);
 
+    // Meshes share geometry arena buffers, so the vertex and index buffers are only rebound when they change
     void SetMesh(std::shared_ptr<Mesh> mesh);
     void DrawMesh(std::shared_ptr<Mesh> mesh, uint32_t instances = 1);
 
+    // Run a function once this command list has been executed on its command queue
+    void AddOnExecutedFunction(std::function<void(void)> function);
+
 protected:
 
 private:
@@ -353,6 +398,10 @@ private:
     // Keep track of the currently bound root signatures to minimize root signature changes
     ID3D12RootSignature* rootSignature;
 
+    // Keep track of the currently bound vertex (slot 0) and index buffers so SetMesh can skip rebinding them
+    const VertexBuffer* boundVertexBuffer = nullptr;
+    const IndexBuffer* boundIndexBuffer = nullptr;
+
     // Resource created in an upload heap. Useful for drawing of dynamic geometry or for uploading constant buffer data that changes every draw call
     std::unique_ptr<UploadBuffer> uploadBuffer;
 
@@ -382,9 +431,16 @@ private:
     {
         ComPtr<ID3D12Resource> Resource;
         bool IsTransparent;
+        // See TextureResidency
+        size_t SizeInBytes = 0;
+        uint64_t LastUsedFrame = 0;
     };
 
+    uint64_t recordingId = 0;
+    inline static std::atomic<uint64_t> nextRecordingId = 1;
+
     // Keep track of loaded textures to avoid loading the same texture multiple times.
-    inline static std::map<std::wstring, CachedTexture> textureCache{};
+    // Keyed by usage too, as the usage decides the format (sRGB albedo vs linear normal maps)
+    inline static std::map<std::pair<std::wstring, TextureUsage>, CachedTexture> textureCache{};
     inline static std::mutex textureCacheMutex{};
 };
\ No newline at end of file
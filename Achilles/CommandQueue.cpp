@@ -78,12 +78,8 @@ std::shared_ptr<CommandList> CommandQueue::GetCommandList()
 {
     std::shared_ptr<CommandList> commandList;
 
-    // If there is a command list on the queue
-    if (!availableCommandLists.Empty())
-    {
-        availableCommandLists.TryPop(commandList);
-    }
-    else
+    // Use a command list from the queue if there is one. Checking Empty first would let another thread take it in between
+    if (!availableCommandLists.TryPop(commandList))
     {
         // Otherwise create a new command list.
         commandList = std::make_shared<CommandList>(commandListType);
@@ -1,6 +1,7 @@
 #pragma once
 #include <tuple>
 #include <mutex>
+#include <atomic>
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
 #include <wrl.h>
@@ -49,7 +50,7 @@ private:
     ComPtr<ID3D12Fence> d3d12Fence;
     std::atomic_uint64_t fenceValue;
 
-    size_t commandListCreatedCount = 0;
+    std::atomic<size_t> commandListCreatedCount = 0;
 
     ThreadSafeQueue<CommandListEntry> inFlightCommandLists;
     ThreadSafeQueue<std::shared_ptr<CommandList>> availableCommandLists;
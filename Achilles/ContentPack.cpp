@@ -0,0 +1,372 @@
+#include "ContentPack.h"
+#include "Helpers.h"
+#include <algorithm>
+#include <compressapi.h>
+#include <filesystem>
+#include <fstream>
+
+#pragma comment(lib, "Cabinet.lib")
+
+static std::wstring NormalizePath(const std::wstring& path)
+{
+    return std::filesystem::path(path).lexically_normal().generic_wstring();
+}
+
+std::wstring ContentPack::GetDefaultPackPath()
+{
+    return GetDirectoryFromPath(GetExePathW()) + L"/content.pack";
+}
+
+bool ContentPack::Mount(const std::wstring& packPath, const std::wstring& contentDirectory)
+{
+    Unmount();
+    if (!Enabled)
+        return false;
+
+    fileHandle = CreateFileW(packPath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize{};
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(Header))
+    {
+        Unmount();
+        return false;
+    }
+
+    mappingHandle = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle != nullptr)
+        view = static_cast<const uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (view == nullptr)
+    {
+        OutputDebugStringWFormatted(L"Failed to map content pack %s\n", packPath.c_str());
+        Unmount();
+        return false;
+    }
+    viewSize = (size_t)fileSize.QuadPart;
+
+    header = reinterpret_cast<const Header*>(view);
+    bool valid = header->Magic == Magic && header->Version == PackVersion
+        && header->IndexOffset <= viewSize && (viewSize - header->IndexOffset) / sizeof(Entry) >= header->EntryCount
+        && header->StringTableOffset <= viewSize && viewSize - header->StringTableOffset >= header->StringTableSize;
+
+    if (valid)
+    {
+        entries = reinterpret_cast<const Entry*>(view + header->IndexOffset);
+        stringTable = reinterpret_cast<const char*>(view + header->StringTableOffset);
+        for (uint32_t i = 0; i < header->EntryCount && valid; i++)
+        {
+            const Entry& entry = entries[i];
+            valid = (uint64_t)entry.PathOffset + entry.PathLength <= header->StringTableSize
+                && entry.DataOffset <= viewSize && viewSize - entry.DataOffset >= entry.StoredSize;
+        }
+    }
+
+    if (!valid)
+    {
+        OutputDebugStringWFormatted(L"Ignoring invalid or outdated content pack %s\n", packPath.c_str());
+        Unmount();
+        return false;
+    }
+
+    contentRoot = ToLowerWString(NormalizePath(contentDirectory));
+    if (contentRoot.empty() || contentRoot.back() != L'/')
+        contentRoot += L'/';
+
+    OutputDebugStringWFormatted(L"Mounted content pack %s (%u files)\n", packPath.c_str(), header->EntryCount);
+    return true;
+}
+
+void ContentPack::Unmount()
+{
+    if (view != nullptr)
+        UnmapViewOfFile(view);
+    if (mappingHandle != nullptr)
+        CloseHandle(mappingHandle);
+    if (fileHandle != INVALID_HANDLE_VALUE)
+        CloseHandle(fileHandle);
+
+    fileHandle = INVALID_HANDLE_VALUE;
+    mappingHandle = nullptr;
+    view = nullptr;
+    viewSize = 0;
+    header = nullptr;
+    entries = nullptr;
+    stringTable = nullptr;
+    contentRoot.clear();
+}
+
+bool ContentPack::IsMounted()
+{
+    return view != nullptr;
+}
+
+bool ContentPack::Contains(const std::wstring& path)
+{
+    return Find(path) != nullptr;
+}
+
+bool ContentPack::Read(const std::wstring& path, File& file)
+{
+    const Entry* entry = Find(path);
+    if (entry == nullptr)
+        return false;
+
+    const uint8_t* stored = view + entry->DataOffset;
+    if (entry->Compression == CompressionMethod::None)
+    {
+        file.Data = stored;
+        file.Size = (size_t)entry->Size;
+        file.Decompressed.clear();
+        return true;
+    }
+
+    DECOMPRESSOR_HANDLE decompressor = nullptr;
+    if (!CreateDecompressor(COMPRESS_ALGORITHM_XPRESS_HUFF, nullptr, &decompressor))
+        throw std::exception("Failed to create a decompressor for the content pack");
+
+    file.Decompressed.resize((size_t)entry->Size);
+    SIZE_T decompressedSize = 0;
+    BOOL decompressed = Decompress(decompressor, stored, (SIZE_T)entry->StoredSize, file.Decompressed.data(), file.Decompressed.size(), &decompressedSize);
+    CloseDecompressor(decompressor);
+
+    if (!decompressed || decompressedSize != entry->Size)
+    {
+        OutputDebugStringWFormatted(L"Failed to decompress %s from the content pack\n", path.c_str());
+        file.Decompressed.clear();
+        return false;
+    }
+
+    file.Data = file.Decompressed.data();
+    file.Size = file.Decompressed.size();
+    return true;
+}
+
+bool ContentPack::GetHash(const std::wstring& path, uint64_t& hash)
+{
+    const Entry* entry = Find(path);
+    if (entry == nullptr)
+        return false;
+
+    hash = entry->Hash;
+    return true;
+}
+
+std::vector<std::wstring> ContentPack::ListDirectory(const std::wstring& directory)
+{
+    std::vector<std::wstring> names;
+    if (!IsMounted())
+        return names;
+
+    std::string prefix = WStringToString(NormalizePath(directory));
+    if (!prefix.empty() && prefix.back() != '/')
+        prefix += '/';
+
+    // The index is sorted, so the directory's files are together starting at the first path not before the prefix
+    const Entry* end = entries + header->EntryCount;
+    const Entry* iter = std::lower_bound(entries, end, prefix, [](const Entry& entry, const std::string& value)
+        {
+            return ComparePaths(GetEntryPath(entry), value) < 0;
+        });
+
+    for (; iter != end; ++iter)
+    {
+        std::string_view entryPath = GetEntryPath(*iter);
+        if (entryPath.size() < prefix.size() || ComparePaths(entryPath.substr(0, prefix.size()), prefix) != 0)
+            break;
+
+        std::string_view name = entryPath.substr(prefix.size());
+        if (name.find('/') == std::string_view::npos)
+            names.push_back(StringToWString(std::string(name)));
+    }
+    return names;
+}
+
+std::wstring ContentPack::FindByName(const std::wstring& directory, const std::wstring& name)
+{
+    std::wstring nameLower = ToLowerWString(name);
+    for (const std::wstring& fileName : ListDirectory(directory))
+    {
+        if (ToLowerWString(std::filesystem::path(fileName).replace_extension().wstring()) == nameLower)
+            return contentRoot + NormalizePath(directory + L"/") + fileName;
+    }
+    return L"";
+}
+
+void ContentPack::Build(const std::wstring& contentDirectory, const std::wstring& packPath, bool compress)
+{
+    struct PackedFile
+    {
+        std::filesystem::path SourcePath;
+        std::string Path;
+    };
+
+    std::vector<PackedFile> files;
+    for (const auto& file : std::filesystem::recursive_directory_iterator(contentDirectory))
+    {
+        if (!file.is_regular_file())
+            continue;
+
+        PackedFile packed;
+        packed.SourcePath = file.path();
+        packed.Path = WStringToString(std::filesystem::relative(file.path(), contentDirectory).generic_wstring());
+        files.push_back(packed);
+    }
+
+    std::sort(files.begin(), files.end(), [](const PackedFile& a, const PackedFile& b) { return ComparePaths(a.Path, b.Path) < 0; });
+    for (size_t i = 1; i < files.size(); i++)
+    {
+        if (ComparePaths(files[i - 1].Path, files[i].Path) == 0)
+            throw std::exception(("Content paths only differ by case: " + files[i].Path).c_str());
+    }
+
+    COMPRESSOR_HANDLE compressor = nullptr;
+    if (compress && !CreateCompressor(COMPRESS_ALGORITHM_XPRESS_HUFF, nullptr, &compressor))
+        throw std::exception("Failed to create a compressor");
+
+    std::wstring temporaryPath = packPath + L".tmp";
+    std::ofstream output(std::filesystem::path(temporaryPath), std::ios::binary | std::ios::trunc);
+    if (!output)
+        throw std::exception("Failed to open the content pack for writing");
+
+    Header packHeader{};
+    output.write(reinterpret_cast<const char*>(&packHeader), sizeof(packHeader));
+
+    std::vector<Entry> packEntries;
+    std::string strings;
+    uint64_t offset = sizeof(Header);
+    uint64_t totalSize = 0;
+    for (const PackedFile& file : files)
+    {
+        std::ifstream input(file.SourcePath, std::ios::binary);
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+        if (!input.eof() && input.fail())
+            throw std::exception(("Failed to read " + file.Path).c_str());
+
+        Entry entry{};
+        entry.PathOffset = (uint32_t)strings.size();
+        entry.PathLength = (uint32_t)file.Path.size();
+        entry.Size = data.size();
+        entry.Hash = Hash(data.data(), data.size());
+        strings += file.Path;
+
+        std::vector<uint8_t> compressed;
+        if (compressor != nullptr && !data.empty())
+        {
+            compressed.resize(data.size());
+            SIZE_T compressedSize = 0;
+            // Fails when the output doesn't fit in the input's size, which isn't worth storing anyway
+            if (Compress(compressor, data.data(), data.size(), compressed.data(), compressed.size(), &compressedSize)
+                && compressedSize <= data.size() * (1.0f - MinCompressionSaving))
+            {
+                compressed.resize(compressedSize);
+                entry.Compression = CompressionMethod::XpressHuff;
+            }
+        }
+
+        const std::vector<uint8_t>& stored = entry.Compression == CompressionMethod::None ? data : compressed;
+        entry.DataOffset = offset;
+        entry.StoredSize = stored.size();
+        output.write(reinterpret_cast<const char*>(stored.data()), stored.size());
+        offset += stored.size();
+        totalSize += stored.size();
+
+        packEntries.push_back(entry);
+    }
+
+    if (compressor != nullptr)
+        CloseCompressor(compressor);
+
+    packHeader.Magic = Magic;
+    packHeader.Version = PackVersion;
+    packHeader.EntryCount = (uint32_t)packEntries.size();
+    packHeader.StringTableOffset = offset;
+    packHeader.StringTableSize = strings.size();
+    output.write(strings.data(), strings.size());
+    offset += strings.size();
+
+    // Keep the index aligned, it's read in place from the mapping
+    uint64_t padding = (alignof(Entry) - (offset % alignof(Entry))) % alignof(Entry);
+    const char zeros[alignof(Entry)] = {};
+    output.write(zeros, padding);
+    offset += padding;
+
+    packHeader.IndexOffset = offset;
+    output.write(reinterpret_cast<const char*>(packEntries.data()), packEntries.size() * sizeof(Entry));
+
+    output.seekp(0);
+    output.write(reinterpret_cast<const char*>(&packHeader), sizeof(packHeader));
+    output.close();
+    if (!output)
+        throw std::exception("Failed to write the content pack");
+
+    std::error_code ec;
+    std::filesystem::rename(temporaryPath, packPath, ec);
+    if (ec)
+    {
+        std::filesystem::remove(temporaryPath, ec);
+        throw std::exception("Failed to replace the content pack");
+    }
+
+    OutputDebugStringWFormatted(L"Packed %zu files (%llu bytes) into %s\n", files.size(), (unsigned long long)totalSize, packPath.c_str());
+}
+
+const ContentPack::Entry* ContentPack::Find(const std::wstring& path)
+{
+    if (!IsMounted())
+        return nullptr;
+
+    std::string relativePath = GetRelativePath(path);
+    if (relativePath.empty())
+        return nullptr;
+
+    const Entry* end = entries + header->EntryCount;
+    const Entry* iter = std::lower_bound(entries, end, relativePath, [](const Entry& entry, const std::string& value)
+        {
+            return ComparePaths(GetEntryPath(entry), value) < 0;
+        });
+
+    if (iter == end || ComparePaths(GetEntryPath(*iter), relativePath) != 0)
+        return nullptr;
+    return iter;
+}
+
+std::string ContentPack::GetRelativePath(const std::wstring& path)
+{
+    std::wstring normalized = NormalizePath(path);
+    if (normalized.size() <= contentRoot.size() || ToLowerWString(normalized.substr(0, contentRoot.size())) != contentRoot)
+        return "";
+    return WStringToString(normalized.substr(contentRoot.size()));
+}
+
+std::string_view ContentPack::GetEntryPath(const Entry& entry)
+{
+    return std::string_view(stringTable + entry.PathOffset, entry.PathLength);
+}
+
+int ContentPack::ComparePaths(std::string_view a, std::string_view b)
+{
+    size_t count = std::min(a.size(), b.size());
+    for (size_t i = 0; i < count; i++)
+    {
+        char charA = (a[i] >= 'A' && a[i] <= 'Z') ? a[i] - 'A' + 'a' : a[i];
+        char charB = (b[i] >= 'A' && b[i] <= 'Z') ? b[i] - 'A' + 'a' : b[i];
+        if (charA != charB)
+            return (unsigned char)charA < (unsigned char)charB ? -1 : 1;
+    }
+    if (a.size() == b.size())
+        return 0;
+    return a.size() < b.size() ? -1 : 1;
+}
+
+uint64_t ContentPack::Hash(const uint8_t* data, size_t size)
+{
+    // FNV-1a, the same as TextureCooker hashes loose files with so cooked textures are shared between the two
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+// A single file holding the content directory, so loading content doesn't scan directories and open every asset on its own
+// The pack is a header, each file's data (compressed when that saves enough), a string table of paths and an index sorted by path
+// It's memory mapped when mounted, files stored uncompressed are read straight out of the mapping
+// ContentPacker builds it as a Release post build step. Files that aren't in the pack (or every file, when there's no pack) are loaded from the content directory as before
+class ContentPack
+{
+public:
+    inline static bool Enabled = true;
+    // Files are only stored compressed when it saves at least this fraction of their size, images are usually compressed already
+    inline static float MinCompressionSaving = 0.1f;
+    // Bump when the layout changes so older packs are ignored
+    static constexpr uint32_t PackVersion = 1;
+
+    // A file's data. Points into the mapped pack, or at Decompressed for compressed files
+    struct File
+    {
+        const uint8_t* Data = nullptr;
+        size_t Size = 0;
+        std::vector<uint8_t> Decompressed;
+    };
+
+    // content.pack next to the executable
+    static std::wstring GetDefaultPackPath();
+
+    // Map the pack so files under contentDirectory are read from it. Must be called before any content is loaded
+    // Returns false, leaving content to be loaded from loose files, when there's no pack or it isn't valid
+    static bool Mount(const std::wstring& packPath, const std::wstring& contentDirectory);
+    static void Unmount();
+    static bool IsMounted();
+
+    // Whether the file at path (an absolute path under the content directory) is in the pack
+    static bool Contains(const std::wstring& path);
+    static bool Read(const std::wstring& path, File& file);
+    // FNV-1a hash of the file's uncompressed data, taken when the pack was built
+    static bool GetHash(const std::wstring& path, uint64_t& hash);
+
+    // Names of the files directly inside directory, which is relative to the content directory, e.g. L"models/"
+    static std::vector<std::wstring> ListDirectory(const std::wstring& directory);
+    // Absolute path of the first file directly inside directory whose name without its extension is name. Empty if there isn't one
+    static std::wstring FindByName(const std::wstring& directory, const std::wstring& name);
+
+    // Pack every file under contentDirectory into packPath. Throws on failure
+    static void Build(const std::wstring& contentDirectory, const std::wstring& packPath, bool compress = true);
+
+protected:
+    enum class CompressionMethod : uint32_t
+    {
+        None,
+        XpressHuff,
+    };
+
+    struct Header
+    {
+        uint32_t Magic = 0;
+        uint32_t Version = 0;
+        uint32_t EntryCount = 0;
+        uint32_t Reserved = 0;
+        uint64_t IndexOffset = 0;
+        uint64_t StringTableOffset = 0;
+        uint64_t StringTableSize = 0;
+    };
+
+    struct Entry
+    {
+        // UTF-8 path relative to the content directory with forward slashes, in the string table
+        uint32_t PathOffset = 0;
+        uint32_t PathLength = 0;
+        uint64_t DataOffset = 0;
+        uint64_t StoredSize = 0;
+        uint64_t Size = 0;
+        uint64_t Hash = 0;
+        CompressionMethod Compression = CompressionMethod::None;
+        uint32_t Reserved = 0;
+    };
+
+    static constexpr uint32_t Magic = 0x4B504341; // "ACPK"
+
+    static const Entry* Find(const std::wstring& path);
+    // Path relative to the content directory, or empty if path isn't under it
+    static std::string GetRelativePath(const std::wstring& path);
+    static std::string_view GetEntryPath(const Entry& entry);
+    // Case insensitive ordering the index is sorted by
+    static int ComparePaths(std::string_view a, std::string_view b);
+    static uint64_t Hash(const uint8_t* data, size_t size);
+
+    inline static HANDLE fileHandle = INVALID_HANDLE_VALUE;
+    inline static HANDLE mappingHandle = nullptr;
+    inline static const uint8_t* view = nullptr;
+    inline static size_t viewSize = 0;
+    inline static const Header* header = nullptr;
+    inline static const Entry* entries = nullptr;
+    inline static const char* stringTable = nullptr;
+    // Lower case, forward slashes and a trailing slash
+    inline static std::wstring contentRoot;
+};
@@ -0,0 +1,405 @@
+#include "GeometryArena.h"
+#include "Application.h"
+#include "CommandList.h"
+#include "VertexBuffer.h"
+#include "IndexBuffer.h"
+#include "Helpers.h"
+#include "MathHelpers.h"
+#include <d3dx12.h>
+
+GeometryPage::GeometryPage(std::shared_ptr<CommandList> commandList, size_t _numElements, size_t _elementSize, DXGI_FORMAT _indexFormat) : numElements(_numElements), elementSize(_elementSize), numFreeElements(_numElements), indexFormat(_indexFormat)
+{
+    // Create the buffer empty, meshes upload into their own ranges
+    if (IsIndexPage())
+    {
+        indexBuffer = std::make_shared<IndexBuffer>(L"Geometry Arena Index Buffer");
+        commandList->CopyIndexBuffer(*indexBuffer, numElements, indexFormat, nullptr);
+    }
+    else
+    {
+        vertexBuffer = std::make_shared<VertexBuffer>(L"Geometry Arena Vertex Buffer");
+        commandList->CopyVertexBuffer(*vertexBuffer, numElements, elementSize, nullptr);
+    }
+
+    AddNewBlock(0, numElements);
+}
+
+size_t GeometryPage::GetElementSize() const
+{
+    return elementSize;
+}
+
+DXGI_FORMAT GeometryPage::GetIndexFormat() const
+{
+    return indexFormat;
+}
+
+bool GeometryPage::IsIndexPage() const
+{
+    return indexFormat != DXGI_FORMAT_UNKNOWN;
+}
+
+size_t GeometryPage::GetNumElements() const
+{
+    return numElements;
+}
+
+size_t GeometryPage::GetNumFreeElements() const
+{
+    return numFreeElements;
+}
+
+std::shared_ptr<VertexBuffer> GeometryPage::GetVertexBuffer() const
+{
+    return vertexBuffer;
+}
+
+std::shared_ptr<IndexBuffer> GeometryPage::GetIndexBuffer() const
+{
+    return indexBuffer;
+}
+
+void GeometryPage::AddNewBlock(size_t offset, size_t count)
+{
+    auto offsetIter = freeListByOffset.emplace(offset, count);
+    auto sizeIter = freeListBySize.emplace(count, offsetIter.first);
+    offsetIter.first->second.FreeListBySizeIt = sizeIter;
+}
+
+GeometryAllocation GeometryPage::Allocate(size_t count, const void* data)
+{
+    size_t offset = 0;
+    {
+        std::lock_guard<std::mutex> lock(allocationMutex);
+
+        if (count == 0 || count > numFreeElements)
+            return GeometryAllocation();
+
+        // Best fit, the smallest block that satisfies the request
+        auto smallestBlockIter = freeListBySize.lower_bound(count);
+        if (smallestBlockIter == freeListBySize.end())
+            return GeometryAllocation();
+
+        size_t blockSize = smallestBlockIter->first;
+        auto offsetIter = smallestBlockIter->second;
+        offset = offsetIter->first;
+
+        freeListBySize.erase(smallestBlockIter);
+        freeListByOffset.erase(offsetIter);
+
+        // Return what's left of the block to the free list
+        if (blockSize > count)
+            AddNewBlock(offset + count, blockSize - count);
+
+        numFreeElements -= count;
+    }
+
+    if (data != nullptr)
+        GeometryArena::StageUpload(shared_from_this(), offset * elementSize, count * elementSize, data);
+
+    GeometryAllocation allocation{};
+    allocation.Page = shared_from_this();
+    allocation.Offset = offset;
+    allocation.Count = count;
+    return allocation;
+}
+
+void GeometryPage::Free(GeometryAllocation&& allocation, uint64_t frameNumber)
+{
+    std::lock_guard<std::mutex> lock(allocationMutex);
+
+    // Don't add the range directly to the free list until the frame has completed
+    staleAllocations.emplace(allocation.Offset, allocation.Count, frameNumber);
+    allocation.Page = nullptr;
+    allocation.Count = 0;
+}
+
+void GeometryPage::FreeBlock(size_t offset, size_t count)
+{
+    // The block after the one being freed
+    auto nextBlockIter = freeListByOffset.upper_bound(offset);
+
+    // The block before the one being freed, if there is one
+    auto prevBlockIter = nextBlockIter;
+    if (prevBlockIter != freeListByOffset.begin())
+        --prevBlockIter;
+    else
+        prevBlockIter = freeListByOffset.end();
+
+    numFreeElements += count;
+
+    // Merge with the previous block if it ends where this one starts
+    if (prevBlockIter != freeListByOffset.end() && offset == prevBlockIter->first + prevBlockIter->second.Size)
+    {
+        offset = prevBlockIter->first;
+        count += prevBlockIter->second.Size;
+
+        freeListBySize.erase(prevBlockIter->second.FreeListBySizeIt);
+        freeListByOffset.erase(prevBlockIter);
+    }
+
+    // Merge with the next block if it starts where this one ends
+    if (nextBlockIter != freeListByOffset.end() && offset + count == nextBlockIter->first)
+    {
+        count += nextBlockIter->second.Size;
+
+        freeListBySize.erase(nextBlockIter->second.FreeListBySizeIt);
+        freeListByOffset.erase(nextBlockIter);
+    }
+
+    AddNewBlock(offset, count);
+}
+
+void GeometryPage::ReleaseStaleAllocations(uint64_t frameNumber)
+{
+    std::lock_guard<std::mutex> lock(allocationMutex);
+
+    while (!staleAllocations.empty() && staleAllocations.front().FrameNumber <= frameNumber)
+    {
+        auto& staleAllocation = staleAllocations.front();
+        FreeBlock(staleAllocation.Offset, staleAllocation.Size);
+        staleAllocations.pop();
+    }
+}
+
+GeometryAllocation GeometryArena::Allocate(std::vector<std::shared_ptr<GeometryPage>>& pages, std::shared_ptr<CommandList> commandList, size_t numElements, size_t elementSize, DXGI_FORMAT indexFormat, size_t pageSize, const void* data)
+{
+    for (std::shared_ptr<GeometryPage> page : pages)
+    {
+        GeometryAllocation allocation = page->Allocate(numElements, data);
+        if (allocation.IsValid())
+            return allocation;
+    }
+
+    // No page had room, so add one. Meshes larger than a page get one sized to fit
+    size_t pageElements = std::max(pageSize / elementSize, numElements);
+    std::shared_ptr<GeometryPage> page = std::make_shared<GeometryPage>(commandList, pageElements, elementSize, indexFormat);
+    pages.push_back(page);
+
+    return page->Allocate(numElements, data);
+}
+
+GeometryAllocation GeometryArena::AllocateVertices(std::shared_ptr<CommandList> commandList, size_t numVertices, size_t vertexStride, const void* vertices)
+{
+    if (numVertices == 0 || vertexStride == 0)
+        return GeometryAllocation();
+
+    std::lock_guard<std::mutex> lock(arenaMutex);
+    return Allocate(vertexPages[vertexStride], commandList, numVertices, vertexStride, DXGI_FORMAT_UNKNOWN, VertexPageSize, vertices);
+}
+
+GeometryAllocation GeometryArena::AllocateIndices(std::shared_ptr<CommandList> commandList, size_t numIndices, DXGI_FORMAT indexFormat, const void* indices)
+{
+    if (numIndices == 0)
+        return GeometryAllocation();
+    if (indexFormat != DXGI_FORMAT_R16_UINT && indexFormat != DXGI_FORMAT_R32_UINT)
+        throw std::exception("Invalid index format");
+
+    size_t indexSize = indexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4;
+
+    std::lock_guard<std::mutex> lock(arenaMutex);
+    return Allocate(indexPages[indexFormat], commandList, numIndices, indexSize, indexFormat, IndexPageSize, indices);
+}
+
+void GeometryArena::Free(GeometryAllocation& allocation)
+{
+    if (!allocation.IsValid())
+        return;
+
+    std::shared_ptr<GeometryPage> page = allocation.Page;
+    page->Free(std::move(allocation), Application::GetGlobalFrameCounter());
+}
+
+void GeometryArena::ReleaseStaleAllocations(uint64_t frameNumber)
+{
+    {
+        std::lock_guard<std::mutex> lock(arenaMutex);
+
+        for (auto& [stride, pages] : vertexPages)
+        {
+            for (std::shared_ptr<GeometryPage> page : pages)
+                page->ReleaseStaleAllocations(frameNumber);
+        }
+        for (auto& [format, pages] : indexPages)
+        {
+            for (std::shared_ptr<GeometryPage> page : pages)
+                page->ReleaseStaleAllocations(frameNumber);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(uploadMutex);
+
+    for (size_t i = 0; i < flushedStagingPages.size();)
+    {
+        std::shared_ptr<StagingPage> staging = flushedStagingPages[i];
+        if (staging->FlushedFrame > frameNumber)
+        {
+            i++;
+            continue;
+        }
+
+        // Pages made for a single oversized upload aren't kept
+        if (staging->Size <= StagingPageSize)
+        {
+            staging->Offset = 0;
+            freeStagingPages.push_back(staging);
+        }
+        flushedStagingPages.erase(flushedStagingPages.begin() + i);
+    }
+}
+
+void GeometryArena::StageUpload(std::shared_ptr<GeometryPage> page, size_t byteOffset, size_t byteSize, const void* data)
+{
+    // Keeps every range's start aligned for the copy out of it
+    constexpr size_t stagingAlignment = 16;
+
+    std::lock_guard<std::mutex> lock(uploadMutex);
+
+    std::shared_ptr<StagingPage> staging;
+    size_t stagingOffset = 0;
+    if (byteSize > StagingPageSize)
+    {
+        // Too large to pack, so it gets a page of its own and the current page keeps its space
+        staging = RequestStagingPage(byteSize);
+        filledStagingPages.push_back(staging);
+    }
+    else
+    {
+        if (currentStagingPage != nullptr)
+            stagingOffset = AlignUp(currentStagingPage->Offset, stagingAlignment);
+        if (currentStagingPage == nullptr || stagingOffset + byteSize > currentStagingPage->Size)
+        {
+            if (currentStagingPage != nullptr)
+                filledStagingPages.push_back(currentStagingPage);
+            currentStagingPage = RequestStagingPage(byteSize);
+            stagingOffset = 0;
+        }
+        staging = currentStagingPage;
+    }
+
+    // Copied under the lock, so FlushUploads never records a copy of a range that's still being written
+    memcpy(staging->CPU + stagingOffset, data, byteSize);
+    staging->Offset = stagingOffset + byteSize;
+
+    PendingUpload upload{};
+    upload.Page = page;
+    upload.ByteOffset = byteOffset;
+    upload.ByteSize = byteSize;
+    upload.Staging = staging;
+    upload.StagingOffset = stagingOffset;
+    pendingUploads.push_back(std::move(upload));
+}
+
+std::shared_ptr<GeometryArena::StagingPage> GeometryArena::RequestStagingPage(size_t byteSize)
+{
+    if (byteSize <= StagingPageSize && !freeStagingPages.empty())
+    {
+        std::shared_ptr<StagingPage> staging = freeStagingPages.back();
+        freeStagingPages.pop_back();
+        return staging;
+    }
+
+    auto device = Application::GetD3D12Device();
+
+    std::shared_ptr<StagingPage> staging = std::make_shared<StagingPage>();
+    staging->Size = std::max(StagingPageSize, byteSize);
+
+    CD3DX12_HEAP_PROPERTIES heapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+    CD3DX12_RESOURCE_DESC resourceDesc = CD3DX12_RESOURCE_DESC::Buffer(staging->Size);
+    ThrowIfFailed(device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &resourceDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&staging->Resource)));
+
+    // Left mapped for its whole life, the CPU only ever writes to it
+    CD3DX12_RANGE readRange(0, 0);
+    ThrowIfFailed(staging->Resource->Map(0, &readRange, reinterpret_cast<void**>(&staging->CPU)));
+    return staging;
+}
+
+void GeometryArena::FlushUploads(std::shared_ptr<CommandList> commandList)
+{
+    std::vector<PendingUpload> uploads;
+    std::vector<std::function<void(void)>> flushedFunctions;
+    {
+        std::lock_guard<std::mutex> lock(uploadMutex);
+        uploads.swap(pendingUploads);
+        flushedFunctions.swap(onFlushedFunctions);
+
+        // Everything staged so far is copied by this frame's command list, so the pages can be reused once it has finished
+        if (currentStagingPage != nullptr && currentStagingPage->Offset > 0)
+        {
+            filledStagingPages.push_back(currentStagingPage);
+            currentStagingPage = nullptr;
+        }
+        for (std::shared_ptr<StagingPage>& staging : filledStagingPages)
+        {
+            staging->FlushedFrame = Application::GetGlobalFrameCounter();
+            flushedStagingPages.push_back(staging);
+        }
+        filledStagingPages.clear();
+    }
+
+    // In staging order, so a range that was freed and allocated again ends up with the newest data
+    for (PendingUpload& upload : uploads)
+    {
+        if (upload.Page->IsIndexPage())
+            commandList->UpdateBufferRegion(*upload.Page->GetIndexBuffer(), upload.ByteOffset, upload.ByteSize, upload.Staging->Resource, upload.StagingOffset);
+        else
+            commandList->UpdateBufferRegion(*upload.Page->GetVertexBuffer(), upload.ByteOffset, upload.ByteSize, upload.Staging->Resource, upload.StagingOffset);
+    }
+
+    for (std::function<void(void)>& func : flushedFunctions)
+        func();
+}
+
+void GeometryArena::AddOnFlushedFunction(std::function<void(void)> func)
+{
+    std::lock_guard<std::mutex> lock(uploadMutex);
+    onFlushedFunctions.push_back(func);
+}
+
+size_t GeometryArena::GetPageCount()
+{
+    std::lock_guard<std::mutex> lock(arenaMutex);
+
+    size_t count = 0;
+    for (auto& [stride, pages] : vertexPages)
+        count += pages.size();
+    for (auto& [format, pages] : indexPages)
+        count += pages.size();
+    return count;
+}
+
+size_t GeometryArena::GetCapacityBytes()
+{
+    std::lock_guard<std::mutex> lock(arenaMutex);
+
+    size_t bytes = 0;
+    for (auto& [stride, pages] : vertexPages)
+    {
+        for (std::shared_ptr<GeometryPage> page : pages)
+            bytes += page->GetNumElements() * page->GetElementSize();
+    }
+    for (auto& [format, pages] : indexPages)
+    {
+        for (std::shared_ptr<GeometryPage> page : pages)
+            bytes += page->GetNumElements() * page->GetElementSize();
+    }
+    return bytes;
+}
+
+size_t GeometryArena::GetUsedBytes()
+{
+    std::lock_guard<std::mutex> lock(arenaMutex);
+
+    size_t bytes = 0;
+    for (auto& [stride, pages] : vertexPages)
+    {
+        for (std::shared_ptr<GeometryPage> page : pages)
+            bytes += (page->GetNumElements() - page->GetNumFreeElements()) * page->GetElementSize();
+    }
+    for (auto& [format, pages] : indexPages)
+    {
+        for (std::shared_ptr<GeometryPage> page : pages)
+            bytes += (page->GetNumElements() - page->GetNumFreeElements()) * page->GetElementSize();
+    }
+    return bytes;
+}
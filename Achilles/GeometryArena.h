@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <map>
+#include <queue>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <d3d12.h>
+#include <wrl.h>
+
+class CommandList;
+class VertexBuffer;
+class IndexBuffer;
+class GeometryPage;
+
+// A range of vertices or indices within one of the geometry arena's shared buffers
+struct GeometryAllocation
+{
+    std::shared_ptr<GeometryPage> Page;
+    // Offset and count are in elements (vertices or indices), so the offset is directly usable as a base vertex or start index
+    size_t Offset = 0;
+    size_t Count = 0;
+
+    bool IsValid() const
+    {
+        return Page != nullptr && Count > 0;
+    }
+};
+
+// One large vertex or index buffer that meshes sub-allocate from
+class GeometryPage : public std::enable_shared_from_this<GeometryPage>
+{
+public:
+    // Used internally by GeometryArena. indexFormat is DXGI_FORMAT_UNKNOWN for vertex pages
+    GeometryPage(std::shared_ptr<CommandList> commandList, size_t _numElements, size_t _elementSize, DXGI_FORMAT _indexFormat);
+
+    size_t GetElementSize() const;
+    DXGI_FORMAT GetIndexFormat() const;
+    bool IsIndexPage() const;
+    size_t GetNumElements() const;
+    size_t GetNumFreeElements() const;
+
+    std::shared_ptr<VertexBuffer> GetVertexBuffer() const;
+    std::shared_ptr<IndexBuffer> GetIndexBuffer() const;
+
+    // Allocate a contiguous range and stage the data to be uploaded into it. Returns an invalid allocation if no free block is large enough
+    GeometryAllocation Allocate(size_t numElements, const void* data);
+
+    // Ranges are not reused straight away, as frames still in flight may be reading them. See ReleaseStaleAllocations
+    void Free(GeometryAllocation&& allocation, uint64_t frameNumber);
+
+    // Return the ranges freed on or before frameNumber to the free list
+    void ReleaseStaleAllocations(uint64_t frameNumber);
+
+protected:
+    // Adds a new block to the free list
+    void AddNewBlock(size_t offset, size_t count);
+
+    // Free a block, merging it with its neighbours in the free list
+    void FreeBlock(size_t offset, size_t count);
+
+private:
+    struct FreeBlockInfo;
+    // Free blocks by their offset in the buffer
+    using FreeListByOffset = std::map<size_t, FreeBlockInfo>;
+    // Free blocks by size, a multimap as multiple blocks can have the same size
+    using FreeListBySize = std::multimap<size_t, FreeListByOffset::iterator>;
+
+    struct FreeBlockInfo
+    {
+        FreeBlockInfo(size_t size) : Size(size) {}
+
+        size_t Size;
+        FreeListBySize::iterator FreeListBySizeIt;
+    };
+
+    struct StaleAllocationInfo
+    {
+        StaleAllocationInfo(size_t offset, size_t size, uint64_t frame) : Offset(offset), Size(size), FrameNumber(frame) {}
+
+        size_t Offset;
+        size_t Size;
+        // The frame number that the range was freed
+        uint64_t FrameNumber;
+    };
+
+    FreeListByOffset freeListByOffset;
+    FreeListBySize freeListBySize;
+    std::queue<StaleAllocationInfo> staleAllocations;
+
+    std::shared_ptr<VertexBuffer> vertexBuffer;
+    std::shared_ptr<IndexBuffer> indexBuffer;
+    size_t numElements;
+    size_t elementSize;
+    // Written under allocationMutex, but read without it for the arena's statistics
+    std::atomic<size_t> numFreeElements;
+    DXGI_FORMAT indexFormat;
+
+    std::mutex allocationMutex;
+};
+
+// Shared vertex and index buffers for static meshes. Meshes with the same vertex stride or index format share buffers, so consecutive draws don't rebind them
+class GeometryArena
+{
+public:
+    // Size of each shared buffer. Meshes larger than this get a page to themselves
+    inline static size_t VertexPageSize = 32 * 1024 * 1024;
+    inline static size_t IndexPageSize = 16 * 1024 * 1024;
+    // Size of each upload buffer that staged geometry is packed into. Larger uploads get a buffer to themselves
+    inline static size_t StagingPageSize = 8 * 1024 * 1024;
+
+    static GeometryAllocation AllocateVertices(std::shared_ptr<CommandList> commandList, size_t numVertices, size_t vertexStride, const void* vertices);
+    static GeometryAllocation AllocateIndices(std::shared_ptr<CommandList> commandList, size_t numIndices, DXGI_FORMAT indexFormat, const void* indices);
+    static void Free(GeometryAllocation& allocation);
+
+    // Called once a frame has finished executing on the GPU. Also recycles the upload buffers flushed on or before that frame
+    static void ReleaseStaleAllocations(uint64_t frameNumber);
+
+    // Copies the uploads staged since the last call into the shared buffers. Pages are drawn from while other threads load meshes,
+    // so uploads are recorded on the render queue's command list before its draws rather than on the loading thread's queue
+    static void FlushUploads(std::shared_ptr<CommandList> commandList);
+    // Called once everything staged before it has been recorded by FlushUploads
+    static void AddOnFlushedFunction(std::function<void(void)> func);
+
+    static size_t GetPageCount();
+    static size_t GetCapacityBytes();
+    static size_t GetUsedBytes();
+
+protected:
+    friend class GeometryPage;
+
+    // A persistently mapped upload buffer that staged geometry is packed into, reused once the frame that flushed it has finished
+    struct StagingPage
+    {
+        Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+        uint8_t* CPU = nullptr;
+        size_t Size = 0;
+        size_t Offset = 0;
+        // The frame whose command list copied out of it
+        uint64_t FlushedFrame = 0;
+    };
+
+    struct PendingUpload
+    {
+        std::shared_ptr<GeometryPage> Page;
+        size_t ByteOffset = 0;
+        size_t ByteSize = 0;
+        std::shared_ptr<StagingPage> Staging;
+        size_t StagingOffset = 0;
+    };
+
+    // Copies the data into the current staging page now, so the caller's data doesn't have to outlive the call
+    static void StageUpload(std::shared_ptr<GeometryPage> page, size_t byteOffset, size_t byteSize, const void* data);
+    // A free staging page with at least byteSize bytes, or a new one. Called with uploadMutex held
+    static std::shared_ptr<StagingPage> RequestStagingPage(size_t byteSize);
+
+    static GeometryAllocation Allocate(std::vector<std::shared_ptr<GeometryPage>>& pages, std::shared_ptr<CommandList> commandList, size_t numElements, size_t elementSize, DXGI_FORMAT indexFormat, size_t pageSize, const void* data);
+
+    // Vertex pages by stride, index pages by format
+    inline static std::map<size_t, std::vector<std::shared_ptr<GeometryPage>>> vertexPages;
+    inline static std::map<DXGI_FORMAT, std::vector<std::shared_ptr<GeometryPage>>> indexPages;
+    inline static std::mutex arenaMutex;
+    inline static std::vector<PendingUpload> pendingUploads;
+    inline static std::vector<std::function<void(void)>> onFlushedFunctions;
+    // The page being staged into, the ones filled since the last flush, and those flushed but maybe still being copied from
+    inline static std::shared_ptr<StagingPage> currentStagingPage;
+    inline static std::vector<std::shared_ptr<StagingPage>> filledStagingPages;
+    inline static std::vector<std::shared_ptr<StagingPage>> flushedStagingPages;
+    inline static std::vector<std::shared_ptr<StagingPage>> freeStagingPages;
+    inline static std::mutex uploadMutex;
+};
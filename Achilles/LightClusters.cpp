@@ -0,0 +1,337 @@
+#include "LightClusters.h"
+#include "Camera.h"
+#include "Profiling.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <random>
+#include <chrono>
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+void LightClusters::Build(std::shared_ptr<Camera> _camera, const std::vector<PointLight>& pointLights, const std::vector<SpotLight>& spotLights)
+{
+    if (_camera == nullptr)
+        return;
+
+    // Spot lights are binned by the sphere around their range, the cone is left to the shader
+    std::vector<BoundingSphere> lights;
+    lights.reserve(pointLights.size() + spotLights.size());
+    for (const PointLight& light : pointLights)
+        lights.push_back(BoundingSphere((Vector3)light.Light.PositionWorldSpace, light.Light.MaxDistance));
+    for (const SpotLight& light : spotLights)
+        lights.push_back(BoundingSphere((Vector3)light.Light.PositionWorldSpace, light.Light.MaxDistance));
+
+    Build(_camera->GetView(), _camera->GetProj(), _camera->IsOrthographic(), _camera->nearZ, _camera->farZ, _camera->viewport, lights);
+    camera = _camera.get();
+}
+
+void LightClusters::Build(const Matrix& view, const Matrix& proj, bool orthographic, float nearZ, float farZ, const D3D12_VIEWPORT& viewport, const std::vector<BoundingSphere>& lights)
+{
+    ScopedTimer _prof(L"LightClusters::Build");
+    camera = nullptr;
+
+    UpdateClusterBounds(proj, orthographic, nearZ, farZ, viewport);
+
+    uint32_t countX = clusterInfo.ClusterCountX;
+    uint32_t countY = clusterInfo.ClusterCountY;
+    uint32_t countZ = clusterInfo.ClusterCountZ;
+    float sliceNear = GetSliceDepth(0);
+    float sliceFar = GetSliceDepth(countZ);
+
+    // Find the clusters each light could reach from its view space sphere
+    lightBounds.clear();
+    lightBounds.reserve(lights.size());
+    sliceLights.resize(countZ);
+    for (std::vector<uint32_t>& slice : sliceLights)
+        slice.clear();
+
+    for (uint32_t i = 0; i < (uint32_t)lights.size(); i++)
+    {
+        float radius = lights[i].Radius;
+        if (radius <= 0.0f)
+            continue;
+
+        Vector3 center = Vector3::Transform((Vector3)lights[i].Center, view);
+        float minDepth = center.z - radius;
+        float maxDepth = center.z + radius;
+        if (maxDepth < sliceNear || minDepth > sliceFar)
+            continue;
+
+        LightBounds bounds{};
+        bounds.Sphere = XMFLOAT4(center.x, center.y, center.z, radius * radius);
+        bounds.MinZ = GetSlice(std::max<float>(minDepth, sliceNear));
+        bounds.MaxZ = GetSlice(std::min<float>(maxDepth, sliceFar));
+
+        // Screen extents of the sphere's view space box. A perspective box reaching behind the near plane could cover any of the screen
+        bounds.MinX = 0;
+        bounds.MaxX = countX - 1;
+        bounds.MinY = 0;
+        bounds.MaxY = countY - 1;
+        if (orthographic || minDepth > std::max<float>(nearZ, 0.0001f))
+        {
+            float ndcMinX = FLT_MAX, ndcMaxX = -FLT_MAX, ndcMinY = FLT_MAX, ndcMaxY = -FLT_MAX;
+            for (float depth : { minDepth, maxDepth })
+            {
+                for (float sign : { -1.0f, 1.0f })
+                {
+                    float x = center.x + radius * sign;
+                    float y = center.y + radius * sign;
+                    float ndcX = orthographic ? x * proj._11 + proj._41 : x * proj._11 / depth + proj._31;
+                    float ndcY = orthographic ? y * proj._22 + proj._42 : y * proj._22 / depth + proj._32;
+                    ndcMinX = std::min<float>(ndcMinX, ndcX);
+                    ndcMaxX = std::max<float>(ndcMaxX, ndcX);
+                    ndcMinY = std::min<float>(ndcMinY, ndcY);
+                    ndcMaxY = std::max<float>(ndcMaxY, ndcY);
+                }
+            }
+
+            if (ndcMaxX < -1.0f || ndcMinX > 1.0f || ndcMaxY < -1.0f || ndcMinY > 1.0f)
+                continue;
+
+            // Tiles go left to right and top to bottom
+            auto toTile = [](float t, uint32_t count) { return (uint32_t)std::clamp<float>(floorf(t * count), 0.0f, (float)(count - 1)); };
+            bounds.MinX = toTile((ndcMinX + 1.0f) * 0.5f, countX);
+            bounds.MaxX = toTile((ndcMaxX + 1.0f) * 0.5f, countX);
+            bounds.MinY = toTile((1.0f - ndcMaxY) * 0.5f, countY);
+            bounds.MaxY = toTile((1.0f - ndcMinY) * 0.5f, countY);
+        }
+
+        bounds.LightIndex = i;
+        uint32_t boundsIndex = (uint32_t)lightBounds.size();
+        lightBounds.push_back(bounds);
+        for (uint32_t z = bounds.MinZ; z <= bounds.MaxZ; z++)
+            sliceLights[z].push_back(boundsIndex);
+    }
+
+    // Every slice only writes to its own clusters, so slices are binned in parallel
+    clusterLights.resize(grid.size());
+    uint32_t workerCount = WorkerCount;
+    if (workerCount == 0)
+        workerCount = std::max(std::thread::hardware_concurrency(), 1u);
+    workerCount = std::min<uint32_t>({ workerCount, countZ, std::max<uint32_t>((uint32_t)lightBounds.size() / std::max<uint32_t>(MinLightsPerWorker, 1), 1) });
+
+    std::atomic<uint32_t> nextSlice = 0;
+    auto work = [&]()
+        {
+            for (uint32_t z = nextSlice++; z < countZ; z = nextSlice++)
+                BinSlice(z);
+        };
+
+    std::vector<std::thread> workers;
+    for (uint32_t i = 1; i < workerCount; i++)
+        workers.emplace_back(work);
+    work();
+
+    for (std::thread& worker : workers)
+        worker.join();
+
+    // Flatten the per cluster lists into one index list
+    lightIndices.clear();
+    droppedLightIndices = 0;
+    for (size_t c = 0; c < grid.size(); c++)
+    {
+        std::vector<uint32_t>& lightsInCluster = clusterLights[c];
+        uint32_t count = (uint32_t)std::min<size_t>(lightsInCluster.size(), MaxLightIndices - lightIndices.size());
+        droppedLightIndices += (uint32_t)lightsInCluster.size() - count;
+
+        grid[c].Offset = (uint32_t)lightIndices.size();
+        grid[c].Count = count;
+        lightIndices.insert(lightIndices.end(), lightsInCluster.begin(), lightsInCluster.begin() + count);
+    }
+
+    clusterInfo.Enabled = 1;
+}
+
+void LightClusters::BinSlice(uint32_t z)
+{
+    XMVECTOR zero = XMVectorZero();
+    uint32_t countX = clusterInfo.ClusterCountX;
+
+    for (uint32_t y = 0; y < clusterInfo.ClusterCountY; y++)
+    {
+        for (uint32_t x = 0; x < countX; x++)
+            clusterLights[GetClusterIndex(x, y, z)].clear();
+    }
+
+    for (uint32_t boundsIndex : sliceLights[z])
+    {
+        const LightBounds& bounds = lightBounds[boundsIndex];
+        // w is zeroed so it drops out of the dot product
+        XMVECTOR center = XMVectorSelect(zero, XMLoadFloat4(&bounds.Sphere), g_XMSelect1110);
+        float radiusSq = bounds.Sphere.w;
+
+        for (uint32_t y = bounds.MinY; y <= bounds.MaxY; y++)
+        {
+            for (uint32_t x = bounds.MinX; x <= bounds.MaxX; x++)
+            {
+                uint32_t cluster = GetClusterIndex(x, y, z);
+
+                // Distance from the sphere's center to the cluster's box
+                XMVECTOR boxMin = XMLoadFloat4(&clusterMin[cluster]);
+                XMVECTOR boxMax = XMLoadFloat4(&clusterMax[cluster]);
+                XMVECTOR offset = XMVectorAdd(XMVectorMax(XMVectorSubtract(boxMin, center), zero), XMVectorMax(XMVectorSubtract(center, boxMax), zero));
+                if (XMVectorGetX(XMVector4Dot(offset, offset)) <= radiusSq)
+                    clusterLights[cluster].push_back(bounds.LightIndex);
+            }
+        }
+    }
+}
+
+void LightClusters::UpdateClusterBounds(const Matrix& proj, bool orthographic, float nearZ, float farZ, const D3D12_VIEWPORT& viewport)
+{
+    uint32_t countX = std::max<uint32_t>(ClusterCountX, 1);
+    uint32_t countY = std::max<uint32_t>(ClusterCountY, 1);
+    uint32_t countZ = std::max<uint32_t>(ClusterCountZ, 1);
+
+    bool unchanged = !grid.empty() && proj == boundsProj && orthographic == boundsOrthographic && nearZ == boundsNearZ && farZ == boundsFarZ
+        && viewport.TopLeftX == boundsViewport.TopLeftX && viewport.TopLeftY == boundsViewport.TopLeftY && viewport.Width == boundsViewport.Width && viewport.Height == boundsViewport.Height
+        && countX == boundsCounts[0] && countY == boundsCounts[1] && countZ == boundsCounts[2];
+    if (unchanged)
+        return;
+
+    boundsProj = proj;
+    boundsOrthographic = orthographic;
+    boundsNearZ = nearZ;
+    boundsFarZ = farZ;
+    boundsViewport = viewport;
+    boundsCounts[0] = countX;
+    boundsCounts[1] = countY;
+    boundsCounts[2] = countZ;
+
+    clusterInfo.ClusterCountX = countX;
+    clusterInfo.ClusterCountY = countY;
+    clusterInfo.ClusterCountZ = countZ;
+    clusterInfo.ViewportOrigin = Vector2(viewport.TopLeftX, viewport.TopLeftY);
+    clusterInfo.ClustersPerPixel = Vector2(countX / std::max<float>(viewport.Width, 1.0f), countY / std::max<float>(viewport.Height, 1.0f));
+
+    // Perspective slices get exponentially deeper so each cluster is roughly as deep as it is wide, orthographic ones are even
+    float sliceNear = std::max<float>(nearZ, 0.0001f);
+    float sliceFar = std::max<float>(farZ, sliceNear * 1.01f);
+    if (orthographic)
+    {
+        sliceNear = nearZ;
+        sliceFar = std::max<float>(farZ, nearZ + 0.0001f);
+        clusterInfo.LinearSlices = 1;
+        clusterInfo.SliceScale = countZ / (sliceFar - sliceNear);
+        clusterInfo.SliceBias = -sliceNear * clusterInfo.SliceScale;
+    }
+    else
+    {
+        clusterInfo.LinearSlices = 0;
+        clusterInfo.SliceScale = countZ / log2f(sliceFar / sliceNear);
+        clusterInfo.SliceBias = -log2f(sliceNear) * clusterInfo.SliceScale;
+    }
+
+    size_t clusterCount = (size_t)countX * countY * countZ;
+    grid.assign(clusterCount, ClusterRange{});
+    clusterMin.resize(clusterCount);
+    clusterMax.resize(clusterCount);
+
+    for (uint32_t z = 0; z < countZ; z++)
+    {
+        float depths[2] = { GetSliceDepth(z), GetSliceDepth(z + 1) };
+        for (uint32_t y = 0; y < countY; y++)
+        {
+            float ndcY[2] = { 1.0f - 2.0f * y / countY, 1.0f - 2.0f * (y + 1) / countY };
+            for (uint32_t x = 0; x < countX; x++)
+            {
+                float ndcX[2] = { 2.0f * x / countX - 1.0f, 2.0f * (x + 1) / countX - 1.0f };
+
+                // Corners of the cluster at the front and back of its slice
+                XMVECTOR boxMin = XMVectorReplicate(FLT_MAX);
+                XMVECTOR boxMax = XMVectorReplicate(-FLT_MAX);
+                for (float depth : depths)
+                {
+                    for (float cornerX : ndcX)
+                    {
+                        for (float cornerY : ndcY)
+                        {
+                            float viewX = orthographic ? (cornerX - proj._41) / proj._11 : (cornerX - proj._31) * depth / proj._11;
+                            float viewY = orthographic ? (cornerY - proj._42) / proj._22 : (cornerY - proj._32) * depth / proj._22;
+                            XMVECTOR corner = XMVectorSet(viewX, viewY, depth, 0.0f);
+                            boxMin = XMVectorMin(boxMin, corner);
+                            boxMax = XMVectorMax(boxMax, corner);
+                        }
+                    }
+                }
+
+                uint32_t cluster = GetClusterIndex(x, y, z);
+                XMStoreFloat4(&clusterMin[cluster], XMVectorSetW(boxMin, 0.0f));
+                XMStoreFloat4(&clusterMax[cluster], XMVectorSetW(boxMax, 0.0f));
+            }
+        }
+    }
+}
+
+float LightClusters::GetSliceDepth(uint32_t slice) const
+{
+    // Inverse of GetSlice
+    float t = ((float)slice - clusterInfo.SliceBias) / clusterInfo.SliceScale;
+    return clusterInfo.LinearSlices ? t : exp2f(t);
+}
+
+uint32_t LightClusters::GetSlice(float viewDepth) const
+{
+    float t = clusterInfo.LinearSlices ? viewDepth : log2f(std::max<float>(viewDepth, 0.0001f));
+    float slice = floorf(t * clusterInfo.SliceScale + clusterInfo.SliceBias);
+    return (uint32_t)std::clamp<float>(slice, 0.0f, (float)(clusterInfo.ClusterCountZ - 1));
+}
+
+uint32_t LightClusters::GetClusterIndex(uint32_t x, uint32_t y, uint32_t z) const
+{
+    return (z * clusterInfo.ClusterCountY + y) * clusterInfo.ClusterCountX + x;
+}
+
+const LightClusters::ClusterInfo& LightClusters::GetClusterInfo() const
+{
+    return clusterInfo;
+}
+
+const std::vector<LightClusters::ClusterRange>& LightClusters::GetGrid() const
+{
+    return grid;
+}
+
+const std::vector<uint32_t>& LightClusters::GetLightIndices() const
+{
+    return lightIndices;
+}
+
+const Camera* LightClusters::GetCamera() const
+{
+    return camera;
+}
+
+uint32_t LightClusters::GetDroppedLightIndices() const
+{
+    return droppedLightIndices;
+}
+
+double LightClusters::Benchmark(uint32_t lightCount, uint32_t iterations)
+{
+    const float nearZ = 0.1f, farZ = 500.0f;
+    Matrix view = Matrix::Identity;
+    Matrix proj = XMMatrixPerspectiveFovLH(XMConvertToRadians(60.0f), 16.0f / 9.0f, nearZ, farZ);
+    D3D12_VIEWPORT viewport{ 0.0f, 0.0f, 1600.0f, 900.0f, 0.0f, 1.0f };
+
+    // Same seed every run so results can be compared
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> spread(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> depth(nearZ, 200.0f);
+    std::uniform_real_distribution<float> range(1.0f, 15.0f);
+    std::vector<BoundingSphere> lights(lightCount);
+    for (BoundingSphere& light : lights)
+        light = BoundingSphere(Vector3(spread(random), spread(random) * 0.5f, depth(random)), range(random));
+
+    LightClusters clusters;
+    clusters.Build(view, proj, false, nearZ, farZ, viewport, lights); // Builds the cluster bounds outside the timing
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+        clusters.Build(view, proj, false, nearZ, farZ, viewport, lights);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count() / std::max<uint32_t>(iterations, 1);
+}
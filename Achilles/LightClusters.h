@@ -0,0 +1,112 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <directxtk12/SimpleMath.h>
+#include "Lights.h"
+
+using DirectX::SimpleMath::Matrix;
+using DirectX::SimpleMath::Vector2;
+using DirectX::BoundingSphere;
+
+class Camera;
+
+// Splits the camera's view frustum into a grid of clusters (screen tiles by depth slices) and bins point and spot lights into them by their range
+// BlinnPhong looks up the cluster a pixel is in and only lights with the lights listed for it
+// Doesn't touch the GPU so it can be driven and checked on its own
+class LightClusters
+{
+public:
+    inline static uint32_t ClusterCountX = 16;
+    inline static uint32_t ClusterCountY = 9;
+    inline static uint32_t ClusterCountZ = 24;
+    // Indices past this are dropped, keeps the list within one upload page
+    inline static uint32_t MaxLightIndices = 128 * 1024;
+    // Threads depth slices are binned on, 0 uses one per hardware thread
+    inline static uint32_t WorkerCount = 0;
+    // Fewer lights than this per thread are binned on the calling thread alone
+    inline static uint32_t MinLightsPerWorker = 256;
+
+    // Matches ClusterInfo in Lighting.hlsli
+    struct ClusterInfo
+    {
+        // 0 bytes
+        uint32_t ClusterCountX = 0;
+        uint32_t ClusterCountY = 0;
+        uint32_t ClusterCountZ = 0;
+        uint32_t Enabled = 0;
+        // 16 bytes
+        Vector2 ViewportOrigin;
+        Vector2 ClustersPerPixel;
+        // 32 bytes
+        float SliceScale = 0.0f;
+        float SliceBias = 0.0f;
+        uint32_t LinearSlices = 0;
+        float Padding = 0.0f;
+        // 48 bytes
+    };
+
+    // Where a cluster's lights start in the light index list and how many there are
+    struct ClusterRange
+    {
+        uint32_t Offset = 0;
+        uint32_t Count = 0;
+    };
+
+    // Bins point lights then spot lights, so indices below the point light count are point lights and the rest are spot lights offset by it
+    void Build(std::shared_ptr<Camera> camera, const std::vector<PointLight>& pointLights, const std::vector<SpotLight>& spotLights);
+    // lights are world space spheres. viewport is the size of the area the camera draws to in pixels
+    void Build(const Matrix& view, const Matrix& proj, bool orthographic, float nearZ, float farZ, const D3D12_VIEWPORT& viewport, const std::vector<BoundingSphere>& lights);
+
+    const ClusterInfo& GetClusterInfo() const;
+    const std::vector<ClusterRange>& GetGrid() const;
+    const std::vector<uint32_t>& GetLightIndices() const;
+    // Camera the clusters were last built for, the clusters only apply to draws from it
+    const Camera* GetCamera() const;
+    // Lights dropped by the last build as MaxLightIndices was reached
+    uint32_t GetDroppedLightIndices() const;
+
+    uint32_t GetClusterIndex(uint32_t x, uint32_t y, uint32_t z) const;
+    // Depth slice a view space depth falls in, the same as the shaders pick
+    uint32_t GetSlice(float viewDepth) const;
+
+    // Times Build with lightCount random lights spread through the view, returns the average milliseconds per build
+    static double Benchmark(uint32_t lightCount, uint32_t iterations = 16);
+
+protected:
+    void UpdateClusterBounds(const Matrix& proj, bool orthographic, float nearZ, float farZ, const D3D12_VIEWPORT& viewport);
+    float GetSliceDepth(uint32_t slice) const;
+
+    struct LightBounds
+    {
+        DirectX::XMFLOAT4 Sphere; // View space center and squared radius
+        uint32_t MinX, MaxX, MinY, MaxY, MinZ, MaxZ;
+        uint32_t LightIndex;
+    };
+    void BinSlice(uint32_t slice);
+
+    ClusterInfo clusterInfo{};
+    std::vector<ClusterRange> grid;
+    std::vector<uint32_t> lightIndices;
+    const Camera* camera = nullptr;
+    uint32_t droppedLightIndices = 0;
+
+    // What the cluster bounds were built for
+    Matrix boundsProj;
+    bool boundsOrthographic = false;
+    float boundsNearZ = 0.0f, boundsFarZ = 0.0f;
+    D3D12_VIEWPORT boundsViewport{};
+    uint32_t boundsCounts[3] = { 0, 0, 0 };
+
+    // View space bounds of every cluster
+    std::vector<DirectX::XMFLOAT4> clusterMin;
+    std::vector<DirectX::XMFLOAT4> clusterMax;
+
+    // Kept between builds so binning doesn't reallocate
+    std::vector<LightBounds> lightBounds;
+    std::vector<std::vector<uint32_t>> sliceLights;
+    std::vector<std::vector<uint32_t>> clusterLights;
+};
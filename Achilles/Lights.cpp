@@ -1,10 +1,18 @@
 #include "Lights.h"
 
-CascadeInfo::CascadeInfo() : CascadeMatrix(Matrix::Identity), DepthStart(0), MinBorderPadding(0), MaxBorderPadding(1), Padding{ 0 }
+CascadeInfo::CascadeInfo() : CascadeMatrix(Matrix::Identity), AtlasRect(0, 0, 0, 0), DepthStart(0), MinBorderPadding(0), MaxBorderPadding(1), Padding{ 0 }
 {
 
 }
 
+PointShadowInfo::PointShadowInfo()
+{
+    for (uint32_t i = 0; i < 6; i++)
+    {
+        FaceMatrices[i] = Matrix::Identity;
+        FaceRects[i] = Vector4(0, 0, 0, 0);
+    }
+}
 
 // Cosntant 1.0, Linear 0.007 & Quadratic 0.0002 Attenuation = 600m
 LightCommon::LightCommon() : PositionWorldSpace(0, 0, 0, 1), Color(1, 1, 1, 1), Strength(1.0f), ConstantAttenuation(1.0f), LinearAttenuation(0.007f), QuadraticAttenuation(0.0002f), MaxDistance(100.0f), Rank(0.0f), Padding{ 0 }
@@ -44,9 +52,9 @@ LightProperties LightData::GetLightProperties()
     lightProperties.PointLightCount = (uint32_t)PointLights.size();
     lightProperties.SpotLightCount = (uint32_t)SpotLights.size();
     lightProperties.DirectionalLightCount = (uint32_t)DirectionalLights.size();
-    lightProperties.SpotShadowCount = (uint32_t)SortedSpotShadowMaps.size();
-    lightProperties.CascadeShadowCount = (uint32_t)SortedCascadeShadowMaps.size();
-    lightProperties.PointShadowCount = (uint32_t)SortedPointShadowMaps.size();
+    lightProperties.SpotShadowCount = SpotShadowCount;
+    lightProperties.CascadeShadowCount = CascadeShadowCount;
+    lightProperties.PointShadowCount = (uint32_t)SortedPointShadowInfos.size();
 
     return lightProperties;
 }
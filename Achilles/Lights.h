@@ -14,6 +14,8 @@ class LightObject;
 class ShadowCamera;
 class ShadowMap;
 class Material;
+class LightClusters;
+class ObjectLightLists;
 
 using DirectX::SimpleMath::Matrix;
 using DirectX::SimpleMath::Vector4;
@@ -23,6 +25,7 @@ using DirectX::SimpleMath::Color;
 struct LightInfo
 {
     Matrix ShadowMatrix;
+    Vector4 AtlasRect; // Where the light's shadow is in the shadow atlas, see ShadowAtlas::GetUVRect
     uint32_t IsShadowCaster;
     float Padding[3] = { 0 };
 };
@@ -30,6 +33,7 @@ struct LightInfo
 struct CascadeInfo
 {
     Matrix CascadeMatrix;
+    Vector4 AtlasRect;
     float DepthStart;
     float MinBorderPadding;
     float MaxBorderPadding;
@@ -38,6 +42,15 @@ struct CascadeInfo
     CascadeInfo();
 };
 
+// One shadow matrix and atlas rect per cube face, in ShadowCamera::GetPointDirectionShadowMatrix order
+struct PointShadowInfo
+{
+    Matrix FaceMatrices[6];
+    Vector4 FaceRects[6];
+
+    PointShadowInfo();
+};
+
 // Point light
 struct LightCommon
 {   
@@ -136,14 +149,29 @@ public:
     AmbientLight AmbientLight{};
 
     std::vector<std::shared_ptr<ShadowCamera>> ShadowCameras{};
-    std::vector<std::shared_ptr<ShadowMap>> SortedSpotShadowMaps{};
-    std::vector<std::shared_ptr<ShadowMap>> SortedCascadeShadowMaps{};
+    // Shadow casting lights are sorted to the front of their lists, these count how many of them have shadows
+    uint32_t SpotShadowCount = 0;
+    uint32_t CascadeShadowCount = 0;
     std::vector<CascadeInfo> SortedCascadeShadowInfos{};
-    std::vector<std::shared_ptr<ShadowMap>> SortedPointShadowMaps{};
+    std::vector<PointShadowInfo> SortedPointShadowInfos{};
+    // Every shadow is a tile of this texture
+    std::shared_ptr<ShadowMap> ShadowAtlasMap{};
+    // Point and spot lights binned by where they reach in the main camera's view, rebuilt every frame
+    std::shared_ptr<LightClusters> Clusters{};
+    // Point and spot lights reaching each drawn object, rebuilt every frame
+    std::shared_ptr<ObjectLightLists> ObjectLights{};
     
     LightProperties GetLightProperties();
 };
 
+// How the point and spot lights each pixel shades are found
+enum class LightAssignment
+{
+    AllLights, // Every light, fine for a handful of lights
+    Clustered, // The lights in the pixel's cluster of the main camera's view
+    PerObject, // Up to ObjectLightLists::MaxLightsPerObject lights reaching the object, cheaper to build for small scenes
+};
+
 enum class LightType
 {
     None = 0,
@@ -7,23 +7,68 @@ using namespace DirectX::SimpleMath;
 
 Mesh::Mesh(std::shared_ptr<CommandList> commandList, void* vertices, UINT vertexCount, size_t vertexStride, const uint16_t* indices, UINT indexCount, std::shared_ptr<Shader> _shader) : shader(_shader)
 {
-    topology = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-    vertexBuffer = std::make_shared<VertexBuffer>(L"Unnamed Mesh Vertex Buffer");
-    indexBuffer = std::make_shared<IndexBuffer>(L"Unnamed Mesh Index Buffer");
+    CreateBuffers(commandList, vertices, vertexCount, vertexStride, indices, indexCount, DXGI_FORMAT_R16_UINT);
+}
 
-    commandList->CopyVertexBuffer(*vertexBuffer, vertexCount, vertexStride, vertices);
-    commandList->CopyIndexBuffer(*indexBuffer, indexCount, DXGI_FORMAT_R16_UINT, indices);
+Mesh::Mesh(std::wstring _name, std::shared_ptr<CommandList> commandList, void* vertices, UINT vertexCount, size_t vertexStride, const uint16_t* indices, UINT indexCount, std::shared_ptr<Shader> _shader)
+    : Mesh(commandList, vertices, vertexCount, vertexStride, indices, indexCount, _shader)
+{
+    SetName(_name);
+}
 
-    isCreated = true;
+Mesh::Mesh(std::shared_ptr<CommandList> commandList, void* vertices, UINT vertexCount, size_t vertexStride, const uint32_t* indices, UINT indexCount, std::shared_ptr<Shader> _shader) : shader(_shader)
+{
+    if (vertexCount <= MaxVertexCount16)
+    {
+        // Every index fits in 16 bits, so halve the index buffer size
+        std::vector<uint16_t> narrowIndices(indexCount);
+        for (UINT i = 0; i < indexCount; i++)
+        {
+            narrowIndices[i] = (uint16_t)indices[i];
+        }
+        CreateBuffers(commandList, vertices, vertexCount, vertexStride, narrowIndices.data(), indexCount, DXGI_FORMAT_R16_UINT);
+    }
+    else
+    {
+        CreateBuffers(commandList, vertices, vertexCount, vertexStride, indices, indexCount, DXGI_FORMAT_R32_UINT);
+    }
 }
 
-Mesh::Mesh(std::wstring _name, std::shared_ptr<CommandList> commandList, void* vertices, UINT vertexCount, size_t vertexStride, const uint16_t* indices, UINT indexCount, std::shared_ptr<Shader> _shader)
+Mesh::Mesh(std::wstring _name, std::shared_ptr<CommandList> commandList, void* vertices, UINT vertexCount, size_t vertexStride, const uint32_t* indices, UINT indexCount, std::shared_ptr<Shader> _shader)
     : Mesh(commandList, vertices, vertexCount, vertexStride, indices, indexCount, _shader)
 {
     SetName(_name);
 }
 
+Mesh::~Mesh()
+{
+    GeometryArena::Free(vertexAllocation);
+    GeometryArena::Free(indexAllocation);
+}
+
+void Mesh::CreateBuffers(std::shared_ptr<CommandList> commandList, void* vertices, UINT vertexCount, size_t _vertexStride, const void* indices, UINT indexCount, DXGI_FORMAT _indexFormat)
+{
+    topology = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+    vertexStride = _vertexStride;
+    indexFormat = _indexFormat;
+
+    size_t indexSize = indexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4;
+    const uint8_t* vertexBytes = reinterpret_cast<const uint8_t*>(vertices);
+    const uint8_t* indexBytes = reinterpret_cast<const uint8_t*>(indices);
+    vertexData.assign(vertexBytes, vertexBytes + vertexCount * vertexStride);
+    indexData.assign(indexBytes, indexBytes + indexCount * indexSize);
+
+    // The arena stages the data straight away, so a temporary narrowed index array is fine to pass
+    vertexAllocation = GeometryArena::AllocateVertices(commandList, vertexCount, vertexStride, vertices);
+    indexAllocation = GeometryArena::AllocateIndices(commandList, indexCount, indexFormat, indices);
+
+    // The data only reaches the shared buffers once the render queue's command list records the staged uploads
+    std::shared_ptr<std::atomic<bool>> copied = hasBeenCopied;
+    GeometryArena::AddOnFlushedFunction([copied](void) { copied->store(true, std::memory_order_release); });
+
+    isCreated = true;
+}
+
 std::wstring Mesh::GetName()
 {
     return name;
@@ -32,10 +77,6 @@ std::wstring Mesh::GetName()
 void Mesh::SetName(std::wstring newName)
 {
     name = newName;
-    if (vertexBuffer)
-        vertexBuffer->SetName(name + L" Vertex Buffer");
-    if (indexBuffer)
-        indexBuffer->SetName(name + L" Index Buffer");
 }
 
 DirectX::BoundingBox Mesh::GetBoundingBox()
@@ -46,16 +87,22 @@ DirectX::BoundingBox Mesh::GetBoundingBox()
 void Mesh::SetBoundingBox(DirectX::BoundingBox box)
 {
     boundingBox = box;
+    for (std::shared_ptr<Mesh> lod : lods)
+        lod->SetBoundingBox(box);
 }
 
 std::shared_ptr<VertexBuffer> Mesh::GetVertexBuffer()
 {
-    return vertexBuffer;
+    if (!vertexAllocation.IsValid())
+        return nullptr;
+    return vertexAllocation.Page->GetVertexBuffer();
 }
 
 std::shared_ptr<IndexBuffer> Mesh::GetIndexBuffer()
 {
-    return indexBuffer;
+    if (!indexAllocation.IsValid())
+        return nullptr;
+    return indexAllocation.Page->GetIndexBuffer();
 }
 
 D3D_PRIMITIVE_TOPOLOGY Mesh::GetTopology()
@@ -68,46 +115,63 @@ std::shared_ptr<Shader> Mesh::GetShader()
     return shader;
 }
 
+uint32_t Mesh::GetNumVertices()
+{
+    return (uint32_t)vertexAllocation.Count;
+}
+
+size_t Mesh::GetVertexStride()
+{
+    return vertexStride;
+}
+
 uint32_t Mesh::GetNumIndices()
 {
-    if (indexBuffer == nullptr)
-        return 0;
-    return (uint32_t)indexBuffer->GetNumIndices();
+    return (uint32_t)indexAllocation.Count;
+}
+
+DXGI_FORMAT Mesh::GetIndexFormat()
+{
+    return indexFormat;
+}
+
+int32_t Mesh::GetBaseVertex()
+{
+    return (int32_t)vertexAllocation.Offset;
+}
+
+uint32_t Mesh::GetStartIndex()
+{
+    return (uint32_t)indexAllocation.Offset;
 }
 
 std::vector<Vector3> Mesh::GetTrianglePoints(Matrix transformMatrix)
 {
     std::vector<Vector3> outPositions;
-    std::shared_ptr<VertexBuffer> vbuffer = GetVertexBuffer();
-    std::shared_ptr<IndexBuffer> ibuffer = GetIndexBuffer();
 
-    if (vbuffer == nullptr || ibuffer == nullptr)
+    if (vertexData.empty() || indexData.empty())
         return outPositions;
 
-    size_t vbufferSize = vbuffer->GetBufferSize();
-    size_t vertexStride = vbuffer->GetVertexStride();
-
-    size_t indexCount = ibuffer->GetNumIndices();
-    size_t indexStride = ibuffer->GetIndexStride();
+    size_t vbufferSize = vertexData.size();
+    size_t indexStride = indexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4;
+    size_t indexCount = indexData.size() / indexStride;
 
-    char* positions = reinterpret_cast<char*>(vbuffer->GetBufferData());
-    void* indices = ibuffer->GetBufferData();
+    const uint8_t* positions = vertexData.data();
+    const void* indices = indexData.data();
 
-    for (size_t i = 0; i < indexCount * indexStride; i += indexStride)
+    for (size_t i = 0; i < indexCount; i++)
     {
         uint32_t index = 0;
         if (indexStride == 2)
-            index = (uint32_t)(reinterpret_cast<uint16_t*>(indices)[i / indexStride]);
-        else if (indexStride == 4)
-            index = reinterpret_cast<uint32_t*>(indices)[i / indexStride];
+            index = (uint32_t)(reinterpret_cast<const uint16_t*>(indices)[i]);
         else
-            return outPositions;
+            index = reinterpret_cast<const uint32_t*>(indices)[i];
 
         if (index * vertexStride >= vbufferSize)
             continue;
 
         // Get position from offset by index * stride
-        Vector3 position = *(reinterpret_cast<Vector3*>(positions + (index * vertexStride)));
+        Vector3 position = *(reinterpret_cast<const Vector3*>(positions + (index * vertexStride)));
         position = Multiply(transformMatrix, position);
 
         outPositions.push_back(position);
@@ -116,9 +180,103 @@ std::vector<Vector3> Mesh::GetTrianglePoints(Matrix transformMatrix)
     return outPositions;
 }
 
+std::shared_ptr<MeshBVH> Mesh::GetBVH()
+{
+    std::lock_guard<std::mutex> lock(bvhMutex);
+
+    if (bvh == nullptr && !vertexData.empty() && !indexData.empty())
+    {
+        ScopedTimer _prof(L"Build Mesh BVH");
+
+        size_t indexStride = indexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4;
+        bvh = std::make_shared<MeshBVH>(vertexData.data(), vertexData.size() / vertexStride, vertexStride, indexData.data(), indexData.size() / indexStride, indexStride);
+    }
+    return bvh;
+}
+
 bool Mesh::HasBeenCopied()
 {
-    if (vertexBuffer == nullptr || indexBuffer == nullptr)
-        return false;
-    return vertexBuffer->HasBeenCopied() && indexBuffer->HasBeenCopied();
+    return isCreated && hasBeenCopied->load(std::memory_order_acquire);
+}
+
+void Mesh::AddLOD(std::shared_ptr<Mesh> lodMesh, float screenSize)
+{
+    if (lodMesh == nullptr)
+        throw std::exception("LOD mesh was invalid");
+
+    // Bounds are kept from the full detail mesh so culling doesn't change between levels
+    lodMesh->SetBoundingBox(boundingBox);
+    lods.push_back(lodMesh);
+    lodScreenSizes.push_back(screenSize);
+}
+
+void Mesh::GenerateLODs(std::shared_ptr<CommandList> commandList, const void* vertices, UINT vertexCount, size_t vertexStride, const std::vector<uint32_t>& indices, uint32_t maxLevels)
+{
+    ScopedTimer _prof(L"Mesh::GenerateLODs");
+
+    std::vector<MeshOptimizer::LODLevel> levels = MeshOptimizer::GenerateLODChain(indices, vertices, vertexCount, vertexStride, maxLevels);
+
+    const char* vertexBytes = reinterpret_cast<const char*>(vertices);
+    std::vector<char> lodVertices;
+    for (MeshOptimizer::LODLevel& level : levels)
+    {
+        // Compact each level's vertices so coarse levels don't carry the whole vertex buffer
+        lodVertices.assign(vertexBytes, vertexBytes + vertexCount * vertexStride);
+        size_t lodVertexCount = MeshOptimizer::OptimizeVertexFetch(lodVertices.data(), vertexCount, vertexStride, level.Indices);
+
+        std::wstring lodName = name + L" LOD" + std::to_wstring(lods.size() + 1);
+        std::shared_ptr<Mesh> lod = std::make_shared<Mesh>(lodName, commandList, lodVertices.data(), (UINT)lodVertexCount, vertexStride, level.Indices.data(), (UINT)level.Indices.size(), shader);
+        AddLOD(lod, level.ScreenSize);
+
+#if defined(_DEBUG) || defined(_UNOPTIMIZED)
+        OutputDebugStringWFormatted(L"%s: %u tris, error %.4f, screen size %.3f\n", lodName.c_str(), (uint32_t)(level.Indices.size() / 3), level.Error, level.ScreenSize);
+#endif
+    }
+}
+
+void Mesh::ClearLODs()
+{
+    lods.clear();
+    lodScreenSizes.clear();
+}
+
+uint32_t Mesh::GetLODCount()
+{
+    return (uint32_t)lods.size() + 1;
+}
+
+std::shared_ptr<Mesh> Mesh::GetLOD(uint32_t level)
+{
+    if (level == 0 || lods.size() == 0)
+        return shared_from_this();
+
+    level = std::min(level, (uint32_t)lods.size());
+    return lods[level - 1];
+}
+
+float Mesh::GetLODScreenSize(uint32_t level)
+{
+    if (level == 0 || lods.size() == 0)
+        return INFINITY;
+
+    level = std::min(level, (uint32_t)lods.size());
+    return lodScreenSizes[level - 1];
+}
+
+uint32_t Mesh::SelectLOD(float screenSize, uint32_t previousLevel, float hysteresis)
+{
+    return SelectLOD(lodScreenSizes, screenSize, previousLevel, hysteresis);
+}
+
+uint32_t Mesh::SelectLOD(const std::vector<float>& screenSizes, float screenSize, uint32_t previousLevel, float hysteresis)
+{
+    uint32_t count = (uint32_t)screenSizes.size() + 1;
+    uint32_t level = std::min(previousLevel, count - 1);
+
+    while (level + 1 < count && screenSize < screenSizes[level] * (1.0f - hysteresis))
+        level++;
+    while (level > 0 && screenSize > screenSizes[level - 1] * (1.0f + hysteresis))
+        level--;
+
+    return level;
 }
@@ -2,38 +2,97 @@
 #include "CommandQueue.h"
 #include "CommandList.h"
 #include "Material.h"
+#include "MeshOptimizer.h"
+#include "GeometryArena.h"
+#include "MeshBVH.h"
+#include "AssetCache.h"
 
 using Microsoft::WRL::ComPtr;
 
-class Mesh
+class Mesh : public std::enable_shared_from_this<Mesh>
 {
 protected:
 	std::wstring name = L"Unnamed Mesh";
 	bool isCreated = false;
-	std::shared_ptr<VertexBuffer> vertexBuffer;
-	std::shared_ptr<IndexBuffer> indexBuffer;
+	// Ranges within the shared geometry arena buffers
+	GeometryAllocation vertexAllocation;
+	GeometryAllocation indexAllocation;
+	size_t vertexStride = 0;
+	DXGI_FORMAT indexFormat = DXGI_FORMAT_UNKNOWN;
+	// CPU copies of the geometry, as the arena buffers are shared
+	std::vector<uint8_t> vertexData;
+	std::vector<uint8_t> indexData;
+	// Set once the render queue's command list has recorded the geometry's upload. Written on the render thread and read from any
+	std::shared_ptr<std::atomic<bool>> hasBeenCopied = std::make_shared<std::atomic<bool>>(false);
 	DirectX::BoundingBox boundingBox;
 	std::shared_ptr<Shader> shader;
 	D3D_PRIMITIVE_TOPOLOGY topology;
+	// Coarser levels of detail. lods[0] is level 1
+	std::vector<std::shared_ptr<Mesh>> lods;
+	std::vector<float> lodScreenSizes;
+	// Built from the CPU copies the first time the mesh is picked
+	std::shared_ptr<MeshBVH> bvh;
+	std::mutex bvhMutex;
 
 public:
+	// Largest vertex count that can be addressed with 16-bit indices
+	static constexpr UINT MaxVertexCount16 = 0xFFFF;
+
+	// Meshes imported from model files, keyed by the file and the mesh within it. See CommonShader::CommonShaderMeshCreation
+	inline static AssetCache<Mesh> importCache{};
+
 	// Only allows D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST at the moment
 	Mesh(std::shared_ptr<CommandList> commandList, void* vertices, UINT vertexCount, size_t vertexStride, const uint16_t* indices, UINT indexCount, std::shared_ptr<Shader> _shader);
 	Mesh(std::wstring _name, std::shared_ptr<CommandList> commandList, void* vertices, UINT vertexCount, size_t vertexStride, const uint16_t* indices, UINT indexCount, std::shared_ptr<Shader> _shader);
+	// 32-bit indices are narrowed to 16-bit when vertexCount fits within MaxVertexCount16
+	Mesh(std::shared_ptr<CommandList> commandList, void* vertices, UINT vertexCount, size_t vertexStride, const uint32_t* indices, UINT indexCount, std::shared_ptr<Shader> _shader);
+	Mesh(std::wstring _name, std::shared_ptr<CommandList> commandList, void* vertices, UINT vertexCount, size_t vertexStride, const uint32_t* indices, UINT indexCount, std::shared_ptr<Shader> _shader);
+	// Frees the mesh's ranges in the geometry arena
+	~Mesh();
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
+
 	std::wstring GetName();
 	void SetName(std::wstring newName);
 
 	DirectX::BoundingBox GetBoundingBox();
 	void SetBoundingBox(DirectX::BoundingBox box);
 
+	// The shared arena buffers this mesh lives in. Draw with GetBaseVertex and GetStartIndex
 	std::shared_ptr<VertexBuffer> GetVertexBuffer();
 	std::shared_ptr<IndexBuffer> GetIndexBuffer();
 	D3D_PRIMITIVE_TOPOLOGY GetTopology();
 	std::shared_ptr<Shader> GetShader();
+	uint32_t GetNumVertices();
+	size_t GetVertexStride();
 	uint32_t GetNumIndices();
+	DXGI_FORMAT GetIndexFormat();
+	int32_t GetBaseVertex();
+	uint32_t GetStartIndex();
 
 	// Gets the position of every vertex. Duplicated points
 	std::vector<DirectX::SimpleMath::Vector3> GetTrianglePoints(DirectX::SimpleMath::Matrix transformMatrix = DirectX::SimpleMath::Matrix::Identity);
 
+	// Triangle hierarchy in local space for ray tests, built on first use. nullptr if the mesh has no geometry
+	std::shared_ptr<MeshBVH> GetBVH();
+
 	bool HasBeenCopied();
+
+	// Level 0 is this mesh. Each level is used once the projected size falls below its screen size (a fraction of the view height)
+	void AddLOD(std::shared_ptr<Mesh> lodMesh, float screenSize);
+	// Simplifies the data this mesh was created from and adds the results as LODs
+	void GenerateLODs(std::shared_ptr<CommandList> commandList, const void* vertices, UINT vertexCount, size_t vertexStride, const std::vector<uint32_t>& indices, uint32_t maxLevels = MeshOptimizer::DefaultLODCount);
+	void ClearLODs();
+	// Includes this mesh
+	uint32_t GetLODCount();
+	// Levels past the coarsest return the coarsest
+	std::shared_ptr<Mesh> GetLOD(uint32_t level);
+	float GetLODScreenSize(uint32_t level);
+	// Picks a level for a projected size. The size has to pass a switch point by the hysteresis fraction before the level changes from previousLevel
+	uint32_t SelectLOD(float screenSize, uint32_t previousLevel, float hysteresis);
+	// The same for a list of switch points, where screenSizes[0] is the screen size of level 1
+	static uint32_t SelectLOD(const std::vector<float>& screenSizes, float screenSize, uint32_t previousLevel, float hysteresis);
+
+protected:
+	void CreateBuffers(std::shared_ptr<CommandList> commandList, void* vertices, UINT vertexCount, size_t _vertexStride, const void* indices, UINT indexCount, DXGI_FORMAT _indexFormat);
 };
@@ -0,0 +1,420 @@
+#include "MeshBVH.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+// Same epsilon DirectXMath uses for its ray/triangle test, so both paths reject the same near-parallel triangles
+static constexpr float RayEpsilon = 1e-20f;
+
+static float SurfaceArea(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax)
+{
+    float x = std::max(boundsMax.x - boundsMin.x, 0.0f);
+    float y = std::max(boundsMax.y - boundsMin.y, 0.0f);
+    float z = std::max(boundsMax.z - boundsMin.z, 0.0f);
+    return 2.0f * (x * y + y * z + z * x);
+}
+
+static void GrowBounds(XMFLOAT3& boundsMin, XMFLOAT3& boundsMax, const XMFLOAT3& pointMin, const XMFLOAT3& pointMax)
+{
+    boundsMin = XMFLOAT3(std::min(boundsMin.x, pointMin.x), std::min(boundsMin.y, pointMin.y), std::min(boundsMin.z, pointMin.z));
+    boundsMax = XMFLOAT3(std::max(boundsMax.x, pointMax.x), std::max(boundsMax.y, pointMax.y), std::max(boundsMax.z, pointMax.z));
+}
+
+static float GetAxis(const XMFLOAT3& value, uint32_t axis)
+{
+    return axis == 0 ? value.x : (axis == 1 ? value.y : value.z);
+}
+
+MeshBVH::MeshBVH(const uint8_t* vertices, size_t vertexCount, size_t vertexStride, const void* indices, size_t indexCount, size_t indexStride)
+{
+    std::vector<BuildTriangle> triangles;
+    triangles.reserve(indexCount / 3);
+
+    for (size_t t = 0; t + 2 < indexCount; t += 3)
+    {
+        BuildTriangle triangle{};
+        triangle.Index = (uint32_t)(t / 3);
+
+        bool valid = true;
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            uint32_t index = 0;
+            if (indexStride == 2)
+                index = (uint32_t)(reinterpret_cast<const uint16_t*>(indices)[t + i]);
+            else
+                index = reinterpret_cast<const uint32_t*>(indices)[t + i];
+
+            if (index >= vertexCount)
+            {
+                valid = false;
+                break;
+            }
+
+            // Position is the first element of every vertex
+            triangle.Vertices[i] = *(reinterpret_cast<const XMFLOAT3*>(vertices + (index * vertexStride)));
+        }
+        if (!valid)
+            continue;
+
+        triangle.BoundsMin = triangle.Vertices[0];
+        triangle.BoundsMax = triangle.Vertices[0];
+        GrowBounds(triangle.BoundsMin, triangle.BoundsMax, triangle.Vertices[1], triangle.Vertices[1]);
+        GrowBounds(triangle.BoundsMin, triangle.BoundsMax, triangle.Vertices[2], triangle.Vertices[2]);
+        triangle.Centroid = XMFLOAT3(
+            (triangle.BoundsMin.x + triangle.BoundsMax.x) * 0.5f,
+            (triangle.BoundsMin.y + triangle.BoundsMax.y) * 0.5f,
+            (triangle.BoundsMin.z + triangle.BoundsMax.z) * 0.5f);
+
+        triangles.push_back(triangle);
+    }
+
+    triangleCount = (uint32_t)triangles.size();
+    if (triangleCount == 0)
+        return;
+
+    nodes.reserve(2 * (triangleCount / MaxLeafTriangles + 1));
+    packets.reserve(triangleCount / MaxLeafTriangles + 1);
+    nodes.push_back(Node{});
+    BuildNode(0, triangles, 0, triangles.size(), 0);
+}
+
+void MeshBVH::BuildNode(uint32_t nodeIndex, std::vector<BuildTriangle>& triangles, size_t begin, size_t end, uint32_t depth)
+{
+    XMFLOAT3 boundsMin = triangles[begin].BoundsMin;
+    XMFLOAT3 boundsMax = triangles[begin].BoundsMax;
+    XMFLOAT3 centroidMin = triangles[begin].Centroid;
+    XMFLOAT3 centroidMax = triangles[begin].Centroid;
+    for (size_t i = begin + 1; i < end; i++)
+    {
+        GrowBounds(boundsMin, boundsMax, triangles[i].BoundsMin, triangles[i].BoundsMax);
+        GrowBounds(centroidMin, centroidMax, triangles[i].Centroid, triangles[i].Centroid);
+    }
+
+    nodes[nodeIndex].BoundsMin = boundsMin;
+    nodes[nodeIndex].BoundsMax = boundsMax;
+
+    size_t count = end - begin;
+    if (count <= MaxLeafTriangles)
+    {
+        CreateLeaf(nodeIndex, triangles, begin, end);
+        return;
+    }
+
+    // Split along the axis the centroids are most spread out on
+    uint32_t axis = 0;
+    float extent = centroidMax.x - centroidMin.x;
+    if (centroidMax.y - centroidMin.y > extent)
+    {
+        axis = 1;
+        extent = centroidMax.y - centroidMin.y;
+    }
+    if (centroidMax.z - centroidMin.z > extent)
+    {
+        axis = 2;
+        extent = centroidMax.z - centroidMin.z;
+    }
+    float axisMin = GetAxis(centroidMin, axis);
+
+    size_t mid = begin;
+    if (extent > 0.0f && depth < MaxTraversalDepth / 2)
+    {
+        struct Bin
+        {
+            XMFLOAT3 BoundsMin = XMFLOAT3(INFINITY, INFINITY, INFINITY);
+            XMFLOAT3 BoundsMax = XMFLOAT3(-INFINITY, -INFINITY, -INFINITY);
+            size_t Count = 0;
+        };
+        Bin bins[SplitBinCount];
+
+        auto getBin = [&](const BuildTriangle& triangle)
+        {
+            uint32_t bin = (uint32_t)((GetAxis(triangle.Centroid, axis) - axisMin) / extent * SplitBinCount);
+            return std::min(bin, SplitBinCount - 1);
+        };
+
+        for (size_t i = begin; i < end; i++)
+        {
+            Bin& bin = bins[getBin(triangles[i])];
+            GrowBounds(bin.BoundsMin, bin.BoundsMax, triangles[i].BoundsMin, triangles[i].BoundsMax);
+            bin.Count++;
+        }
+
+        // Sweep from the right to get the cost of everything past each split plane
+        float rightCosts[SplitBinCount] = {};
+        Bin right;
+        for (uint32_t b = SplitBinCount - 1; b > 0; b--)
+        {
+            GrowBounds(right.BoundsMin, right.BoundsMax, bins[b].BoundsMin, bins[b].BoundsMax);
+            right.Count += bins[b].Count;
+            rightCosts[b] = right.Count > 0 ? SurfaceArea(right.BoundsMin, right.BoundsMax) * right.Count : 0.0f;
+        }
+
+        // Then from the left, the plane between bins b - 1 and b
+        uint32_t bestSplit = 0;
+        float bestCost = INFINITY;
+        Bin left;
+        for (uint32_t b = 1; b < SplitBinCount; b++)
+        {
+            GrowBounds(left.BoundsMin, left.BoundsMax, bins[b - 1].BoundsMin, bins[b - 1].BoundsMax);
+            left.Count += bins[b - 1].Count;
+            if (left.Count == 0 || left.Count == count)
+                continue;
+
+            float cost = SurfaceArea(left.BoundsMin, left.BoundsMax) * left.Count + rightCosts[b];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestSplit = b;
+            }
+        }
+
+        if (bestSplit > 0)
+        {
+            auto midIter = std::partition(triangles.begin() + begin, triangles.begin() + end, [&](const BuildTriangle& triangle) { return getBin(triangle) < bestSplit; });
+            mid = midIter - triangles.begin();
+        }
+    }
+
+    // All centroids are in one bin or the tree is already deep, so split down the middle
+    if (mid == begin || mid == end)
+    {
+        mid = begin + count / 2;
+        std::nth_element(triangles.begin() + begin, triangles.begin() + mid, triangles.begin() + end, [axis](const BuildTriangle& a, const BuildTriangle& b) { return GetAxis(a.Centroid, axis) < GetAxis(b.Centroid, axis); });
+    }
+
+    uint32_t leftChild = (uint32_t)nodes.size();
+    nodes.push_back(Node{});
+    nodes.push_back(Node{});
+    nodes[nodeIndex].FirstChildOrPacket = leftChild;
+    nodes[nodeIndex].TriangleCount = 0;
+
+    BuildNode(leftChild, triangles, begin, mid, depth + 1);
+    BuildNode(leftChild + 1, triangles, mid, end, depth + 1);
+}
+
+void MeshBVH::CreateLeaf(uint32_t nodeIndex, const std::vector<BuildTriangle>& triangles, size_t begin, size_t end)
+{
+    // Unused lanes are left as degenerate triangles, which the intersector always rejects
+    XMFLOAT4 v0[3] = {};
+    XMFLOAT4 edge1[3] = {};
+    XMFLOAT4 edge2[3] = {};
+
+    TrianglePacket packet{};
+    for (uint32_t lane = 0; lane < MaxLeafTriangles; lane++)
+    {
+        packet.Triangles[lane] = UINT32_MAX;
+        if (begin + lane >= end)
+            continue;
+
+        const BuildTriangle& triangle = triangles[begin + lane];
+        packet.Triangles[lane] = triangle.Index;
+
+        for (uint32_t axis = 0; axis < 3; axis++)
+        {
+            float p0 = GetAxis(triangle.Vertices[0], axis);
+            (&v0[axis].x)[lane] = p0;
+            (&edge1[axis].x)[lane] = GetAxis(triangle.Vertices[1], axis) - p0;
+            (&edge2[axis].x)[lane] = GetAxis(triangle.Vertices[2], axis) - p0;
+        }
+    }
+
+    for (uint32_t axis = 0; axis < 3; axis++)
+    {
+        packet.V0[axis] = XMLoadFloat4(&v0[axis]);
+        packet.Edge1[axis] = XMLoadFloat4(&edge1[axis]);
+        packet.Edge2[axis] = XMLoadFloat4(&edge2[axis]);
+    }
+
+    nodes[nodeIndex].FirstChildOrPacket = (uint32_t)packets.size();
+    nodes[nodeIndex].TriangleCount = (uint32_t)(end - begin);
+    packets.push_back(packet);
+}
+
+bool MeshBVH::IntersectNode(const Node& node, FXMVECTOR origin, FXMVECTOR inverseDirection, float maxDistance, float& entryDistance) const
+{
+    // Slab test. Rays starting inside the node enter it at 0
+    XMVECTOR t0 = XMVectorMultiply(XMVectorSubtract(XMLoadFloat3(&node.BoundsMin), origin), inverseDirection);
+    XMVECTOR t1 = XMVectorMultiply(XMVectorSubtract(XMLoadFloat3(&node.BoundsMax), origin), inverseDirection);
+    XMVECTOR tMin = XMVectorMin(t0, t1);
+    XMVECTOR tMax = XMVectorMax(t0, t1);
+
+    float tNear = std::max(std::max(XMVectorGetX(tMin), XMVectorGetY(tMin)), std::max(XMVectorGetZ(tMin), 0.0f));
+    float tFar = std::min(std::min(XMVectorGetX(tMax), XMVectorGetY(tMax)), std::min(XMVectorGetZ(tMax), maxDistance));
+
+    entryDistance = tNear;
+    return tNear <= tFar;
+}
+
+uint32_t MeshBVH::IntersectPacket(const TrianglePacket& packet, const RayPacket& ray, float& distance)
+{
+    // Moller-Trumbore on four triangles at once
+    const XMVECTOR* d = ray.Direction;
+    const XMVECTOR* e1 = packet.Edge1;
+    const XMVECTOR* e2 = packet.Edge2;
+
+    XMVECTOR p[3] = {
+        XMVectorSubtract(XMVectorMultiply(d[1], e2[2]), XMVectorMultiply(d[2], e2[1])),
+        XMVectorSubtract(XMVectorMultiply(d[2], e2[0]), XMVectorMultiply(d[0], e2[2])),
+        XMVectorSubtract(XMVectorMultiply(d[0], e2[1]), XMVectorMultiply(d[1], e2[0])),
+    };
+    XMVECTOR det = XMVectorMultiplyAdd(e1[0], p[0], XMVectorMultiplyAdd(e1[1], p[1], XMVectorMultiply(e1[2], p[2])));
+    XMVECTOR inverseDet = XMVectorReciprocal(det);
+
+    XMVECTOR s[3] = {
+        XMVectorSubtract(ray.Origin[0], packet.V0[0]),
+        XMVectorSubtract(ray.Origin[1], packet.V0[1]),
+        XMVectorSubtract(ray.Origin[2], packet.V0[2]),
+    };
+    XMVECTOR u = XMVectorMultiply(XMVectorMultiplyAdd(s[0], p[0], XMVectorMultiplyAdd(s[1], p[1], XMVectorMultiply(s[2], p[2]))), inverseDet);
+
+    XMVECTOR q[3] = {
+        XMVectorSubtract(XMVectorMultiply(s[1], e1[2]), XMVectorMultiply(s[2], e1[1])),
+        XMVectorSubtract(XMVectorMultiply(s[2], e1[0]), XMVectorMultiply(s[0], e1[2])),
+        XMVectorSubtract(XMVectorMultiply(s[0], e1[1]), XMVectorMultiply(s[1], e1[0])),
+    };
+    XMVECTOR v = XMVectorMultiply(XMVectorMultiplyAdd(d[0], q[0], XMVectorMultiplyAdd(d[1], q[1], XMVectorMultiply(d[2], q[2]))), inverseDet);
+    XMVECTOR t = XMVectorMultiply(XMVectorMultiplyAdd(e2[0], q[0], XMVectorMultiplyAdd(e2[1], q[1], XMVectorMultiply(e2[2], q[2]))), inverseDet);
+
+    XMVECTOR zero = XMVectorZero();
+    XMVECTOR hit = XMVectorGreater(XMVectorAbs(det), XMVectorReplicate(RayEpsilon));
+    hit = XMVectorAndInt(hit, XMVectorGreaterOrEqual(u, zero));
+    hit = XMVectorAndInt(hit, XMVectorGreaterOrEqual(v, zero));
+    hit = XMVectorAndInt(hit, XMVectorLessOrEqual(XMVectorAdd(u, v), XMVectorSplatOne()));
+    hit = XMVectorAndInt(hit, XMVectorGreaterOrEqual(t, zero));
+    hit = XMVectorAndInt(hit, XMVectorLess(t, XMVectorReplicate(distance)));
+
+    uint32_t hitMask = 0;
+    XMVectorEqualIntR(&hitMask, hit, XMVectorTrueInt());
+    if (XMComparisonAllFalse(hitMask))
+        return MaxLeafTriangles;
+
+    XMFLOAT4 distances;
+    XMStoreFloat4(&distances, XMVectorSelect(XMVectorReplicate(INFINITY), t, hit));
+
+    uint32_t nearestLane = MaxLeafTriangles;
+    for (uint32_t lane = 0; lane < MaxLeafTriangles; lane++)
+    {
+        float laneDistance = (&distances.x)[lane];
+        if (laneDistance < distance)
+        {
+            distance = laneDistance;
+            nearestLane = lane;
+        }
+    }
+    return nearestLane;
+}
+
+bool MeshBVH::Intersects(FXMVECTOR origin, FXMVECTOR direction, float& distance, uint32_t* triangleIndex) const
+{
+    if (nodes.empty())
+        return false;
+
+    RayPacket ray{};
+    ray.Origin[0] = XMVectorSplatX(origin);
+    ray.Origin[1] = XMVectorSplatY(origin);
+    ray.Origin[2] = XMVectorSplatZ(origin);
+    ray.Direction[0] = XMVectorSplatX(direction);
+    ray.Direction[1] = XMVectorSplatY(direction);
+    ray.Direction[2] = XMVectorSplatZ(direction);
+
+    // Axis aligned directions divide to infinity, which the slab test handles
+    XMVECTOR inverseDirection = XMVectorReciprocal(direction);
+
+    float nearestDistance = distance;
+    uint32_t nearestTriangle = UINT32_MAX;
+
+    float entryDistance = 0.0f;
+    if (!IntersectNode(nodes[0], origin, inverseDirection, nearestDistance, entryDistance))
+        return false;
+
+    // Fixed size stack so picking doesn't allocate. Nodes are pushed with their entry distance so ones behind a closer hit are skipped
+    uint32_t stack[MaxTraversalDepth];
+    float stackDistances[MaxTraversalDepth];
+    uint32_t stackSize = 0;
+    uint32_t current = 0;
+
+    while (true)
+    {
+        const Node& node = nodes[current];
+        if (node.TriangleCount > 0)
+        {
+            const TrianglePacket& packet = packets[node.FirstChildOrPacket];
+            uint32_t lane = IntersectPacket(packet, ray, nearestDistance);
+            if (lane < MaxLeafTriangles)
+                nearestTriangle = packet.Triangles[lane];
+        }
+        else
+        {
+            uint32_t leftChild = node.FirstChildOrPacket;
+            uint32_t rightChild = leftChild + 1;
+            float leftDistance = 0.0f;
+            float rightDistance = 0.0f;
+            bool hitLeft = IntersectNode(nodes[leftChild], origin, inverseDirection, nearestDistance, leftDistance);
+            bool hitRight = IntersectNode(nodes[rightChild], origin, inverseDirection, nearestDistance, rightDistance);
+
+            if (hitLeft && hitRight)
+            {
+                // Visit the nearer child first, it's the most likely to shorten the ray
+                if (rightDistance < leftDistance)
+                {
+                    std::swap(leftChild, rightChild);
+                    std::swap(leftDistance, rightDistance);
+                }
+                stack[stackSize] = rightChild;
+                stackDistances[stackSize] = rightDistance;
+                stackSize++;
+                current = leftChild;
+                continue;
+            }
+            if (hitLeft || hitRight)
+            {
+                current = hitLeft ? leftChild : rightChild;
+                continue;
+            }
+        }
+
+        // Pop the next node that could still contain a closer hit
+        bool found = false;
+        while (stackSize > 0)
+        {
+            stackSize--;
+            if (stackDistances[stackSize] < nearestDistance)
+            {
+                current = stack[stackSize];
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            break;
+    }
+
+    if (nearestTriangle == UINT32_MAX)
+        return false;
+
+    distance = nearestDistance;
+    if (triangleIndex != nullptr)
+        *triangleIndex = nearestTriangle;
+    return true;
+}
+
+uint32_t MeshBVH::GetTriangleCount() const
+{
+    return triangleCount;
+}
+
+uint32_t MeshBVH::GetNodeCount() const
+{
+    return (uint32_t)nodes.size();
+}
+
+BoundingBox MeshBVH::GetBounds() const
+{
+    BoundingBox bounds;
+    if (nodes.empty())
+        return bounds;
+
+    BoundingBox::CreateFromPoints(bounds, XMLoadFloat3(&nodes[0].BoundsMin), XMLoadFloat3(&nodes[0].BoundsMax));
+    return bounds;
+}
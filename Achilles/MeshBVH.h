@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+// Bounding volume hierarchy over a mesh's triangles, in the mesh's local space. Used for ray picking
+class MeshBVH
+{
+public:
+    // Triangles are intersected four at a time, so a leaf holds at most one packet
+    static constexpr uint32_t MaxLeafTriangles = 4;
+    // Bins used when evaluating split planes
+    static constexpr uint32_t SplitBinCount = 12;
+    // Deep enough for any tree built from 32-bit triangle indices
+    static constexpr uint32_t MaxTraversalDepth = 64;
+
+    // Compares every BVH pick against the brute force path and logs mismatches. Debug builds only
+    inline static bool ValidatePicking = false;
+
+    // Positions are read from the start of each vertex. indexStride is 2 or 4
+    MeshBVH(const uint8_t* vertices, size_t vertexCount, size_t vertexStride, const void* indices, size_t indexCount, size_t indexStride);
+
+    // Nearest hit along the ray that is closer than distance. On a hit, distance is set to it
+    // The direction doesn't have to be normalised, distances are in multiples of its length. Doesn't allocate
+    bool Intersects(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, float& distance, uint32_t* triangleIndex = nullptr) const;
+
+    uint32_t GetTriangleCount() const;
+    uint32_t GetNodeCount() const;
+    DirectX::BoundingBox GetBounds() const;
+
+protected:
+    struct Node
+    {
+        DirectX::XMFLOAT3 BoundsMin;
+        // Left child for inner nodes, the right child follows it. Packet index for leaves
+        uint32_t FirstChildOrPacket;
+        DirectX::XMFLOAT3 BoundsMax;
+        // 0 for inner nodes
+        uint32_t TriangleCount;
+    };
+
+    // Four triangles with each component in its own vector, so one lane is one triangle
+    struct TrianglePacket
+    {
+        DirectX::XMVECTOR V0[3];
+        DirectX::XMVECTOR Edge1[3];
+        DirectX::XMVECTOR Edge2[3];
+        uint32_t Triangles[MaxLeafTriangles];
+    };
+
+    // The ray with each component splatted across a vector
+    struct RayPacket
+    {
+        DirectX::XMVECTOR Origin[3];
+        DirectX::XMVECTOR Direction[3];
+    };
+
+    struct BuildTriangle
+    {
+        DirectX::XMFLOAT3 Vertices[3];
+        DirectX::XMFLOAT3 BoundsMin;
+        DirectX::XMFLOAT3 BoundsMax;
+        DirectX::XMFLOAT3 Centroid;
+        uint32_t Index;
+    };
+
+    // Splits with binned SAH until depth reaches half of MaxTraversalDepth, then by median so the depth stays bounded
+    void BuildNode(uint32_t nodeIndex, std::vector<BuildTriangle>& triangles, size_t begin, size_t end, uint32_t depth);
+    void CreateLeaf(uint32_t nodeIndex, const std::vector<BuildTriangle>& triangles, size_t begin, size_t end);
+
+    // Distance to where the ray enters the node, if it does so before maxDistance
+    bool IntersectNode(const Node& node, DirectX::FXMVECTOR origin, DirectX::FXMVECTOR inverseDirection, float maxDistance, float& entryDistance) const;
+    // Nearest hit of the four triangles that is closer than distance. Returns the lane hit, or MaxLeafTriangles if none were
+    static uint32_t IntersectPacket(const TrianglePacket& packet, const RayPacket& ray, float& distance);
+
+    std::vector<Node> nodes;
+    std::vector<TrianglePacket> packets;
+    uint32_t triangleCount = 0;
+};
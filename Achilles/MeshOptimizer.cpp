@@ -0,0 +1,868 @@
+#include "MeshOptimizer.h"
+#include "Helpers.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cfloat>
+#include <numeric>
+#include <unordered_map>
+
+// Forsyth's scoring constants - https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+constexpr uint32_t ForsythCacheSize = 32;
+constexpr float ForsythCacheDecayPower = 1.5f;
+constexpr float ForsythLastTriScore = 0.75f;
+constexpr float ForsythValenceBoostScale = 2.0f;
+constexpr float ForsythValenceBoostPower = 0.5f;
+
+static float ForsythVertexScore(int32_t cachePosition, uint32_t remainingTriangles)
+{
+    // No triangles left to use this vertex
+    if (remainingTriangles == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0)
+    {
+        if (cachePosition < 3)
+        {
+            // Used by the last triangle, so a fixed score to avoid favouring any one of the three
+            score = ForsythLastTriScore;
+        }
+        else
+        {
+            const float scaler = 1.0f / (ForsythCacheSize - 3);
+            score = 1.0f - (cachePosition - 3) * scaler;
+            score = powf(score, ForsythCacheDecayPower);
+        }
+    }
+
+    // Boost vertices with few remaining triangles so lone triangles get cleared out rather than left until last
+    score += ForsythValenceBoostScale * powf((float)remainingTriangles, -ForsythValenceBoostPower);
+    return score;
+}
+
+MeshOptimizer::VertexCacheStatistics MeshOptimizer::AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize)
+{
+    VertexCacheStatistics statistics{};
+    statistics.TriangleCount = (uint32_t)(indices.size() / 3);
+    if (statistics.TriangleCount == 0 || vertexCount == 0)
+        return statistics;
+
+    // Timestamp based FIFO: a vertex is in the cache if it was pushed within the last cacheSize misses
+    std::vector<uint32_t> cacheTimestamps(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+    uint32_t timestamp = cacheSize + 1;
+
+    for (size_t i = 0; i < statistics.TriangleCount * 3; i++)
+    {
+        uint32_t index = indices[i];
+        if (index >= vertexCount)
+            continue;
+
+        if (!referenced[index])
+        {
+            referenced[index] = true;
+            statistics.UniqueVertices++;
+        }
+
+        if (timestamp - cacheTimestamps[index] > cacheSize)
+        {
+            cacheTimestamps[index] = timestamp++;
+            statistics.VerticesTransformed++;
+        }
+    }
+
+    statistics.ACMR = (float)statistics.VerticesTransformed / statistics.TriangleCount;
+    statistics.ATVR = statistics.UniqueVertices == 0 ? 0.0f : (float)statistics.VerticesTransformed / statistics.UniqueVertices;
+    return statistics;
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount)
+{
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || vertexCount == 0)
+        return;
+
+    // Build vertex to triangle adjacency
+    std::vector<uint32_t> activeTriangleCount(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+    {
+        if (indices[i] >= vertexCount)
+            return; // Malformed mesh, leave it as it is
+        activeTriangleCount[indices[i]]++;
+    }
+
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + activeTriangleCount[v];
+    }
+
+    std::vector<uint32_t> adjacency(adjacencyOffsets[vertexCount]);
+    {
+        std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (uint32_t t = 0; t < triangleCount; t++)
+        {
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                adjacency[fill[indices[t * 3 + k]]++] = t;
+            }
+        }
+    }
+
+    // Initial scores
+    std::vector<int32_t> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        vertexScores[v] = ForsythVertexScore(-1, activeTriangleCount[v]);
+    }
+
+    std::vector<bool> triangleAdded(triangleCount, false);
+
+    std::vector<uint32_t> outIndices;
+    outIndices.reserve(triangleCount * 3);
+
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> newCache;
+    cache.reserve(ForsythCacheSize + 3);
+    newCache.reserve(ForsythCacheSize + 3);
+
+    size_t inputCursor = 0; // Used to find the next triangle when the cache holds no usable triangles
+    int64_t bestTriangle = -1;
+
+    for (size_t added = 0; added < triangleCount; added++)
+    {
+        if (bestTriangle < 0)
+        {
+            while (inputCursor < triangleCount && triangleAdded[inputCursor])
+                inputCursor++;
+            if (inputCursor >= triangleCount)
+                break;
+            bestTriangle = (int64_t)inputCursor;
+        }
+
+        uint32_t triangle = (uint32_t)bestTriangle;
+        const uint32_t* triangleIndices = &indices[triangle * 3];
+        triangleAdded[triangle] = true;
+        outIndices.insert(outIndices.end(), triangleIndices, triangleIndices + 3);
+
+        // Remove the triangle from its vertices' active lists
+        for (uint32_t k = 0; k < 3; k++)
+        {
+            uint32_t vertex = triangleIndices[k];
+            uint32_t* begin = &adjacency[adjacencyOffsets[vertex]];
+            uint32_t* end = begin + activeTriangleCount[vertex];
+            uint32_t* found = std::find(begin, end, triangle);
+            if (found != end)
+            {
+                *found = *(end - 1);
+                activeTriangleCount[vertex]--;
+            }
+        }
+
+        // Push the triangle's vertices to the front of the LRU cache
+        newCache.clear();
+        newCache.insert(newCache.end(), triangleIndices, triangleIndices + 3);
+        for (uint32_t vertex : cache)
+        {
+            if (vertex != triangleIndices[0] && vertex != triangleIndices[1] && vertex != triangleIndices[2])
+                newCache.push_back(vertex);
+        }
+
+        for (size_t i = 0; i < newCache.size(); i++)
+        {
+            uint32_t vertex = newCache[i];
+            cachePositions[vertex] = i < ForsythCacheSize ? (int32_t)i : -1;
+            vertexScores[vertex] = ForsythVertexScore(cachePositions[vertex], activeTriangleCount[vertex]);
+        }
+
+        // Rescore the triangles touching the cache and choose the best for the next step
+        bestTriangle = -1;
+        float bestScore = -1.0f;
+        for (uint32_t vertex : newCache)
+        {
+            const uint32_t* begin = &adjacency[adjacencyOffsets[vertex]];
+            for (uint32_t a = 0; a < activeTriangleCount[vertex]; a++)
+            {
+                uint32_t t = begin[a];
+                float score = vertexScores[indices[t * 3 + 0]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    bestTriangle = t;
+                }
+            }
+        }
+
+        if (newCache.size() > ForsythCacheSize)
+            newCache.resize(ForsythCacheSize);
+        cache.swap(newCache);
+    }
+
+    // Degenerate indices past the last full triangle are kept at the end
+    for (size_t i = triangleCount * 3; i < indices.size(); i++)
+        outIndices.push_back(indices[i]);
+
+    indices.swap(outIndices);
+}
+
+void MeshOptimizer::OptimizeOverdraw(std::vector<uint32_t>& indices, const void* vertices, size_t vertexCount, size_t vertexStride, float threshold)
+{
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount <= 1 || vertexCount == 0 || vertices == nullptr)
+        return;
+
+    for (size_t i = 0; i < triangleCount * 3; i++)
+    {
+        if (indices[i] >= vertexCount)
+            return;
+    }
+
+    const char* vertexBytes = reinterpret_cast<const char*>(vertices);
+    auto position = [&](uint32_t index) -> const float*
+        {
+            return reinterpret_cast<const float*>(vertexBytes + index * vertexStride);
+        };
+
+    VertexCacheStatistics inputStatistics = AnalyzeVertexCache(indices, vertexCount);
+
+    // Split into clusters wherever the simulated cache would have to start over (all three vertices miss)
+    // Small clusters sort more freely but cost cache efficiency, so only split once the cluster has paid for its misses
+    std::vector<size_t> clusterStarts{ 0 };
+    {
+        std::vector<uint32_t> cacheTimestamps(vertexCount, 0);
+        uint32_t timestamp = DefaultCacheSize + 1;
+        uint32_t clusterMisses = 0;
+        size_t clusterStart = 0;
+
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            uint32_t misses = 0;
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                uint32_t index = indices[t * 3 + k];
+                if (timestamp - cacheTimestamps[index] > DefaultCacheSize)
+                {
+                    cacheTimestamps[index] = timestamp++;
+                    misses++;
+                }
+            }
+
+            size_t clusterTriangles = t - clusterStart;
+            if (t > clusterStart && misses == 3 && (float)clusterMisses / clusterTriangles <= inputStatistics.ACMR * threshold)
+            {
+                clusterStarts.push_back(t);
+                clusterStart = t;
+                clusterMisses = 0;
+            }
+            clusterMisses += misses;
+        }
+    }
+
+    if (clusterStarts.size() <= 1)
+        return;
+
+    // Mesh centroid, weighted by triangle area
+    float meshCentroid[3] = { 0, 0, 0 };
+    float meshArea = 0.0f;
+    std::vector<float> triangleData(triangleCount * 7); // Area-weighted normal (3), centroid (3), area (1)
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        const float* p0 = position(indices[t * 3 + 0]);
+        const float* p1 = position(indices[t * 3 + 1]);
+        const float* p2 = position(indices[t * 3 + 2]);
+
+        float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        float normal[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        float area = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+        float* data = &triangleData[t * 7];
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            data[c] = normal[c];
+            data[3 + c] = (p0[c] + p1[c] + p2[c]) / 3.0f;
+            meshCentroid[c] += data[3 + c] * area;
+        }
+        data[6] = area;
+        meshArea += area;
+    }
+
+    if (meshArea <= 0.0f)
+        return;
+
+    for (uint32_t c = 0; c < 3; c++)
+        meshCentroid[c] /= meshArea;
+
+    // Sort clusters by how much they face away from the centre of the mesh, those facing outwards are more likely to occlude the rest
+    struct Cluster
+    {
+        size_t start;
+        size_t end;
+        float sortKey;
+    };
+
+    std::vector<Cluster> clusters;
+    clusters.reserve(clusterStarts.size());
+    for (size_t c = 0; c < clusterStarts.size(); c++)
+    {
+        Cluster cluster{};
+        cluster.start = clusterStarts[c];
+        cluster.end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+
+        float normal[3] = { 0, 0, 0 };
+        float centroid[3] = { 0, 0, 0 };
+        float area = 0.0f;
+        for (size_t t = cluster.start; t < cluster.end; t++)
+        {
+            const float* data = &triangleData[t * 7];
+            for (uint32_t i = 0; i < 3; i++)
+            {
+                normal[i] += data[i];
+                centroid[i] += data[3 + i] * data[6];
+            }
+            area += data[6];
+        }
+
+        float normalLength = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (area > 0.0f && normalLength > 0.0f)
+        {
+            cluster.sortKey = 0.0f;
+            for (uint32_t i = 0; i < 3; i++)
+                cluster.sortKey += (centroid[i] / area - meshCentroid[i]) * (normal[i] / normalLength);
+        }
+        else
+        {
+            cluster.sortKey = -INFINITY;
+        }
+        clusters.push_back(cluster);
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+    std::vector<uint32_t> outIndices;
+    outIndices.reserve(indices.size());
+    for (const Cluster& cluster : clusters)
+    {
+        outIndices.insert(outIndices.end(), indices.begin() + cluster.start * 3, indices.begin() + cluster.end * 3);
+    }
+    outIndices.insert(outIndices.end(), indices.begin() + triangleCount * 3, indices.end());
+
+    // Reject the reorder if it hurt the vertex cache more than we allow
+    VertexCacheStatistics outputStatistics = AnalyzeVertexCache(outIndices, vertexCount);
+    if (outputStatistics.ACMR <= inputStatistics.ACMR * threshold)
+        indices.swap(outIndices);
+}
+
+size_t MeshOptimizer::OptimizeVertexFetch(void* vertices, size_t vertexCount, size_t vertexStride, std::vector<uint32_t>& indices)
+{
+    if (vertices == nullptr || vertexCount == 0 || vertexStride == 0)
+        return vertexCount;
+
+    constexpr uint32_t Unassigned = ~0u;
+    std::vector<uint32_t> remap(vertexCount, Unassigned);
+    uint32_t nextVertex = 0;
+    for (uint32_t index : indices)
+    {
+        if (index >= vertexCount)
+            return vertexCount; // Malformed mesh, leave it as it is
+
+        if (remap[index] == Unassigned)
+            remap[index] = nextVertex++;
+    }
+
+    // Apply the remap now that we know every index is valid
+    for (uint32_t& index : indices)
+        index = remap[index];
+
+    char* vertexBytes = reinterpret_cast<char*>(vertices);
+    std::vector<char> reordered((size_t)nextVertex * vertexStride);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        if (remap[v] != Unassigned)
+            memcpy(reordered.data() + remap[v] * vertexStride, vertexBytes + v * vertexStride, vertexStride);
+    }
+    memcpy(vertexBytes, reordered.data(), reordered.size());
+
+    return nextVertex;
+}
+
+size_t MeshOptimizer::OptimizeMesh(void* vertices, size_t vertexCount, size_t vertexStride, std::vector<uint32_t>& indices)
+{
+#if defined(_DEBUG) || defined(_UNOPTIMIZED)
+    VertexCacheStatistics before = AnalyzeVertexCache(indices, vertexCount);
+#endif
+
+    OptimizeVertexCache(indices, vertexCount);
+    OptimizeOverdraw(indices, vertices, vertexCount, vertexStride);
+    size_t newVertexCount = OptimizeVertexFetch(vertices, vertexCount, vertexStride, indices);
+
+#if defined(_DEBUG) || defined(_UNOPTIMIZED)
+    VertexCacheStatistics after = AnalyzeVertexCache(indices, newVertexCount);
+    OutputDebugStringWFormatted(L"Mesh optimized (%u tris): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", before.TriangleCount, before.ACMR, after.ACMR, before.ATVR, after.ATVR);
+#endif
+
+    return newVertexCount;
+}
+
+// Local to this file, so they can't clash with other translation units' types of the same name
+namespace
+{
+// Symmetric 4x4 matrix accumulating weighted squared distances to planes
+struct Quadric
+{
+    double a2 = 0, ab = 0, ac = 0, ad = 0;
+    double b2 = 0, bc = 0, bd = 0;
+    double c2 = 0, cd = 0;
+    double d2 = 0;
+    double weight = 0;
+
+    void AddPlane(double a, double b, double c, double d, double weight)
+    {
+        a2 += a * a * weight; ab += a * b * weight; ac += a * c * weight; ad += a * d * weight;
+        b2 += b * b * weight; bc += b * c * weight; bd += b * d * weight;
+        c2 += c * c * weight; cd += c * d * weight;
+        d2 += d * d * weight;
+        this->weight += weight;
+    }
+
+    void Add(const Quadric& other)
+    {
+        a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+        b2 += other.b2; bc += other.bc; bd += other.bd;
+        c2 += other.c2; cd += other.cd;
+        d2 += other.d2;
+        weight += other.weight;
+    }
+
+    // Weighted mean squared distance, so the result is in squared position units regardless of triangle area
+    double Error(const float* p) const
+    {
+        double x = p[0], y = p[1], z = p[2];
+        double error = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+            + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+            + c2 * z * z + 2 * cd * z
+            + d2;
+        return (error <= 0 || weight <= 0) ? 0 : error / weight;
+    }
+};
+
+struct PositionKey
+{
+    uint32_t x, y, z;
+    bool operator==(const PositionKey& other) const { return x == other.x && y == other.y && z == other.z; }
+};
+
+struct PositionKeyHash
+{
+    size_t operator()(const PositionKey& key) const
+    {
+        size_t seed = 0;
+        std::hash_combine(seed, key.x);
+        std::hash_combine(seed, key.y);
+        std::hash_combine(seed, key.z);
+        return seed;
+    }
+};
+}
+
+// Border edges are weighted heavily so the outline of open meshes stays put
+constexpr double SimplifyBorderWeight = 10.0;
+// Meshes are not simplified below this many triangles
+constexpr size_t LODMinimumTriangles = 16;
+// Upper bound on error for any generated level, relative to the mesh extents
+constexpr float LODMaximumError = 0.25f;
+
+static void Cross(const float* a, const float* b, float* out)
+{
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static float Dot(const float* a, const float* b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void TriangleNormal(const float* p0, const float* p1, const float* p2, float* out)
+{
+    float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    Cross(e1, e2, out);
+}
+
+std::vector<uint32_t> MeshOptimizer::SimplifyMesh(const std::vector<uint32_t>& indices, const void* vertices, size_t vertexCount, size_t vertexStride, size_t targetIndexCount, float targetError, float* resultError)
+{
+    std::vector<uint32_t> result(indices.begin(), indices.begin() + (indices.size() / 3) * 3);
+    if (resultError != nullptr)
+        *resultError = 0.0f;
+
+    if (result.size() <= targetIndexCount || vertices == nullptr || vertexCount == 0)
+        return result;
+
+    for (uint32_t index : result)
+    {
+        if (index >= vertexCount)
+            return result;
+    }
+
+    const char* vertexBytes = reinterpret_cast<const char*>(vertices);
+    auto position = [&](size_t index) -> const float*
+        {
+            return reinterpret_cast<const float*>(vertexBytes + index * vertexStride);
+        };
+
+    // Weld vertices sharing a position so attribute seams don't split the topology. Positions are normalised to the mesh extents
+    std::vector<uint32_t> weld(vertexCount);
+    std::vector<float> positions;
+    {
+        float minimum[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+        float maximum[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            const float* p = position(v);
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                minimum[c] = std::min(minimum[c], p[c]);
+                maximum[c] = std::max(maximum[c], p[c]);
+            }
+        }
+
+        float extent = std::max({ maximum[0] - minimum[0], maximum[1] - minimum[1], maximum[2] - minimum[2] });
+        if (!(extent > 0.0f))
+            return result;
+        float scale = 1.0f / extent;
+
+        std::unordered_map<PositionKey, uint32_t, PositionKeyHash> positionMap;
+        positionMap.reserve(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            const float* p = position(v);
+            PositionKey key{};
+            memcpy(&key, p, sizeof(key));
+
+            auto [iter, inserted] = positionMap.try_emplace(key, (uint32_t)(positions.size() / 3));
+            if (inserted)
+            {
+                for (uint32_t c = 0; c < 3; c++)
+                    positions.push_back((p[c] - minimum[c]) * scale);
+            }
+            weld[v] = iter->second;
+        }
+    }
+    const size_t weldedCount = positions.size() / 3;
+    auto weldedPosition = [&](uint32_t welded) -> const float*
+        {
+            return &positions[welded * 3];
+        };
+
+    // Plane quadrics from each triangle, weighted by area
+    std::vector<Quadric> quadrics(weldedCount);
+    std::unordered_map<uint64_t, uint32_t> edgeUseCount;
+    edgeUseCount.reserve(result.size());
+    auto edgeKey = [](uint32_t a, uint32_t b) -> uint64_t
+        {
+            return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+        };
+
+    for (size_t t = 0; t < result.size(); t += 3)
+    {
+        uint32_t w[3] = { weld[result[t + 0]], weld[result[t + 1]], weld[result[t + 2]] };
+        if (w[0] == w[1] || w[1] == w[2] || w[0] == w[2])
+            continue;
+
+        float normal[3];
+        TriangleNormal(weldedPosition(w[0]), weldedPosition(w[1]), weldedPosition(w[2]), normal);
+        float length = sqrtf(Dot(normal, normal));
+        if (length <= 0.0f)
+            continue;
+        for (uint32_t c = 0; c < 3; c++)
+            normal[c] /= length;
+
+        float d = -Dot(normal, weldedPosition(w[0]));
+        for (uint32_t k = 0; k < 3; k++)
+        {
+            quadrics[w[k]].AddPlane(normal[0], normal[1], normal[2], d, length * 0.5);
+            edgeUseCount[edgeKey(w[k], w[(k + 1) % 3])]++;
+        }
+    }
+
+    // Border edges get a plane perpendicular to their triangle
+    for (size_t t = 0; t < result.size(); t += 3)
+    {
+        uint32_t w[3] = { weld[result[t + 0]], weld[result[t + 1]], weld[result[t + 2]] };
+        if (w[0] == w[1] || w[1] == w[2] || w[0] == w[2])
+            continue;
+
+        float normal[3];
+        TriangleNormal(weldedPosition(w[0]), weldedPosition(w[1]), weldedPosition(w[2]), normal);
+
+        for (uint32_t k = 0; k < 3; k++)
+        {
+            uint32_t a = w[k];
+            uint32_t b = w[(k + 1) % 3];
+            if (edgeUseCount[edgeKey(a, b)] != 1)
+                continue;
+
+            const float* pa = weldedPosition(a);
+            const float* pb = weldedPosition(b);
+            float edge[3] = { pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2] };
+            float plane[3];
+            Cross(edge, normal, plane);
+            float length = sqrtf(Dot(plane, plane));
+            if (length <= 0.0f)
+                continue;
+            for (uint32_t c = 0; c < 3; c++)
+                plane[c] /= length;
+
+            double weight = SimplifyBorderWeight * Dot(edge, edge);
+            float d = -Dot(plane, pa);
+            quadrics[a].AddPlane(plane[0], plane[1], plane[2], d, weight);
+            quadrics[b].AddPlane(plane[0], plane[1], plane[2], d, weight);
+        }
+    }
+
+    struct Collapse
+    {
+        uint32_t from;
+        uint32_t to;
+        double cost;
+    };
+
+    const double maxCost = (double)targetError * targetError;
+    double resultCost = 0.0;
+
+    std::vector<uint32_t> adjacencyOffsets(weldedCount + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<uint64_t> edges;
+    std::vector<Collapse> collapses;
+    std::vector<bool> locked(weldedCount);
+    std::vector<uint32_t> vertexRemap(vertexCount);
+    std::vector<std::pair<uint32_t, uint32_t>> pendingRemap;
+
+    // Each pass collapses the cheapest edges that don't touch each other, then rebuilds the triangle list
+    while (result.size() > targetIndexCount)
+    {
+        const size_t triangleCount = result.size() / 3;
+
+        // Welded vertex to triangle adjacency
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (uint32_t index : result)
+            adjacencyOffsets[weld[index] + 1]++;
+        for (size_t w = 0; w < weldedCount; w++)
+            adjacencyOffsets[w + 1] += adjacencyOffsets[w];
+
+        adjacency.resize(result.size());
+        {
+            std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (uint32_t t = 0; t < triangleCount; t++)
+            {
+                for (uint32_t k = 0; k < 3; k++)
+                    adjacency[fill[weld[result[t * 3 + k]]]++] = t;
+            }
+        }
+
+        // Gather unique edges and pick the cheaper direction of each
+        edges.clear();
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                uint32_t a = weld[result[i + k]];
+                uint32_t b = weld[result[i + (k + 1) % 3]];
+                if (a != b)
+                    edges.push_back(edgeKey(a, b));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+        collapses.clear();
+        for (uint64_t edge : edges)
+        {
+            uint32_t a = (uint32_t)(edge >> 32);
+            uint32_t b = (uint32_t)(edge & 0xFFFFFFFF);
+
+            Quadric quadric = quadrics[a];
+            quadric.Add(quadrics[b]);
+            double costAToB = quadric.Error(weldedPosition(b));
+            double costBToA = quadric.Error(weldedPosition(a));
+
+            if (costAToB <= costBToA)
+                collapses.push_back({ a, b, costAToB });
+            else
+                collapses.push_back({ b, a, costBToA });
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+        std::fill(locked.begin(), locked.end(), false);
+        std::iota(vertexRemap.begin(), vertexRemap.end(), 0);
+        size_t trianglesLeft = triangleCount;
+        size_t collapsed = 0;
+
+        for (const Collapse& collapse : collapses)
+        {
+            if (collapse.cost > maxCost || trianglesLeft * 3 <= targetIndexCount)
+                break;
+            if (locked[collapse.from] || locked[collapse.to])
+                continue;
+
+            const uint32_t* fromTriangles = &adjacency[adjacencyOffsets[collapse.from]];
+            const uint32_t fromTriangleCount = adjacencyOffsets[collapse.from + 1] - adjacencyOffsets[collapse.from];
+
+            auto triangleHasWelded = [&](uint32_t t, uint32_t welded)
+                {
+                    return weld[result[t * 3 + 0]] == welded || weld[result[t * 3 + 1]] == welded || weld[result[t * 3 + 2]] == welded;
+                };
+
+            // Reject collapses that would flip a remaining triangle
+            bool flips = false;
+            uint32_t removedTriangles = 0;
+            for (uint32_t a = 0; a < fromTriangleCount && !flips; a++)
+            {
+                uint32_t t = fromTriangles[a];
+                if (triangleHasWelded(t, collapse.to))
+                {
+                    removedTriangles++;
+                    continue;
+                }
+
+                const float* before[3];
+                const float* after[3];
+                for (uint32_t k = 0; k < 3; k++)
+                {
+                    uint32_t w = weld[result[t * 3 + k]];
+                    before[k] = weldedPosition(w);
+                    after[k] = w == collapse.from ? weldedPosition(collapse.to) : before[k];
+                }
+
+                float normalBefore[3], normalAfter[3];
+                TriangleNormal(before[0], before[1], before[2], normalBefore);
+                TriangleNormal(after[0], after[1], after[2], normalAfter);
+                flips = Dot(normalBefore, normalAfter) <= 0.0f;
+            }
+            if (flips)
+                continue;
+
+            // Every copy of the from vertex must be able to move to a copy of the to vertex it shares a triangle with, otherwise the collapse would tear a seam
+            pendingRemap.clear();
+            bool seamTear = false;
+            for (uint32_t a = 0; a < fromTriangleCount && !seamTear; a++)
+            {
+                uint32_t t = fromTriangles[a];
+                for (uint32_t k = 0; k < 3 && !seamTear; k++)
+                {
+                    uint32_t v = result[t * 3 + k];
+                    if (weld[v] != collapse.from)
+                        continue;
+                    if (std::find_if(pendingRemap.begin(), pendingRemap.end(), [v](const auto& pair) { return pair.first == v; }) != pendingRemap.end())
+                        continue;
+
+                    uint32_t replacement = ~0u;
+                    for (uint32_t b = 0; b < fromTriangleCount && replacement == ~0u; b++)
+                    {
+                        uint32_t s = fromTriangles[b];
+                        const uint32_t* triangle = &result[s * 3];
+                        if (triangle[0] != v && triangle[1] != v && triangle[2] != v)
+                            continue;
+                        for (uint32_t j = 0; j < 3; j++)
+                        {
+                            if (weld[triangle[j]] == collapse.to)
+                            {
+                                replacement = triangle[j];
+                                break;
+                            }
+                        }
+                    }
+
+                    if (replacement == ~0u)
+                        seamTear = true;
+                    else
+                        pendingRemap.push_back({ v, replacement });
+                }
+            }
+            if (seamTear)
+                continue;
+
+            for (const auto& [from, to] : pendingRemap)
+                vertexRemap[from] = to;
+
+            // Lock the neighbourhood as its triangles are stale until the next pass
+            for (uint32_t a = 0; a < fromTriangleCount; a++)
+            {
+                uint32_t t = fromTriangles[a];
+                for (uint32_t k = 0; k < 3; k++)
+                    locked[weld[result[t * 3 + k]]] = true;
+            }
+            locked[collapse.to] = true;
+
+            quadrics[collapse.to].Add(quadrics[collapse.from]);
+            resultCost = std::max(resultCost, collapse.cost);
+            trianglesLeft -= std::min<size_t>(removedTriangles, trianglesLeft);
+            collapsed++;
+        }
+
+        if (collapsed == 0)
+            break;
+
+        // Apply the remap and drop triangles that collapsed into a line
+        size_t write = 0;
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            uint32_t i0 = vertexRemap[result[i + 0]];
+            uint32_t i1 = vertexRemap[result[i + 1]];
+            uint32_t i2 = vertexRemap[result[i + 2]];
+            if (weld[i0] == weld[i1] || weld[i1] == weld[i2] || weld[i0] == weld[i2])
+                continue;
+
+            result[write++] = i0;
+            result[write++] = i1;
+            result[write++] = i2;
+        }
+        result.resize(write);
+    }
+
+    if (resultError != nullptr)
+        *resultError = (float)sqrt(resultCost);
+
+    return result;
+}
+
+std::vector<MeshOptimizer::LODLevel> MeshOptimizer::GenerateLODChain(const std::vector<uint32_t>& indices, const void* vertices, size_t vertexCount, size_t vertexStride, uint32_t maxLevels, float screenError)
+{
+    std::vector<LODLevel> levels;
+    levels.reserve(maxLevels); // Each level simplifies the last, so the vector must not reallocate
+
+    const std::vector<uint32_t>* source = &indices;
+    float sourceError = 0.0f;
+    float sourceScreenSize = 1.0f;
+
+    for (uint32_t level = 0; level < maxLevels; level++)
+    {
+        size_t targetIndexCount = (source->size() / 6) * 3;
+        if (targetIndexCount < LODMinimumTriangles * 3)
+            break;
+
+        LODLevel lod{};
+        float error = 0.0f;
+        lod.Indices = SimplifyMesh(*source, vertices, vertexCount, vertexStride, targetIndexCount, LODMaximumError - sourceError, &error);
+
+        // Not worth another level unless at least a fifth of the triangles were removed
+        if (lod.Indices.empty() || lod.Indices.size() > source->size() * 4 / 5)
+            break;
+
+        // Errors compound as each level is simplified from the last
+        lod.Error = sourceError + error;
+        lod.ScreenSize = lod.Error > 0.0f ? std::min(sourceScreenSize, screenError / lod.Error) : sourceScreenSize;
+        OptimizeVertexCache(lod.Indices, vertexCount);
+
+        levels.push_back(std::move(lod));
+        source = &levels.back().Indices;
+        sourceError = levels.back().Error;
+        sourceScreenSize = levels.back().ScreenSize;
+    }
+
+    return levels;
+}
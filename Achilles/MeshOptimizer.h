@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// CPU-side index and vertex reordering applied to meshes when they are imported
+namespace MeshOptimizer
+{
+    // Size of the simulated post-transform cache used for statistics
+    constexpr uint32_t DefaultCacheSize = 16;
+    // Number of simplified levels generated below the full detail mesh
+    constexpr uint32_t DefaultLODCount = 4;
+    // Simplification error allowed on screen, as a fraction of the view height. 0.002 is about 2 pixels at 1080p
+    constexpr float DefaultLODScreenError = 0.002f;
+
+    struct VertexCacheStatistics
+    {
+        uint32_t VerticesTransformed = 0;
+        uint32_t UniqueVertices = 0;
+        uint32_t TriangleCount = 0;
+        float ACMR = 0.0f; // Average cache miss ratio, transformed vertices per triangle. 0.5 is ideal, 3.0 is worst
+        float ATVR = 0.0f; // Average transform to vertex ratio, transformed vertices per unique vertex. 1.0 is ideal
+    };
+
+    struct LODLevel
+    {
+        std::vector<uint32_t> Indices;
+        float Error = 0.0f; // Simplification error relative to the mesh extents
+        float ScreenSize = 0.0f; // This level is used once the projected size falls below this fraction of the view height
+    };
+
+    // Simulates a FIFO post-transform cache over a triangle list
+    VertexCacheStatistics AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = DefaultCacheSize);
+
+    // Reorders triangles for post-transform cache locality using Tom Forsyth's linear-speed algorithm
+    void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+
+    // Splits the triangle order into clusters and sorts outward-facing clusters first to reduce overdraw
+    // Positions are read as three floats at the start of each vertex. The new order is kept only if ACMR stays within threshold of the input
+    void OptimizeOverdraw(std::vector<uint32_t>& indices, const void* vertices, size_t vertexCount, size_t vertexStride, float threshold = 1.05f);
+
+    // Reorders vertices into first-use order and remaps indices. Unused vertices are dropped. Returns the new vertex count
+    size_t OptimizeVertexFetch(void* vertices, size_t vertexCount, size_t vertexStride, std::vector<uint32_t>& indices);
+
+    // Runs the vertex cache, overdraw and vertex fetch passes in order. Returns the new vertex count
+    size_t OptimizeMesh(void* vertices, size_t vertexCount, size_t vertexStride, std::vector<uint32_t>& indices);
+
+    // Collapses edges by quadric error until targetIndexCount is reached or the next collapse would exceed targetError (relative to the mesh extents)
+    // Vertices are never moved or created, and collapses that would tear attribute seams or flip triangles are skipped. The returned indices use the same vertices
+    std::vector<uint32_t> SimplifyMesh(const std::vector<uint32_t>& indices, const void* vertices, size_t vertexCount, size_t vertexStride, size_t targetIndexCount, float targetError, float* resultError = nullptr);
+
+    // Builds up to maxLevels index lists, each targeting half the triangles of the last. Stops early once simplification stalls
+    std::vector<LODLevel> GenerateLODChain(const std::vector<uint32_t>& indices, const void* vertices, size_t vertexCount, size_t vertexStride, uint32_t maxLevels = DefaultLODCount, float screenError = DefaultLODScreenError);
+}
@@ -3,13 +3,22 @@
 #include "Shader.h"
 #include "Application.h"
 #include "MathHelpers.h"
+#include "Camera.h"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <assimp/DefaultIOSystem.h>
+#include <assimp/IOStream.hpp>
 #include "CommandQueue.h"
+#include "ContentPack.h"
 #include "CommandList.h"
 #include "LightObject.h"
 #include "Scene.h"
+#include "Profiling.h"
+#include <algorithm>
+#include <atomic>
+#include <objbase.h>
+#include <thread>
 
 using namespace DirectX;
 using namespace DirectX::SimpleMath;
@@ -41,6 +50,9 @@ std::shared_ptr<Object> Object::Clone(std::shared_ptr<Object> newParent)
         clone->SetKnit(i, Knit(knits[i]));
     }
     clone->SetActive(IsActive());
+    clone->SetStatic(IsStatic());
+    clone->SetOccluder(IsOccluder());
+    clone->SetOccluderMesh(GetOccluderMesh());
 
     for (auto child : GetChildren())
     {
@@ -149,6 +161,64 @@ void Object::SetMaterial(uint32_t index, Material _material)
     knits[index].material = _material;
 }
 
+//// Level of detail functions ////
+
+float Object::GetProjectedScreenSize(std::shared_ptr<Camera> camera)
+{
+    if (camera == nullptr)
+        return INFINITY;
+
+    return GetProjectedScreenSize(camera->GetProj(), camera->GetPosition(), camera->IsOrthographic());
+}
+
+float Object::GetProjectedScreenSize(const Matrix& projection, Vector3 viewPosition, bool orthographic)
+{
+    BoundingSphere sphere;
+    BoundingSphere::CreateFromBoundingBox(sphere, GetWorldBoundingBox());
+
+    // _22 is the vertical projection scale, which works out the same for perspective (over distance) and orthographic
+    if (orthographic)
+        return sphere.Radius * projection._22;
+
+    float distance = Vector3::Distance(viewPosition, sphere.Center);
+    if (distance <= sphere.Radius)
+        return INFINITY;
+
+    return sphere.Radius * projection._22 / distance;
+}
+
+uint32_t Object::GetLODLevel(uint32_t index, std::shared_ptr<Camera> camera)
+{
+    std::shared_ptr<Mesh> mesh = GetMesh(index);
+    if (mesh == nullptr || camera == nullptr || mesh->GetLODCount() <= 1)
+        return 0;
+
+    auto iter = cameraLODLevels.find(camera.get());
+    if (iter == cameraLODLevels.end() || iter->second.Camera.lock() != camera)
+    {
+        // Cameras that are gone, one of which may have had this camera's address
+        std::erase_if(cameraLODLevels, [](const auto& entry) { return entry.second.Camera.expired(); });
+
+        iter = cameraLODLevels.insert_or_assign(camera.get(), CameraLODLevels{ camera }).first;
+    }
+
+    std::vector<uint32_t>& levels = iter->second.Levels;
+    if (levels.size() <= index)
+        levels.resize(knits.size(), 0);
+
+    levels[index] = mesh->SelectLOD(GetProjectedScreenSize(camera), levels[index], LODHysteresis);
+    return levels[index];
+}
+
+std::shared_ptr<Mesh> Object::GetLODMesh(uint32_t index, std::shared_ptr<Camera> camera, uint32_t lodBias)
+{
+    std::shared_ptr<Mesh> mesh = GetMesh(index);
+    if (mesh == nullptr || !UseLODs || mesh->GetLODCount() <= 1)
+        return mesh;
+
+    return mesh->GetLOD(GetLODLevel(index, camera) + lodBias);
+}
+
 //// Empty / Active functions ////
 
 bool Object::IsEmpty()
@@ -189,6 +259,32 @@ void Object::SetReceiveShadows(bool _receiveShadows)
 {
     receiveShadows = _receiveShadows;
 }
+bool Object::IsStatic()
+{
+    return isStatic;
+}
+void Object::SetStatic(bool _isStatic)
+{
+    isStatic = _isStatic;
+}
+
+//// Occlusion States ////
+bool Object::IsOccluder()
+{
+    return isOccluder;
+}
+void Object::SetOccluder(bool _isOccluder)
+{
+    isOccluder = _isOccluder;
+}
+std::shared_ptr<Mesh> Object::GetOccluderMesh()
+{
+    return occluderMesh;
+}
+void Object::SetOccluderMesh(std::shared_ptr<Mesh> _occluderMesh)
+{
+    occluderMesh = _occluderMesh;
+}
 
 //// Get/set this object's children ////
 
@@ -634,11 +730,13 @@ void Object::SetBoundingBox(DirectX::BoundingOrientedBox box)
 {
     boundingBox = box;
     dirtyBoundingBox = false;
+    boundsVersion++;
 }
 
 void Object::SetBoundingBoxDirty()
 {
     dirtyBoundingBox = true;
+    boundsVersion++;
 }
 
 bool Object::ShouldDraw(DirectX::BoundingFrustum frustum)
@@ -646,6 +744,11 @@ bool Object::ShouldDraw(DirectX::BoundingFrustum frustum)
     return frustum.Contains(GetWorldBoundingBox()) != DirectX::ContainmentType::DISJOINT;
 }
 
+uint64_t Object::GetBoundsVersion()
+{
+    return boundsVersion;
+}
+
 void Object::ConstructMatrix()
 {
     // SRT
@@ -668,6 +771,7 @@ void Object::ConstructWorldMatrix()
 void Object::SetWorldMatrixDirty()
 {
     dirtyWorldMatrix = true;
+    boundsVersion++;
 
     for (std::shared_ptr<Object> child : children)
     {
@@ -826,23 +930,131 @@ std::shared_ptr<LightObject> Object::CreateLightObjectFromSceneNode(aiScene* sce
     return lightObject;
 }
 
-std::shared_ptr<Object> Object::CreateObjectsFromSceneNode(aiScene* scene, aiNode* node, std::shared_ptr<Object> parent, std::shared_ptr<Shader> shader, std::wstring filePath)
+static aiLight* FindSceneNodeLight(aiScene* scene, aiNode* node)
 {
-    std::shared_ptr<Object> thisObject;
-
-    // Check if this node is a light
     for (uint32_t i = 0; i < scene->mNumLights; i++)
     {
         if (scene->mLights[i]->mName == node->mName)
+            return scene->mLights[i];
+    }
+    return nullptr;
+}
+
+Object::ImportedMeshes Object::ConvertSceneMeshes(aiScene* scene, std::shared_ptr<Shader> shader, std::wstring filePath)
+{
+    ScopedTimer _prof(L"Convert Scene Meshes");
+
+    struct MeshJob
+    {
+        aiNode* Node;
+        aiMesh* InMesh;
+        ImportedMesh* Result;
+    };
+
+    // Gather every mesh up front so the workers only share a job index. Light nodes don't get meshes, as in CreateObjectsFromSceneNode
+    ImportedMeshes importedMeshes;
+    std::vector<MeshJob> jobs;
+    std::vector<aiNode*> nodes{ scene->mRootNode };
+    while (!nodes.empty())
+    {
+        aiNode* node = nodes.back();
+        nodes.pop_back();
+        for (uint32_t i = 0; i < node->mNumChildren; i++)
+            nodes.push_back(node->mChildren[i]);
+
+        if (node->mNumMeshes == 0 || FindSceneNodeLight(scene, node) != nullptr)
+            continue;
+
+        std::vector<ImportedMesh>& nodeMeshes = importedMeshes[node];
+        nodeMeshes.resize(node->mNumMeshes);
+        for (uint32_t i = 0; i < node->mNumMeshes; i++)
+            jobs.push_back(MeshJob{ node, scene->mMeshes[node->mMeshes[i]], &nodeMeshes[i] });
+    }
+
+    if (jobs.empty())
+        return importedMeshes;
+
+    uint32_t workerCount = ImportWorkerCount;
+    if (workerCount == 0)
+        workerCount = std::max(std::thread::hardware_concurrency(), 1u);
+    workerCount = std::min(workerCount, (uint32_t)jobs.size());
+
+    // Workers record on their own lists from the calling thread's creation queue
+    GetCreationCommandList();
+    std::shared_ptr<CommandQueue> creationQueue = currentCreationCommandQueue;
+    std::vector<std::shared_ptr<CommandList>> workerCommandLists(workerCount);
+    std::vector<std::exception_ptr> workerErrors(workerCount);
+    std::atomic<size_t> nextJob = 0;
+    MeshCreation createFunc = shader->meshCreateCallback;
+
+    auto work = [&](uint32_t workerIndex)
         {
-            // This node is a light
-            thisObject = std::dynamic_pointer_cast<Object>(CreateLightObjectFromSceneNode(scene, node, scene->mLights[i], parent));
-            for (uint32_t i = 0; i < node->mNumChildren; i++)
+            std::shared_ptr<CommandQueue> previousQueue = currentCreationCommandQueue;
+            std::shared_ptr<CommandList> previousCommandList = currentCreationCommandList;
+            currentCreationCommandQueue = creationQueue;
+            currentCreationCommandList = creationQueue->GetCommandList();
+            workerCommandLists[workerIndex] = currentCreationCommandList;
+
+            try
+            {
+                for (size_t j = nextJob++; j < jobs.size(); j = nextJob++)
+                {
+                    MeshJob& job = jobs[j];
+                    job.Result->mesh = createFunc(scene, job.Node, job.InMesh, shader, job.Result->material, filePath);
+                }
+            }
+            catch (...)
             {
-                CreateObjectsFromSceneNode(scene, node->mChildren[i], thisObject, shader, filePath);
+                workerErrors[workerIndex] = std::current_exception();
             }
-            return thisObject;
+
+            currentCreationCommandQueue = previousQueue;
+            currentCreationCommandList = previousCommandList;
+        };
+
+    std::vector<std::thread> workers;
+    for (uint32_t i = 1; i < workerCount; i++)
+    {
+        workers.emplace_back([&work, i]()
+            {
+                // WIC texture decoding needs COM on this thread
+                HRESULT comResult = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+                work(i);
+                if (SUCCEEDED(comResult))
+                    CoUninitialize();
+            });
+    }
+    work(0);
+
+    for (std::thread& worker : workers)
+        worker.join();
+
+    pendingCreationCommandLists.insert(pendingCreationCommandLists.end(), workerCommandLists.begin(), workerCommandLists.end());
+
+    for (std::exception_ptr error : workerErrors)
+    {
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    return importedMeshes;
+}
+
+std::shared_ptr<Object> Object::CreateObjectsFromSceneNode(aiScene* scene, aiNode* node, std::shared_ptr<Object> parent, std::shared_ptr<Shader> shader, std::wstring filePath, const ImportedMeshes* importedMeshes)
+{
+    std::shared_ptr<Object> thisObject;
+
+    // Check if this node is a light
+    aiLight* light = FindSceneNodeLight(scene, node);
+    if (light != nullptr)
+    {
+        // This node is a light
+        thisObject = std::dynamic_pointer_cast<Object>(CreateLightObjectFromSceneNode(scene, node, light, parent));
+        for (uint32_t i = 0; i < node->mNumChildren; i++)
+        {
+            CreateObjectsFromSceneNode(scene, node->mChildren[i], thisObject, shader, filePath, importedMeshes);
         }
+        return thisObject;
     }
 
     // The object wasn't a light, so create a mesh
@@ -851,6 +1063,14 @@ std::shared_ptr<Object> Object::CreateObjectsFromSceneNode(aiScene* scene, aiNod
     MeshCreation createFunc = shader->meshCreateCallback;
     for (uint32_t i = 0; i < node->mNumMeshes; i++)
     {
+        if (importedMeshes != nullptr)
+        {
+            const ImportedMesh& imported = importedMeshes->at(node)[i];
+            thisObject->SetMaterial(i, imported.material);
+            thisObject->SetMesh(i, imported.mesh);
+            continue;
+        }
+
         aiMesh* inMesh = scene->mMeshes[node->mMeshes[i]];
         thisObject->SetKnit(i, Knit{}); // resize the knit vector so we can get the material directtly
         std::shared_ptr<Mesh> mesh = createFunc(scene, node, inMesh, shader, thisObject->GetMaterial(i), filePath);
@@ -876,7 +1096,7 @@ std::shared_ptr<Object> Object::CreateObjectsFromSceneNode(aiScene* scene, aiNod
 
     for (uint32_t i = 0; i < node->mNumChildren; i++)
     {
-        CreateObjectsFromSceneNode(scene, node->mChildren[i], thisObject, shader, filePath);
+        CreateObjectsFromSceneNode(scene, node->mChildren[i], thisObject, shader, filePath, importedMeshes);
     }
     return thisObject;
 }
@@ -936,7 +1156,13 @@ std::shared_ptr<Object> Object::CreateObjectsFromScene(aiScene* scene, std::shar
         scene->mRootNode->mTransformation = mat;
     }
 
-    std::shared_ptr<Object> objectTree = CreateObjectsFromSceneNode(scene, scene->mRootNode, nullptr, shader, filePath);
+    // Convert the meshes in parallel first, then build the tree from the results on this thread
+    ImportedMeshes importedMeshes;
+    bool convertInParallel = scene->mNumMeshes >= ParallelImportMinMeshes;
+    if (convertInParallel)
+        importedMeshes = ConvertSceneMeshes(scene, shader, filePath);
+
+    std::shared_ptr<Object> objectTree = CreateObjectsFromSceneNode(scene, scene->mRootNode, nullptr, shader, filePath, convertInParallel ? &importedMeshes : nullptr);
     if (objectTree->GetName() == L"RootNode")
     {
         if (scene->mName.length != 0 && scene->mName.C_Str() != "")
@@ -959,9 +1185,83 @@ std::shared_ptr<Object> Object::CreateObjectsFromScene(aiScene* scene, std::shar
     return objectTree;
 }
 
+// Lets Assimp open models, and the files they reference (materials, buffers), from the content pack
+class ContentPackIOStream : public Assimp::IOStream
+{
+public:
+    ContentPackIOStream(ContentPack::File&& packedFile) : file(std::move(packedFile)) {}
+
+    size_t Read(void* buffer, size_t size, size_t count) override
+    {
+        if (size == 0)
+            return 0;
+        size_t readCount = std::min(count, (file.Size - position) / size);
+        memcpy(buffer, file.Data + position, readCount * size);
+        position += readCount * size;
+        return readCount;
+    }
+
+    size_t Write(const void* buffer, size_t size, size_t count) override
+    {
+        return 0;
+    }
+
+    aiReturn Seek(size_t offset, aiOrigin origin) override
+    {
+        size_t base = origin == aiOrigin_SET ? 0 : origin == aiOrigin_CUR ? position : file.Size;
+        if (base + offset > file.Size)
+            return aiReturn_FAILURE;
+        position = base + offset;
+        return aiReturn_SUCCESS;
+    }
+
+    size_t Tell() const override
+    {
+        return position;
+    }
+
+    size_t FileSize() const override
+    {
+        return file.Size;
+    }
+
+    void Flush() override
+    {
+    }
+
+protected:
+    ContentPack::File file;
+    size_t position = 0;
+};
+
+class ContentPackIOSystem : public Assimp::DefaultIOSystem
+{
+public:
+    bool Exists(const char* file) const override
+    {
+        return ContentPack::Contains(StringToWString(file)) || DefaultIOSystem::Exists(file);
+    }
+
+    Assimp::IOStream* Open(const char* file, const char* mode) override
+    {
+        ContentPack::File packedFile;
+        if (strchr(mode, 'w') == nullptr && ContentPack::Read(StringToWString(file), packedFile))
+            return new ContentPackIOStream(std::move(packedFile));
+        return DefaultIOSystem::Open(file, mode);
+    }
+};
+
 std::shared_ptr<Object> Object::CreateObjectsFromFile(std::wstring filePath, std::shared_ptr<Shader> shader)
 {
-    static Assimp::Importer importer;
+    // The importer owns the scene it returns, so each thread needs its own
+    static thread_local Assimp::Importer importer;
+    static thread_local bool importerInitialized = false;
+    if (!importerInitialized)
+    {
+        // The importer takes ownership of the IO system
+        importer.SetIOHandler(new ContentPackIOSystem());
+        importerInitialized = true;
+    }
 
     // Resolve smybolic link
     std::error_code ec;
@@ -976,9 +1276,15 @@ std::shared_ptr<Object> Object::CreateObjectsFromFile(std::wstring filePath, std
 
     std::string filePathA = WStringToString(filePath);
 
-    importer.SetPropertyInteger(AI_CONFIG_PP_SLM_TRIANGLE_LIMIT, 65535);
-    importer.SetPropertyInteger(AI_CONFIG_PP_SLM_VERTEX_LIMIT, 65535);
-    aiScene* scene = const_cast<aiScene*>(importer.ReadFile(filePathA, aiProcess_Triangulate | aiProcess_CalcTangentSpace | aiProcess_JoinIdenticalVertices | aiProcess_SortByPType | aiProcess_SplitLargeMeshes | aiProcess_MakeLeftHanded | aiProcess_FlipUVs | aiProcess_FlipWindingOrder));
+    unsigned int importFlags = aiProcess_Triangulate | aiProcess_CalcTangentSpace | aiProcess_JoinIdenticalVertices | aiProcess_SortByPType | aiProcess_MakeLeftHanded | aiProcess_FlipUVs | aiProcess_FlipWindingOrder;
+    if (SplitLargeMeshes)
+    {
+        importer.SetPropertyInteger(AI_CONFIG_PP_SLM_TRIANGLE_LIMIT, Mesh::MaxVertexCount16);
+        importer.SetPropertyInteger(AI_CONFIG_PP_SLM_VERTEX_LIMIT, Mesh::MaxVertexCount16);
+        importFlags |= aiProcess_SplitLargeMeshes;
+    }
+
+    aiScene* scene = const_cast<aiScene*>(importer.ReadFile(filePathA, importFlags));
     if (scene == nullptr)
     {
         OutputDebugStringAFormatted("Model importing (%s) failed: %s\n", filePathA, importer.GetErrorString());
@@ -1015,7 +1321,12 @@ void Object::ExecuteCreationCommandList()
     if (currentCreationCommandQueue == nullptr || currentCreationCommandList == nullptr)
         return; //throw std::exception("Command queue or list was null, cannot execute");
 
-    currentCreationCommandQueue->ExecuteCommandList(currentCreationCommandList);
+    // Submit the workers' lists in the same batch
+    std::vector<std::shared_ptr<CommandList>> commandLists;
+    commandLists.swap(pendingCreationCommandLists);
+    commandLists.push_back(currentCreationCommandList);
+
+    currentCreationCommandQueue->ExecuteCommandLists(commandLists);
     currentCreationCommandQueue->Flush();
     currentCreationCommandList = nullptr;
 }
\ No newline at end of file
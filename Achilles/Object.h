@@ -4,6 +4,7 @@
 #include <vector>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
 #include "ObjectTag.h"
@@ -20,6 +21,7 @@ struct aiMesh;
 struct aiLight;
 class CommandQueue;
 class CommandList;
+class Camera;
 
 // Return false to end traverse early
 typedef bool (CALLBACK* TraverseObject)(std::shared_ptr<Object> object);
@@ -32,6 +34,22 @@ class Object : public std::enable_shared_from_this<Object>
     friend class Achilles; // Achilles can access currentCreationCommandQueue
 public:
     inline static std::wstring DefaultName = L"Unnamed Object";
+    // Splits imported meshes so each fits within 16-bit indices. Meshes use 32-bit indices when needed so this is off by default
+    inline static bool SplitLargeMeshes = false;
+    // Reorders imported mesh indices and vertices for the post-transform cache, overdraw and vertex fetch
+    inline static bool OptimizeMeshes = true;
+    // Generates simplified levels of detail for imported meshes
+    inline static bool GenerateLODs = true;
+    // Draws coarser mesh levels of detail as objects get smaller on screen
+    inline static bool UseLODs = true;
+    // Fraction past a level's screen size before switching, so objects on a boundary don't pop back and forth
+    inline static float LODHysteresis = 0.1f;
+    // How many levels coarser than the main view shadow passes draw
+    inline static uint32_t ShadowLODBias = 1;
+    // Threads converting meshes when importing a scene, including the calling thread. 0 uses the number of hardware threads
+    inline static uint32_t ImportWorkerCount = 0;
+    // Scenes with fewer meshes than this are converted on the calling thread only
+    inline static uint32_t ParallelImportMinMeshes = 4;
     //// Public constructors & destructor functions ////
 
     // Should not be used. Use CreateObject instead!
@@ -71,6 +89,18 @@ public:
     void SetMaterial(uint32_t index, Material _material);
 
 
+    //// Level of detail functions ////
+
+    // Projected bounding sphere diameter as a fraction of the camera's view height
+    float GetProjectedScreenSize(std::shared_ptr<Camera> camera);
+    // Same as above from a projection and where it's viewed from, such as a shadow cascade
+    float GetProjectedScreenSize(const DirectX::SimpleMath::Matrix& projection, DirectX::SimpleMath::Vector3 viewPosition, bool orthographic);
+    // The last level picked for each camera is kept so hysteresis can be applied
+    uint32_t GetLODLevel(uint32_t index, std::shared_ptr<Camera> camera);
+    // Gets the mesh level of detail to draw from a camera. lodBias picks coarser levels, such as for shadow passes
+    std::shared_ptr<Mesh> GetLODMesh(uint32_t index, std::shared_ptr<Camera> camera, uint32_t lodBias = 0);
+
+
     //// Empty / Active functions ////
 
     bool IsEmpty();
@@ -84,6 +114,20 @@ public:
     bool ReceivesShadows();
     void SetCastsShadows(bool _castShadows);
     void SetReceiveShadows(bool _receiveShadows);
+    // Static objects are drawn into the cached shadow maps, which are only redrawn when a static caster in the light's view changes
+    bool IsStatic();
+    void SetStatic(bool _isStatic);
+
+
+    //// Occlusion States ////
+
+    // Occluders large enough on screen are drawn into the occlusion buffer to hide the objects behind them
+    bool IsOccluder();
+    void SetOccluder(bool _isOccluder);
+    // Low detail mesh drawn into the occlusion buffer instead of the knits. nullptr uses the knits
+    // It must stay inside the knits' surface, or it will hide things that should be seen
+    std::shared_ptr<Mesh> GetOccluderMesh();
+    void SetOccluderMesh(std::shared_ptr<Mesh> _occluderMesh);
 
 
     ////  Get/set this object's children ////
@@ -166,6 +210,8 @@ public:
     virtual void SetBoundingBox(DirectX::BoundingOrientedBox box);
     virtual void SetBoundingBoxDirty();
     virtual bool ShouldDraw(DirectX::BoundingFrustum frustum);
+    // Changes whenever the world bounds might have, so results based on them can be kept until it does
+    uint64_t GetBoundsVersion();
 
 protected:
     //// Internal matrix functions ////
@@ -190,6 +236,14 @@ protected:
 
     std::vector<Knit> knits;
 
+    // Each knit's LOD for a camera, kept per camera for hysteresis
+    struct CameraLODLevels
+    {
+        std::weak_ptr<Camera> Camera;
+        std::vector<uint32_t> Levels;
+    };
+    std::unordered_map<const Camera*, CameraLODLevels> cameraLODLevels;
+
     std::vector<std::shared_ptr<Object>> children{};
     std::weak_ptr<Object> parent{};
 
@@ -202,6 +256,10 @@ protected:
 
     bool castShadows = true;
     bool receiveShadows = true;
+    bool isStatic = false;
+
+    bool isOccluder = true;
+    std::shared_ptr<Mesh> occluderMesh;
 
     DirectX::SimpleMath::Vector3 position {0, 0, 0};
     DirectX::SimpleMath::Quaternion rotation {0, 0, 0, 1};
@@ -215,6 +273,7 @@ protected:
 
     DirectX::BoundingOrientedBox boundingBox;
     bool dirtyBoundingBox = true;
+    uint64_t boundsVersion = 0;
 
 public:
     //// Static Object creation functions ////
@@ -225,10 +284,23 @@ public:
 
     // Create objects from an aiScene
 
+    // A mesh converted ahead of building the object tree, and the material its shader's mesh creation callback filled in
+    struct ImportedMesh
+    {
+        std::shared_ptr<Mesh> mesh;
+        Material material;
+    };
+    // Converted meshes for each node, in the node's mesh order
+    using ImportedMeshes = std::unordered_map<const aiNode*, std::vector<ImportedMesh>>;
+
     // Create a light object from the scene
     static std::shared_ptr<LightObject> CreateLightObjectFromSceneNode(aiScene* scene, aiNode* node, aiLight* light, std::shared_ptr<Object> parent);
+    // Runs the shader's mesh creation callback for every mesh in the scene across worker threads. Each worker records its uploads on its own command list,
+    // which ExecuteCreationCommandList submits together with the calling thread's. Mesh creation callbacks must be thread safe
+    static ImportedMeshes ConvertSceneMeshes(aiScene* scene, std::shared_ptr<Shader> shader, std::wstring filePath);
     // Returns one object or nullptr. Child meshes are parented under one object with the scene name
-    static std::shared_ptr<Object> CreateObjectsFromSceneNode(aiScene* scene, aiNode* node, std::shared_ptr<Object> parent, std::shared_ptr<Shader> shader, std::wstring filePath);
+    // Meshes are taken from importedMeshes when given, otherwise they're created as the tree is built
+    static std::shared_ptr<Object> CreateObjectsFromSceneNode(aiScene* scene, aiNode* node, std::shared_ptr<Object> parent, std::shared_ptr<Shader> shader, std::wstring filePath, const ImportedMeshes* importedMeshes = nullptr);
     static std::shared_ptr<Object> CreateObjectsFromScene(aiScene* scene, std::shared_ptr<Shader> shader, std::wstring filePath);
     static std::shared_ptr<Object> CreateObjectsFromFile(std::wstring filePath, std::shared_ptr<Shader> shader);
     static std::shared_ptr<Object> CreateObjectsFromContentFile(std::wstring file, std::shared_ptr<Shader> shader);
@@ -237,6 +309,9 @@ public:
     static void ExecuteCreationCommandList();
 
 protected:
-    inline static std::shared_ptr<CommandQueue> currentCreationCommandQueue = nullptr;
-    inline static std::shared_ptr<CommandList> currentCreationCommandList = nullptr;
+    // Per thread, so the load thread and drag and drop can import at the same time
+    inline static thread_local std::shared_ptr<CommandQueue> currentCreationCommandQueue = nullptr;
+    inline static thread_local std::shared_ptr<CommandList> currentCreationCommandList = nullptr;
+    // Lists recorded by ConvertSceneMeshes' workers, submitted with currentCreationCommandList
+    inline static thread_local std::vector<std::shared_ptr<CommandList>> pendingCreationCommandLists{};
 };
@@ -0,0 +1,212 @@
+#include "ObjectLightLists.h"
+#include "VisibilityCache.h"
+#include "Object.h"
+#include "Camera.h"
+#include "Profiling.h"
+#include <algorithm>
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+void ObjectLightLists::Build(const std::vector<PointLight>& pointLights, const std::vector<SpotLight>& spotLights, const std::deque<DrawEvent>& opaqueQueue, const std::deque<DrawEvent>& transparentQueue, bool frustumCulling)
+{
+    ScopedTimer _prof(L"ObjectLightLists::Build");
+
+    lights.clear();
+    for (const PointLight& light : pointLights)
+        AddLight(light.Light);
+    for (const SpotLight& light : spotLights)
+        AddLight(light.Light);
+    BuildGrid();
+
+    objectRanges.clear();
+    lightIndices.clear();
+    lightVisited.assign(lights.size(), 0);
+    visitStamp = 0;
+
+    // Each knit of an object is its own event, but they all share the object's list
+    for (const std::deque<DrawEvent>* queue : { &opaqueQueue, &transparentQueue })
+    {
+        for (const DrawEvent& de : *queue)
+        {
+            if (de.eventType != DrawEventType::DrawIndexed || de.object == nullptr || objectRanges.contains(de.object.get()))
+                continue;
+            if (frustumCulling && de.camera != nullptr && !VisibilityCache::IsVisible(de.camera, de.object))
+                continue;
+
+            FindObjectLights(de.object.get(), de.object->GetWorldAABB());
+        }
+    }
+}
+
+void ObjectLightLists::AddLight(const LightCommon& light)
+{
+    // Lights without any range keep their index but are never added to the grid
+    GridLight gridLight
+    {
+        .Sphere = BoundingSphere((Vector3)light.PositionWorldSpace, light.MaxDistance),
+        .Intensity = std::max<float>(0.0f, light.Strength) * std::max<float>({ light.Color.x, light.Color.y, light.Color.z }),
+        .ConstantAttenuation = light.ConstantAttenuation,
+        .LinearAttenuation = light.LinearAttenuation,
+        .QuadraticAttenuation = light.QuadraticAttenuation,
+    };
+    lights.push_back(gridLight);
+}
+
+void ObjectLightLists::BuildGrid()
+{
+    cells.clear();
+    largeLights.clear();
+
+    // Cells about as wide as the average light, so most lights touch a handful of them
+    cellSize = CellSize;
+    if (cellSize <= 0.0f)
+    {
+        float totalRange = 0.0f;
+        uint32_t rangedLights = 0;
+        for (const GridLight& light : lights)
+        {
+            if (light.Sphere.Radius <= 0.0f)
+                continue;
+            totalRange += light.Sphere.Radius;
+            rangedLights++;
+        }
+        cellSize = rangedLights > 0 ? 2.0f * totalRange / rangedLights : 1.0f;
+    }
+    cellSize = std::max<float>(cellSize, 0.001f);
+
+    for (uint32_t i = 0; i < (uint32_t)lights.size(); i++)
+    {
+        const BoundingSphere& sphere = lights[i].Sphere;
+        if (sphere.Radius <= 0.0f)
+            continue;
+
+        int32_t minX = (int32_t)floorf((sphere.Center.x - sphere.Radius) / cellSize);
+        int32_t minY = (int32_t)floorf((sphere.Center.y - sphere.Radius) / cellSize);
+        int32_t minZ = (int32_t)floorf((sphere.Center.z - sphere.Radius) / cellSize);
+        int32_t maxX = (int32_t)floorf((sphere.Center.x + sphere.Radius) / cellSize);
+        int32_t maxY = (int32_t)floorf((sphere.Center.y + sphere.Radius) / cellSize);
+        int32_t maxZ = (int32_t)floorf((sphere.Center.z + sphere.Radius) / cellSize);
+
+        uint64_t cellCount = (uint64_t)(maxX - minX + 1) * (maxY - minY + 1) * (maxZ - minZ + 1);
+        if (cellCount > MaxCellsPerLight)
+        {
+            largeLights.push_back(i);
+            continue;
+        }
+
+        for (int32_t z = minZ; z <= maxZ; z++)
+        {
+            for (int32_t y = minY; y <= maxY; y++)
+            {
+                for (int32_t x = minX; x <= maxX; x++)
+                    cells[GetCellKey(x, y, z)].push_back(i);
+            }
+        }
+    }
+}
+
+void ObjectLightLists::FindObjectLights(Object* object, const BoundingBox& bounds)
+{
+    candidates.clear();
+    Vector3 boundsMin = (Vector3)bounds.Center - (Vector3)bounds.Extents;
+    Vector3 boundsMax = (Vector3)bounds.Center + (Vector3)bounds.Extents;
+
+    // Lights touching more than one of the object's cells are only tested once
+    visitStamp++;
+    auto testLight = [&](uint32_t i)
+        {
+            if (lightVisited[i] == visitStamp)
+                return;
+            lightVisited[i] = visitStamp;
+
+            const GridLight& light = lights[i];
+            if (!bounds.Intersects(light.Sphere))
+                return;
+
+            // Strongest at the closest point of the bounds, so the weakest lights are the ones dropped
+            Vector3 center = light.Sphere.Center;
+            Vector3 closest = center;
+            closest.Clamp(boundsMin, boundsMax);
+            float distance = Vector3::Distance(center, closest);
+            float attenuation = light.ConstantAttenuation + light.LinearAttenuation * distance + light.QuadraticAttenuation * distance * distance;
+            float contribution = attenuation > 0.0f ? light.Intensity / attenuation : light.Intensity;
+            candidates.push_back({ contribution, i });
+        };
+
+    for (uint32_t i : largeLights)
+        testLight(i);
+
+    int32_t minX = (int32_t)floorf(boundsMin.x / cellSize);
+    int32_t minY = (int32_t)floorf(boundsMin.y / cellSize);
+    int32_t minZ = (int32_t)floorf(boundsMin.z / cellSize);
+    int32_t maxX = (int32_t)floorf(boundsMax.x / cellSize);
+    int32_t maxY = (int32_t)floorf(boundsMax.y / cellSize);
+    int32_t maxZ = (int32_t)floorf(boundsMax.z / cellSize);
+
+    // Huge objects check every occupied cell rather than walking the cells they cover
+    uint64_t cellCount = (uint64_t)(maxX - minX + 1) * (maxY - minY + 1) * (maxZ - minZ + 1);
+    if (cellCount > cells.size())
+    {
+        for (const auto& [key, cellLights] : cells)
+        {
+            for (uint32_t i : cellLights)
+                testLight(i);
+        }
+    }
+    else
+    {
+        for (int32_t z = minZ; z <= maxZ; z++)
+        {
+            for (int32_t y = minY; y <= maxY; y++)
+            {
+                for (int32_t x = minX; x <= maxX; x++)
+                {
+                    auto iter = cells.find(GetCellKey(x, y, z));
+                    if (iter == cells.end())
+                        continue;
+                    for (uint32_t i : iter->second)
+                        testLight(i);
+                }
+            }
+        }
+    }
+
+    size_t count = std::min<size_t>(candidates.size(), MaxLightsPerObject);
+    if (count < candidates.size())
+        std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    // Index order keeps the shadowed lights, which are at the front of each type, together
+    std::sort(candidates.begin(), candidates.begin() + count, [](const auto& a, const auto& b) { return a.second < b.second; });
+
+    LightRange range{ (uint32_t)lightIndices.size(), (uint32_t)count };
+    for (size_t i = 0; i < count; i++)
+        lightIndices.push_back(candidates[i].second);
+    objectRanges[object] = range;
+}
+
+uint64_t ObjectLightLists::GetCellKey(int32_t x, int32_t y, int32_t z) const
+{
+    // 21 bits per axis
+    constexpr uint64_t mask = (1ull << 21) - 1;
+    return ((uint64_t)x & mask) | (((uint64_t)y & mask) << 21) | (((uint64_t)z & mask) << 42);
+}
+
+bool ObjectLightLists::GetLightRange(Object* object, LightRange& range) const
+{
+    auto iter = objectRanges.find(object);
+    if (iter == objectRanges.end())
+        return false;
+    range = iter->second;
+    return true;
+}
+
+const std::vector<uint32_t>& ObjectLightLists::GetLightIndices() const
+{
+    return lightIndices;
+}
+
+size_t ObjectLightLists::GetObjectCount() const
+{
+    return objectRanges.size();
+}
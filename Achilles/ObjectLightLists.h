@@ -0,0 +1,70 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <cstdint>
+#include <DirectXCollision.h>
+#include "Lights.h"
+#include "DrawEvent.h"
+
+using DirectX::BoundingSphere;
+using DirectX::BoundingBox;
+
+// Finds the point and spot lights that reach each drawn object, for scenes too small to be worth clustering
+// Lights are put in a uniform world grid by their range, then each object takes up to MaxLightsPerObject of the lights in the cells its bounds touch
+class ObjectLightLists
+{
+public:
+    // Lights past this reaching an object are dropped, weakest first
+    inline static uint32_t MaxLightsPerObject = 16;
+    // World size of a grid cell, 0 fits it to the average light range
+    inline static float CellSize = 0.0f;
+    // Lights covering more cells than this are tested against every object instead
+    inline static uint32_t MaxCellsPerLight = 64;
+
+    // Where an object's lights start in the light index list and how many there are
+    struct LightRange
+    {
+        uint32_t Offset = 0;
+        uint32_t Count = 0;
+    };
+
+    // Indices are the same as LightClusters, point lights then spot lights offset by the point light count
+    // Only objects in the queues that pass their camera's frustum get a list
+    void Build(const std::vector<PointLight>& pointLights, const std::vector<SpotLight>& spotLights, const std::deque<DrawEvent>& opaqueQueue, const std::deque<DrawEvent>& transparentQueue, bool frustumCulling);
+
+    // False for objects without a list, which should fall back to every light
+    bool GetLightRange(Object* object, LightRange& range) const;
+    const std::vector<uint32_t>& GetLightIndices() const;
+    size_t GetObjectCount() const;
+
+protected:
+    struct GridLight
+    {
+        BoundingSphere Sphere;
+        float Intensity;
+        float ConstantAttenuation;
+        float LinearAttenuation;
+        float QuadraticAttenuation;
+    };
+
+    void AddLight(const LightCommon& light);
+    void BuildGrid();
+    void FindObjectLights(Object* object, const BoundingBox& bounds);
+    uint64_t GetCellKey(int32_t x, int32_t y, int32_t z) const;
+
+    float cellSize = 1.0f;
+    std::vector<GridLight> lights;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> cells;
+    std::vector<uint32_t> largeLights;
+
+    std::unordered_map<Object*, LightRange> objectRanges;
+    std::vector<uint32_t> lightIndices;
+
+    // Kept between builds so finding lights doesn't reallocate
+    std::vector<uint32_t> lightVisited;
+    uint32_t visitStamp = 0;
+    std::vector<std::pair<float, uint32_t>> candidates;
+};
@@ -0,0 +1,482 @@
+#include "OcclusionBuffer.h"
+#include "VisibilityCache.h"
+#include "Object.h"
+#include "Mesh.h"
+#include "Camera.h"
+#include "Shader.h"
+#include "Profiling.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <random>
+#include <chrono>
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+// Runs work(workerIndex) on workerCount threads, worker 0 being the calling thread
+static void RunWorkers(uint32_t workerCount, const std::function<void(uint32_t)>& work)
+{
+    std::vector<std::thread> workers;
+    for (uint32_t i = 1; i < workerCount; i++)
+        workers.emplace_back(work, i);
+    work(0);
+
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+void OcclusionBuffer::Render(std::shared_ptr<Camera> _camera, const std::vector<std::shared_ptr<Object>>& objects)
+{
+    ScopedTimer _prof(L"OcclusionBuffer::Render");
+    if (_camera == nullptr)
+    {
+        Clear();
+        return;
+    }
+
+    // Largest on screen first
+    std::vector<std::pair<float, std::shared_ptr<Object>>> candidates;
+    for (std::shared_ptr<Object> object : objects)
+    {
+        if (object == nullptr || !object->HasTag(ObjectTag::Mesh) || !object->IsOccluder() || !VisibilityCache::IsVisible(_camera, object))
+            continue;
+
+        float screenSize = object->GetProjectedScreenSize(_camera);
+        if (screenSize >= MinOccluderScreenSize)
+            candidates.push_back({ screenSize, object });
+    }
+    size_t occluderCount = std::min<size_t>(candidates.size(), MaxOccluders);
+    std::partial_sort(candidates.begin(), candidates.begin() + occluderCount, candidates.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    std::vector<Occluder> occluders;
+    for (size_t i = 0; i < occluderCount; i++)
+    {
+        std::shared_ptr<Object> object = candidates[i].second;
+        Matrix world = object->GetWorldMatrix();
+
+        // An authored proxy stands in for every knit
+        std::shared_ptr<Mesh> occluderMesh = object->GetOccluderMesh();
+        if (occluderMesh != nullptr)
+        {
+            occluders.push_back({ world, GetMeshTriangles(occluderMesh) });
+            continue;
+        }
+
+        for (uint32_t k = 0; k < object->GetKnitCount(); k++)
+        {
+            Knit& knit = object->GetKnit(k);
+            if (knit.mesh == nullptr || knit.material.shader == nullptr)
+                continue;
+
+            // Anything can be seen through a transparent knit
+            IsKnitTransparent isTransparent = knit.material.shader->knitTransparencyCallback;
+            if (isTransparent != nullptr && isTransparent(object, k, knit.mesh, knit.material))
+                continue;
+
+            // Simplified levels can bulge past the real surface and hide things that should show, so only the full mesh is drawn.
+            // Meshes too large to draw are skipped, which can only let more through. Give them an occluder mesh instead
+            if (knit.mesh->GetNumIndices() / 3 > MaxOccluderTriangles)
+                continue;
+            occluders.push_back({ world, GetMeshTriangles(knit.mesh) });
+        }
+    }
+
+    Render(_camera->GetViewProj(), occluders);
+    camera = _camera.get();
+}
+
+void OcclusionBuffer::Render(const Matrix& _viewProjection, const std::vector<Occluder>& occluders)
+{
+    camera = nullptr;
+    viewProjection = _viewProjection;
+    statistics = Statistics{};
+    statistics.OccluderCount = (uint32_t)occluders.size();
+
+    // Rows are rasterised 4 pixels at a time
+    uint32_t newWidth = (std::max<uint32_t>(Width, 4) + 3) & ~3u;
+    uint32_t newHeight = std::max<uint32_t>(Height, 1);
+    if (newWidth != width || newHeight != height || levels.empty())
+    {
+        width = newWidth;
+        height = newHeight;
+        levels.clear();
+        levelWidths.clear();
+        levelHeights.clear();
+
+        uint32_t levelWidth = width, levelHeight = height;
+        while (true)
+        {
+            levels.push_back(std::vector<float>((size_t)levelWidth * levelHeight, 1.0f));
+            levelWidths.push_back(levelWidth);
+            levelHeights.push_back(levelHeight);
+            if (levelWidth == 1 && levelHeight == 1)
+                break;
+            levelWidth = (levelWidth + 1) / 2;
+            levelHeight = (levelHeight + 1) / 2;
+        }
+    }
+    std::fill(levels[0].begin(), levels[0].end(), 1.0f);
+
+    size_t triangleCount = 0;
+    for (const Occluder& occluder : occluders)
+    {
+        if (occluder.Triangles != nullptr)
+            triangleCount += occluder.Triangles->size() / 3;
+    }
+
+    uint32_t workerCount = WorkerCount;
+    if (workerCount == 0)
+        workerCount = std::max(std::thread::hardware_concurrency(), 1u);
+    workerCount = std::min<uint32_t>(workerCount, (uint32_t)std::max<size_t>(triangleCount / std::max<uint32_t>(MinTrianglesPerWorker, 1), 1));
+
+    // Transform, clip and set up each occluder's triangles
+    workerTriangles.resize(std::max<size_t>(workerTriangles.size(), workerCount));
+    for (std::vector<ScreenTriangle>& triangles : workerTriangles)
+        triangles.clear();
+
+    std::atomic<size_t> nextOccluder = 0;
+    RunWorkers(workerCount, [&](uint32_t worker)
+        {
+            for (size_t i = nextOccluder++; i < occluders.size(); i = nextOccluder++)
+                SetupTriangles(occluders[i], workerTriangles[worker]);
+        });
+
+    // Each band of rows is only written by the worker rasterising it
+    uint32_t bandHeight = std::max<uint32_t>(BandHeight, 1);
+    uint32_t bandCount = (height + bandHeight - 1) / bandHeight;
+    bandTriangles.resize(bandCount);
+    for (std::vector<const ScreenTriangle*>& band : bandTriangles)
+        band.clear();
+
+    for (const std::vector<ScreenTriangle>& triangles : workerTriangles)
+    {
+        for (const ScreenTriangle& triangle : triangles)
+        {
+            for (uint32_t band = triangle.MinY / bandHeight; band <= (uint32_t)triangle.MaxY / bandHeight; band++)
+                bandTriangles[band].push_back(&triangle);
+        }
+        statistics.TriangleCount += (uint32_t)triangles.size();
+    }
+
+    std::atomic<uint32_t> nextBand = 0;
+    RunWorkers(std::min<uint32_t>(workerCount, bandCount), [&](uint32_t)
+        {
+            for (uint32_t band = nextBand++; band < bandCount; band = nextBand++)
+                RasteriseBand(band);
+        });
+
+    BuildHierarchy();
+    hasRendered = true;
+}
+
+void OcclusionBuffer::SetupTriangles(const Occluder& occluder, std::vector<ScreenTriangle>& triangles) const
+{
+    if (occluder.Triangles == nullptr)
+        return;
+
+    XMMATRIX worldViewProjection = XMMatrixMultiply(occluder.World, viewProjection);
+    const std::vector<XMFLOAT3>& points = *occluder.Triangles;
+    for (size_t i = 0; i + 2 < points.size(); i += 3)
+    {
+        XMFLOAT4 clip[3];
+        for (int v = 0; v < 3; v++)
+            XMStoreFloat4(&clip[v], XMVector3Transform(XMLoadFloat3(&points[i + v]), worldViewProjection));
+
+        // Wholly outside one side of the view
+        if ((clip[0].x > clip[0].w && clip[1].x > clip[1].w && clip[2].x > clip[2].w) || (clip[0].x < -clip[0].w && clip[1].x < -clip[1].w && clip[2].x < -clip[2].w)
+            || (clip[0].y > clip[0].w && clip[1].y > clip[1].w && clip[2].y > clip[2].w) || (clip[0].y < -clip[0].w && clip[1].y < -clip[1].w && clip[2].y < -clip[2].w)
+            || (clip[0].z > clip[0].w && clip[1].z > clip[1].w && clip[2].z > clip[2].w))
+            continue;
+
+        int inside = (clip[0].z >= 0.0f) + (clip[1].z >= 0.0f) + (clip[2].z >= 0.0f);
+        if (inside == 0)
+            continue;
+        if (inside == 3)
+        {
+            SetupTriangle(clip[0], clip[1], clip[2], triangles);
+            continue;
+        }
+
+        // Clip to the near plane, which leaves one or two triangles
+        XMFLOAT4 polygon[4];
+        int polygonCount = 0;
+        for (int v = 0; v < 3; v++)
+        {
+            const XMFLOAT4& a = clip[v];
+            const XMFLOAT4& b = clip[(v + 1) % 3];
+            if (a.z >= 0.0f)
+                polygon[polygonCount++] = a;
+            if ((a.z >= 0.0f) != (b.z >= 0.0f))
+            {
+                float t = a.z / (a.z - b.z);
+                XMStoreFloat4(&polygon[polygonCount++], XMVectorLerp(XMLoadFloat4(&a), XMLoadFloat4(&b), t));
+            }
+        }
+        for (int v = 1; v + 1 < polygonCount; v++)
+            SetupTriangle(polygon[0], polygon[v], polygon[v + 1], triangles);
+    }
+}
+
+void OcclusionBuffer::SetupTriangle(const XMFLOAT4& a, const XMFLOAT4& b, const XMFLOAT4& c, std::vector<ScreenTriangle>& triangles) const
+{
+    // Pixel space, with y going down the screen
+    XMFLOAT3 v[3];
+    const XMFLOAT4* clip[3] = { &a, &b, &c };
+    for (int i = 0; i < 3; i++)
+    {
+        float invW = 1.0f / clip[i]->w;
+        v[i] = XMFLOAT3((clip[i]->x * invW * 0.5f + 0.5f) * width, (0.5f - clip[i]->y * invW * 0.5f) * height, clip[i]->z * invW);
+    }
+
+    // Both windings are drawn, as occluders can be single sided planes seen from behind
+    float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+    if (area < 0.0f)
+    {
+        std::swap(v[1], v[2]);
+        area = -area;
+    }
+    if (area < 1e-6f)
+        return;
+
+    ScreenTriangle triangle{};
+    triangle.MinX = std::max<int32_t>((int32_t)floorf(std::min<float>({ v[0].x, v[1].x, v[2].x })), 0) & ~3;
+    triangle.MaxX = std::min<int32_t>((int32_t)ceilf(std::max<float>({ v[0].x, v[1].x, v[2].x })), (int32_t)width - 1);
+    triangle.MinY = std::max<int32_t>((int32_t)floorf(std::min<float>({ v[0].y, v[1].y, v[2].y })), 0);
+    triangle.MaxY = std::min<int32_t>((int32_t)ceilf(std::max<float>({ v[0].y, v[1].y, v[2].y })), (int32_t)height - 1);
+    if (triangle.MinX > triangle.MaxX || triangle.MinY > triangle.MaxY)
+        return;
+
+    // Edge i is opposite vertex i and is positive inside the triangle
+    for (int i = 0; i < 3; i++)
+    {
+        const XMFLOAT3& p1 = v[(i + 1) % 3];
+        const XMFLOAT3& p2 = v[(i + 2) % 3];
+        triangle.EdgeA[i] = p1.y - p2.y;
+        triangle.EdgeB[i] = p2.x - p1.x;
+        triangle.EdgeC[i] = -(triangle.EdgeA[i] * p1.x + triangle.EdgeB[i] * p1.y);
+    }
+
+    float invArea = 1.0f / area;
+    triangle.DepthA = (triangle.EdgeA[0] * v[0].z + triangle.EdgeA[1] * v[1].z + triangle.EdgeA[2] * v[2].z) * invArea;
+    triangle.DepthB = (triangle.EdgeB[0] * v[0].z + triangle.EdgeB[1] * v[1].z + triangle.EdgeB[2] * v[2].z) * invArea;
+    triangle.DepthC = (triangle.EdgeC[0] * v[0].z + triangle.EdgeC[1] * v[1].z + triangle.EdgeC[2] * v[2].z) * invArea;
+
+    triangles.push_back(triangle);
+}
+
+void OcclusionBuffer::RasteriseBand(uint32_t band)
+{
+    uint32_t bandHeight = std::max<uint32_t>(BandHeight, 1);
+    int32_t bandStart = (int32_t)(band * bandHeight);
+    int32_t bandEnd = std::min<int32_t>(bandStart + (int32_t)bandHeight, (int32_t)height) - 1;
+
+    std::vector<float>& depth = levels[0];
+    const XMVECTOR zero = XMVectorZero();
+    const XMVECTOR pixelOffsets = XMVectorSet(0.5f, 1.5f, 2.5f, 3.5f);
+
+    for (const ScreenTriangle* triangle : bandTriangles[band])
+    {
+        int32_t minY = std::max<int32_t>(triangle->MinY, bandStart);
+        int32_t maxY = std::min<int32_t>(triangle->MaxY, bandEnd);
+
+        // Four pixels along the row at a time
+        XMVECTOR startX = XMVectorAdd(XMVectorReplicate((float)triangle->MinX), pixelOffsets);
+        XMVECTOR edgeA[3], edgeStep[3];
+        for (int i = 0; i < 3; i++)
+        {
+            edgeA[i] = XMVectorReplicate(triangle->EdgeA[i]);
+            edgeStep[i] = XMVectorReplicate(triangle->EdgeA[i] * 4.0f);
+        }
+        XMVECTOR depthStep = XMVectorReplicate(triangle->DepthA * 4.0f);
+
+        for (int32_t y = minY; y <= maxY; y++)
+        {
+            float pixelY = y + 0.5f;
+            XMVECTOR edges[3];
+            for (int i = 0; i < 3; i++)
+                edges[i] = XMVectorMultiplyAdd(edgeA[i], startX, XMVectorReplicate(triangle->EdgeB[i] * pixelY + triangle->EdgeC[i]));
+            XMVECTOR z = XMVectorMultiplyAdd(XMVectorReplicate(triangle->DepthA), startX, XMVectorReplicate(triangle->DepthB * pixelY + triangle->DepthC));
+
+            float* row = depth.data() + (size_t)y * width;
+            for (int32_t x = triangle->MinX; x <= triangle->MaxX; x += 4)
+            {
+                XMVECTOR inside = XMVectorAndInt(XMVectorAndInt(XMVectorGreaterOrEqual(edges[0], zero), XMVectorGreaterOrEqual(edges[1], zero)), XMVectorGreaterOrEqual(edges[2], zero));
+                if (!XMVector4EqualInt(inside, XMVectorFalseInt()))
+                {
+                    XMFLOAT4* pixels = reinterpret_cast<XMFLOAT4*>(row + x);
+                    XMVECTOR current = XMLoadFloat4(pixels);
+                    XMStoreFloat4(pixels, XMVectorSelect(current, XMVectorMin(current, z), inside));
+                }
+
+                for (int i = 0; i < 3; i++)
+                    edges[i] = XMVectorAdd(edges[i], edgeStep[i]);
+                z = XMVectorAdd(z, depthStep);
+            }
+        }
+    }
+}
+
+void OcclusionBuffer::BuildHierarchy()
+{
+    // Each texel is the farthest depth of the 2x2 texels under it, edges repeat for odd sizes
+    for (size_t level = 1; level < levels.size(); level++)
+    {
+        const std::vector<float>& source = levels[level - 1];
+        uint32_t sourceWidth = levelWidths[level - 1];
+        uint32_t sourceHeight = levelHeights[level - 1];
+        std::vector<float>& target = levels[level];
+
+        for (uint32_t y = 0; y < levelHeights[level]; y++)
+        {
+            uint32_t y0 = y * 2, y1 = std::min<uint32_t>(y * 2 + 1, sourceHeight - 1);
+            for (uint32_t x = 0; x < levelWidths[level]; x++)
+            {
+                uint32_t x0 = x * 2, x1 = std::min<uint32_t>(x * 2 + 1, sourceWidth - 1);
+                target[(size_t)y * levelWidths[level] + x] = std::max<float>({ source[(size_t)y0 * sourceWidth + x0], source[(size_t)y0 * sourceWidth + x1], source[(size_t)y1 * sourceWidth + x0], source[(size_t)y1 * sourceWidth + x1] });
+            }
+        }
+    }
+}
+
+void OcclusionBuffer::Clear()
+{
+    hasRendered = false;
+    camera = nullptr;
+    statistics = Statistics{};
+}
+
+bool OcclusionBuffer::IsOccluded(const BoundingBox& worldBox)
+{
+    if (!hasRendered)
+        return false;
+    statistics.TestedCount++;
+
+    XMFLOAT3 corners[BoundingBox::CORNER_COUNT];
+    worldBox.GetCorners(corners);
+
+    float minX = FLT_MAX, maxX = -FLT_MAX, minY = FLT_MAX, maxY = -FLT_MAX, minZ = FLT_MAX;
+    for (const XMFLOAT3& corner : corners)
+    {
+        XMFLOAT4 clip;
+        XMStoreFloat4(&clip, XMVector3Transform(XMLoadFloat3(&corner), viewProjection));
+        if (clip.z < 0.0f || clip.w <= 0.0f)
+            return false;
+
+        float invW = 1.0f / clip.w;
+        minX = std::min<float>(minX, clip.x * invW);
+        maxX = std::max<float>(maxX, clip.x * invW);
+        minY = std::min<float>(minY, clip.y * invW);
+        maxY = std::max<float>(maxY, clip.y * invW);
+        minZ = std::min<float>(minZ, clip.z * invW);
+    }
+
+    // Off screen is left to frustum culling
+    if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+        return false;
+
+    auto toPixel = [](float t, uint32_t size) { return (uint32_t)std::clamp<float>(floorf(t * size), 0.0f, (float)(size - 1)); };
+    uint32_t pixelMinX = toPixel(minX * 0.5f + 0.5f, width);
+    uint32_t pixelMaxX = toPixel(maxX * 0.5f + 0.5f, width);
+    uint32_t pixelMinY = toPixel(0.5f - maxY * 0.5f, height);
+    uint32_t pixelMaxY = toPixel(0.5f - minY * 0.5f, height);
+
+    // The level where the box covers a few texels across
+    uint32_t size = std::max(pixelMaxX - pixelMinX, pixelMaxY - pixelMinY) + 1;
+    uint32_t level = 0;
+    while ((size >> level) > 4 && level + 1 < levels.size())
+        level++;
+
+    const std::vector<float>& depth = levels[level];
+    uint32_t levelWidth = levelWidths[level];
+    uint32_t levelHeight = levelHeights[level];
+    for (uint32_t y = std::min(pixelMinY >> level, levelHeight - 1); y <= std::min(pixelMaxY >> level, levelHeight - 1); y++)
+    {
+        for (uint32_t x = std::min(pixelMinX >> level, levelWidth - 1); x <= std::min(pixelMaxX >> level, levelWidth - 1); x++)
+        {
+            if (depth[(size_t)y * levelWidth + x] >= minZ)
+                return false;
+        }
+    }
+
+    statistics.OccludedCount++;
+    return true;
+}
+
+const std::vector<XMFLOAT3>* OcclusionBuffer::GetMeshTriangles(std::shared_ptr<Mesh> mesh)
+{
+    if (mesh == nullptr)
+        return nullptr;
+
+    auto iter = meshTriangles.find(mesh.get());
+    if (iter != meshTriangles.end() && iter->second.Mesh.lock() == mesh)
+        return &iter->second.Triangles;
+
+    // A new mesh may have the address of one that's gone
+    std::erase_if(meshTriangles, [](const auto& entry) { return entry.second.Mesh.expired(); });
+
+    MeshTriangles& triangles = meshTriangles[mesh.get()];
+    triangles.Mesh = mesh;
+    triangles.Triangles.clear();
+    for (const Vector3& point : mesh->GetTrianglePoints())
+        triangles.Triangles.push_back(point);
+    return &triangles.Triangles;
+}
+
+const Camera* OcclusionBuffer::GetCamera() const
+{
+    return camera;
+}
+
+OcclusionBuffer::Statistics OcclusionBuffer::GetStatistics() const
+{
+    return statistics;
+}
+
+const std::vector<float>& OcclusionBuffer::GetDepth(uint32_t level) const
+{
+    static const std::vector<float> empty;
+    if (level >= levels.size())
+        return empty;
+    return levels[level];
+}
+
+uint32_t OcclusionBuffer::GetLevelCount() const
+{
+    return (uint32_t)levels.size();
+}
+
+double OcclusionBuffer::Benchmark(uint32_t occluderCount, uint32_t iterations)
+{
+    Matrix viewProjection = XMMatrixPerspectiveFovLH(XMConvertToRadians(60.0f), 16.0f / 9.0f, 0.1f, 500.0f);
+
+    // Unit cube, 12 triangles
+    std::vector<XMFLOAT3> cube;
+    const XMFLOAT3 corners[8] = { { -1, -1, -1 }, { 1, -1, -1 }, { 1, 1, -1 }, { -1, 1, -1 }, { -1, -1, 1 }, { 1, -1, 1 }, { 1, 1, 1 }, { -1, 1, 1 } };
+    const uint32_t faces[36] = { 0, 1, 2, 0, 2, 3, 4, 6, 5, 4, 7, 6, 0, 4, 5, 0, 5, 1, 3, 2, 6, 3, 6, 7, 0, 3, 7, 0, 7, 4, 1, 5, 6, 1, 6, 2 };
+    for (uint32_t index : faces)
+        cube.push_back(corners[index]);
+
+    // Same seed every run so results can be compared
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> spread(-60.0f, 60.0f);
+    std::uniform_real_distribution<float> depth(5.0f, 200.0f);
+    std::uniform_real_distribution<float> scale(0.5f, 8.0f);
+    std::vector<Occluder> occluders(occluderCount);
+    for (Occluder& occluder : occluders)
+    {
+        occluder.World = Matrix::CreateScale(scale(random), scale(random), scale(random)) * Matrix::CreateTranslation(spread(random), spread(random) * 0.5f, depth(random));
+        occluder.Triangles = &cube;
+    }
+
+    OcclusionBuffer buffer;
+    buffer.Render(viewProjection, occluders); // Allocates outside the timing
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+        buffer.Render(viewProjection, occluders);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count() / std::max<uint32_t>(iterations, 1);
+}
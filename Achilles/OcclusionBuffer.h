@@ -0,0 +1,107 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <directxtk12/SimpleMath.h>
+
+using DirectX::SimpleMath::Matrix;
+using DirectX::BoundingBox;
+
+class Camera;
+class Object;
+class Mesh;
+
+// Low resolution depth buffer the largest meshes in view are rasterised into on the CPU, so objects hidden behind them can be skipped before they're queued
+// Depth is the projection's 0 to 1 z, with a hierarchy of the farthest depth in each 2x2 block for testing bounds
+// Doesn't touch the GPU so it can be driven and checked on its own
+class OcclusionBuffer
+{
+public:
+    inline static uint32_t Width = 256;
+    inline static uint32_t Height = 128;
+    // Rows each worker rasterises at a time
+    inline static uint32_t BandHeight = 8;
+    // Objects smaller than this fraction of the view height aren't drawn as occluders
+    inline static float MinOccluderScreenSize = 0.2f;
+    // Only the largest occluders on screen are drawn
+    inline static uint32_t MaxOccluders = 64;
+    // Knits with more triangles than this aren't drawn as occluders. Objects with an occluder mesh always draw it
+    inline static uint32_t MaxOccluderTriangles = 2048;
+    // Threads rasterising, including the calling thread. 0 uses one per hardware thread
+    inline static uint32_t WorkerCount = 0;
+    // Fewer triangles than this per thread are rasterised on the calling thread alone
+    inline static uint32_t MinTrianglesPerWorker = 512;
+
+    // World space triangle list, three points per triangle
+    struct Occluder
+    {
+        Matrix World;
+        const std::vector<DirectX::XMFLOAT3>* Triangles = nullptr;
+    };
+
+    struct Statistics
+    {
+        uint32_t OccluderCount = 0;
+        uint32_t TriangleCount = 0;
+        uint32_t TestedCount = 0;
+        uint32_t OccludedCount = 0;
+    };
+
+    // Picks the occluders from objects and draws them from the camera
+    void Render(std::shared_ptr<Camera> camera, const std::vector<std::shared_ptr<Object>>& objects);
+    void Render(const Matrix& viewProjection, const std::vector<Occluder>& occluders);
+    // Nothing is occluded until the next Render
+    void Clear();
+
+    // True when every pixel the box could cover is behind something drawn. Boxes crossing the near plane are never occluded
+    bool IsOccluded(const BoundingBox& worldBox);
+    // The camera the buffer was last drawn from, nullptr after Clear or a Render without one
+    const Camera* GetCamera() const;
+    Statistics GetStatistics() const;
+    // Level 0 is Width x Height, each level after is half the size
+    const std::vector<float>& GetDepth(uint32_t level = 0) const;
+    uint32_t GetLevelCount() const;
+
+    // Times Render with occluderCount random boxes in front of the camera, returns the average milliseconds per render
+    static double Benchmark(uint32_t occluderCount, uint32_t iterations = 16);
+
+protected:
+    // Edge functions and depth as planes over the screen, so a pixel's values are a * x + b * y + c
+    struct ScreenTriangle
+    {
+        float EdgeA[3], EdgeB[3], EdgeC[3];
+        float DepthA, DepthB, DepthC;
+        int32_t MinX, MaxX, MinY, MaxY;
+    };
+
+    void SetupTriangles(const Occluder& occluder, std::vector<ScreenTriangle>& triangles) const;
+    void SetupTriangle(const DirectX::XMFLOAT4& a, const DirectX::XMFLOAT4& b, const DirectX::XMFLOAT4& c, std::vector<ScreenTriangle>& triangles) const;
+    void RasteriseBand(uint32_t band);
+    void BuildHierarchy();
+    // Triangles of a mesh in its local space, kept until the mesh is gone
+    const std::vector<DirectX::XMFLOAT3>* GetMeshTriangles(std::shared_ptr<Mesh> mesh);
+
+    Matrix viewProjection;
+    const Camera* camera = nullptr;
+    bool hasRendered = false;
+    uint32_t width = 0, height = 0;
+    std::vector<std::vector<float>> levels;
+    std::vector<uint32_t> levelWidths;
+    std::vector<uint32_t> levelHeights;
+    Statistics statistics;
+
+    // Kept between renders so drawing doesn't reallocate
+    std::vector<std::vector<ScreenTriangle>> workerTriangles;
+    std::vector<std::vector<const ScreenTriangle*>> bandTriangles;
+
+    struct MeshTriangles
+    {
+        std::weak_ptr<Mesh> Mesh;
+        std::vector<DirectX::XMFLOAT3> Triangles;
+    };
+    std::unordered_map<const Mesh*, MeshTriangles> meshTriangles;
+};
@@ -1,76 +1,143 @@
 #include "PostProcessing.h"
 #include "Application.h"
 
-PostProcessing::PostProcessing(float width, float height)
+PostProcessing::PostProcessing()
 {
-    PPBloom::CreateUAVs(width, height);
 }
 
 PostProcessing::~PostProcessing()
 {
 }
 
-void PostProcessing::ApplyPostProcessing(std::shared_ptr<Texture> texture, std::shared_ptr<Texture> presentTexture, bool postProcessingEnable)
+void PostProcessing::AddPasses(RenderGraph& graph, uint32_t segment, RenderGraph::ResourceHandle texture, RenderGraph::ResourceHandle presentTexture, bool postProcessingEnable)
 {
-    std::shared_ptr<CommandQueue> commandQueue = Application::GetCommandQueue(D3D12_COMMAND_LIST_TYPE_COMPUTE);
-    std::shared_ptr<CommandList> commandList = commandQueue->GetCommandList();
-
     // Apply present conversion from 16 bit float HDR down to 8 bit unorm SDR
     if (!postProcessingEnable)
     {
-        ApplyPresentConversion(commandList, texture, presentTexture);
-        commandQueue->ExecuteCommandList(commandList);
+        AddPresentConversionPass(graph, segment, texture, presentTexture);
         return;
     }
 
     // Bloom
     if (EnableBloom)
     {
-        ApplyBloom(commandList, texture);
+        texture = AddBloomPasses(graph, segment, texture);
     }
-    commandList->FlushResourceBarriers();
 
     // Exposure
 
     // Tone Mapping
-    ApplyToneMapping(commandList, texture, presentTexture);
+    AddToneMappingPass(graph, segment, texture, presentTexture);
 
     // Gamma Correction
     if (EnableGammaCorrection)
     {
-        ApplyGammaCorrection(commandList, presentTexture);
+        AddGammaCorrectionPass(graph, segment, presentTexture);
     }
-
-    commandQueue->ExecuteCommandList(commandList);
 }
 
-void PostProcessing::Resize(uint32_t width, uint32_t height)
+RenderGraph::ResourceHandle PostProcessing::AddBloomPasses(RenderGraph& graph, uint32_t segment, RenderGraph::ResourceHandle texture)
 {
-    PPBloom::ResizeUAVs(width, height);
-}
+    const D3D12_RESOURCE_DESC& textureDesc = graph.GetDesc(texture);
+    uint32_t bloomWidth = 0, bloomHeight = 0;
+    PPBloom::GetBloomSize((uint32_t)textureDesc.Width, textureDesc.Height, bloomWidth, bloomHeight);
 
-void PostProcessing::ApplyBloom(std::shared_ptr<CommandList> commandList, std::shared_ptr<Texture> texture)
-{
-    ScopedTimer _prof(L"Bloom");
-    PPBloom::ApplyBloom(commandList, texture, BloomThreshold, BloomUpsampleFactor, BloomStrength);
+    // Each level of the blur chain has a buffer blurred from and one blurred into. Most are only alive for a couple of passes, so they share memory
+    RenderGraph::ResourceHandle buffers[5][2];
+    CD3DX12_RESOURCE_DESC bufferDesc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R16G16B16A16_FLOAT, bloomWidth, bloomHeight, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    for (uint32_t i = 0; i < 5; i++)
+    {
+        buffers[i][0] = graph.CreateTransientTexture(L"Bloom Buffer " + std::to_wstring(i + 1) + L"a", bufferDesc);
+        buffers[i][1] = graph.CreateTransientTexture(L"Bloom Buffer " + std::to_wstring(i + 1) + L"b", bufferDesc);
+        bufferDesc.Width /= 2;
+        bufferDesc.Height /= 2;
+    }
+
+    CD3DX12_RESOURCE_DESC lumaDesc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8_UNORM, bloomWidth, bloomHeight, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    RenderGraph::ResourceHandle lumaBuffer = graph.CreateTransientTexture(L"Bloom Luma Buffer", lumaDesc);
+    CD3DX12_RESOURCE_DESC outputDesc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R16G16B16A16_FLOAT, textureDesc.Width, textureDesc.Height, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    RenderGraph::ResourceHandle output = graph.CreateTransientTexture(L"Bloom Output", outputDesc);
+
+    uint32_t pass = graph.AddPass(L"Bloom Extract", segment, [=, this](RenderGraph& renderGraph, std::shared_ptr<CommandList> commandList)
+        {
+            PPBloom::ExtractBloom(commandList, renderGraph.GetTexture(texture), renderGraph.GetTexture(buffers[0][0]), BloomThreshold);
+        });
+    graph.Read(pass, texture, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    graph.Write(pass, buffers[0][0], D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+    pass = graph.AddPass(L"Bloom Downsample", segment, [=](RenderGraph& renderGraph, std::shared_ptr<CommandList> commandList)
+        {
+            std::shared_ptr<Texture> downsampledBuffers[4];
+            for (uint32_t i = 0; i < 4; i++)
+                downsampledBuffers[i] = renderGraph.GetTexture(buffers[i + 1][0]);
+            PPBloom::DownsampleBloom(commandList, renderGraph.GetTexture(buffers[0][0]), downsampledBuffers);
+        });
+    graph.Read(pass, buffers[0][0], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    for (uint32_t i = 1; i < 5; i++)
+        graph.Write(pass, buffers[i][0], D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+    // The smallest buffer is blurred on its own, then each one above it is blurred and blended with the one below
+    pass = graph.AddPass(L"Bloom Blur", segment, [=](RenderGraph& renderGraph, std::shared_ptr<CommandList> commandList)
+        {
+            std::shared_ptr<Texture> blurBuffers[2] = { renderGraph.GetTexture(buffers[4][0]), renderGraph.GetTexture(buffers[4][1]) };
+            PPBlur::BlurTexture(commandList, blurBuffers, blurBuffers[0], 1.0f);
+        });
+    graph.Read(pass, buffers[4][0], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    graph.Write(pass, buffers[4][1], D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+    for (int32_t i = 3; i >= 0; i--)
+    {
+        pass = graph.AddPass(L"Bloom Upsample " + std::to_wstring(i + 1), segment, [=, this](RenderGraph& renderGraph, std::shared_ptr<CommandList> commandList)
+            {
+                std::shared_ptr<Texture> blurBuffers[2] = { renderGraph.GetTexture(buffers[i][0]), renderGraph.GetTexture(buffers[i][1]) };
+                std::shared_ptr<Texture> lowerResBuffer = renderGraph.GetTexture(buffers[i + 1][1]);
+                PPBlur::BlurTexture(commandList, blurBuffers, lowerResBuffer, BloomUpsampleFactor);
+            });
+        graph.Read(pass, buffers[i][0], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+        graph.Read(pass, buffers[i + 1][1], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+        graph.Write(pass, buffers[i][1], D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    }
+
+    pass = graph.AddPass(L"Bloom Apply", segment, [=, this](RenderGraph& renderGraph, std::shared_ptr<CommandList> commandList)
+        {
+            PPBloom::ApplyBloom(commandList, renderGraph.GetTexture(buffers[0][1]), renderGraph.GetTexture(texture), renderGraph.GetTexture(output), renderGraph.GetTexture(lumaBuffer), BloomStrength);
+        });
+    graph.Read(pass, buffers[0][1], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    graph.Read(pass, texture, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    graph.Write(pass, output, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    graph.Write(pass, lumaBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+    return output;
 }
 
-void PostProcessing::ApplyToneMapping(std::shared_ptr<CommandList> commandList, std::shared_ptr<Texture> texture, std::shared_ptr<Texture> presentTexture)
+void PostProcessing::AddToneMappingPass(RenderGraph& graph, uint32_t segment, RenderGraph::ResourceHandle texture, RenderGraph::ResourceHandle presentTexture)
 {
-    ScopedTimer _prof(L"Tone Mapping");
-    // Always apply tone mapping to convert down to presentTexture's format. If tone mapping is disabled then pass a none tonemapper
-    PPToneMapping::ApplyToneMapping(commandList, texture, presentTexture, EnableToneMapping ? ToneMapper : PPToneMapping::ToneMappers::None);
+    uint32_t pass = graph.AddPass(L"Tone Mapping", segment, [=, this](RenderGraph& renderGraph, std::shared_ptr<CommandList> commandList)
+        {
+            // Always apply tone mapping to convert down to presentTexture's format. If tone mapping is disabled then pass a none tonemapper
+            PPToneMapping::ApplyToneMapping(commandList, renderGraph.GetTexture(texture), renderGraph.GetTexture(presentTexture), EnableToneMapping ? ToneMapper : PPToneMapping::ToneMappers::None);
+        });
+    graph.Read(pass, texture, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    graph.Write(pass, presentTexture, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 }
 
-void PostProcessing::ApplyGammaCorrection(std::shared_ptr<CommandList> commandList, std::shared_ptr<Texture> presentTexture)
+void PostProcessing::AddGammaCorrectionPass(RenderGraph& graph, uint32_t segment, RenderGraph::ResourceHandle presentTexture)
 {
-    ScopedTimer _prof(L"Gamma Correction");
-    PPGammaCorrection::ApplyGammaCorrection(commandList, presentTexture, GammaCorrection);
+    uint32_t pass = graph.AddPass(L"Gamma Correction", segment, [=, this](RenderGraph& renderGraph, std::shared_ptr<CommandList> commandList)
+        {
+            PPGammaCorrection::ApplyGammaCorrection(commandList, renderGraph.GetTexture(presentTexture), GammaCorrection);
+        });
+    graph.Read(pass, presentTexture, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    graph.Write(pass, presentTexture, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 }
 
-void PostProcessing::ApplyPresentConversion(std::shared_ptr<CommandList> commandList, std::shared_ptr<Texture> texture, std::shared_ptr<Texture> presentTexture)
+void PostProcessing::AddPresentConversionPass(RenderGraph& graph, uint32_t segment, RenderGraph::ResourceHandle texture, RenderGraph::ResourceHandle presentTexture)
 {
-    ScopedTimer _prof(L"Present Conversion");
-    // Tone mapping converts, so let's just use that instead
-    PPToneMapping::ApplyToneMapping(commandList, texture, presentTexture, PPToneMapping::ToneMappers::None);
-}
\ No newline at end of file
+    uint32_t pass = graph.AddPass(L"Present Conversion", segment, [=](RenderGraph& renderGraph, std::shared_ptr<CommandList> commandList)
+        {
+            // Tone mapping converts, so let's just use that instead
+            PPToneMapping::ApplyToneMapping(commandList, renderGraph.GetTexture(texture), renderGraph.GetTexture(presentTexture), PPToneMapping::ToneMappers::None);
+        });
+    graph.Read(pass, texture, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    graph.Write(pass, presentTexture, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+}
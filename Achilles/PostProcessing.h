@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ShaderInclude.h"
+#include "RenderGraph.h"
 #include "shaders/PPBloom.h"
 #include "shaders/PPToneMapping.h"
 #include "shaders/PPGammaCorrection.h"
@@ -22,20 +23,17 @@ public:
     bool EnableGammaCorrection = true;
     float GammaCorrection = 1.6f;
 
-protected:
-
-
 public:
-    PostProcessing(float width, float height);
+    PostProcessing();
     virtual ~PostProcessing();
 
-    virtual void ApplyPostProcessing(std::shared_ptr<Texture> texture, std::shared_ptr<Texture> presentTexture, bool postProcessingEnable);
-    virtual void Resize(uint32_t width, uint32_t height);
+    // Declares the passes taking texture to presentTexture in segment, which should be a compute segment
+    virtual void AddPasses(RenderGraph& graph, uint32_t segment, RenderGraph::ResourceHandle texture, RenderGraph::ResourceHandle presentTexture, bool postProcessingEnable);
 
 protected:
-    virtual void ApplyBloom(std::shared_ptr<CommandList> commandList, std::shared_ptr<Texture> texture);
-    virtual void ApplyToneMapping(std::shared_ptr<CommandList> commandList, std::shared_ptr<Texture> texture, std::shared_ptr<Texture> presentTexture);
-    virtual void ApplyGammaCorrection(std::shared_ptr<CommandList> commandList, std::shared_ptr<Texture> presentTexture);
-    virtual void ApplyPresentConversion(std::shared_ptr<CommandList> commandList, std::shared_ptr<Texture> texture, std::shared_ptr<Texture> presentTexture);
+    // Returns a transient the size of texture with the bloom added
+    virtual RenderGraph::ResourceHandle AddBloomPasses(RenderGraph& graph, uint32_t segment, RenderGraph::ResourceHandle texture);
+    virtual void AddToneMappingPass(RenderGraph& graph, uint32_t segment, RenderGraph::ResourceHandle texture, RenderGraph::ResourceHandle presentTexture);
+    virtual void AddGammaCorrectionPass(RenderGraph& graph, uint32_t segment, RenderGraph::ResourceHandle presentTexture);
+    virtual void AddPresentConversionPass(RenderGraph& graph, uint32_t segment, RenderGraph::ResourceHandle texture, RenderGraph::ResourceHandle presentTexture);
 };
-
@@ -109,13 +109,16 @@ void Profiling::Print()
 ScopedTimer::ScopedTimer(const std::wstring& name)
 {
 #if defined(_DEBUG) || defined(_UNOPTIMIZED)
-    Profiling::BeginBlock(name);
+    recording = std::this_thread::get_id() == Profiling::ProfilerThreadId;
+    if (recording)
+        Profiling::BeginBlock(name);
 #endif
 }
 
 ScopedTimer::~ScopedTimer()
 {
 #if defined(_DEBUG) || defined(_UNOPTIMIZED)
-    Profiling::EndBlock();
+    if (recording)
+        Profiling::EndBlock();
 #endif
 }
@@ -5,6 +5,7 @@
 #include <map>
 #include <chrono>
 #include <algorithm>
+#include <thread>
 
 class Profiling
 {
@@ -28,6 +29,8 @@ public:
     inline static std::map<std::wstring, std::shared_ptr<ProfilerBlock>> ProfilerBlocksByFullname{};
 
     inline static bool ProfilerShouldPrint = false;
+    // The block stack isn't thread safe, so only this thread (the one that started the application) records blocks
+    inline static std::thread::id ProfilerThreadId = std::this_thread::get_id();
 
     static void BeginBlock(const std::wstring& name);
     static void EndBlock();
@@ -40,4 +43,8 @@ class ScopedTimer
 public:
     ScopedTimer(const std::wstring& name);
     ~ScopedTimer();
+
+protected:
+    // False on threads other than Profiling::ProfilerThreadId, e.g. workers and the content loading thread
+    bool recording = false;
 };
\ No newline at end of file
@@ -0,0 +1,727 @@
+#include "RenderGraph.h"
+#include "Application.h"
+#include "CommandList.h"
+#include "CommandQueue.h"
+#include "ResourceStateTracker.h"
+#include "Texture.h"
+#include "Profiling.h"
+#include <algorithm>
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+    alignment = std::max<uint64_t>(alignment, 1);
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static bool IsReadOnlyState(D3D12_RESOURCE_STATES state)
+{
+    constexpr D3D12_RESOURCE_STATES readStates = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_INDEX_BUFFER | D3D12_RESOURCE_STATE_DEPTH_READ
+        | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT
+        | D3D12_RESOURCE_STATE_COPY_SOURCE | D3D12_RESOURCE_STATE_RESOLVE_SOURCE;
+    return state != D3D12_RESOURCE_STATE_COMMON && (state & ~readStates) == 0;
+}
+
+static bool IsSameDesc(const D3D12_RESOURCE_DESC& a, const D3D12_RESOURCE_DESC& b)
+{
+    return a.Dimension == b.Dimension && a.Alignment == b.Alignment && a.Width == b.Width && a.Height == b.Height && a.DepthOrArraySize == b.DepthOrArraySize
+        && a.MipLevels == b.MipLevels && a.Format == b.Format && a.SampleDesc.Count == b.SampleDesc.Count && a.SampleDesc.Quality == b.SampleDesc.Quality
+        && a.Layout == b.Layout && a.Flags == b.Flags;
+}
+
+uint32_t RenderGraph::AddSegment(D3D12_COMMAND_LIST_TYPE type)
+{
+    Segment segment;
+    segment.Type = type;
+    segments.push_back(segment);
+    compiled = false;
+    return (uint32_t)segments.size() - 1;
+}
+
+uint32_t RenderGraph::AddPass(const std::wstring& name, uint32_t segment, ExecuteFunction execute)
+{
+    if (segment >= segments.size())
+        throw std::exception("Render graph pass added to a segment that doesn't exist");
+    if (!passes.empty() && segment < passes.back().Segment)
+        throw std::exception("Render graph passes must be added in segment order");
+
+    Pass pass;
+    pass.Name = name;
+    pass.Segment = segment;
+    pass.Execute = execute;
+    passes.push_back(pass);
+    compiled = false;
+    return (uint32_t)passes.size() - 1;
+}
+
+void RenderGraph::Read(uint32_t pass, ResourceHandle resource, D3D12_RESOURCE_STATES state)
+{
+    AddAccess(pass, resource, state, false);
+}
+
+void RenderGraph::Write(uint32_t pass, ResourceHandle resource, D3D12_RESOURCE_STATES state)
+{
+    AddAccess(pass, resource, state, true);
+}
+
+void RenderGraph::AddAccess(uint32_t pass, ResourceHandle resource, D3D12_RESOURCE_STATES state, bool write)
+{
+    if (pass >= passes.size() || resource.Index >= resources.size())
+        throw std::exception("Render graph access to a pass or resource that doesn't exist");
+    if (!IsStateValidOnQueue(state, segments[passes[pass].Segment].Type))
+        throw std::exception("Render graph access in a state its pass's queue can't use");
+
+    compiled = false;
+    for (Access& access : passes[pass].Accesses)
+    {
+        if (access.Resource != resource.Index)
+            continue;
+        if (access.State != state)
+            throw std::exception("Render graph pass uses a resource in two states");
+
+        access.Read |= !write;
+        access.Write |= write;
+        return;
+    }
+
+    passes[pass].Accesses.push_back({ resource.Index, state, !write, write });
+}
+
+RenderGraph::ResourceHandle RenderGraph::ImportTexture(const std::wstring& name, std::shared_ptr<Texture> texture)
+{
+    if (texture == nullptr)
+        throw std::exception("Render graph can't import a null texture");
+
+    ResourceEntry entry;
+    entry.Name = name;
+    entry.Desc = texture->GetD3D12ResourceDesc();
+    entry.Texture = texture;
+    resources.push_back(entry);
+    compiled = false;
+    return ResourceHandle{ (uint32_t)resources.size() - 1 };
+}
+
+RenderGraph::ResourceHandle RenderGraph::CreateTransient(const std::wstring& name, const D3D12_RESOURCE_DESC& desc, uint64_t size, uint64_t alignment)
+{
+    if (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER || desc.Dimension == D3D12_RESOURCE_DIMENSION_UNKNOWN)
+        throw std::exception("Render graph transients must be textures");
+
+    ResourceEntry entry;
+    entry.Name = name;
+    entry.Desc = desc;
+    entry.Transient = true;
+    entry.Size = size;
+    entry.Alignment = alignment;
+    bool target = (desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)) != 0;
+    entry.Group = target ? HeapGroupTargets : HeapGroupTextures;
+    resources.push_back(entry);
+    compiled = false;
+    return ResourceHandle{ (uint32_t)resources.size() - 1 };
+}
+
+RenderGraph::ResourceHandle RenderGraph::CreateTransientTexture(const std::wstring& name, const D3D12_RESOURCE_DESC& desc)
+{
+    D3D12_RESOURCE_ALLOCATION_INFO info = Application::GetD3D12Device()->GetResourceAllocationInfo(0, 1, &desc);
+    return CreateTransient(name, desc, info.SizeInBytes, info.Alignment);
+}
+
+const D3D12_RESOURCE_DESC& RenderGraph::GetDesc(ResourceHandle resource) const
+{
+    return resources.at(resource.Index).Desc;
+}
+
+std::shared_ptr<Texture> RenderGraph::GetTexture(ResourceHandle resource) const
+{
+    return resources.at(resource.Index).Texture;
+}
+
+void RenderGraph::Compile()
+{
+    ScopedTimer _prof(L"RenderGraph::Compile");
+
+    statistics = Statistics{};
+    passOrder.clear();
+    for (Pass& pass : passes)
+    {
+        pass.Culled = false;
+        pass.Barriers.clear();
+    }
+    for (Segment& segment : segments)
+        segment.EndBarriers.clear();
+
+    CullPasses();
+    ComputeLifetimes();
+    PlaceTransients();
+    PlanBarriers();
+
+    statistics.Passes = (uint32_t)passOrder.size();
+    statistics.CulledPasses = (uint32_t)(passes.size() - passOrder.size());
+    compiled = true;
+}
+
+void RenderGraph::CullPasses()
+{
+    // Walking back from the end, a pass is kept if something after it reads what it writes
+    // Imported resources are always needed, and passes that don't write anything the graph knows about are assumed to have other side effects
+    std::vector<bool> needed(resources.size());
+    for (size_t i = 0; i < resources.size(); i++)
+        needed[i] = !resources[i].Transient;
+
+    for (size_t i = passes.size(); i-- > 0;)
+    {
+        Pass& pass = passes[i];
+        bool writes = false, used = false;
+        for (const Access& access : pass.Accesses)
+        {
+            if (!access.Write)
+                continue;
+            writes = true;
+            used |= needed[access.Resource];
+        }
+
+        pass.Culled = writes && !used;
+        if (pass.Culled)
+            continue;
+
+        // Anything written here is only needed before this pass if it's read here too
+        for (const Access& access : pass.Accesses)
+        {
+            if (access.Write)
+                needed[access.Resource] = !resources[access.Resource].Transient;
+        }
+        for (const Access& access : pass.Accesses)
+        {
+            if (access.Read)
+                needed[access.Resource] = true;
+        }
+    }
+
+    for (uint32_t i = 0; i < (uint32_t)passes.size(); i++)
+    {
+        if (!passes[i].Culled)
+            passOrder.push_back(i);
+    }
+}
+
+void RenderGraph::ComputeLifetimes()
+{
+    for (ResourceEntry& resource : resources)
+    {
+        resource.FirstPosition = UINT32_MAX;
+        resource.LastPosition = 0;
+        resource.Aliased = false;
+        resource.Placed = SIZE_MAX;
+        if (resource.Transient)
+            resource.Texture = nullptr;
+    }
+
+    for (uint32_t position = 0; position < (uint32_t)passOrder.size(); position++)
+    {
+        for (const Access& access : passes[passOrder[position]].Accesses)
+        {
+            ResourceEntry& resource = resources[access.Resource];
+            if (resource.FirstPosition == UINT32_MAX)
+            {
+                if (resource.Transient && access.Read)
+                    throw std::exception("Render graph transient is read before it's written");
+                resource.FirstPosition = position;
+                resource.FirstState = access.State;
+            }
+            resource.LastPosition = position;
+            resource.LastState = access.State;
+        }
+    }
+}
+
+void RenderGraph::PlaceTransients()
+{
+    for (uint32_t group = 0; group < HeapGroupCount; group++)
+    {
+        heapBytes[group] = 0;
+        heapAlignments[group] = 0;
+
+        std::vector<uint32_t> order;
+        for (uint32_t i = 0; i < (uint32_t)resources.size(); i++)
+        {
+            ResourceEntry& resource = resources[i];
+            if (!resource.Transient || resource.Group != group || resource.FirstPosition == UINT32_MAX)
+                continue;
+
+            resource.Aliasable = group == HeapGroupTextures || resource.FirstState == D3D12_RESOURCE_STATE_RENDER_TARGET || resource.FirstState == D3D12_RESOURCE_STATE_DEPTH_WRITE;
+            statistics.TransientBytes += resource.Size;
+            order.push_back(i);
+        }
+
+        // Largest first, so the small ones fill the gaps left between them
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+            {
+                if (resources[a].Size != resources[b].Size)
+                    return resources[a].Size > resources[b].Size;
+                return a < b;
+            });
+
+        auto conflicts = [&](const ResourceEntry& a, const ResourceEntry& b)
+            {
+                if (!AliasTransients || !a.Aliasable || !b.Aliasable)
+                    return true;
+                return a.FirstPosition <= b.LastPosition && b.FirstPosition <= a.LastPosition;
+            };
+
+        std::vector<uint32_t> placed;
+        for (uint32_t i : order)
+        {
+            ResourceEntry& resource = resources[i];
+
+            // The lowest offset clear of everything already placed that's alive at the same time
+            std::vector<uint64_t> candidates{ 0 };
+            for (uint32_t j : placed)
+            {
+                if (conflicts(resource, resources[j]))
+                    candidates.push_back(AlignUp(resources[j].Offset + resources[j].Size, resource.Alignment));
+            }
+            std::sort(candidates.begin(), candidates.end());
+
+            for (uint64_t candidate : candidates)
+            {
+                bool fits = true;
+                for (uint32_t j : placed)
+                {
+                    const ResourceEntry& other = resources[j];
+                    if (conflicts(resource, other) && candidate < other.Offset + other.Size && other.Offset < candidate + resource.Size)
+                    {
+                        fits = false;
+                        break;
+                    }
+                }
+                if (fits)
+                {
+                    resource.Offset = candidate;
+                    break;
+                }
+            }
+
+            heapBytes[group] = std::max<uint64_t>(heapBytes[group], resource.Offset + resource.Size);
+            heapAlignments[group] = std::max<uint64_t>(heapAlignments[group], resource.Alignment);
+            placed.push_back(i);
+        }
+
+        // Anything sharing memory with another transient, this frame or the next, needs an aliasing barrier before its first use
+        for (uint32_t i : order)
+        {
+            for (uint32_t j : order)
+            {
+                if (i != j && resources[i].Offset < resources[j].Offset + resources[j].Size && resources[j].Offset < resources[i].Offset + resources[i].Size)
+                {
+                    resources[i].Aliased = true;
+                    break;
+                }
+            }
+        }
+
+        statistics.HeapBytes += heapBytes[group];
+    }
+}
+
+std::vector<RenderGraph::Usage> RenderGraph::GetUsages(uint32_t resource) const
+{
+    std::vector<Usage> usages;
+    for (uint32_t position = 0; position < (uint32_t)passOrder.size(); position++)
+    {
+        const Pass& pass = passes[passOrder[position]];
+        for (const Access& access : pass.Accesses)
+        {
+            if (access.Resource != resource)
+                continue;
+
+            if (!usages.empty() && usages.back().Segment == pass.Segment)
+            {
+                Usage& last = usages.back();
+                // Reads in a row share one transition into every state they need
+                bool reads = !access.Write && IsReadOnlyState(access.State) && !last.Write && IsReadOnlyState(last.State);
+                // As do writes in the same state, other than UAVs which need a barrier between them
+                bool sameState = access.State == last.State && (access.State & D3D12_RESOURCE_STATE_UNORDERED_ACCESS) == 0;
+                if (reads || sameState)
+                {
+                    last.State |= access.State;
+                    last.LastPosition = position;
+                    last.Write |= access.Write;
+                    continue;
+                }
+            }
+
+            usages.push_back({ position, position, pass.Segment, access.State, access.Write });
+        }
+    }
+    return usages;
+}
+
+void RenderGraph::PlanBarriers()
+{
+    for (uint32_t r = 0; r < (uint32_t)resources.size(); r++)
+    {
+        ResourceEntry& resource = resources[r];
+        std::vector<Usage> usages = GetUsages(r);
+        if (usages.empty())
+            continue;
+        resource.LastState = usages.back().State;
+
+        for (size_t k = 0; k < usages.size(); k++)
+        {
+            const Usage& usage = usages[k];
+            Pass& pass = passes[passOrder[usage.FirstPosition]];
+
+            if (k == 0)
+            {
+                if (resource.Transient && resource.Aliased)
+                {
+                    // The transient that finished with the memory last this frame, if there was one
+                    Barrier aliasing{ BarrierType::Aliasing, r };
+                    for (uint32_t o = 0; o < (uint32_t)resources.size(); o++)
+                    {
+                        const ResourceEntry& other = resources[o];
+                        if (o == r || !other.Transient || other.Group != resource.Group || other.FirstPosition == UINT32_MAX || other.LastPosition >= usage.FirstPosition)
+                            continue;
+                        if (other.Offset >= resource.Offset + resource.Size || resource.Offset >= other.Offset + other.Size)
+                            continue;
+                        if (aliasing.AliasedResource == UINT32_MAX || other.LastPosition >= resources[aliasing.AliasedResource].LastPosition)
+                            aliasing.AliasedResource = o;
+                    }
+                    pass.Barriers.push_back(aliasing);
+                }
+
+                Barrier transition{ BarrierType::Transition, r };
+                transition.StateAfter = usage.State;
+                transition.FirstUse = true;
+                pass.Barriers.push_back(transition);
+                continue;
+            }
+
+            const Usage& previous = usages[k - 1];
+            if (previous.State == usage.State)
+            {
+                if (usage.State & D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+                    pass.Barriers.push_back(Barrier{ BarrierType::UAV, r });
+                continue;
+            }
+
+            Barrier transition{ BarrierType::Transition, r };
+            transition.StateBefore = previous.State;
+            transition.StateAfter = usage.State;
+
+            if (previous.Segment == usage.Segment)
+            {
+                // Passes in a segment are contiguous, so the one after the producer is in the same command list
+                if (SplitBarriers && usage.FirstPosition > previous.LastPosition + 1)
+                {
+                    Barrier begin = transition;
+                    begin.Type = BarrierType::SplitBegin;
+                    passes[passOrder[previous.LastPosition + 1]].Barriers.push_back(begin);
+                    transition.Type = BarrierType::SplitEnd;
+                }
+                pass.Barriers.push_back(transition);
+            }
+            else if (IsStateValidOnQueue(previous.State, segments[previous.Segment].Type) && IsStateValidOnQueue(usage.State, segments[previous.Segment].Type))
+            {
+                // Leaving the producer's command list ready, e.g. so a compute list never sees a render target state
+                segments[previous.Segment].EndBarriers.push_back(transition);
+            }
+            else if (IsStateValidOnQueue(previous.State, segments[usage.Segment].Type))
+            {
+                pass.Barriers.push_back(transition);
+            }
+            else
+            {
+                throw std::exception("Render graph resource can't be transitioned on either queue");
+            }
+        }
+    }
+
+    std::vector<const std::vector<Barrier>*> batches;
+    for (uint32_t passIndex : passOrder)
+        batches.push_back(&passes[passIndex].Barriers);
+    for (const Segment& segment : segments)
+        batches.push_back(&segment.EndBarriers);
+
+    for (const std::vector<Barrier>* batch : batches)
+    {
+        if (batch->empty())
+            continue;
+
+        statistics.Batches++;
+        for (const Barrier& barrier : *batch)
+        {
+            switch (barrier.Type)
+            {
+            case BarrierType::Transition:
+                statistics.Transitions++;
+                break;
+            case BarrierType::SplitBegin:
+                statistics.SplitBarriers++;
+                break;
+            case BarrierType::SplitEnd:
+                break;
+            case BarrierType::UAV:
+                statistics.UAVBarriers++;
+                break;
+            case BarrierType::Aliasing:
+                statistics.AliasingBarriers++;
+                break;
+            }
+        }
+    }
+}
+
+std::shared_ptr<CommandList> RenderGraph::Execute(std::shared_ptr<CommandList> commandList)
+{
+    ScopedTimer _prof(L"RenderGraph::Execute");
+
+    if (!compiled)
+        Compile();
+    if (segments.empty())
+        return commandList;
+    if (commandList != nullptr && commandList->GetCommandListType() != segments[0].Type)
+        throw std::exception("Render graph's first segment is a different type to its command list");
+
+    AcquireTransients();
+
+    std::vector<bool> splitBegun(resources.size());
+    size_t next = 0;
+    for (uint32_t s = 0; s < (uint32_t)segments.size(); s++)
+    {
+        const Segment& segment = segments[s];
+        std::shared_ptr<CommandQueue> commandQueue = Application::GetCommandQueue(segment.Type);
+        if (s > 0 || commandList == nullptr)
+            commandList = commandQueue->GetCommandList();
+
+        // Heaps can be replaced while earlier frames still use them
+        for (const TransientHeap& heap : heaps)
+        {
+            if (heap.Heap != nullptr)
+                commandList->TrackObject(heap.Heap);
+        }
+
+        for (; next < passOrder.size() && passes[passOrder[next]].Segment == s; next++)
+        {
+            Pass& pass = passes[passOrder[next]];
+            RecordBarriers(*commandList, pass.Barriers, splitBegun);
+
+            ScopedTimer _prof2(pass.Name);
+            pass.Execute(*this, commandList);
+        }
+        RecordBarriers(*commandList, segment.EndBarriers, splitBegun);
+
+        if (s + 1 == segments.size())
+            break;
+
+        commandQueue->ExecuteCommandList(commandList);
+        if (segments[s + 1].Type != segment.Type)
+            Application::GetCommandQueue(segments[s + 1].Type)->Wait(*commandQueue);
+    }
+
+    // Next frame's first use of each placed texture starts from where this frame left it
+    for (ResourceEntry& resource : resources)
+    {
+        if (resource.Transient && resource.Placed != SIZE_MAX)
+            placedTextures[resource.Placed].State = resource.LastState;
+    }
+
+    return commandList;
+}
+
+void RenderGraph::AcquireTransients()
+{
+    uint64_t frame = Application::GetGlobalFrameCounter();
+    auto device = Application::GetD3D12Device();
+
+    std::erase_if(placedTextures, [&](const PlacedTexture& placed)
+        {
+            if (frame - placed.LastUsed <= EvictAfterFrames)
+                return false;
+            ResourceStateTracker::RemoveGlobalResourceState(placed.Texture->GetD3D12Resource().Get());
+            return true;
+        });
+
+    for (uint32_t group = 0; group < HeapGroupCount; group++)
+    {
+        TransientHeap& heap = heaps[group];
+        if (heapBytes[group] == 0 || (heap.Heap != nullptr && heap.Size >= heapBytes[group] && heap.Alignment >= heapAlignments[group]))
+            continue;
+
+        // Textures placed in the old heap are kept alive by the command lists that used them until they're done
+        std::erase_if(placedTextures, [&](const PlacedTexture& placed)
+            {
+                if (placed.Group != group)
+                    return false;
+                ResourceStateTracker::RemoveGlobalResourceState(placed.Texture->GetD3D12Resource().Get());
+                return true;
+            });
+
+        heap.Alignment = heapAlignments[group];
+        heap.Size = AlignUp(heapBytes[group], heap.Alignment);
+        D3D12_HEAP_FLAGS flags = group == HeapGroupTargets ? D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES : D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES;
+        CD3DX12_HEAP_DESC heapDesc(heap.Size, D3D12_HEAP_TYPE_DEFAULT, heap.Alignment, flags);
+        ThrowIfFailed(device->CreateHeap(&heapDesc, IID_PPV_ARGS(&heap.Heap)));
+        heap.Heap->SetName(group == HeapGroupTargets ? L"Render Graph Targets Heap" : L"Render Graph Textures Heap");
+    }
+
+    for (PlacedTexture& placed : placedTextures)
+        placed.InUse = false;
+
+    for (ResourceEntry& resource : resources)
+    {
+        if (!resource.Transient || resource.FirstPosition == UINT32_MAX)
+            continue;
+
+        // Each transient gets its own texture even when an identical one sits at the same offset, so their states are tracked apart
+        D3D12_COMMAND_LIST_TYPE firstType = segments[passes[passOrder[resource.FirstPosition]].Segment].Type;
+        auto iter = std::find_if(placedTextures.begin(), placedTextures.end(), [&](const PlacedTexture& placed)
+            {
+                return !placed.InUse && placed.Group == resource.Group && placed.Offset == resource.Offset && IsSameDesc(placed.Desc, resource.Desc) && IsStateValidOnQueue(placed.State, firstType);
+            });
+
+        if (iter == placedTextures.end())
+        {
+            ComPtr<ID3D12Resource> d3d12Resource;
+            ThrowIfFailed(device->CreatePlacedResource(heaps[resource.Group].Heap.Get(), resource.Offset, &resource.Desc, resource.FirstState, nullptr, IID_PPV_ARGS(&d3d12Resource)));
+            ResourceStateTracker::AddGlobalResourceState(d3d12Resource.Get(), resource.FirstState);
+
+            PlacedTexture placed;
+            placed.Group = resource.Group;
+            placed.Offset = resource.Offset;
+            placed.Desc = resource.Desc;
+            placed.Texture = std::make_shared<Texture>(d3d12Resource, nullptr, TextureUsage::Generic, resource.Name);
+            placed.State = resource.FirstState;
+            placedTextures.push_back(placed);
+            iter = placedTextures.end() - 1;
+        }
+        else if (iter->Texture->GetName() != resource.Name)
+        {
+            iter->Texture->SetName(resource.Name);
+        }
+
+        iter->InUse = true;
+        iter->LastUsed = frame;
+        resource.Placed = iter - placedTextures.begin();
+        resource.Texture = iter->Texture;
+    }
+}
+
+void RenderGraph::RecordBarriers(CommandList& commandList, const std::vector<Barrier>& barriers, std::vector<bool>& splitBegun)
+{
+    if (barriers.empty())
+        return;
+
+    // Everything goes through the command list's tracker so state changes made inside passes are still followed, and the batch is flushed as one
+    ResourceStateTracker& tracker = *commandList.resourceStateTracker;
+    std::vector<ID3D12Resource*> discards;
+    for (const Barrier& barrier : barriers)
+    {
+        const ResourceEntry& resource = resources[barrier.Resource];
+        ID3D12Resource* d3d12Resource = resource.Texture->GetD3D12Resource().Get();
+
+        switch (barrier.Type)
+        {
+        case BarrierType::Transition:
+            if (barrier.FirstUse && resource.Transient)
+                tracker.SetResourceState(d3d12Resource, placedTextures[resource.Placed].State);
+            tracker.TransitionResource(d3d12Resource, barrier.StateAfter);
+            break;
+        case BarrierType::SplitBegin:
+            splitBegun[barrier.Resource] = tracker.SplitTransitionResource(d3d12Resource, barrier.StateAfter, true);
+            break;
+        case BarrierType::SplitEnd:
+            if (!splitBegun[barrier.Resource] || !tracker.SplitTransitionResource(d3d12Resource, barrier.StateAfter, false))
+                tracker.TransitionResource(d3d12Resource, barrier.StateAfter);
+            splitBegun[barrier.Resource] = false;
+            break;
+        case BarrierType::UAV:
+            tracker.UAVBarrier(resource.Texture.get());
+            break;
+        case BarrierType::Aliasing:
+        {
+            const Resource* aliased = barrier.AliasedResource != UINT32_MAX ? resources[barrier.AliasedResource].Texture.get() : nullptr;
+            tracker.AliasBarrier(aliased, resource.Texture.get());
+            // Render and depth targets need their contents discarding once they take over the memory
+            if (resource.Group == HeapGroupTargets)
+                discards.push_back(d3d12Resource);
+            break;
+        }
+        }
+
+        commandList.TrackResource(*resource.Texture);
+    }
+
+    commandList.FlushResourceBarriers();
+    for (ID3D12Resource* d3d12Resource : discards)
+        commandList.GetGraphicsCommandList()->DiscardResource(d3d12Resource, nullptr);
+}
+
+const std::vector<uint32_t>& RenderGraph::GetPassOrder() const
+{
+    return passOrder;
+}
+
+bool RenderGraph::IsCulled(uint32_t pass) const
+{
+    return passes.at(pass).Culled;
+}
+
+const std::vector<RenderGraph::Barrier>& RenderGraph::GetBarriersBefore(uint32_t pass) const
+{
+    return passes.at(pass).Barriers;
+}
+
+const std::vector<RenderGraph::Barrier>& RenderGraph::GetSegmentEndBarriers(uint32_t segment) const
+{
+    return segments.at(segment).EndBarriers;
+}
+
+bool RenderGraph::GetLifetime(ResourceHandle resource, uint32_t& firstPosition, uint32_t& lastPosition) const
+{
+    const ResourceEntry& entry = resources.at(resource.Index);
+    if (entry.FirstPosition == UINT32_MAX)
+        return false;
+
+    firstPosition = entry.FirstPosition;
+    lastPosition = entry.LastPosition;
+    return true;
+}
+
+uint64_t RenderGraph::GetHeapOffset(ResourceHandle resource) const
+{
+    return resources.at(resource.Index).Offset;
+}
+
+RenderGraph::Statistics RenderGraph::GetStatistics() const
+{
+    return statistics;
+}
+
+bool RenderGraph::IsStateValidOnQueue(D3D12_RESOURCE_STATES state, D3D12_COMMAND_LIST_TYPE type)
+{
+    D3D12_RESOURCE_STATES allowed = D3D12_RESOURCE_STATE_COMMON;
+    switch (type)
+    {
+    case D3D12_COMMAND_LIST_TYPE_DIRECT:
+        return true;
+    case D3D12_COMMAND_LIST_TYPE_COMPUTE:
+        allowed = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_UNORDERED_ACCESS | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE
+            | D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT | D3D12_RESOURCE_STATE_COPY_DEST | D3D12_RESOURCE_STATE_COPY_SOURCE;
+        break;
+    case D3D12_COMMAND_LIST_TYPE_COPY:
+        allowed = D3D12_RESOURCE_STATE_COPY_DEST | D3D12_RESOURCE_STATE_COPY_SOURCE;
+        break;
+    default:
+        return false;
+    }
+    return (state & ~allowed) == 0;
+}
+
+void RenderGraph::Release()
+{
+    for (PlacedTexture& placed : placedTextures)
+        ResourceStateTracker::RemoveGlobalResourceState(placed.Texture->GetD3D12Resource().Get());
+    placedTextures.clear();
+
+    for (TransientHeap& heap : heaps)
+        heap = TransientHeap{};
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstdint>
+#include <d3d12.h>
+#include <wrl.h>
+
+using Microsoft::WRL::ComPtr;
+
+class CommandList;
+class Texture;
+
+// Frame graph each frame's passes are declared into, along with the resources every pass reads and writes
+// Compile culls passes whose output is never used, finds each transient's lifetime, places transients that are never alive at the same time
+// in the same memory and plans the barriers between passes, batched per pass and split over the passes in between where it can
+// Compile only looks at the declarations, so it can be driven and checked without a device. Execute records and submits the passes
+class RenderGraph
+{
+public:
+    // Transients that are never alive at the same time share memory in the placed heaps
+    inline static bool AliasTransients = true;
+    // Transitions with passes between the producer and consumer begin after one and end before the other
+    inline static bool SplitBarriers = true;
+    // Placed textures that haven't been used for this many frames are released
+    inline static uint32_t EvictAfterFrames = 120;
+
+    struct ResourceHandle
+    {
+        uint32_t Index = UINT32_MAX;
+
+        bool IsValid() const
+        {
+            return Index != UINT32_MAX;
+        }
+    };
+
+    using ExecuteFunction = std::function<void(RenderGraph& graph, std::shared_ptr<CommandList> commandList)>;
+
+    enum class BarrierType
+    {
+        Transition,
+        SplitBegin,
+        SplitEnd,
+        UAV,
+        Aliasing
+    };
+
+    struct Barrier
+    {
+        BarrierType Type = BarrierType::Transition;
+        uint32_t Resource = UINT32_MAX;
+        // Aliasing barriers only, the transient that last used the memory this frame or UINT32_MAX when it was one from an earlier frame
+        uint32_t AliasedResource = UINT32_MAX;
+        // Unknown for a resource's first use in the frame, which starts from wherever it was left
+        D3D12_RESOURCE_STATES StateBefore = D3D12_RESOURCE_STATE_COMMON;
+        D3D12_RESOURCE_STATES StateAfter = D3D12_RESOURCE_STATE_COMMON;
+        bool FirstUse = false;
+    };
+
+    struct Statistics
+    {
+        uint32_t Passes = 0;
+        uint32_t CulledPasses = 0;
+        uint32_t Transitions = 0;
+        uint32_t SplitBarriers = 0; // Begin and end pairs
+        uint32_t UAVBarriers = 0;
+        uint32_t AliasingBarriers = 0;
+        uint32_t Batches = 0; // Places barriers are flushed together
+        uint64_t TransientBytes = 0; // What the transients would take on their own
+        uint64_t HeapBytes = 0; // What they take once aliased
+    };
+
+    // Segments are executed in the order they're added, each as one command list on its type's queue
+    uint32_t AddSegment(D3D12_COMMAND_LIST_TYPE type);
+    // Passes run in the order they're added, so a pass can't be added to a segment before the last pass's
+    uint32_t AddPass(const std::wstring& name, uint32_t segment, ExecuteFunction execute);
+    // A pass can read and write a resource in the same state, but not use it in two states
+    void Read(uint32_t pass, ResourceHandle resource, D3D12_RESOURCE_STATES state);
+    void Write(uint32_t pass, ResourceHandle resource, D3D12_RESOURCE_STATES state);
+
+    // A texture that lives outside the graph. Its first use each frame is resolved by the command list's state tracker
+    ResourceHandle ImportTexture(const std::wstring& name, std::shared_ptr<Texture> texture);
+    // A texture that only lives between its first and last use this frame. size and alignment are as ID3D12Device::GetResourceAllocationInfo gives them
+    ResourceHandle CreateTransient(const std::wstring& name, const D3D12_RESOURCE_DESC& desc, uint64_t size, uint64_t alignment);
+    // Gets the size and alignment from the device
+    ResourceHandle CreateTransientTexture(const std::wstring& name, const D3D12_RESOURCE_DESC& desc);
+
+    const D3D12_RESOURCE_DESC& GetDesc(ResourceHandle resource) const;
+    // Transients only have a texture while the graph executes
+    std::shared_ptr<Texture> GetTexture(ResourceHandle resource) const;
+
+    void Compile();
+    // Records every segment's passes and executes them in order, with each queue waiting for the one before when it changes
+    // commandList is used for the first segment. The last segment's command list is returned without being executed, so more can be recorded on it
+    std::shared_ptr<CommandList> Execute(std::shared_ptr<CommandList> commandList);
+
+    // The passes left after culling, in the order they run
+    const std::vector<uint32_t>& GetPassOrder() const;
+    bool IsCulled(uint32_t pass) const;
+    const std::vector<Barrier>& GetBarriersBefore(uint32_t pass) const;
+    const std::vector<Barrier>& GetSegmentEndBarriers(uint32_t segment) const;
+    // Positions in GetPassOrder of the first and last pass using the resource. False if nothing that survived culling uses it
+    bool GetLifetime(ResourceHandle resource, uint32_t& firstPosition, uint32_t& lastPosition) const;
+    uint64_t GetHeapOffset(ResourceHandle resource) const;
+    Statistics GetStatistics() const;
+
+    // Whether a command list of the type can transition a resource into or out of the state
+    static bool IsStateValidOnQueue(D3D12_RESOURCE_STATES state, D3D12_COMMAND_LIST_TYPE type);
+    static void Release();
+
+protected:
+    // Tier 1 heaps can't mix render and depth targets with other textures, so they're placed in separate heaps
+    enum HeapGroup
+    {
+        HeapGroupTextures,
+        HeapGroupTargets,
+        HeapGroupCount
+    };
+
+    struct Access
+    {
+        uint32_t Resource;
+        D3D12_RESOURCE_STATES State;
+        bool Read;
+        bool Write;
+    };
+
+    struct Pass
+    {
+        std::wstring Name;
+        uint32_t Segment = 0;
+        ExecuteFunction Execute;
+        std::vector<Access> Accesses;
+        bool Culled = false;
+        std::vector<Barrier> Barriers;
+    };
+
+    struct Segment
+    {
+        D3D12_COMMAND_LIST_TYPE Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
+        std::vector<Barrier> EndBarriers;
+    };
+
+    struct ResourceEntry
+    {
+        std::wstring Name;
+        D3D12_RESOURCE_DESC Desc{};
+        bool Transient = false;
+        std::shared_ptr<Texture> Texture;
+
+        // Transients only
+        uint64_t Size = 0;
+        uint64_t Alignment = 0;
+        HeapGroup Group = HeapGroupTextures;
+        // Render and depth targets can only share memory when their first use can discard what was there
+        bool Aliasable = true;
+        uint64_t Offset = 0;
+        bool Aliased = false;
+        D3D12_RESOURCE_STATES FirstState = D3D12_RESOURCE_STATE_COMMON;
+        D3D12_RESOURCE_STATES LastState = D3D12_RESOURCE_STATE_COMMON;
+        size_t Placed = SIZE_MAX;
+
+        uint32_t FirstPosition = UINT32_MAX;
+        uint32_t LastPosition = 0;
+    };
+
+    // Consecutive uses of a resource in one state, so a run of reads in a segment needs one transition
+    struct Usage
+    {
+        uint32_t FirstPosition;
+        uint32_t LastPosition;
+        uint32_t Segment;
+        D3D12_RESOURCE_STATES State;
+        bool Write;
+    };
+
+    void AddAccess(uint32_t pass, ResourceHandle resource, D3D12_RESOURCE_STATES state, bool write);
+    void CullPasses();
+    void ComputeLifetimes();
+    void PlaceTransients();
+    void PlanBarriers();
+    std::vector<Usage> GetUsages(uint32_t resource) const;
+
+    void AcquireTransients();
+    void RecordBarriers(CommandList& commandList, const std::vector<Barrier>& barriers, std::vector<bool>& splitBegun);
+
+    std::vector<Pass> passes;
+    std::vector<Segment> segments;
+    std::vector<ResourceEntry> resources;
+    std::vector<uint32_t> passOrder;
+    bool compiled = false;
+    Statistics statistics;
+    uint64_t heapBytes[HeapGroupCount] = {};
+    uint64_t heapAlignments[HeapGroupCount] = {};
+
+    // Heaps and the textures placed in them are kept between frames, and only replaced when the plan no longer fits
+    struct TransientHeap
+    {
+        ComPtr<ID3D12Heap> Heap;
+        uint64_t Size = 0;
+        uint64_t Alignment = 0;
+    };
+
+    struct PlacedTexture
+    {
+        HeapGroup Group = HeapGroupTextures;
+        uint64_t Offset = 0;
+        D3D12_RESOURCE_DESC Desc{};
+        std::shared_ptr<Texture> Texture;
+        // The state it was left in, which its first use in the next frame starts from
+        D3D12_RESOURCE_STATES State = D3D12_RESOURCE_STATE_COMMON;
+        uint64_t LastUsed = 0;
+        bool InUse = false;
+    };
+
+    inline static TransientHeap heaps[HeapGroupCount];
+    inline static std::vector<PlacedTexture> placedTextures;
+};
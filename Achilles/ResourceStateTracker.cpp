@@ -90,6 +90,32 @@ void ResourceStateTracker::AliasBarrier(const Resource* resourceBefore, const Re
     ResourceBarrier(CD3DX12_RESOURCE_BARRIER::Aliasing(pResourceBefore, pResourceAfter));
 }
 
+void ResourceStateTracker::SetResourceState(ID3D12Resource* resource, D3D12_RESOURCE_STATES state)
+{
+    if (resource)
+    {
+        finalResourceState[resource].SetSubresourceState(D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, state);
+    }
+}
+
+bool ResourceStateTracker::SplitTransitionResource(ID3D12Resource* resource, D3D12_RESOURCE_STATES stateAfter, bool begin)
+{
+    const auto iter = finalResourceState.find(resource);
+    if (iter == finalResourceState.end() || !iter->second.SubresourceState.empty())
+        return false;
+
+    // The known state doesn't change until the end half, so both halves have the same before state
+    D3D12_RESOURCE_STATES stateBefore = iter->second.State;
+    if (stateBefore == stateAfter)
+        return false;
+
+    D3D12_RESOURCE_BARRIER_FLAGS flags = begin ? D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY : D3D12_RESOURCE_BARRIER_FLAG_END_ONLY;
+    resourceBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(resource, stateBefore, stateAfter, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, flags));
+    if (!begin)
+        iter->second.SetSubresourceState(D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, stateAfter);
+    return true;
+}
+
 void ResourceStateTracker::FlushResourceBarriers(CommandList& commandList)
 {
     UINT numBarriers = static_cast<UINT>(resourceBarriers.size());
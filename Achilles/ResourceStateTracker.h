@@ -38,6 +38,13 @@ public:
  // Either the beforeResource or the afterResource parameters can be NULL which indicates that any placed or reserved resource could cause aliasing.
     void AliasBarrier(const Resource* resourceBefore = nullptr, const Resource* resourceAfter = nullptr);
 
+    // Set the state a resource is known to be in on this command list without pushing a barrier, for resources whose state is kept elsewhere
+    void SetResourceState(ID3D12Resource* resource, D3D12_RESOURCE_STATES state);
+
+    // Push one half of a split transition barrier. Returns false without pushing anything if the resource's state on this command list isn't known or already matches
+    // The end half sets the resource's state, so nothing else should transition it between the two halves
+    bool SplitTransitionResource(ID3D12Resource* resource, D3D12_RESOURCE_STATES stateAfter, bool begin);
+
     // Flush any pending resource barriers to the command list
     // Returns the number of resource barriers that were flushed to the command list
     uint32_t FlushPendingResourceBarriers(CommandList& commandList);
@@ -1,17 +1,48 @@
 #include "Shader.h"
 #include "Application.h"
+#include "ContentPack.h"
 #include "RootSignature.h"
+#include "ShaderCache.h"
+#include "ShaderCompiler.h"
 #include "Texture.h"
+#include "TextureResidency.h"
 
-HRESULT CompileShader(std::wstring shaderPath, std::wstring entry, std::wstring profile, ComPtr<IDxcBlob>& outShader)
+// Resolves #includes from the content pack, falling back to the default handler for files that aren't packed
+class ContentPackIncludeHandler : public Microsoft::WRL::RuntimeClass<Microsoft::WRL::RuntimeClassFlags<Microsoft::WRL::ClassicCom>, IDxcIncludeHandler>
+{
+public:
+    ContentPackIncludeHandler(ComPtr<IDxcUtils> _utils, ComPtr<IDxcIncludeHandler> _defaultHandler) : utils(_utils), defaultHandler(_defaultHandler) {}
+
+    HRESULT STDMETHODCALLTYPE LoadSource(LPCWSTR filename, IDxcBlob** includeSource) override
+    {
+        ContentPack::File packedFile;
+        if (!ContentPack::Read(filename, packedFile))
+            return defaultHandler->LoadSource(filename, includeSource);
+
+        ComPtr<IDxcBlobEncoding> blob;
+        HRESULT hr = utils->CreateBlob(packedFile.Data, static_cast<UINT32>(packedFile.Size), DXC_CP_ACP, &blob);
+        if (SUCCEEDED(hr))
+            *includeSource = blob.Detach();
+        return hr;
+    }
+
+protected:
+    ComPtr<IDxcUtils> utils;
+    ComPtr<IDxcIncludeHandler> defaultHandler;
+};
+
+HRESULT CompileShader(std::wstring shaderPath, std::wstring entry, std::wstring profile, ComPtr<IDxcBlob>& outShader, const std::vector<std::wstring>& defines)
 {
     ComPtr<IDxcUtils> utils;
     ComPtr<IDxcCompiler3> compiler;
     ThrowIfFailed(::DxcCreateInstance(CLSID_DxcUtils, IID_PPV_ARGS(&utils)));
     ThrowIfFailed(::DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&compiler)));
 
-    ComPtr<IDxcIncludeHandler> includeHandler;
-    ThrowIfFailed(utils->CreateDefaultIncludeHandler(&includeHandler));
+    ComPtr<IDxcIncludeHandler> defaultIncludeHandler;
+    ThrowIfFailed(utils->CreateDefaultIncludeHandler(&defaultIncludeHandler));
+    ComPtr<IDxcIncludeHandler> includeHandler = defaultIncludeHandler;
+    if (ContentPack::IsMounted())
+        includeHandler = Microsoft::WRL::Make<ContentPackIncludeHandler>(utils, defaultIncludeHandler);
 
     std::vector<LPCWSTR> compilationArguments
     {
@@ -26,15 +57,29 @@ HRESULT CompileShader(std::wstring shaderPath, std::wstring entry, std::wstring
     compilationArguments.push_back(DXC_ARG_OPTIMIZATION_LEVEL3);
 #endif
 
+    for (const std::wstring& define : defines)
+    {
+        compilationArguments.push_back(L"-D");
+        compilationArguments.push_back(define.c_str());
+    }
+
     ComPtr<IDxcBlobEncoding> source = nullptr;
 
-    std::error_code ec;
-    if (!std::filesystem::exists(shaderPath, ec))
+    ContentPack::File packedFile;
+    if (ContentPack::Read(shaderPath, packedFile))
     {
-        throw std::exception("File does not exist");
+        ThrowIfFailed(utils->CreateBlob(packedFile.Data, static_cast<UINT32>(packedFile.Size), DXC_CP_ACP, &source));
     }
+    else
+    {
+        std::error_code ec;
+        if (!std::filesystem::exists(shaderPath, ec))
+        {
+            throw std::exception("File does not exist");
+        }
 
-    ThrowIfFailed(utils->LoadFile(shaderPath.c_str(), nullptr, &source));
+        ThrowIfFailed(utils->LoadFile(shaderPath.c_str(), nullptr, &source));
+    }
 
     DxcBuffer sourceBuffer
     {
@@ -43,6 +88,14 @@ HRESULT CompileShader(std::wstring shaderPath, std::wstring entry, std::wstring
         .Encoding = DXC_CP_ACP,
     };
 
+    std::wstring cachePath;
+    if (ShaderCache::Enabled)
+    {
+        cachePath = ShaderCache::GetCachePath(compiler.Get(), includeHandler.Get(), sourceBuffer, shaderPath, entry, compilationArguments);
+        if (!cachePath.empty() && ShaderCache::Load(utils.Get(), cachePath, outShader))
+            return S_OK;
+    }
+
     ComPtr<IDxcResult> compiledShader{};
     HRESULT hr = compiler->Compile(&sourceBuffer, compilationArguments.data(), static_cast<uint32_t>(compilationArguments.size()), includeHandler.Get(), IID_PPV_ARGS(&compiledShader));
 
@@ -110,6 +163,9 @@ HRESULT CompileShader(std::wstring shaderPath, std::wstring entry, std::wstring
 
     outShader = shader;
 
+    if (!cachePath.empty())
+        ShaderCache::Store(cachePath, shader.Get());
+
     return S_OK;
 }
 
@@ -132,6 +188,7 @@ void Shader::BindTexture(CommandList& commandList, uint32_t rootParamIndex, uint
 {
     if (texture && texture->IsValid())
     {
+        TextureResidency::Touch(*texture);
         commandList.SetShaderResourceView(rootParamIndex, offset, *texture, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
     }
     else
@@ -144,6 +201,7 @@ void Shader::BindTexture(CommandList& commandList, uint32_t rootParamIndex, uint
 {
     if (texture != nullptr && texture->IsValid())
     {
+        TextureResidency::Touch(*texture);
         commandList.SetShaderResourceView(rootParamIndex, offset, *texture, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
     }
     else
@@ -152,7 +210,63 @@ void Shader::BindTexture(CommandList& commandList, uint32_t rootParamIndex, uint
     }
 }
 
-std::shared_ptr<Shader> Shader::ShaderVSPS(ComPtr<ID3D12Device2> device, D3D12_INPUT_ELEMENT_DESC* _vertexLayout, UINT vertexLayoutCount, size_t _vertexSize, std::shared_ptr<RootSignature> rootSignature, ShaderRender _renderCallback, std::wstring shaderName, D3D12_CULL_MODE cullMode, bool enableTransparency, DXGI_FORMAT rtvFormat)
+std::vector<std::wstring> Shader::GetPermutationDefines(ShaderPermutationKey key) const
+{
+    std::vector<std::wstring> defines = { L"PERMUTATION" };
+    for (size_t i = 0; i < permutationDefines.size(); i++)
+    {
+        if (key.Has(1u << i))
+            defines.push_back(permutationDefines[i]);
+    }
+    return defines;
+}
+
+std::shared_ptr<Shader> Shader::GetPermutation(ShaderPermutationKey key)
+{
+    if (permutationCreateCallback == nullptr)
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(permutationMutex);
+    auto iter = permutations.find(key.Features);
+    if (iter == permutations.end())
+    {
+        // Compiled off the render thread, anything drawn with this key uses the uber shader in the meantime
+        ShaderPermutationCreation create = permutationCreateCallback;
+        Permutation permutation;
+        permutation.Pending = std::async(std::launch::async, [create, key]() { return create(key); }).share();
+        permutations[key.Features] = permutation;
+        return nullptr;
+    }
+
+    Permutation& permutation = iter->second;
+    if (permutation.Ready != nullptr || permutation.Failed)
+        return permutation.Ready;
+    if (permutation.Pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return nullptr;
+
+    try
+    {
+        permutation.Ready = permutation.Pending.get();
+    }
+    catch (const std::exception& e)
+    {
+        OutputDebugStringWFormatted(L"Failed to create permutation 0x%X of %s: %S\n", key.Features, name.c_str(), e.what());
+    }
+    permutation.Failed = permutation.Ready == nullptr;
+    permutation.Pending = {};
+    return permutation.Ready;
+}
+
+std::shared_ptr<Shader> Shader::ResolvePermutation(std::shared_ptr<Shader> shader, std::shared_ptr<Object> object, uint32_t knitIndex, std::shared_ptr<Mesh> mesh, Material& material)
+{
+    if (!PermutationsEnabled || shader->permutationKeyCallback == nullptr)
+        return shader;
+
+    std::shared_ptr<Shader> permutation = shader->GetPermutation(shader->permutationKeyCallback(object, knitIndex, mesh, material));
+    return permutation != nullptr ? permutation : shader;
+}
+
+std::shared_ptr<Shader> Shader::ShaderVSPS(ComPtr<ID3D12Device2> device, D3D12_INPUT_ELEMENT_DESC* _vertexLayout, UINT vertexLayoutCount, size_t _vertexSize, std::shared_ptr<RootSignature> rootSignature, ShaderRender _renderCallback, std::wstring shaderName, D3D12_CULL_MODE cullMode, bool enableTransparency, DXGI_FORMAT rtvFormat, const std::vector<std::wstring>& defines)
 {
     std::shared_ptr<Shader> shader = std::make_shared<Shader>(shaderName, _vertexLayout, _vertexSize, _renderCallback);
     shader->rootSignature = rootSignature;
@@ -160,12 +274,14 @@ std::shared_ptr<Shader> Shader::ShaderVSPS(ComPtr<ID3D12Device2> device, D3D12_I
 
     std::wstring shaderPath = GetContentDirectoryW() + L"shaders/" + shaderName + L".hlsl";
 
-    // Compile shaders at runtime
+    // Compile shaders at runtime, queueing every stage before waiting on any so they compile in parallel
+    auto startTime = std::chrono::steady_clock::now();
+    std::shared_future<ComPtr<IDxcBlob>> vertexStage = ShaderCompiler::CompileAsync(shaderPath, L"VS", L"vs_6_4", defines);
+    std::shared_future<ComPtr<IDxcBlob>> pixelStage = ShaderCompiler::CompileAsync(shaderPath, L"PS", L"ps_6_4", defines);
 
-    ComPtr<IDxcBlob> vertexShader;
-    ComPtr<IDxcBlob> pixelShader;
-    ThrowIfFailed(CompileShader(shaderPath, L"VS", L"vs_6_4", vertexShader));
-    ThrowIfFailed(CompileShader(shaderPath, L"PS", L"ps_6_4", pixelShader));
+    ComPtr<IDxcBlob> vertexShader = vertexStage.get();
+    ComPtr<IDxcBlob> pixelShader = pixelStage.get();
+    auto stagesReadyTime = std::chrono::steady_clock::now();
 
     if (vertexShader == nullptr || pixelShader == nullptr)
         throw std::exception("Shader(s) did not compile");
@@ -264,6 +380,8 @@ std::shared_ptr<Shader> Shader::ShaderVSPS(ComPtr<ID3D12Device2> device, D3D12_I
 
     shader->defaultSRV = std::make_shared<ShaderResourceView>(nullptr, &SRV);
 
+    ShaderCompiler::RecordShaderTiming(shaderName, startTime, stagesReadyTime);
+
     return shader;
 }
 
@@ -275,12 +393,14 @@ std::shared_ptr<Shader> Shader::ShaderDepthOnlyVSPS(ComPtr<ID3D12Device2> device
 
     std::wstring shaderPath = GetContentDirectoryW() + L"shaders/" + shaderName + L".hlsl";
 
-    // Compile shaders at runtime
+    // Compile shaders at runtime, queueing every stage before waiting on any so they compile in parallel
+    auto startTime = std::chrono::steady_clock::now();
+    std::shared_future<ComPtr<IDxcBlob>> vertexStage = ShaderCompiler::CompileAsync(shaderPath, L"VS", L"vs_6_4");
+    std::shared_future<ComPtr<IDxcBlob>> pixelStage = ShaderCompiler::CompileAsync(shaderPath, L"PS", L"ps_6_4");
 
-    ComPtr<IDxcBlob> vertexShader;
-    ComPtr<IDxcBlob> pixelShader;
-    ThrowIfFailed(CompileShader(shaderPath, L"VS", L"vs_6_4", vertexShader));
-    ThrowIfFailed(CompileShader(shaderPath, L"PS", L"ps_6_4", pixelShader));
+    ComPtr<IDxcBlob> vertexShader = vertexStage.get();
+    ComPtr<IDxcBlob> pixelShader = pixelStage.get();
+    auto stagesReadyTime = std::chrono::steady_clock::now();
 
     if (vertexShader == nullptr || pixelShader == nullptr)
         throw std::exception("Shader(s) did not compile");
@@ -356,6 +476,8 @@ std::shared_ptr<Shader> Shader::ShaderDepthOnlyVSPS(ComPtr<ID3D12Device2> device
 
     shader->defaultSRV = std::make_shared<ShaderResourceView>(nullptr, &SRV);
 
+    ShaderCompiler::RecordShaderTiming(shaderName, startTime, stagesReadyTime);
+
     return shader;
 }
 
@@ -367,14 +489,16 @@ std::shared_ptr<Shader> Shader::ShaderDepthOnlyVSGSPS(ComPtr<ID3D12Device2> devi
 
     std::wstring shaderPath = GetContentDirectoryW() + L"shaders/" + shaderName + L".hlsl";
 
-    // Compile shaders at runtime
+    // Compile shaders at runtime, queueing every stage before waiting on any so they compile in parallel
+    auto startTime = std::chrono::steady_clock::now();
+    std::shared_future<ComPtr<IDxcBlob>> vertexStage = ShaderCompiler::CompileAsync(shaderPath, L"VS", L"vs_6_4");
+    std::shared_future<ComPtr<IDxcBlob>> pixelStage = ShaderCompiler::CompileAsync(shaderPath, L"PS", L"ps_6_4");
+    std::shared_future<ComPtr<IDxcBlob>> geometryStage = ShaderCompiler::CompileAsync(shaderPath, L"GS", L"gs_6_4");
 
-    ComPtr<IDxcBlob> vertexShader;
-    ComPtr<IDxcBlob> pixelShader;
-    ComPtr<IDxcBlob> geometryShader;
-    ThrowIfFailed(CompileShader(shaderPath, L"VS", L"vs_6_4", vertexShader));
-    ThrowIfFailed(CompileShader(shaderPath, L"PS", L"ps_6_4", pixelShader));
-    ThrowIfFailed(CompileShader(shaderPath, L"GS", L"gs_6_4", geometryShader));
+    ComPtr<IDxcBlob> vertexShader = vertexStage.get();
+    ComPtr<IDxcBlob> pixelShader = pixelStage.get();
+    ComPtr<IDxcBlob> geometryShader = geometryStage.get();
+    auto stagesReadyTime = std::chrono::steady_clock::now();
 
     if (vertexShader == nullptr || pixelShader == nullptr || geometryShader == nullptr)
         throw std::exception("Shader(s) did not compile");
@@ -452,6 +576,8 @@ std::shared_ptr<Shader> Shader::ShaderDepthOnlyVSGSPS(ComPtr<ID3D12Device2> devi
 
     shader->defaultSRV = std::make_shared<ShaderResourceView>(nullptr, &SRV);
 
+    ShaderCompiler::RecordShaderTiming(shaderName, startTime, stagesReadyTime);
+
     return shader;
 }
 
@@ -463,12 +589,14 @@ std::shared_ptr<Shader> Shader::ShaderSkyboxVSPS(ComPtr<ID3D12Device2> device, D
 
     std::wstring shaderPath = GetContentDirectoryW() + L"shaders/" + shaderName + L".hlsl";
 
-    // Compile shaders at runtime
+    // Compile shaders at runtime, queueing every stage before waiting on any so they compile in parallel
+    auto startTime = std::chrono::steady_clock::now();
+    std::shared_future<ComPtr<IDxcBlob>> vertexStage = ShaderCompiler::CompileAsync(shaderPath, L"VS", L"vs_6_4");
+    std::shared_future<ComPtr<IDxcBlob>> pixelStage = ShaderCompiler::CompileAsync(shaderPath, L"PS", L"ps_6_4");
 
-    ComPtr<IDxcBlob> vertexShader;
-    ComPtr<IDxcBlob> pixelShader;
-    ThrowIfFailed(CompileShader(shaderPath, L"VS", L"vs_6_4", vertexShader));
-    ThrowIfFailed(CompileShader(shaderPath, L"PS", L"ps_6_4", pixelShader));
+    ComPtr<IDxcBlob> vertexShader = vertexStage.get();
+    ComPtr<IDxcBlob> pixelShader = pixelStage.get();
+    auto stagesReadyTime = std::chrono::steady_clock::now();
 
     if (vertexShader == nullptr || pixelShader == nullptr)
         throw std::exception("Shader(s) did not compile");
@@ -553,6 +681,8 @@ std::shared_ptr<Shader> Shader::ShaderSkyboxVSPS(ComPtr<ID3D12Device2> device, D
 
     shader->defaultSRV = std::make_shared<ShaderResourceView>(nullptr, &SRV);
 
+    ShaderCompiler::RecordShaderTiming(shaderName, startTime, stagesReadyTime);
+
     return shader;
 }
 
@@ -564,12 +694,14 @@ std::shared_ptr<Shader> Shader::ShaderWireframeVSPS(ComPtr<ID3D12Device2> device
 
     std::wstring shaderPath = GetContentDirectoryW() + L"shaders/" + shaderName + L".hlsl";
 
-    // Compile shaders at runtime
+    // Compile shaders at runtime, queueing every stage before waiting on any so they compile in parallel
+    auto startTime = std::chrono::steady_clock::now();
+    std::shared_future<ComPtr<IDxcBlob>> vertexStage = ShaderCompiler::CompileAsync(shaderPath, L"VS", L"vs_6_4");
+    std::shared_future<ComPtr<IDxcBlob>> pixelStage = ShaderCompiler::CompileAsync(shaderPath, L"PS", L"ps_6_4");
 
-    ComPtr<IDxcBlob> vertexShader;
-    ComPtr<IDxcBlob> pixelShader;
-    ThrowIfFailed(CompileShader(shaderPath, L"VS", L"vs_6_4", vertexShader));
-    ThrowIfFailed(CompileShader(shaderPath, L"PS", L"ps_6_4", pixelShader));
+    ComPtr<IDxcBlob> vertexShader = vertexStage.get();
+    ComPtr<IDxcBlob> pixelShader = pixelStage.get();
+    auto stagesReadyTime = std::chrono::steady_clock::now();
 
     if (vertexShader == nullptr || pixelShader == nullptr)
         throw std::exception("Shader(s) did not compile");
@@ -645,10 +777,12 @@ std::shared_ptr<Shader> Shader::ShaderWireframeVSPS(ComPtr<ID3D12Device2> device
 
     shader->defaultSRV = std::make_shared<ShaderResourceView>(nullptr, &SRV);
 
+    ShaderCompiler::RecordShaderTiming(shaderName, startTime, stagesReadyTime);
+
     return shader;
 }
 
-std::shared_ptr<Shader> Shader::ShaderCS(ComPtr<ID3D12Device2> device, std::shared_ptr<RootSignature> rootSignature, std::wstring shaderName)
+std::shared_ptr<Shader> Shader::ShaderCS(ComPtr<ID3D12Device2> device, std::shared_ptr<RootSignature> rootSignature, std::wstring shaderName, const std::vector<std::wstring>& defines)
 {
     std::shared_ptr<Shader> shader = std::make_shared<Shader>(shaderName);
     shader->rootSignature = rootSignature;
@@ -657,9 +791,9 @@ std::shared_ptr<Shader> Shader::ShaderCS(ComPtr<ID3D12Device2> device, std::shar
     std::wstring shaderPath = GetContentDirectoryW() + L"shaders/" + shaderName + L".hlsl";
 
     // Compile shaders at runtime
-
-    ComPtr<IDxcBlob> computeShader;
-    ThrowIfFailed(CompileShader(shaderPath, L"CS", L"cs_6_4", computeShader));
+    auto startTime = std::chrono::steady_clock::now();
+    ComPtr<IDxcBlob> computeShader = ShaderCompiler::CompileAsync(shaderPath, L"CS", L"cs_6_4", defines).get();
+    auto stagesReadyTime = std::chrono::steady_clock::now();
 
     if (computeShader == nullptr)
         throw std::exception("Shader did not compile");
@@ -681,5 +815,7 @@ std::shared_ptr<Shader> Shader::ShaderCS(ComPtr<ID3D12Device2> device, std::shar
 
     shader->pipelineState->SetName(shaderName.c_str());
 
+    ShaderCompiler::RecordShaderTiming(shaderName, startTime, stagesReadyTime);
+
     return shader;
 }
@@ -5,6 +5,9 @@
 #include <wrl.h>
 #include <dxgi1_6.h>
 #include <directx-dxc/dxcapi.h>
+#include <future>
+#include <map>
+#include <mutex>
 #include "CommandList.h"
 #include "ShaderResourceView.h"
 
@@ -34,7 +37,28 @@ typedef std::shared_ptr<Mesh> (CALLBACK* MeshCreation)(aiScene* scene, aiNode* n
 
 typedef bool (CALLBACK* IsKnitTransparent)(std::shared_ptr<Object> object, uint32_t knitIndex, std::shared_ptr<Mesh> mesh, Material material);
 
-HRESULT CompileShader(std::wstring shaderPath, std::wstring entry, std::wstring profile, ComPtr<IDxcResult>& outShader);
+// Compile time features of a shader permutation. Each set bit is compiled in as the #define at the same index in Shader::permutationDefines
+struct ShaderPermutationKey
+{
+    uint32_t Features = 0;
+
+    constexpr ShaderPermutationKey() = default;
+    constexpr explicit ShaderPermutationKey(uint32_t features) : Features(features) {}
+
+    constexpr bool Has(uint32_t feature) const { return (Features & feature) == feature; }
+    constexpr ShaderPermutationKey With(uint32_t feature, bool enabled = true) const { return ShaderPermutationKey(enabled ? (Features | feature) : (Features & ~feature)); }
+
+    constexpr bool operator==(const ShaderPermutationKey& other) const = default;
+};
+
+// Returns the features a knit needs, so it can be drawn with the cheapest permutation that covers them
+typedef ShaderPermutationKey (CALLBACK* ShaderPermutationKeyResolve)(std::shared_ptr<Object> object, uint32_t knitIndex, std::shared_ptr<Mesh> mesh, Material& material);
+
+// Creates the permutation for key, normally by calling a Shader factory with Shader::GetPermutationDefines(key). Called off the render thread
+typedef std::shared_ptr<Shader> (CALLBACK* ShaderPermutationCreation)(ShaderPermutationKey key);
+
+// Compile an entry point from an HLSL file, loading it from the ShaderCache when it hasn't changed since it was last compiled
+HRESULT CompileShader(std::wstring shaderPath, std::wstring entry, std::wstring profile, ComPtr<IDxcBlob>& outShader, const std::vector<std::wstring>& defines = {});
 
 class Shader
 {
@@ -55,6 +79,14 @@ public:
     MeshCreation meshCreateCallback = nullptr;
     IsKnitTransparent knitTransparencyCallback = nullptr;
 
+    // Permutations compile features in or out with #defines rather than branching on them per pixel. The shader itself is the
+    // uber shader with every feature, which is drawn with until the permutation a knit resolves to has finished compiling
+    inline static bool PermutationsEnabled = true;
+    ShaderPermutationKeyResolve permutationKeyCallback = nullptr;
+    ShaderPermutationCreation permutationCreateCallback = nullptr;
+    // #define for each feature bit. PERMUTATION is always defined for permutations so the source can tell them apart from the uber shader
+    std::vector<std::wstring> permutationDefines;
+
     Shader(std::wstring _name);
     Shader(std::wstring _name, D3D12_INPUT_ELEMENT_DESC* _vertexLayout, size_t _vertexSize);
     Shader(std::wstring _name, D3D12_INPUT_ELEMENT_DESC* _vertexLayout, size_t _vertexSize, ShaderRender _renderCallback);
@@ -63,14 +95,32 @@ public:
     void BindTexture(CommandList& commandList, uint32_t rootParamIndex, uint32_t offset, std::shared_ptr<Texture>& texture);
     void BindTexture(CommandList& commandList, uint32_t rootParamIndex, uint32_t offset, Texture* texture);
 
+    std::vector<std::wstring> GetPermutationDefines(ShaderPermutationKey key) const;
+    // The compiled permutation for key, or nullptr while it's compiling (which this starts) or if it failed to compile
+    std::shared_ptr<Shader> GetPermutation(ShaderPermutationKey key);
+    // The shader to draw the knit with: its permutation if the shader has them and it's ready, otherwise the shader itself
+    static std::shared_ptr<Shader> ResolvePermutation(std::shared_ptr<Shader> shader, std::shared_ptr<Object> object, uint32_t knitIndex, std::shared_ptr<Mesh> mesh, Material& material);
+
     // Presumes shader file is contains two entrypoints - VS + PS for vertex and pixel shaders respectively
-    static std::shared_ptr<Shader> ShaderVSPS(ComPtr<ID3D12Device2> device, D3D12_INPUT_ELEMENT_DESC* _vertexLayout, UINT vertexLayoutCount, size_t _vertexSize, std::shared_ptr<RootSignature> rootSignature, ShaderRender _renderCallback, std::wstring shaderName, D3D12_CULL_MODE cullMode = D3D12_CULL_MODE_BACK, bool enableTransparency = false, DXGI_FORMAT rtvFormat = DXGI_FORMAT_R16G16B16A16_FLOAT);
+    static std::shared_ptr<Shader> ShaderVSPS(ComPtr<ID3D12Device2> device, D3D12_INPUT_ELEMENT_DESC* _vertexLayout, UINT vertexLayoutCount, size_t _vertexSize, std::shared_ptr<RootSignature> rootSignature, ShaderRender _renderCallback, std::wstring shaderName, D3D12_CULL_MODE cullMode = D3D12_CULL_MODE_BACK, bool enableTransparency = false, DXGI_FORMAT rtvFormat = DXGI_FORMAT_R16G16B16A16_FLOAT, const std::vector<std::wstring>& defines = {});
     static std::shared_ptr<Shader> ShaderDepthOnlyVSPS(ComPtr<ID3D12Device2> device, D3D12_INPUT_ELEMENT_DESC* _vertexLayout, UINT vertexLayoutCount, size_t _vertexSize, std::shared_ptr<RootSignature> rootSignature, std::wstring shaderName, uint32_t depthBias = 100);
     static std::shared_ptr<Shader> ShaderDepthOnlyVSGSPS(ComPtr<ID3D12Device2> device, D3D12_INPUT_ELEMENT_DESC* _vertexLayout, UINT vertexLayoutCount, size_t _vertexSize, std::shared_ptr<RootSignature> rootSignature, std::wstring shaderName, uint32_t depthBias = 100);
     static std::shared_ptr<Shader> ShaderSkyboxVSPS(ComPtr<ID3D12Device2> device, D3D12_INPUT_ELEMENT_DESC* _vertexLayout, UINT vertexLayoutCount, size_t _vertexSize, std::shared_ptr<RootSignature> rootSignature, ShaderRender _renderCallback, std::wstring shaderName);
     static std::shared_ptr<Shader> ShaderWireframeVSPS(ComPtr<ID3D12Device2> device, D3D12_INPUT_ELEMENT_DESC* _vertexLayout, UINT vertexLayoutCount, size_t _vertexSize, std::shared_ptr<RootSignature> rootSignature, ShaderRender _renderCallback, std::wstring shaderName);
 
-    static std::shared_ptr<Shader> ShaderCS(ComPtr<ID3D12Device2> device, std::shared_ptr<RootSignature> rootSignature, std::wstring shaderName);
+    static std::shared_ptr<Shader> ShaderCS(ComPtr<ID3D12Device2> device, std::shared_ptr<RootSignature> rootSignature, std::wstring shaderName, const std::vector<std::wstring>& defines = {});
+
+protected:
+    struct Permutation
+    {
+        std::shared_future<std::shared_ptr<Shader>> Pending;
+        std::shared_ptr<Shader> Ready;
+        bool Failed = false;
+    };
+
+    // By ShaderPermutationKey::Features
+    std::map<uint32_t, Permutation> permutations;
+    std::mutex permutationMutex;
 };
 
 inline void ThrowBlobIfFailed(HRESULT hr, ComPtr<ID3DBlob> errorBlob)
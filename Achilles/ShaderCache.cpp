@@ -0,0 +1,169 @@
+#include "ShaderCache.h"
+#include "Helpers.h"
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+std::wstring ShaderCache::GetCacheDirectory()
+{
+    return GetDirectoryFromPath(GetExePathW()) + L"/shadercache/";
+}
+
+std::wstring ShaderCache::GetCachePath(IDxcCompiler3* compiler, IDxcIncludeHandler* includeHandler, const DxcBuffer& source, const std::wstring& shaderPath, const std::wstring& entry, const std::vector<LPCWSTR>& compilationArguments)
+{
+    // Preprocessing pulls in the includes and applies the defines, so a change to either changes the hash
+    std::vector<LPCWSTR> preprocessArguments = compilationArguments;
+    preprocessArguments.push_back(L"-P");
+
+    ComPtr<IDxcResult> preprocessed;
+    if (FAILED(compiler->Compile(&source, preprocessArguments.data(), static_cast<uint32_t>(preprocessArguments.size()), includeHandler, IID_PPV_ARGS(&preprocessed))))
+        return L"";
+
+    HRESULT hrStatus;
+    if (FAILED(preprocessed->GetStatus(&hrStatus)) || FAILED(hrStatus))
+        return L"";
+
+    ComPtr<IDxcBlobUtf8> preprocessedSource;
+    if (FAILED(preprocessed->GetOutput(DXC_OUT_HLSL, IID_PPV_ARGS(&preprocessedSource), nullptr)) || preprocessedSource == nullptr)
+        return L"";
+
+    std::string_view preprocessedText(preprocessedSource->GetStringPointer(), preprocessedSource->GetStringLength());
+    return GetCachePath(preprocessedText, shaderPath, entry, compilationArguments, HashCompilerVersion(compiler));
+}
+
+std::wstring ShaderCache::GetCachePath(const std::string_view preprocessedSource, const std::wstring& shaderPath, const std::wstring& entry, const std::vector<LPCWSTR>& compilationArguments, uint64_t compilerVersion)
+{
+    uint64_t hash = Hash(preprocessedSource.data(), preprocessedSource.size());
+    for (LPCWSTR argument : compilationArguments)
+        hash = Hash(argument, (wcslen(argument) + 1) * sizeof(wchar_t), hash);
+    hash = Hash(&CacheVersion, sizeof(CacheVersion), hash);
+    hash = Hash(&compilerVersion, sizeof(compilerVersion), hash);
+
+    wchar_t hashString[17] = {};
+    swprintf_s(hashString, L"%016llx", (unsigned long long)hash);
+
+    std::wstring stem = std::filesystem::path(shaderPath).stem().wstring();
+    return GetCacheDirectory() + stem + L"_" + entry + L"_" + hashString + L".dxil";
+}
+
+bool ShaderCache::Load(IDxcUtils* utils, const std::wstring& cachePath, ComPtr<IDxcBlob>& outShader)
+{
+    std::vector<uint8_t> data;
+    if (!ReadBlob(cachePath, data))
+        return false;
+
+    ComPtr<IDxcBlobEncoding> blob;
+    if (FAILED(utils->CreateBlob(data.data(), static_cast<UINT32>(data.size()), DXC_CP_ACP, &blob)) || blob == nullptr)
+        return false;
+
+    outShader = blob;
+    return true;
+}
+
+void ShaderCache::Store(const std::wstring& cachePath, IDxcBlob* shader)
+{
+    WriteBlob(cachePath, shader->GetBufferPointer(), shader->GetBufferSize());
+}
+
+bool ShaderCache::ReadBlob(const std::wstring& cachePath, std::vector<uint8_t>& outData)
+{
+    // Opened at the end to get the size of this file, as another thread may rename a new one over the path
+    std::ifstream input(std::filesystem::path(cachePath), std::ios::binary | std::ios::ate);
+    if (!input)
+        return false;
+    uint64_t fileSize = static_cast<uint64_t>(input.tellg());
+    input.seekg(0);
+
+    Header header;
+    if (!input.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.Magic != Magic || header.Version != CacheVersion || header.Size == 0)
+        return false;
+
+    // Anything after the blob means the file isn't what was written either
+    if (fileSize != sizeof(header) + header.Size)
+        return false;
+
+    std::vector<uint8_t> data(header.Size);
+    if (!input.read(reinterpret_cast<char*>(data.data()), data.size()) || Hash(data.data(), data.size()) != header.Hash)
+        return false;
+
+    outData = std::move(data);
+    return true;
+}
+
+bool ShaderCache::WriteBlob(const std::wstring& cachePath, const void* data, size_t size)
+{
+    if (data == nullptr || size == 0)
+        return false;
+
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(cachePath).parent_path(), ec);
+
+    Header header;
+    header.Magic = Magic;
+    header.Version = CacheVersion;
+    header.Size = size;
+    header.Hash = Hash(data, size);
+
+    // Write to a temporary file first so a concurrent load never reads a partial blob
+    std::wstring temporaryPath = cachePath + L".tmp" + std::to_wstring(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    {
+        std::ofstream output(std::filesystem::path(temporaryPath), std::ios::binary);
+        if (!output)
+            return false;
+        output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        output.write(reinterpret_cast<const char*>(data), size);
+        if (!output)
+        {
+            output.close();
+            std::filesystem::remove(temporaryPath, ec);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temporaryPath, cachePath, ec);
+    if (ec)
+    {
+        std::filesystem::remove(temporaryPath, ec);
+        return false;
+    }
+    return true;
+}
+
+uint64_t ShaderCache::Hash(const void* data, size_t size, uint64_t hash)
+{
+    // FNV-1a
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t ShaderCache::HashCompilerVersion(IDxcCompiler3* compiler)
+{
+    uint64_t hash = Hash(nullptr, 0); // Just the FNV offset basis
+    ComPtr<IDxcVersionInfo> versionInfo;
+    if (SUCCEEDED(compiler->QueryInterface(IID_PPV_ARGS(&versionInfo))))
+    {
+        UINT32 version[2] = {};
+        if (SUCCEEDED(versionInfo->GetVersion(&version[0], &version[1])))
+            hash = Hash(version, sizeof(version), hash);
+    }
+
+    // Builds of the same version can still generate different code
+    ComPtr<IDxcVersionInfo2> versionInfo2;
+    if (SUCCEEDED(compiler->QueryInterface(IID_PPV_ARGS(&versionInfo2))))
+    {
+        UINT32 commitCount = 0;
+        char* commitHash = nullptr;
+        if (SUCCEEDED(versionInfo2->GetCommitInfo(&commitCount, &commitHash)) && commitHash != nullptr)
+        {
+            hash = Hash(&commitCount, sizeof(commitCount), hash);
+            hash = Hash(commitHash, strlen(commitHash), hash);
+            CoTaskMemFree(commitHash);
+        }
+    }
+    return hash;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <Windows.h>
+#include <wrl.h>
+#include <directx-dxc/dxcapi.h>
+
+using Microsoft::WRL::ComPtr;
+
+// Compiled shader blobs on disk, so shaders that haven't changed skip DXC on startup
+// Blobs are keyed by a hash of the preprocessed source (which covers includes and defines), the arguments and the compiler version
+class ShaderCache
+{
+public:
+    inline static bool Enabled = true;
+    // Bump when the cache's layout changes so older blobs are ignored
+    static constexpr uint32_t CacheVersion = 2;
+    static constexpr uint32_t Magic = 0x43534341; // "ACSC"
+
+    // Written before each blob, so files that were truncated or corrupted are recompiled rather than handed to the device
+    struct Header
+    {
+        uint32_t Magic = 0;
+        uint32_t Version = 0;
+        uint64_t Size = 0;
+        uint64_t Hash = 0;
+    };
+
+    // Where cached blobs are written, next to the executable
+    static std::wstring GetCacheDirectory();
+
+    // Path of the cached blob for this compile. Empty if the source couldn't be preprocessed, in which case it shouldn't be cached
+    static std::wstring GetCachePath(IDxcCompiler3* compiler, IDxcIncludeHandler* includeHandler, const DxcBuffer& source, const std::wstring& shaderPath, const std::wstring& entry, const std::vector<LPCWSTR>& compilationArguments);
+    // The same from source that has already been preprocessed, and a hash of the compiler's version from HashCompilerVersion
+    static std::wstring GetCachePath(const std::string_view preprocessedSource, const std::wstring& shaderPath, const std::wstring& entry, const std::vector<LPCWSTR>& compilationArguments, uint64_t compilerVersion);
+    static uint64_t HashCompilerVersion(IDxcCompiler3* compiler);
+
+    static bool Load(IDxcUtils* utils, const std::wstring& cachePath, ComPtr<IDxcBlob>& outShader);
+    static void Store(const std::wstring& cachePath, IDxcBlob* shader);
+
+    // The file side of Load and Store. Read fails for missing files and for any that don't match their header
+    static bool ReadBlob(const std::wstring& cachePath, std::vector<uint8_t>& outData);
+    // Writes to a temporary file and renames it over cachePath, so a concurrent read never sees a partial blob
+    static bool WriteBlob(const std::wstring& cachePath, const void* data, size_t size);
+
+protected:
+    static uint64_t Hash(const void* data, size_t size, uint64_t hash = 14695981039346656037ull);
+};
@@ -0,0 +1,194 @@
+#include "ShaderCompiler.h"
+#include "Helpers.h"
+#include "Shader.h"
+#include <algorithm>
+
+std::shared_future<ComPtr<IDxcBlob>> ShaderCompiler::CompileAsync(const std::wstring& shaderPath, const std::wstring& entry, const std::wstring& profile, const std::vector<std::wstring>& defines)
+{
+    std::wstring key = shaderPath + L"|" + entry + L"|" + profile;
+    for (const std::wstring& define : defines)
+        key += L"|" + define;
+    std::shared_future<ComPtr<IDxcBlob>> stage;
+    std::packaged_task<ComPtr<IDxcBlob>()> inlineJob;
+    {
+        std::lock_guard<std::mutex> lock(compilerMutex);
+        auto iter = stages.find(key);
+        if (iter != stages.end())
+            return iter->second;
+
+        std::packaged_task<ComPtr<IDxcBlob>()> job([key, shaderPath, entry, profile, defines]()
+            {
+                auto start = std::chrono::steady_clock::now();
+
+                ComPtr<IDxcBlob> shader;
+                if (FAILED(CompileShader(shaderPath, entry, profile, shader, defines)) || shader == nullptr)
+                {
+                    // Forgotten so the next request compiles again, e.g. once the error has been fixed and the shader reloaded
+                    // Anything already waiting on this stage still gets the error
+                    {
+                        std::lock_guard<std::mutex> lock(compilerMutex);
+                        stages.erase(key);
+                    }
+
+                    std::string error = "Failed to compile " + WStringToString(entry) + " of " + WStringToString(shaderPath);
+                    throw std::exception(error.c_str());
+                }
+
+                double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                std::lock_guard<std::mutex> lock(compilerMutex);
+                stageTimings.push_back(ShaderStageTiming{ shaderPath, entry, milliseconds });
+                return shader;
+            });
+
+        stage = job.get_future().share();
+        stages[key] = stage;
+
+        // Nothing will pick the job up once the workers have been stopped
+        if (stopWorkers)
+            inlineJob = std::move(job);
+        else
+            jobs.push(std::move(job));
+    }
+
+    if (inlineJob.valid())
+    {
+        inlineJob();
+        return stage;
+    }
+
+    StartWorkers();
+    jobCV.notify_one();
+    return stage;
+}
+
+void ShaderCompiler::Precompile(const std::wstring& shaderName, ShaderType shaderType)
+{
+    std::wstring shaderPath = GetContentDirectoryW() + L"shaders/" + shaderName + L".hlsl";
+    switch (shaderType)
+    {
+    case ShaderType::VSPS:
+        CompileAsync(shaderPath, L"VS", L"vs_6_4");
+        CompileAsync(shaderPath, L"PS", L"ps_6_4");
+        break;
+    case ShaderType::VSGSPS:
+        CompileAsync(shaderPath, L"VS", L"vs_6_4");
+        CompileAsync(shaderPath, L"GS", L"gs_6_4");
+        CompileAsync(shaderPath, L"PS", L"ps_6_4");
+        break;
+    case ShaderType::CS:
+        CompileAsync(shaderPath, L"CS", L"cs_6_4");
+        break;
+    default:
+        throw std::exception("Can't precompile a shader without a type");
+    }
+}
+
+void ShaderCompiler::RecordShaderTiming(const std::wstring& shaderName, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point stagesReady)
+{
+    auto end = std::chrono::steady_clock::now();
+
+    ShaderTiming timing;
+    timing.ShaderName = shaderName;
+    timing.WaitMilliseconds = std::chrono::duration<double, std::milli>(stagesReady - start).count();
+    timing.PipelineMilliseconds = std::chrono::duration<double, std::milli>(end - stagesReady).count();
+
+    std::lock_guard<std::mutex> lock(compilerMutex);
+    shaderTimings.push_back(timing);
+}
+
+std::vector<ShaderStageTiming> ShaderCompiler::GetStageTimings()
+{
+    std::lock_guard<std::mutex> lock(compilerMutex);
+    return stageTimings;
+}
+
+std::vector<ShaderTiming> ShaderCompiler::GetShaderTimings()
+{
+    std::lock_guard<std::mutex> lock(compilerMutex);
+    return shaderTimings;
+}
+
+void ShaderCompiler::PrintTimings()
+{
+    std::vector<ShaderStageTiming> stageTimes = GetStageTimings();
+    std::vector<ShaderTiming> shaderTimes = GetShaderTimings();
+
+    std::sort(shaderTimes.begin(), shaderTimes.end(), [](const ShaderTiming& a, const ShaderTiming& b)
+        {
+            return a.WaitMilliseconds + a.PipelineMilliseconds > b.WaitMilliseconds + b.PipelineMilliseconds;
+        });
+
+    double totalStageMilliseconds = 0.0;
+    for (const ShaderStageTiming& stage : stageTimes)
+        totalStageMilliseconds += stage.Milliseconds;
+
+    OutputDebugStringW(L"Shader startup timings:\n");
+    for (const ShaderTiming& shader : shaderTimes)
+    {
+        double compileMilliseconds = 0.0;
+        std::wstring shaderPath = GetContentDirectoryW() + L"shaders/" + shader.ShaderName + L".hlsl";
+        for (const ShaderStageTiming& stage : stageTimes)
+        {
+            if (stage.ShaderPath == shaderPath)
+                compileMilliseconds += stage.Milliseconds;
+        }
+
+        OutputDebugStringWFormatted(L" %s - waited %.2fms, pipeline %.2fms (stages took %.2fms on workers)\n", shader.ShaderName.c_str(), shader.WaitMilliseconds, shader.PipelineMilliseconds, compileMilliseconds);
+    }
+    OutputDebugStringWFormatted(L"%zu stages, %.2fms of compiling across %zu workers\n", stageTimes.size(), totalStageMilliseconds, workers.size());
+}
+
+void ShaderCompiler::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(compilerMutex);
+        stopWorkers = true;
+    }
+    jobCV.notify_all();
+
+    for (std::thread& worker : workers)
+    {
+        if (worker.joinable())
+            worker.join();
+    }
+
+    std::lock_guard<std::mutex> lock(compilerMutex);
+    workers.clear();
+    // Abandoned jobs break their promises, so anything still waiting on them throws rather than hangs
+    jobs = {};
+    stages.clear();
+}
+
+void ShaderCompiler::StartWorkers()
+{
+    std::lock_guard<std::mutex> lock(compilerMutex);
+    if (!workers.empty() || stopWorkers)
+        return;
+
+    uint32_t count = WorkerCount;
+    if (count == 0)
+        count = std::max(std::thread::hardware_concurrency(), 1u);
+
+    for (uint32_t i = 0; i < count; i++)
+        workers.emplace_back(&ShaderCompiler::WorkerLoop);
+}
+
+void ShaderCompiler::WorkerLoop()
+{
+    while (true)
+    {
+        std::packaged_task<ComPtr<IDxcBlob>()> job;
+        {
+            std::unique_lock<std::mutex> lock(compilerMutex);
+            jobCV.wait(lock, [] { return stopWorkers || !jobs.empty(); });
+            if (stopWorkers)
+                break;
+
+            job = std::move(jobs.front());
+            jobs.pop();
+        }
+
+        // Exceptions are stored in the job's future for whoever waits on the stage
+        job();
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include <Windows.h>
+#include <wrl.h>
+#include <directx-dxc/dxcapi.h>
+
+using Microsoft::WRL::ComPtr;
+
+enum class ShaderType;
+
+struct ShaderStageTiming
+{
+    std::wstring ShaderPath;
+    std::wstring Entry;
+    // Time spent on a worker compiling (or loading from ShaderCache) the stage
+    double Milliseconds = 0.0;
+};
+
+struct ShaderTiming
+{
+    std::wstring ShaderName;
+    // Time the factory spent waiting on its stages. Stages queued by Precompile have usually finished by the time they're asked for
+    double WaitMilliseconds = 0.0;
+    // Time spent creating the root signature and pipeline state once the stages were ready
+    double PipelineMilliseconds = 0.0;
+};
+
+// Compiles shader stages on a pool of worker threads
+// Startup queues every shader it's about to create (see Precompile) so all of their stages compile at once, then each factory only waits on its own stages
+// and creates its pipeline state as soon as they're done. The same stage requested twice shares one compile
+class ShaderCompiler
+{
+public:
+    // 0 uses the number of hardware threads
+    inline static uint32_t WorkerCount = 0;
+
+    // Queue a stage, or get the one already queued for the same file, entry point, profile and defines. Compile errors are rethrown by get()
+    static std::shared_future<ComPtr<IDxcBlob>> CompileAsync(const std::wstring& shaderPath, const std::wstring& entry, const std::wstring& profile, const std::vector<std::wstring>& defines = {});
+
+    // Queue every stage of a content shader of the given type, e.g. VS and PS for ShaderType::VSPS
+    static void Precompile(const std::wstring& shaderName, ShaderType shaderType);
+
+    // Called by the Shader factories once their pipeline state is created
+    static void RecordShaderTiming(const std::wstring& shaderName, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point stagesReady);
+
+    static std::vector<ShaderStageTiming> GetStageTimings();
+    static std::vector<ShaderTiming> GetShaderTimings();
+    // Prints every shader created so far, slowest first
+    static void PrintTimings();
+
+    // Stops the workers. Stages that haven't started are abandoned
+    static void Shutdown();
+
+protected:
+    static void StartWorkers();
+    static void WorkerLoop();
+
+    inline static std::vector<std::thread> workers;
+    inline static std::queue<std::packaged_task<ComPtr<IDxcBlob>()>> jobs;
+    // Every stage queued so far that hasn't failed, by path, entry, profile and defines
+    inline static std::map<std::wstring, std::shared_future<ComPtr<IDxcBlob>>> stages;
+    inline static std::vector<ShaderStageTiming> stageTimings;
+    inline static std::vector<ShaderTiming> shaderTimings;
+    inline static std::mutex compilerMutex;
+    inline static std::condition_variable jobCV;
+    inline static bool stopWorkers = false;
+};
@@ -15,6 +15,7 @@
 #include "Knit.h"
 #include "Object.h"
 #include "Mesh.h"
+#include "MeshOptimizer.h"
 #include "Texture.h"
 #include "Material.h"
 #include "Camera.h"
@@ -0,0 +1,166 @@
+#include "ShadowAtlas.h"
+#include "ShadowCamera.h"
+#include "ShadowMap.h"
+#include "MathHelpers.h"
+#include "Profiling.h"
+#include <d3dx12.h>
+#include <algorithm>
+#include <numeric>
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+std::shared_ptr<ShadowMap> ShadowAtlas::GetAtlas()
+{
+    uint32_t atlasSize = ShadowAtlasAllocator::RoundUpToPowerOfTwo(std::max<uint32_t>(AtlasSize, 1));
+    if (atlas != nullptr)
+    {
+        float width, height;
+        if (atlas->GetSize(width, height) && (uint32_t)width == atlasSize)
+            return atlas;
+    }
+
+    atlas = ShadowMap::CreateShadowMap(atlasSize, atlasSize);
+    atlas->SetName(L"Shadow Atlas");
+    return atlas;
+}
+
+std::shared_ptr<ShadowMap> ShadowAtlas::GetStaticCache()
+{
+    uint32_t atlasSize = ShadowAtlasAllocator::RoundUpToPowerOfTwo(std::max<uint32_t>(AtlasSize, 1));
+    if (staticCache != nullptr)
+    {
+        float width, height;
+        if (staticCache->GetSize(width, height) && (uint32_t)width == atlasSize)
+            return staticCache;
+    }
+
+    // Every light's cached tiles are lost with the old texture
+    allocationIndex++;
+
+    staticCache = ShadowMap::CreateShadowMap(atlasSize, atlasSize);
+    staticCache->SetName(L"Static Shadow Cache");
+    return staticCache;
+}
+
+void ShadowAtlas::Release()
+{
+    atlas.reset();
+    staticCache.reset();
+    allocator.Reset(0, 1);
+}
+
+float ShadowAtlas::GetScreenCoverage(const BoundingSphere& bounds, std::shared_ptr<Camera> camera)
+{
+    if (camera == nullptr)
+        return 1.0f;
+
+    if (!camera->GetFrustum().Intersects(bounds))
+        return 0.0f;
+
+    float distance = (Vector3(bounds.Center) - camera->GetPosition()).Length();
+    if (distance <= bounds.Radius || camera->IsOrthographic())
+        return 1.0f;
+
+    // Tangent of the angle the sphere's radius subtends, relative to the tangent of half the vertical FOV
+    float tanRadius = bounds.Radius / sqrtf(distance * distance - bounds.Radius * bounds.Radius);
+    float tanHalfFOV = tanf(toRad(camera->GetFOV()) * 0.5f);
+    return std::clamp(tanRadius / tanHalfFOV, 0.0f, 1.0f);
+}
+
+uint32_t ShadowAtlas::GetDesiredTileSize(uint32_t maxResolution, float screenCoverage, uint32_t rankIndex)
+{
+    uint32_t maxTileSize = std::min<uint32_t>({ ShadowAtlasAllocator::RoundUpToPowerOfTwo(maxResolution), MaxTileSize, AtlasSize });
+    uint32_t minTileSize = std::min<uint32_t>(MinTileSize, maxTileSize);
+
+    float importance = powf(1.0f - std::clamp(RankFalloff, 0.0f, 1.0f), (float)rankIndex);
+    float size = (float)maxTileSize * std::clamp(screenCoverage, 0.0f, 1.0f) * importance;
+
+    uint32_t tileSize = ShadowAtlasAllocator::RoundUpToPowerOfTwo((uint32_t)size);
+    return std::clamp<uint32_t>(tileSize, minTileSize, maxTileSize);
+}
+
+void ShadowAtlas::Allocate(std::vector<TileRequest>& requests)
+{
+    ScopedTimer _prof(L"ShadowAtlas::Allocate");
+    allocationIndex++;
+
+    // Place the biggest tiles first, the sort is stable so equal sizes stay in rank order
+    std::vector<size_t> order(requests.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return requests[a].TileSize > requests[b].TileSize; });
+
+    std::vector<ShadowAtlasRect> tiles;
+    for (uint32_t shift = 0; shift < 32; shift++)
+    {
+        allocator.Reset(AtlasSize, MinTileSize);
+        bool allFit = true;
+        bool canShrink = false;
+
+        for (size_t index : order)
+        {
+            TileRequest& request = requests[index];
+            if (request.ShadowCamera == nullptr)
+                continue;
+
+            uint32_t tileSize = std::max<uint32_t>(request.TileSize >> shift, MinTileSize);
+            if (tileSize > MinTileSize)
+                canShrink = true;
+
+            uint32_t viewCount = request.ShadowCamera->GetViewCount();
+            tiles.resize(viewCount);
+
+            bool fits = true;
+            for (uint32_t v = 0; v < viewCount; v++)
+            {
+                if (!allocator.Allocate(tileSize, tiles[v]))
+                {
+                    // Give back this camera's other views so a smaller light can still use the space
+                    for (uint32_t f = 0; f < v; f++)
+                        allocator.Free(tiles[f]);
+                    fits = false;
+                    break;
+                }
+            }
+
+            if (fits)
+            {
+                request.ShadowCamera->SetAtlasTiles(tiles);
+            }
+            else
+            {
+                request.ShadowCamera->SetAtlasTiles({});
+                allFit = false;
+            }
+        }
+
+        if (allFit || !canShrink)
+            break;
+    }
+}
+
+Vector4 ShadowAtlas::GetUVRect(const ShadowAtlasRect& rect)
+{
+    float atlasSize = (float)std::max<uint32_t>(allocator.GetAtlasSize(), 1);
+    return Vector4(rect.X / atlasSize, rect.Y / atlasSize, rect.Size / atlasSize, rect.Size / atlasSize);
+}
+
+D3D12_VIEWPORT ShadowAtlas::GetViewport(const ShadowAtlasRect& rect)
+{
+    return CD3DX12_VIEWPORT((float)rect.X, (float)rect.Y, (float)rect.Size, (float)rect.Size, 0.0f, 1.0f);
+}
+
+D3D12_RECT ShadowAtlas::GetScissorRect(const ShadowAtlasRect& rect)
+{
+    return CD3DX12_RECT((LONG)rect.X, (LONG)rect.Y, (LONG)(rect.X + rect.Size), (LONG)(rect.Y + rect.Size));
+}
+
+const ShadowAtlasAllocator& ShadowAtlas::GetAllocator()
+{
+    return allocator;
+}
+
+uint64_t ShadowAtlas::GetAllocationIndex()
+{
+    return allocationIndex;
+}
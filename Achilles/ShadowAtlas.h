@@ -0,0 +1,66 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <d3d12.h>
+#include <DirectXCollision.h>
+#include <directxtk12/SimpleMath.h>
+#include "ShadowAtlasAllocator.h"
+
+using DirectX::SimpleMath::Vector4;
+using DirectX::BoundingSphere;
+
+class Camera;
+class ShadowCamera;
+class ShadowMap;
+
+// Every shadow view (spot lights, each cascade of directional lights and each face of point lights) renders into a tile of one shared depth texture
+// Tiles are handed out each frame, sized from how much of the screen the light covers and where it sits in ShadowScheduler's score order
+class ShadowAtlas
+{
+public:
+    inline static uint32_t AtlasSize = 4096;
+    inline static uint32_t MinTileSize = 128;
+    inline static uint32_t MaxTileSize = 2048;
+    // Each shadow casting light after the first gets this much less of its resolution than the one before it
+    inline static float RankFalloff = 0.15f;
+    // Keeps static casters in a second atlas-sized texture that's only redrawn per light when its static casters change
+    // The cache is copied into the atlas each shadow update and dynamic casters are drawn on top
+    inline static bool CacheStaticShadows = true;
+
+    struct TileRequest
+    {
+        std::shared_ptr<ShadowCamera> ShadowCamera;
+        uint32_t TileSize = 0; // Size wanted for each of the camera's views
+    };
+
+    // Created on first use, and again if AtlasSize changes
+    static std::shared_ptr<ShadowMap> GetAtlas();
+    static void Release();
+    // Same size and tile layout as the atlas. Created on first use, and again if AtlasSize changes
+    static std::shared_ptr<ShadowMap> GetStaticCache();
+
+    // Fraction of the camera's screen height the bounds span, 0 when they're outside its frustum
+    static float GetScreenCoverage(const BoundingSphere& bounds, std::shared_ptr<Camera> camera);
+    // rankIndex is the light's position among the scheduled shadow casting lights, highest score first
+    static uint32_t GetDesiredTileSize(uint32_t maxResolution, float screenCoverage, uint32_t rankIndex);
+
+    // Gives every camera one tile per view. If they don't all fit every tile is halved until they do
+    // Cameras that still don't fit once tiles are at MinTileSize are given no tiles and don't render shadows this frame
+    static void Allocate(std::vector<TileRequest>& requests);
+
+    // xy is the tile's offset and zw its scale in atlas UVs, so atlasUV = tileUV * zw + xy
+    static Vector4 GetUVRect(const ShadowAtlasRect& rect);
+    static D3D12_VIEWPORT GetViewport(const ShadowAtlasRect& rect);
+    static D3D12_RECT GetScissorRect(const ShadowAtlasRect& rect);
+
+    static const ShadowAtlasAllocator& GetAllocator();
+    // Increases with every call to Allocate, and when the static cache is recreated
+    static uint64_t GetAllocationIndex();
+
+protected:
+    inline static std::shared_ptr<ShadowMap> atlas;
+    inline static std::shared_ptr<ShadowMap> staticCache;
+    inline static ShadowAtlasAllocator allocator;
+    inline static uint64_t allocationIndex = 0;
+};
@@ -0,0 +1,130 @@
+#include "ShadowAtlasAllocator.h"
+#include <algorithm>
+#include <bit>
+
+ShadowAtlasAllocator::ShadowAtlasAllocator()
+{
+
+}
+
+ShadowAtlasAllocator::ShadowAtlasAllocator(uint32_t _atlasSize, uint32_t _minTileSize)
+{
+    Reset(_atlasSize, _minTileSize);
+}
+
+void ShadowAtlasAllocator::Reset(uint32_t _atlasSize, uint32_t _minTileSize)
+{
+    atlasSize = RoundUpToPowerOfTwo(_atlasSize);
+    minTileSize = std::min<uint32_t>(RoundUpToPowerOfTwo(std::max<uint32_t>(1, _minTileSize)), atlasSize);
+    allocatedArea = 0;
+
+    freeTiles.clear();
+    if (atlasSize == 0)
+        return;
+
+    freeTiles.resize(GetLevel(minTileSize) + 1);
+    freeTiles[0].push_back(ShadowAtlasRect{ 0, 0, atlasSize });
+}
+
+bool ShadowAtlasAllocator::Allocate(uint32_t size, ShadowAtlasRect& rect)
+{
+    if (atlasSize == 0)
+        return false;
+
+    size = std::max<uint32_t>(RoundUpToPowerOfTwo(size), minTileSize);
+    if (size > atlasSize)
+        return false;
+
+    uint32_t level = GetLevel(size);
+
+    // Find the smallest free tile that's big enough
+    int32_t freeLevel = (int32_t)level;
+    while (freeLevel >= 0 && freeTiles[freeLevel].empty())
+        freeLevel--;
+    if (freeLevel < 0)
+        return false;
+
+    ShadowAtlasRect tile = freeTiles[freeLevel].back();
+    freeTiles[freeLevel].pop_back();
+
+    // Split it down to the requested size, keeping the top left quadrant each time
+    while ((uint32_t)freeLevel < level)
+    {
+        uint32_t half = tile.Size / 2;
+        freeLevel++;
+        freeTiles[freeLevel].push_back(ShadowAtlasRect{ tile.X + half, tile.Y + half, half });
+        freeTiles[freeLevel].push_back(ShadowAtlasRect{ tile.X, tile.Y + half, half });
+        freeTiles[freeLevel].push_back(ShadowAtlasRect{ tile.X + half, tile.Y, half });
+        tile.Size = half;
+    }
+
+    allocatedArea += (uint64_t)tile.Size * tile.Size;
+    rect = tile;
+    return true;
+}
+
+void ShadowAtlasAllocator::Free(const ShadowAtlasRect& rect)
+{
+    if (atlasSize == 0 || rect.Size == 0)
+        return;
+
+    allocatedArea -= std::min<uint64_t>(allocatedArea, (uint64_t)rect.Size * rect.Size);
+
+    ShadowAtlasRect tile = rect;
+    uint32_t level = GetLevel(tile.Size);
+    while (level > 0)
+    {
+        // Merge with the other three quadrants of the parent if they're all free
+        uint32_t parentSize = tile.Size * 2;
+        uint32_t parentX = tile.X - (tile.X % parentSize);
+        uint32_t parentY = tile.Y - (tile.Y % parentSize);
+
+        std::vector<ShadowAtlasRect>& tiles = freeTiles[level];
+        std::vector<size_t> siblings;
+        for (size_t i = 0; i < tiles.size() && siblings.size() < 3; i++)
+        {
+            const ShadowAtlasRect& other = tiles[i];
+            if (other.X - (other.X % parentSize) == parentX && other.Y - (other.Y % parentSize) == parentY)
+                siblings.push_back(i);
+        }
+
+        if (siblings.size() < 3)
+            break;
+
+        // Erase back to front so the indices stay valid
+        for (auto iter = siblings.rbegin(); iter != siblings.rend(); iter++)
+            tiles.erase(tiles.begin() + *iter);
+
+        tile = ShadowAtlasRect{ parentX, parentY, parentSize };
+        level--;
+    }
+
+    freeTiles[level].push_back(tile);
+}
+
+uint32_t ShadowAtlasAllocator::GetAtlasSize() const
+{
+    return atlasSize;
+}
+
+uint32_t ShadowAtlasAllocator::GetMinTileSize() const
+{
+    return minTileSize;
+}
+
+uint64_t ShadowAtlasAllocator::GetAllocatedArea() const
+{
+    return allocatedArea;
+}
+
+uint32_t ShadowAtlasAllocator::RoundUpToPowerOfTwo(uint32_t value)
+{
+    if (value == 0)
+        return 0;
+    return std::bit_ceil(value);
+}
+
+uint32_t ShadowAtlasAllocator::GetLevel(uint32_t size) const
+{
+    return (uint32_t)(std::countr_zero(atlasSize) - std::countr_zero(size));
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// A square region of the shadow atlas in texels
+struct ShadowAtlasRect
+{
+    uint32_t X = 0;
+    uint32_t Y = 0;
+    uint32_t Size = 0;
+};
+
+// Quadtree allocator for square power of two tiles within a square power of two atlas
+// Free tiles are kept in a list per level, larger tiles are split into quadrants on demand and merged back when all four quadrants are freed
+// Doesn't touch the GPU so it can be driven and checked on its own
+class ShadowAtlasAllocator
+{
+public:
+    ShadowAtlasAllocator();
+    ShadowAtlasAllocator(uint32_t atlasSize, uint32_t minTileSize);
+
+    // Frees every tile. Sizes are rounded up to powers of two
+    void Reset(uint32_t atlasSize, uint32_t minTileSize);
+
+    // Size is rounded up to a power of two no smaller than the min tile size. Returns false if there isn't a free tile that big
+    bool Allocate(uint32_t size, ShadowAtlasRect& rect);
+    void Free(const ShadowAtlasRect& rect);
+
+    uint32_t GetAtlasSize() const;
+    uint32_t GetMinTileSize() const;
+    uint64_t GetAllocatedArea() const;
+
+    static uint32_t RoundUpToPowerOfTwo(uint32_t value);
+
+protected:
+    uint32_t GetLevel(uint32_t size) const;
+
+    uint32_t atlasSize = 0;
+    uint32_t minTileSize = 1;
+    uint64_t allocatedArea = 0;
+    // Index 0 holds the whole atlas, each level after holds tiles half the size of the one before
+    std::vector<std::vector<ShadowAtlasRect>> freeTiles;
+};
@@ -1,5 +1,6 @@
 #include "ShadowCamera.h"
 #include "LightObject.h"
+#include "shaders/DepthReduction.h"
 
 using namespace DirectX;
 using namespace DirectX::SimpleMath;
@@ -17,15 +18,13 @@ ShadowCamera::ShadowCamera() : ShadowCamera(L"ShadowCamera", ShadowCameraWidth,
 
 ShadowCamera::ShadowCamera(std::wstring _name, uint32_t width, uint32_t height) : Camera(_name, width, height)
 {
-    cameraWidth = width;
-    cameraHeight = height;
+    maxResolution = std::max<uint32_t>(width, height);
+    // Small casters only cast a few texels of shadow, so more is culled than from the main view
+    minScreenSize = 0.01f;
 
     SetOrthographic(true);
 
     ResizeCascades(numCascades);
-
-    shadowMapRT = std::make_shared<RenderTarget>();
-    shadowMapRT->AttachTexture(AttachmentPoint::DepthStencil, shadowMaps[0]);
 }
 
 ShadowCamera::~ShadowCamera()
@@ -106,25 +105,6 @@ const Matrix& ShadowCamera::GetShadowMatrix() const
     return shadowMatrix;
 }
 
-std::shared_ptr<ShadowMap> ShadowCamera::GetShadowMap(uint32_t index)
-{
-    if (GetLightType() == LightType::Directional && numCascades == 0)
-        return shadowMaps[0];
-
-    if (GetLightType() == LightType::Spot)
-        return shadowMaps[0];
-
-    if (index >= shadowMaps.size())
-        return nullptr;
-
-    return shadowMaps[index];
-}
-
-std::shared_ptr<RenderTarget> ShadowCamera::GetShadowMapRenderTarget()
-{
-    return shadowMapRT;
-}
-
 LightType ShadowCamera::GetLightType()
 {
     return lightType;
@@ -155,18 +135,167 @@ void ShadowCamera::SetRank(float _rank)
     rank = _rank;
 }
 
-void ShadowCamera::ResizeShadowMaps(uint32_t width, uint32_t height)
+uint32_t ShadowCamera::GetMaxResolution()
+{
+    return maxResolution;
+}
+
+void ShadowCamera::SetMaxResolution(uint32_t resolution)
+{
+    maxResolution = std::max<uint32_t>(resolution, 1);
+}
+
+uint32_t ShadowCamera::GetViewCount()
+{
+    if (GetLightType() == LightType::Point)
+        return 6;
+    if (GetLightType() == LightType::Directional)
+        return std::max<uint32_t>(1, numCascades);
+    return 1;
+}
+
+void ShadowCamera::SetAtlasTiles(const std::vector<ShadowAtlasRect>& tiles)
+{
+    atlasTiles = tiles;
+    if (!atlasTiles.empty())
+        UpdateViewport(atlasTiles[0].Size, atlasTiles[0].Size);
+    else
+        InvalidateStaticShadows();
+}
+
+bool ShadowCamera::HasAtlasTiles()
+{
+    return !atlasTiles.empty() && atlasTiles.size() >= GetViewCount();
+}
+
+const ShadowAtlasRect& ShadowCamera::GetAtlasTile(uint32_t view)
+{
+    static const ShadowAtlasRect emptyTile{};
+    if (view >= atlasTiles.size())
+        return emptyTile;
+    return atlasTiles[view];
+}
+
+uint32_t ShadowCamera::GetTileSize()
+{
+    if (atlasTiles.empty())
+        return maxResolution;
+    return atlasTiles[0].Size;
+}
+
+Matrix ShadowCamera::GetViewProjection(uint32_t view)
+{
+    if (GetLightType() == LightType::Point)
+        return GetPointDirectionShadowMatrix(view) * GetProj();
+    if (GetLightType() == LightType::Directional && numCascades > 0)
+    {
+        if (view < renderedCascadeMatrices.size())
+            return renderedCascadeMatrices[view];
+        if (view < cascadeProjections.size())
+            return GetView() * cascadeProjections[view];
+    }
+    return GetView() * GetProj();
+}
+
+bool ShadowCamera::UpdateStaticShadowSignature(uint32_t view, size_t signature, uint64_t allocationIndex)
+{
+    // New views start out of date, no allocation index follows UINT64_MAX - 1
+    if (staticShadowViews.size() <= view)
+        staticShadowViews.resize(view + 1, StaticShadowView{ 0, UINT64_MAX - 1 });
+
+    StaticShadowView& cached = staticShadowViews[view];
+    bool upToDate = cached.Signature == signature && cached.Allocation + 1 == allocationIndex;
+
+    cached.Signature = signature;
+    cached.Allocation = allocationIndex;
+    return !upToDate;
+}
+
+void ShadowCamera::InvalidateStaticShadows()
+{
+    staticShadowViews.clear();
+}
+
+uint32_t ShadowCamera::GetCascadeUpdateInterval(uint32_t cascade)
+{
+    if (cascade >= MAX_NUM_CASCADES)
+        return 1;
+    return cascadeUpdateIntervals[cascade];
+}
+
+void ShadowCamera::SetCascadeUpdateInterval(uint32_t cascade, uint32_t interval)
 {
-    cameraWidth = width;
-    cameraHeight = height;
+    if (cascade >= MAX_NUM_CASCADES)
+        return;
+    cascadeUpdateIntervals[cascade] = std::max<uint32_t>(interval, 1);
+}
+
+void ShadowCamera::ScheduleViews(uint64_t allocationIndex, bool due)
+{
+    bool continuous = scheduledAllocation + 1 == allocationIndex;
+    scheduledAllocation = allocationIndex;
+    scheduledViewMask = ~0u;
+
+    if (GetLightType() != LightType::Directional || numCascades == 0 || !HasAtlasTiles())
+    {
+        renderedCascadeMatrices.clear();
+        renderedCascadeTiles.clear();
+
+        // A skipped light is shaded with what its tiles already hold, which only holds while the tiles and its matrices are the same
+        Matrix viewProjection = GetView() * GetProj();
+        bool tilesMoved = renderedTiles.size() != atlasTiles.size();
+        for (size_t t = 0; !tilesMoved && t < atlasTiles.size(); t++)
+            tilesMoved = atlasTiles[t].X != renderedTiles[t].X || atlasTiles[t].Y != renderedTiles[t].Y || atlasTiles[t].Size != renderedTiles[t].Size;
+
+        if (!due && continuous && HasAtlasTiles() && !tilesMoved && viewProjection == renderedViewProjection)
+        {
+            scheduledViewMask = 0;
+            return;
+        }
+
+        renderedViewProjection = viewProjection;
+        renderedTiles = atlasTiles;
+        return;
+    }
+    renderedTiles.clear();
+
+    // Skipped cascades are reprojected by the shaders with the matrix they were drawn with, which only holds while the light faces the same way
+    Matrix view = GetView();
+    if (!continuous || view != scheduledView || renderedCascadeMatrices.size() != cascadeProjections.size())
+    {
+        renderedCascadeMatrices.clear();
+        renderedCascadeTiles.clear();
+    }
+    scheduledView = view;
+    renderedCascadeMatrices.resize(cascadeProjections.size());
+    renderedCascadeTiles.resize(cascadeProjections.size());
+
+    // Lights the scheduler skipped only redraw cascades whose tiles moved, and don't advance the round-robin
+    if (due)
+        cascadeUpdateCounter++;
+    scheduledViewMask = 0;
+    for (uint32_t c = 0; c < (uint32_t)cascadeProjections.size(); c++)
+    {
+        // Offset by the cascade index so cascades sharing an interval take turns
+        uint32_t interval = GetCascadeUpdateInterval(c);
+        bool cascadeDue = due && (cascadeUpdateCounter + c) % interval == 0;
 
-    for (uint32_t i = 0; i < shadowMaps.size(); i++)
-        shadowMaps[i]->Resize(cameraWidth, cameraHeight);
+        const ShadowAtlasRect& tile = GetAtlasTile(c);
+        const ShadowAtlasRect& renderedTile = renderedCascadeTiles[c];
+        bool tileMoved = tile.X != renderedTile.X || tile.Y != renderedTile.Y || tile.Size != renderedTile.Size;
 
-    if (cubeShadowMap)
-        cubeShadowMap->Resize(cameraWidth, cameraHeight, 6);
+        if (cascadeDue || tileMoved)
+        {
+            renderedCascadeMatrices[c] = view * cascadeProjections[c];
+            renderedCascadeTiles[c] = tile;
+            scheduledViewMask |= 1u << c;
+        }
+    }
+}
 
-    UpdateViewport(width, height);
+uint32_t ShadowCamera::GetScheduledViewMask()
+{
+    return scheduledViewMask;
 }
 
 static const float preCalculatedPartitions[MAX_NUM_CASCADES][MAX_NUM_CASCADES] =
@@ -197,35 +326,18 @@ void ShadowCamera::ResizeCascades(uint32_t newCascades)
     if (numCascades > 0)
     {
         cascadePartitions.resize(numCascades);
-        shadowMaps.resize(numCascades);
         for (uint32_t i = 0; i < numCascades; i++)
         {
             // const float curve = 1.75f;
             // cascadePartitions[i] = (i + 1) / (curve + i + 1);
             cascadePartitions[i] = preCalculatedPartitions[numCascades - 1][i];
-            shadowMaps[i] = ShadowMap::CreateShadowMap(cameraWidth, cameraHeight);
         }
     }
     else
     {
         cascadePartitions.resize(1);
-        shadowMaps.resize(1);
         cascadePartitions[0] = 1.0f;
-        shadowMaps[0] = ShadowMap::CreateShadowMap(cameraWidth, cameraHeight);
-    }
-}
-
-void ShadowCamera::CreatePointShadowMaps()
-{
-    numCascades = 0;
-    shadowMaps.resize(6);
-    for (uint32_t i = 0; i < 6; i++)
-    {
-        shadowMaps[i] = ShadowMap::CreateShadowMap(cameraWidth, cameraHeight);
-        shadowMaps[i]->SetName(L"Point Shadow Map " + std::to_wstring(i));
     }
-    cascadePartitions.resize(1);
-    cascadePartitions[0] = 1.0f;
 }
 
 uint32_t ShadowCamera::GetNumCascades()
@@ -244,7 +356,7 @@ std::vector<Matrix> ShadowCamera::GetCascadeMatrices()
     matrices.resize(cascadeProjections.size());
     for (uint32_t i = 0; i < cascadeProjections.size(); i++)
     {
-        matrices[i] = ((GetView() * cascadeProjections[i]) * ShadowCamera::NDCToTextureTransform).Transpose();
+        matrices[i] = (GetViewProjection(i) * ShadowCamera::NDCToTextureTransform).Transpose();
     }
     return matrices;
 }
@@ -254,6 +366,65 @@ std::vector<float> ShadowCamera::GetCascadePartitions()
     return cascadePartitions;
 }
 
+const std::vector<Vector2>& ShadowCamera::GetCascadeIntervals()
+{
+    return cascadeIntervals;
+}
+
+bool ShadowCamera::GetSampleDistribution()
+{
+    return sampleDistribution;
+}
+
+void ShadowCamera::SetSampleDistribution(bool enabled)
+{
+    sampleDistribution = enabled;
+}
+
+bool ShadowCamera::IsUsingSampleDistribution()
+{
+    return usingSampleDistribution;
+}
+
+void ShadowCamera::UpdateCascadeIntervals(std::shared_ptr<Camera> camera, uint32_t numCascades)
+{
+    cascadeIntervals.resize(numCascades);
+    usingSampleDistribution = false;
+
+    float depthNear, depthFar;
+    if (sampleDistribution && DepthReduction::GetViewDepthRange(camera, depthNear, depthFar))
+    {
+        // Snap to quarter powers of two so the splits, and the cascade sizes fitted to them, don't change every time the view moves slightly
+        const float steps = 4.0f;
+        float logNear = floorf(log2f(std::max<float>(depthNear, 0.0001f)) * steps) / steps;
+        float logFar = ceilf(log2f(std::max<float>(depthFar, 0.0001f)) * steps) / steps;
+
+        float splitNear = std::clamp(exp2f(logNear), std::max<float>(camera->nearZ, 0.0001f), camera->farZ);
+        float splitFar = std::min<float>(std::max<float>(exp2f(logFar), splitNear * 1.01f), camera->farZ);
+        if (splitFar > splitNear)
+        {
+            // Logarithmic splits keep the ratio of texels to screen pixels the same in each cascade
+            for (uint32_t i = 0; i < numCascades; i++)
+            {
+                float begin = splitNear * powf(splitFar / splitNear, (float)i / numCascades);
+                float end = splitNear * powf(splitFar / splitNear, (float)(i + 1) / numCascades);
+                cascadeIntervals[i] = Vector2(begin, end);
+            }
+            usingSampleDistribution = true;
+            return;
+        }
+    }
+
+    // Fixed partitions of the whole camera range
+    float cameraZRange = camera->farZ - camera->nearZ;
+    for (uint32_t i = 0; i < numCascades; i++)
+    {
+        float begin = i == 0 ? 0.0f : cascadePartitions[i - 1];
+        float end = std::max<float>(0.01f, cascadePartitions[i]);
+        cascadeIntervals[i] = Vector2(begin * cameraZRange, end * cameraZRange);
+    }
+}
+
 DirectX::SimpleMath::Matrix ShadowCamera::GetPointDirectionShadowMatrix(uint32_t directionIndex)
 {
     Vector3 pos = GetPosition();
@@ -284,22 +455,6 @@ DirectX::SimpleMath::Matrix ShadowCamera::GetPointDirectionShadowMatrix(uint32_t
     return directionalView;
 }
 
-std::shared_ptr<ShadowMap> ShadowCamera::GetPointCubeShadowMap(std::shared_ptr<CommandList> commandList)
-{
-    if (cubeShadowMap == nullptr)
-    {
-        cubeShadowMap = ShadowMap::CreateShadowMap(cameraWidth, cameraHeight, 6Ui16);
-        cubeShadowMap->SetName(L"Point Cube ShadowMap");
-    }
-
-    if (commandList != nullptr)
-    {
-        commandList->CopyTexturesToCubemap(*cubeShadowMap, *GetShadowMap(0), *GetShadowMap(1), *GetShadowMap(2), *GetShadowMap(3), *GetShadowMap(4), *GetShadowMap(5));
-    }
-
-    return cubeShadowMap;
-}
-
 std::vector<Matrix> ShadowCamera::GetDirectionalLightFrustumFromSceneAndCamera(BoundingBox sceneAABB, std::shared_ptr<Camera> camera, uint32_t numCascades)
 {
     if (camera == nullptr)
@@ -335,6 +490,8 @@ std::vector<Matrix> ShadowCamera::GetDirectionalLightFrustumFromSceneAndCamera(B
     float cameraNearZ = camera->nearZ;
     float cameraFarZ = camera->farZ;
     float cameraZRange = cameraFarZ - cameraNearZ;
+
+    UpdateCascadeIntervals(camera, numCascades);
     Matrix cameraView = camera->GetView();
     Matrix cameraInverseView = XMMatrixInverse(nullptr, cameraView);
     // Matrix cameraInverseView = camera->GetInverseView().Transpose();
@@ -348,12 +505,8 @@ std::vector<Matrix> ShadowCamera::GetDirectionalLightFrustumFromSceneAndCamera(B
     for (uint32_t cascadeIndex = 0; cascadeIndex < numCascades; cascadeIndex++)
     {
         // Use fit to cascades, no overlap between cascades
-        if (cascadeIndex == 0)
-            intervalBegin = 0.0f;
-        else
-            intervalBegin = cascadePartitions[cascadeIndex - 1];
-
-        intervalEnd = std::max<float>(0.01f, cascadePartitions[cascadeIndex]);
+        intervalBegin = cascadeIntervals[cascadeIndex].x;
+        intervalEnd = cascadeIntervals[cascadeIndex].y;
 
         /*
         if (cascadeIndex > 0)
@@ -367,9 +520,6 @@ std::vector<Matrix> ShadowCamera::GetDirectionalLightFrustumFromSceneAndCamera(B
         if (fitToScene)
             intervalBegin = 0;
 
-        intervalBegin *= cameraZRange;
-        intervalEnd *= cameraZRange;
-
         Vector4 frustumPoints[8];
         camera->CreateFrustumPointsFromCascadeInterval(intervalBegin, intervalEnd, frustumPoints);
 
@@ -412,7 +562,7 @@ std::vector<Matrix> ShadowCamera::GetDirectionalLightFrustumFromSceneAndCamera(B
             lightCameraOrthographicMin -= vBorderOffset;
 
             // The world units per texel are used to snap the shadow the orthographic projection to texel sized increments.  This keeps the edges of the shadows from shimmering
-            float fWorldUnitsPerTexel = (cascadeBound) / (float)cameraWidth;
+            float fWorldUnitsPerTexel = (cascadeBound) / (float)GetTileSize();
             worldUnitsPerTexel = XMVectorSet(fWorldUnitsPerTexel, fWorldUnitsPerTexel, 0.0f, 0.0f);
         }
 
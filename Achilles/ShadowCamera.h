@@ -5,6 +5,7 @@
 #include "ShadowMap.h"
 #include "RenderTarget.h"
 #include "Lights.h"
+#include "ShadowAtlasAllocator.h"
 
 using DirectX::SimpleMath::Matrix;
 using DirectX::SimpleMath::Vector2;
@@ -31,9 +32,6 @@ public:
 
     const Matrix& GetShadowMatrix() const;
 
-    std::shared_ptr<ShadowMap> GetShadowMap(uint32_t index = 0);
-    std::shared_ptr<RenderTarget> GetShadowMapRenderTarget();
-
     LightType GetLightType();
     void SetLightType(LightType _lightType);
 
@@ -44,38 +42,93 @@ public:
     float GetRank();
     void SetRank(float rank);
 
-    void ResizeShadowMaps(uint32_t width, uint32_t height);
+    // Largest tile each of this camera's views can be given in the shadow atlas
+    uint32_t GetMaxResolution();
+    void SetMaxResolution(uint32_t resolution);
+
+    // Spot lights have one view, point lights one per cube face and directional lights one per cascade
+    uint32_t GetViewCount();
+    // Set by ShadowAtlas::Allocate, one tile per view. Empty when the camera didn't fit in the atlas
+    void SetAtlasTiles(const std::vector<ShadowAtlasRect>& tiles);
+    bool HasAtlasTiles();
+    const ShadowAtlasRect& GetAtlasTile(uint32_t view = 0);
+    // Size of the tiles given this frame, or the max resolution before any have been
+    uint32_t GetTileSize();
+
+    // View and projection a view's tile was last drawn with. Cascades that weren't scheduled this update keep their old matrix
+    Matrix GetViewProjection(uint32_t view);
+
+    // Returns true when the static casters cached in a view's tile are out of date and remembers signature as drawn
+    // The cache only holds if the camera also had tiles in the previous allocation, otherwise another light may have drawn over them
+    bool UpdateStaticShadowSignature(uint32_t view, size_t signature, uint64_t allocationIndex);
+    void InvalidateStaticShadows();
+
+    // How many shadow updates apart a cascade is redrawn, 1 redraws it on every update
+    uint32_t GetCascadeUpdateInterval(uint32_t cascade);
+    void SetCascadeUpdateInterval(uint32_t cascade, uint32_t interval);
+    // Picks the views to draw this shadow update, call once per update after UpdateMatrix and ShadowAtlas::Allocate
+    // Cascades are drawn round-robin by their update interval, and all of them when the light turns or the tiles move
+    // When due is false (see ShadowScheduler) views are only drawn if what their tiles hold can't be used any more
+    void ScheduleViews(uint64_t allocationIndex, bool due = true);
+    // One bit per view scheduled by ScheduleViews
+    uint32_t GetScheduledViewMask();
+
     void ResizeCascades(uint32_t newCascades);
-    void CreatePointShadowMaps();
     uint32_t GetNumCascades();
 
     std::vector<Matrix> GetCascadeProjections();
     std::vector<Matrix> GetCascadeMatrices();
     std::vector<float> GetCascadePartitions();
+    // View space depth each cascade begins and ends at, from the last UpdateMatrix
+    const std::vector<Vector2>& GetCascadeIntervals();
+
+    // Fits logarithmic cascade splits to the depth range the camera's Z-prepass saw last frame
+    // Falls back to the fixed partitions when there's no depth range, e.g. the Z-prepass is off
+    bool GetSampleDistribution();
+    void SetSampleDistribution(bool enabled);
+    // Whether the last UpdateMatrix used the depth range
+    bool IsUsingSampleDistribution();
 
     DirectX::SimpleMath::Matrix GetPointDirectionShadowMatrix(uint32_t directionIndex);
-    std::shared_ptr<ShadowMap> GetPointCubeShadowMap(std::shared_ptr<CommandList> commandList);
 
 protected:
     // Returns a vector of orthographic matrices, one per cascade. used when setting the directional light's projection matrix
     std::vector<Matrix> GetDirectionalLightFrustumFromSceneAndCamera(BoundingBox sceneAABB, std::shared_ptr<Camera> camera, uint32_t numCascades);
-
-public:
-    uint32_t cameraWidth = ShadowCameraWidth;
-    uint32_t cameraHeight = ShadowCameraWidth;
+    void UpdateCascadeIntervals(std::shared_ptr<Camera> camera, uint32_t numCascades);
 
 protected:
+    uint32_t maxResolution = ShadowCameraWidth;
+    std::vector<ShadowAtlasRect> atlasTiles;
+
+    struct StaticShadowView
+    {
+        size_t Signature = 0;
+        uint64_t Allocation = 0;
+    };
+    std::vector<StaticShadowView> staticShadowViews;
+
+    // Near cascades every update, then every second and every fourth
+    uint32_t cascadeUpdateIntervals[MAX_NUM_CASCADES] = { 1, 2, 4, 4, 4, 4 };
+    uint32_t cascadeUpdateCounter = 0;
+    uint64_t scheduledAllocation = 0;
+    uint32_t scheduledViewMask = ~0u;
+    Matrix scheduledView;
+    std::vector<Matrix> renderedCascadeMatrices;
+    std::vector<ShadowAtlasRect> renderedCascadeTiles;
+    // Spot and point lights, and directional lights without cascades
+    Matrix renderedViewProjection;
+    std::vector<ShadowAtlasRect> renderedTiles;
+
     Matrix shadowMatrix;
     std::vector<Matrix> cascadeProjections;
-    std::vector<std::shared_ptr<ShadowMap>> shadowMaps;
-    std::shared_ptr<RenderTarget> shadowMapRT;
     LightType lightType = LightType::None;
     LightObject* lightObject{};
 
     uint32_t numCascades = ShadowCameraNumCascades;
     std::vector<float> cascadePartitions{};
-
-    std::shared_ptr<ShadowMap> cubeShadowMap;
+    std::vector<Vector2> cascadeIntervals{};
+    bool sampleDistribution = true;
+    bool usingSampleDistribution = false;
 
     float rank = -1000.0f; // Return small rank so it becomes the last in the sorted shadow camera list
 
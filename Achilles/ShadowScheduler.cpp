@@ -0,0 +1,210 @@
+#include "ShadowScheduler.h"
+#include "ShadowAtlas.h"
+#include "ShadowCamera.h"
+#include "LightObject.h"
+#include "Profiling.h"
+#include <algorithm>
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+std::vector<ShadowScheduler::ScheduledShadow> ShadowScheduler::Schedule(std::vector<CombinedLight>& lights, std::shared_ptr<Camera> camera)
+{
+    ScopedTimer _prof(L"ShadowScheduler::Schedule");
+    scheduleIndex++;
+
+    // Ties and lights without a slot keep the rank order
+    std::sort(lights.begin(), lights.end(), CombinedLightRankSort);
+
+    std::vector<ScheduledShadow> scheduled;
+    if (camera == nullptr)
+        return scheduled;
+
+    struct Candidate
+    {
+        size_t Index;
+        float Score;
+        float SlotScore;
+        float ScreenCoverage;
+        LightState* State;
+    };
+    std::vector<Candidate> candidates;
+    for (size_t i = 0; i < lights.size(); i++)
+    {
+        const CombinedLight& light = lights[i];
+        if (!light.IsShadowCaster || light.LightObject == nullptr)
+            continue;
+
+        float screenCoverage;
+        float score = ScoreLight(light, camera, screenCoverage);
+
+        LightState& state = lightStates[{ light.LightObject, light.LightType }];
+        state.Score = score;
+        state.LastScheduled = scheduleIndex;
+
+        // Holding a slot counts for more so two similar lights don't trade it back and forth
+        float slotScore = state.HadSlot ? score * (1.0f + Hysteresis) : score;
+        candidates.push_back({ i, score, slotScore, screenCoverage, &state });
+    }
+
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.SlotScore > b.SlotScore; });
+
+    // Lights that were removed since the last update
+    std::erase_if(lightStates, [](const auto& entry) { return entry.second.LastScheduled != scheduleIndex; });
+
+    // Slots are handed out best first, up to what the shaders support of each type
+    std::vector<bool> hasSlot(lights.size(), false);
+    std::vector<Candidate> slotted;
+    uint32_t spotSlots = 0, directionalSlots = 0, pointSlots = 0;
+    for (Candidate& candidate : candidates)
+    {
+        const CombinedLight& light = lights[candidate.Index];
+        bool hadSlot = candidate.State->HadSlot;
+        candidate.State->HadSlot = false;
+
+        // Nothing the light reaches is on screen
+        if (candidate.Score <= 0.0f)
+            continue;
+
+        if (light.LightType == LightType::Point && pointSlots++ >= MAX_POINT_SHADOW_MAPS)
+            continue;
+        if (light.LightType == LightType::Spot && spotSlots++ >= MAX_SPOT_SHADOW_MAPS)
+            continue;
+        if (light.LightType == LightType::Directional && directionalSlots++ >= MAX_CASCADED_SHADOW_MAPS)
+            continue;
+
+        std::shared_ptr<ShadowCamera> shadowCamera = light.LightObject->GetShadowCamera(light.LightType, nullptr);
+        if (shadowCamera == nullptr)
+            continue;
+
+        // Resolution tier from the light's coverage and place in the score order
+        // The previous tier is kept unless the coverage has moved far enough that it's no longer in reach
+        LightState& state = *candidate.State;
+        uint32_t rankIndex = (uint32_t)scheduled.size();
+        uint32_t tileSize = ShadowAtlas::GetDesiredTileSize(shadowCamera->GetMaxResolution(), candidate.ScreenCoverage, rankIndex);
+        if (hadSlot && state.TileSize != 0 && tileSize != state.TileSize)
+        {
+            uint32_t lowerTileSize = ShadowAtlas::GetDesiredTileSize(shadowCamera->GetMaxResolution(), candidate.ScreenCoverage * (1.0f - Hysteresis), rankIndex);
+            uint32_t upperTileSize = ShadowAtlas::GetDesiredTileSize(shadowCamera->GetMaxResolution(), candidate.ScreenCoverage * (1.0f + Hysteresis), rankIndex);
+            if (state.TileSize >= lowerTileSize && state.TileSize <= upperTileSize)
+                tileSize = state.TileSize;
+        }
+
+        // A new slot or tier has nothing usable in its tiles yet
+        bool mustDraw = !hadSlot || tileSize != state.TileSize || state.UpdatesSinceDrawn + 1 >= MaxUpdateInterval;
+        state.TileSize = tileSize;
+        state.HadSlot = true;
+
+        ScheduledShadow shadow
+        {
+            .LightObject = light.LightObject,
+            .LightType = light.LightType,
+            .ShadowCamera = shadowCamera,
+            .TileSize = tileSize,
+            .Score = candidate.Score,
+            .UpdateDue = mustDraw,
+        };
+        scheduled.push_back(shadow);
+        slotted.push_back(candidate);
+        hasSlot[candidate.Index] = true;
+    }
+
+    // Redraw the lights that have gone longest for their score first, until the budget runs out
+    std::vector<size_t> updateOrder(scheduled.size());
+    for (size_t i = 0; i < updateOrder.size(); i++)
+        updateOrder[i] = i;
+    auto priority = [&](size_t i) { return slotted[i].Score * (1.0f + StalenessWeight * slotted[i].State->UpdatesSinceDrawn); };
+    std::stable_sort(updateOrder.begin(), updateOrder.end(), [&](size_t a, size_t b) { return priority(a) > priority(b); });
+
+    auto cost = [&](size_t i) { return (uint64_t)scheduled[i].TileSize * scheduled[i].TileSize * scheduled[i].ShadowCamera->GetViewCount(); };
+
+    // Lights that have to be drawn are paid for first, so they don't push the optional redraws before them over budget
+    uint64_t texelsDrawn = 0;
+    for (size_t i = 0; i < scheduled.size(); i++)
+    {
+        if (scheduled[i].UpdateDue)
+            texelsDrawn += cost(i);
+    }
+
+    for (size_t i : updateOrder)
+    {
+        ScheduledShadow& shadow = scheduled[i];
+
+        // Something is always drawn, even if it alone is over budget
+        if (!shadow.UpdateDue && (texelsDrawn == 0 || texelsDrawn + cost(i) <= TexelBudget))
+        {
+            shadow.UpdateDue = true;
+            texelsDrawn += cost(i);
+        }
+
+        if (shadow.UpdateDue)
+            slotted[i].State->UpdatesSinceDrawn = 0;
+        else
+            slotted[i].State->UpdatesSinceDrawn++;
+    }
+
+    // Shadowed lights first in score order, as the shaders only look up shadows for the first of each type
+    std::vector<CombinedLight> sortedLights;
+    sortedLights.reserve(lights.size());
+    for (const Candidate& candidate : slotted)
+        sortedLights.push_back(lights[candidate.Index]);
+    for (size_t i = 0; i < lights.size(); i++)
+    {
+        if (!hasSlot[i])
+            sortedLights.push_back(lights[i]);
+    }
+    lights = std::move(sortedLights);
+
+    return scheduled;
+}
+
+float ShadowScheduler::GetScore(LightObject* lightObject, LightType lightType)
+{
+    auto iter = lightStates.find({ lightObject, lightType });
+    if (iter == lightStates.end())
+        return 0.0f;
+    return iter->second.Score;
+}
+
+float ShadowScheduler::ScoreLight(const CombinedLight& light, std::shared_ptr<Camera> camera, float& screenCoverage)
+{
+    screenCoverage = 1.0f;
+    if (camera == nullptr || light.LightObject == nullptr)
+        return 0.0f;
+
+    Color color;
+    float strength = 0.0f;
+    float rank = 0.0f;
+    float distanceFactor = 1.0f;
+
+    if (light.LightType == LightType::Directional)
+    {
+        // Directional lights reach everything on screen
+        color = light.DirectionalLight.Color;
+        strength = light.DirectionalLight.Strength;
+        rank = light.DirectionalLight.Rank;
+    }
+    else
+    {
+        const LightCommon& common = light.LightType == LightType::Point ? light.PointLight.Light : light.SpotLight.Light;
+        color = common.Color;
+        strength = common.Strength;
+        rank = common.Rank;
+
+        Vector3 position = light.LightObject->GetWorldPosition();
+        float range = std::max<float>(common.MaxDistance, 0.001f);
+        screenCoverage = ShadowAtlas::GetScreenCoverage(BoundingSphere(position, range), camera);
+
+        // Falls off with the camera's distance from the edge of the light's range
+        float distance = std::max<float>(0.0f, (position - camera->GetPosition()).Length() - range);
+        distanceFactor = range / (range + distance);
+    }
+
+    float intensity = std::max<float>(0.0f, strength) * std::max<float>({ color.x, color.y, color.z });
+    return intensity * screenCoverage * distanceFactor * exp2f(rank * RankWeight);
+}
+
+void ShadowScheduler::Release()
+{
+    lightStates.clear();
+}
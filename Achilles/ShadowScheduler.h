@@ -0,0 +1,63 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <map>
+#include "Lights.h"
+
+class Camera;
+class ShadowCamera;
+class LightObject;
+
+// Decides each shadow update which lights get shadows, how big their atlas tiles are and whether they're redrawn
+// Lights are scored from their screen coverage, distance, intensity, rank and how long it's been since they were drawn
+class ShadowScheduler
+{
+public:
+    // Each rank a light is above another doubles its score this many times
+    inline static float RankWeight = 0.25f;
+    // How much more a light's score counts towards being redrawn for each update it's skipped
+    inline static float StalenessWeight = 0.5f;
+    // A light holding a slot or tile size keeps it until it's beaten by this fraction, so lights don't pop between them
+    inline static float Hysteresis = 0.25f;
+    // Texels redrawn each shadow update, lights past it are skipped and keep what their tiles already hold
+    // Only lights that have to be drawn (a new slot or tile size, or MaxUpdateInterval reached) can take it over
+    // GPU time isn't measured, so texels stand in for the cost of a redraw
+    inline static uint64_t TexelBudget = 2048ull * 2048ull * 2ull;
+    // A light is redrawn at least every this many updates, whatever the budget
+    inline static uint32_t MaxUpdateInterval = 8;
+
+    struct ScheduledShadow
+    {
+        LightObject* LightObject = nullptr;
+        LightType LightType = LightType::None;
+        std::shared_ptr<ShadowCamera> ShadowCamera;
+        uint32_t TileSize = 0;
+        float Score = 0.0f;
+        bool UpdateDue = true;
+    };
+
+    // Scores every shadow casting light and gives the best of each type a shadow slot, up to the MAX_*_SHADOW_MAPS limits
+    // lights is sorted so those given a slot come first, best first, as the shaders expect shadowed lights at the front
+    // Returns one entry per slot in the same order. Nothing is scheduled without a camera
+    static std::vector<ScheduledShadow> Schedule(std::vector<CombinedLight>& lights, std::shared_ptr<Camera> camera);
+
+    // Score from the last Schedule, 0 for lights that weren't scored
+    static float GetScore(LightObject* lightObject, LightType lightType);
+    static float ScoreLight(const CombinedLight& light, std::shared_ptr<Camera> camera, float& screenCoverage);
+
+    static void Release();
+
+protected:
+    struct LightState
+    {
+        float Score = 0.0f;
+        bool HadSlot = false;
+        uint32_t TileSize = 0;
+        uint32_t UpdatesSinceDrawn = 0;
+        uint64_t LastScheduled = 0;
+    };
+
+    inline static std::map<std::pair<LightObject*, LightType>, LightState> lightStates;
+    inline static uint64_t scheduleIndex = 0;
+};
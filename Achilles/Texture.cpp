@@ -2,6 +2,8 @@
 #include "Application.h"
 #include "ResourceStateTracker.h"
 #include "CommandList.h"
+#include "TextureResidency.h"
+#include "TextureStreamer.h"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
@@ -80,6 +82,33 @@ void Texture::Resize(uint32_t width, uint32_t height, uint32_t depthOrArraySize)
     }
 }
 
+void Texture::SetPlaceholder(std::shared_ptr<Texture> placeholder)
+{
+    // Set directly rather than through SetD3D12Resource, which would rename the placeholder's resource
+    d3d12Resource = placeholder->GetD3D12Resource();
+    isTransparent = placeholder->IsTransparent();
+    isStreaming = true;
+    CreateViews();
+}
+
+void Texture::FinishStreaming(ComPtr<ID3D12Resource> resource, bool _isTransparent)
+{
+    SetD3D12Resource(resource);
+    isTransparent = _isTransparent;
+    isStreaming = false;
+    CreateViews();
+}
+
+size_t Texture::GetSizeInBytes() const
+{
+    if (sizedResource != d3d12Resource.Get())
+    {
+        sizedResource = d3d12Resource.Get();
+        sizeInBytes = TextureResidency::GetResourceSize(sizedResource);
+    }
+    return sizeInBytes;
+}
+
 bool Texture::GetSize(float& width, float& height)
 {
     width = 0;
@@ -430,21 +459,30 @@ DXGI_FORMAT Texture::GetTypelessFormat(DXGI_FORMAT format)
     return typelessFormat;
 }
 
-void Texture::AddCachedTexture(std::wstring contentName, std::shared_ptr<Texture> texture)
+void Texture::AddCachedTexture(std::wstring contentName, std::shared_ptr<Texture> texture, bool evictable)
 {
+    texture->isEvictable = evictable;
+
+    std::lock_guard<std::mutex> lock(textureCacheMutex);
     textureCache[contentName] = texture;
 }
 
 std::shared_ptr<Texture> Texture::AddCachedTextureFromContent(std::shared_ptr<CommandList> commandList, std::wstring contentName, TextureUsage textureUsage)
 {
-    std::shared_ptr<Texture> texture = std::make_shared<Texture>();
-    commandList->LoadTextureFromContent(*texture, contentName, textureUsage);
+    AssetKey key(GetContentDirectoryW() + L"textures/" + contentName, std::to_wstring((int)textureUsage));
+    std::shared_ptr<Texture> texture = assetCache.GetOrLoad(key, [&]()
+        {
+            std::shared_ptr<Texture> loadedTexture = std::make_shared<Texture>();
+            commandList->LoadTextureFromContent(*loadedTexture, contentName, textureUsage);
+            return loadedTexture;
+        });
     AddCachedTexture(contentName, texture);
     return texture;
 }
 
 std::shared_ptr<Texture> Texture::GetCachedTexture(std::wstring contentName)
 {
+    std::lock_guard<std::mutex> lock(textureCacheMutex);
     auto iter = textureCache.find(contentName);
     if (iter != textureCache.end())
     {
@@ -456,6 +494,7 @@ std::shared_ptr<Texture> Texture::GetCachedTexture(std::wstring contentName)
 std::vector<std::wstring> Texture::GetCachedTextureNames()
 {
     std::vector<std::wstring> names{};
+    std::lock_guard<std::mutex> lock(textureCacheMutex);
     for (auto pair : textureCache)
     {
         names.push_back(pair.first);
@@ -553,56 +592,64 @@ std::shared_ptr<Texture> Texture::LoadTextureFromAssimp(std::shared_ptr<CommandL
             commandList->GenerateMips(*texture);
         }
 
-        Texture::AddCachedTexture(textureFilename, texture);;
+        Texture::AddCachedTexture(textureFilename, texture, true);
     }
     return texture;
 }
 
-std::shared_ptr<Texture> Texture::GetTextureFromPath(std::shared_ptr<CommandList> commandList, std::wstring path, std::wstring basePath)
+std::shared_ptr<Texture> Texture::GetTextureFromPath(std::shared_ptr<CommandList> commandList, std::wstring path, std::wstring basePath, TextureUsage textureUsage)
 {
     std::filesystem::path file = std::filesystem::path(path);
     std::wstring filename = file.filename();
     std::error_code ec;
 
-    std::shared_ptr<Texture> cachedTexture = GetCachedTexture(filename);
-    if (cachedTexture != nullptr && cachedTexture->IsValid())
-    {
-        return cachedTexture;
-    }
-
     if (basePath == L"")
         basePath = std::filesystem::current_path();
 
-    std::shared_ptr<Texture> texture = std::make_shared<Texture>(TextureUsage::Generic, filename);
-
-    // Absolute Path
+    // Absolute path, then relative path
     std::filesystem::path realPath = file;
-    if (std::filesystem::exists(realPath))
-    {
-        commandList->LoadTextureFromFile(*texture, realPath, TextureUsage::Generic);
-        Texture::AddCachedTexture(filename, texture);
-
-        return texture;
-    }
+    if (!std::filesystem::exists(realPath, ec))
+        realPath = std::filesystem::canonical(basePath + path, ec);
 
-    // Relative path
-    realPath = std::filesystem::canonical(basePath + path, ec);
-    if (std::filesystem::exists(realPath))
+    bool isFile = std::filesystem::exists(realPath, ec);
+    if (!isFile)
     {
-        commandList->LoadTextureFromFile(*texture, realPath, TextureUsage::Generic);
-        Texture::AddCachedTexture(filename, texture);
-
-        return texture;
+        // Textures referenced relative to a packed model only exist in the pack
+        std::filesystem::path packedPath = std::filesystem::path(basePath + path).lexically_normal();
+        if (ContentPack::Contains(packedPath))
+        {
+            realPath = packedPath;
+            isFile = true;
+        }
     }
+    AssetKey key(isFile ? realPath.wstring() : GetContentDirectoryW() + L"textures/" + filename, std::to_wstring((int)textureUsage));
 
-    // Content
-    commandList->LoadTextureFromContent(*texture, filename, TextureUsage::Generic);
-
-    if (texture != nullptr && texture->IsValid())
+    auto loadTexture = [&]() -> std::shared_ptr<Texture>
+        {
+            std::shared_ptr<Texture> texture = std::make_shared<Texture>(textureUsage, filename);
+            if (isFile)
+            {
+                if (!TextureStreamer::LoadTextureFromFile(texture, realPath, textureUsage))
+                    commandList->LoadTextureFromFile(*texture, realPath, textureUsage);
+            }
+            else
+            {
+                // Content
+                commandList->LoadTextureFromContent(*texture, filename, textureUsage);
+                if (!texture->IsValid())
+                    return nullptr;
+            }
+
+            Texture::AddCachedTexture(filename, texture, true);
+            return texture;
+        };
+
+    std::shared_ptr<Texture> texture = assetCache.GetOrLoad(key, loadTexture);
+    if (texture != nullptr && !texture->IsValid())
     {
-        Texture::AddCachedTexture(filename, texture);
-        return texture;
+        // A file that failed to stream in earlier, try it again
+        assetCache.Remove(key);
+        texture = assetCache.GetOrLoad(key, loadTexture);
     }
-
-    return nullptr;
+    return texture;
 }
@@ -2,6 +2,7 @@
 
 #include <filesystem>
 #include "Common.h"
+#include "AssetCache.h"
 #include "Resource.h"
 #include "DescriptorAllocation.h"
 #include "TextureUsage.h"
@@ -13,6 +14,8 @@ using Microsoft::WRL::ComPtr;
 
 class Texture : public Resource
 {
+    friend class TextureResidency;
+
 public:
     explicit Texture(TextureUsage _textureUsage = TextureUsage::Albedo, const std::wstring& name = L"");
     explicit Texture(const D3D12_RESOURCE_DESC& _resourceDesc, const D3D12_CLEAR_VALUE* _clearValue = nullptr, TextureUsage _textureUsage = TextureUsage::Albedo, const std::wstring& name = L"");
@@ -44,6 +47,20 @@ public:
         isTransparent = _isTransparent;
     }
 
+    // Whether a placeholder is being shown while the texture's file streams in. See TextureStreamer
+    virtual bool IsStreaming() const
+    {
+        return isStreaming;
+    }
+
+    // Show the placeholder's resource until FinishStreaming is called
+    virtual void SetPlaceholder(std::shared_ptr<Texture> placeholder);
+    // Swap the placeholder for the loaded resource. A null resource leaves the texture empty, for files that failed to load
+    virtual void FinishStreaming(ComPtr<ID3D12Resource> resource, bool _isTransparent);
+
+    // Size of the resource's allocation in video memory
+    virtual size_t GetSizeInBytes() const;
+
     // Resize the texture.
     virtual void Resize(uint32_t width, uint32_t height, uint32_t depthOrArraySize = 1);
 
@@ -109,17 +126,28 @@ protected:
 
     TextureUsage textureUsage;
     bool isTransparent = false;
+    bool isStreaming = false;
+
+    // See TextureResidency
+    uint64_t lastUsedFrame = 0;
+    bool isEvictable = false;
+    mutable size_t sizeInBytes = 0;
+    mutable ID3D12Resource* sizedResource = nullptr;
 
 protected:
     inline static std::map<std::wstring, std::shared_ptr<Texture>> textureCache{};
+    inline static std::mutex textureCacheMutex{};
+    // Textures loaded from files, by path and usage. Loads of the same file share one texture, even across threads
+    inline static AssetCache<Texture> assetCache{};
 
 public:
-    static void AddCachedTexture(std::wstring contentName, std::shared_ptr<Texture> texture);
+    // Evictable textures are dropped by TextureResidency once nothing else holds them and the cache is over budget
+    static void AddCachedTexture(std::wstring contentName, std::shared_ptr<Texture> texture, bool evictable = false);
     static std::shared_ptr<Texture> AddCachedTextureFromContent(std::shared_ptr<CommandList> commandList, std::wstring contentName, TextureUsage textureUsage = TextureUsage::Albedo);
     static std::shared_ptr<Texture> GetCachedTexture(std::wstring contentName);
     static std::vector<std::wstring> GetCachedTextureNames();
     static std::map<std::wstring, std::shared_ptr<Texture>>& GetTextureCache();
 
     static std::shared_ptr<Texture> LoadTextureFromAssimp(std::shared_ptr<CommandList> commandList, const aiTexture* tex, std::wstring textureFilename);
-    static std::shared_ptr<Texture> GetTextureFromPath(std::shared_ptr<CommandList> commandList, std::wstring path, std::wstring basePath = L"");
+    static std::shared_ptr<Texture> GetTextureFromPath(std::shared_ptr<CommandList> commandList, std::wstring path, std::wstring basePath = L"", TextureUsage textureUsage = TextureUsage::Generic);
 };
\ No newline at end of file
@@ -0,0 +1,285 @@
+#include "TextureCooker.h"
+#include "CommandList.h"
+#include "ContentPack.h"
+#include "Helpers.h"
+#include "Profiling.h"
+#include <DirectXTex.h>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+using namespace DirectX;
+
+void TextureCooker::LoadTexture(const std::wstring& fileName, TextureUsage textureUsage, TexMetadata& metadata, ScratchImage& scratchImage, bool& isTransparent)
+{
+    if (!Enabled || !CanCook(fileName, textureUsage))
+    {
+        CommandList::DecodeTextureFile(fileName, metadata, scratchImage);
+        isTransparent = !scratchImage.IsAlphaAllOpaque();
+        return;
+    }
+
+    SourceStamp source{};
+    if (!GetSourceStamp(fileName, source))
+    {
+        CommandList::DecodeTextureFile(fileName, metadata, scratchImage);
+        isTransparent = !scratchImage.IsAlphaAllOpaque();
+        return;
+    }
+
+    std::wstring cookedPath = GetCookedPath(fileName, textureUsage);
+    std::wstring ddsPath = cookedPath + L".dds";
+    std::wstring sidecarPath = cookedPath + L".meta";
+
+    // The sidecar is written last, so a DDS without one is from an interrupted cook
+    SourceStamp cooked{};
+    bool hashed = source.Packed;
+    if (ReadSidecar(sidecarPath, cooked, isTransparent))
+    {
+        bool upToDate = false;
+        if (source.Packed)
+        {
+            upToDate = cooked.Hash == source.Hash;
+        }
+        else if (cooked.Size == source.Size)
+        {
+            // Only read the whole source when its write time has changed, e.g. after a checkout that left it as it was
+            upToDate = cooked.WriteTime == source.WriteTime;
+            if (!upToDate)
+            {
+                source.Hash = HashFile(fileName);
+                hashed = true;
+                upToDate = cooked.Hash == source.Hash;
+                if (upToDate)
+                    WriteSidecar(sidecarPath, fileName, source, isTransparent);
+            }
+        }
+
+        if (upToDate && SUCCEEDED(LoadFromDDSFile(ddsPath.c_str(), DDS_FLAGS_NONE, &metadata, scratchImage)))
+            return;
+    }
+
+    CommandList::DecodeTextureFile(fileName, metadata, scratchImage);
+    isTransparent = !scratchImage.IsAlphaAllOpaque();
+
+    if (!CanCook(metadata))
+        return;
+
+    {
+        ScopedTimer _prof(L"Cook Texture");
+        Cook(textureUsage, metadata, scratchImage, isTransparent);
+    }
+
+    // Write to a temporary file first so a concurrent load never reads a partial DDS
+    std::error_code ec;
+    std::filesystem::create_directories(GetCookedDirectory(), ec);
+    std::wstring temporaryPath = ddsPath + L".tmp" + std::to_wstring(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    if (FAILED(SaveToDDSFile(scratchImage.GetImages(), scratchImage.GetImageCount(), metadata, DDS_FLAGS_NONE, temporaryPath.c_str())))
+    {
+        OutputDebugStringWFormatted(L"Failed to save cooked texture %s\n", ddsPath.c_str());
+        std::filesystem::remove(temporaryPath, ec);
+        return;
+    }
+    std::filesystem::rename(temporaryPath, ddsPath, ec);
+    if (ec)
+    {
+        std::filesystem::remove(temporaryPath, ec);
+        return;
+    }
+
+    if (!hashed)
+        source.Hash = HashFile(fileName);
+    WriteSidecar(sidecarPath, fileName, source, isTransparent);
+}
+
+std::wstring TextureCooker::GetCookedDirectory()
+{
+    return GetDirectoryFromPath(GetExePathW()) + L"/cooked/";
+}
+
+bool TextureCooker::CanCook(const std::wstring& fileName, TextureUsage textureUsage)
+{
+    // DDS files are already in their GPU format, and BC6H isn't worth cooking HDRs on load for
+    std::wstring extension = ToLowerWString(std::filesystem::path(fileName).extension().wstring());
+    if (extension == L".dds" || extension == L".hdr")
+        return false;
+
+    switch (textureUsage)
+    {
+    case TextureUsage::Generic:
+    case TextureUsage::Linear:
+    case TextureUsage::Heightmap:
+    case TextureUsage::Normalmap:
+    case TextureUsage::sRGB:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool TextureCooker::CanCook(const TexMetadata& metadata)
+{
+    return metadata.dimension == TEX_DIMENSION_TEXTURE2D && metadata.arraySize == 1 && metadata.depth == 1 && !metadata.IsCubemap()
+        && !IsCompressed(metadata.format) && BitsPerColor(metadata.format) == 8;
+}
+
+std::wstring TextureCooker::GetCookedPath(const std::wstring& fileName, TextureUsage textureUsage)
+{
+    // FNV-1a over the absolute path, so the same file reached through different relative paths shares a cooked file
+    std::error_code ec;
+    std::wstring absolutePath = std::filesystem::absolute(fileName, ec).wstring();
+    if (ec)
+        absolutePath = fileName;
+    uint64_t pathHash = 14695981039346656037ull;
+    for (wchar_t c : absolutePath)
+    {
+        pathHash ^= (uint64_t)c;
+        pathHash *= 1099511628211ull;
+    }
+
+    wchar_t hash[17] = {};
+    swprintf_s(hash, L"%016llx", (unsigned long long)pathHash);
+
+    std::wstring stem = std::filesystem::path(fileName).stem().wstring();
+    std::wstring mode = UseBC7 ? L"bc7" : L"bc";
+    return GetCookedDirectory() + stem + L"_" + hash + L"_" + std::to_wstring((int)textureUsage) + L"_" + mode + L"_v" + std::to_wstring(CookerVersion);
+}
+
+bool TextureCooker::GetSourceStamp(const std::wstring& fileName, SourceStamp& stamp)
+{
+    // Packed files were hashed when the pack was built
+    if (ContentPack::GetHash(fileName, stamp.Hash))
+    {
+        stamp.Packed = true;
+        return true;
+    }
+
+    std::error_code ec;
+    std::filesystem::path path(fileName);
+    stamp.Size = std::filesystem::file_size(path, ec);
+    if (ec)
+        return false;
+    stamp.WriteTime = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+    return !ec;
+}
+
+uint64_t TextureCooker::HashFile(const std::wstring& fileName)
+{
+    uint64_t hash = 14695981039346656037ull;
+
+    std::ifstream file(std::filesystem::path(fileName), std::ios::binary);
+    char buffer[64 * 1024];
+    while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0)
+    {
+        std::streamsize count = file.gcount();
+        for (std::streamsize i = 0; i < count; i++)
+        {
+            hash ^= (uint8_t)buffer[i];
+            hash *= 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+DXGI_FORMAT TextureCooker::GetCompressedFormat(TextureUsage textureUsage, bool isTransparent)
+{
+    // Normals only need two channels, the shader reconstructs z
+    if (textureUsage == TextureUsage::Normalmap)
+        return DXGI_FORMAT_BC5_UNORM;
+    if (UseBC7)
+        return DXGI_FORMAT_BC7_UNORM;
+    return isTransparent ? DXGI_FORMAT_BC3_UNORM : DXGI_FORMAT_BC1_UNORM;
+}
+
+void TextureCooker::Cook(TextureUsage textureUsage, TexMetadata& metadata, ScratchImage& scratchImage, bool isTransparent)
+{
+    // Tag sRGB data before filtering so the mips are averaged in linear space
+    if (textureUsage == TextureUsage::sRGB)
+    {
+        scratchImage.OverrideFormat(MakeSRGB(metadata.format));
+        metadata.format = scratchImage.GetMetadata().format;
+    }
+
+    if (metadata.mipLevels <= 1)
+    {
+        ScratchImage mipChain;
+        ThrowIfFailed(GenerateMipMaps(scratchImage.GetImages(), scratchImage.GetImageCount(), metadata, TEX_FILTER_DEFAULT, 0, mipChain));
+        scratchImage = std::move(mipChain);
+        metadata = scratchImage.GetMetadata();
+    }
+
+    // Block compressed textures need the top level to be a multiple of 4. Others are kept uncompressed, but still get their mips cooked
+    if (metadata.width % 4 != 0 || metadata.height % 4 != 0)
+        return;
+
+    DXGI_FORMAT compressedFormat = GetCompressedFormat(textureUsage, isTransparent);
+    if (IsSRGB(metadata.format))
+        compressedFormat = MakeSRGB(compressedFormat);
+
+    TEX_COMPRESS_FLAGS compressFlags = TEX_COMPRESS_DEFAULT | TEX_COMPRESS_PARALLEL;
+    if (compressedFormat == DXGI_FORMAT_BC7_UNORM || compressedFormat == DXGI_FORMAT_BC7_UNORM_SRGB)
+        compressFlags |= TEX_COMPRESS_BC7_QUICK;
+
+    ScratchImage compressed;
+    ThrowIfFailed(Compress(scratchImage.GetImages(), scratchImage.GetImageCount(), metadata, compressedFormat, compressFlags, TEX_THRESHOLD_DEFAULT, compressed));
+    scratchImage = std::move(compressed);
+    metadata = scratchImage.GetMetadata();
+}
+
+bool TextureCooker::ReadSidecar(const std::wstring& path, SourceStamp& stamp, bool& isTransparent)
+{
+    std::wifstream file(std::filesystem::path(path), std::ios::in);
+    if (!file.is_open())
+        return false;
+
+    // Every value has to be there, a sidecar missing one is from an older cooker or was cut short
+    bool hasTransparent = false, hasSize = false, hasWriteTime = false, hasHash = false;
+    std::wstring key;
+    while (file >> key)
+    {
+        if (key == L"Transparent")
+        {
+            int value = 0;
+            hasTransparent = (bool)(file >> value);
+            isTransparent = value != 0;
+        }
+        else if (key == L"Size")
+        {
+            hasSize = (bool)(file >> stamp.Size);
+        }
+        else if (key == L"WriteTime")
+        {
+            hasWriteTime = (bool)(file >> stamp.WriteTime);
+        }
+        else if (key == L"Hash")
+        {
+            hasHash = (bool)(file >> std::hex >> stamp.Hash >> std::dec);
+        }
+        else
+        {
+            // The source's path, which may contain spaces
+            std::wstring rest;
+            std::getline(file, rest);
+        }
+    }
+    return hasTransparent && hasSize && hasWriteTime && hasHash;
+}
+
+void TextureCooker::WriteSidecar(const std::wstring& path, const std::wstring& sourceFileName, const SourceStamp& stamp, bool isTransparent)
+{
+    // Written to a temporary file first so a concurrent load never reads a partial sidecar
+    std::wstring temporaryPath = path + L".tmp" + std::to_wstring(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    {
+        std::wofstream file(std::filesystem::path(temporaryPath), std::ios::out);
+        file << L"Transparent " << (isTransparent ? 1 : 0) << L"\n";
+        file << L"Size " << stamp.Size << L"\n";
+        file << L"WriteTime " << stamp.WriteTime << L"\n";
+        file << L"Hash " << std::hex << stamp.Hash << std::dec << L"\n";
+        file << L"Source " << sourceFileName << L"\n";
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temporaryPath, path, ec);
+    if (ec)
+        std::filesystem::remove(temporaryPath, ec);
+}
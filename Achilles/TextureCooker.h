@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <dxgiformat.h>
+#include "TextureUsage.h"
+
+namespace DirectX
+{
+    struct TexMetadata;
+    class ScratchImage;
+}
+
+// Converts texture files into block compressed DDS files with a full mip chain the first time they're loaded
+// Cooked files are keyed by the source's path and the usage. The sidecar records the source's size, write time and content hash,
+// so an unchanged source is recognised without reading it and only one with a new write time is hashed to see if it was edited
+class TextureCooker
+{
+public:
+    inline static bool Enabled = true;
+    // Colour textures use BC7 rather than BC1/BC3. Better quality, but much slower to cook
+    inline static bool UseBC7 = false;
+    // Bump when the cooked output changes so older files are ignored
+    static constexpr uint32_t CookerVersion = 2;
+
+    // Decode fileName, preferring its cooked version and cooking it if there isn't one
+    // Files that can't be cooked (DDS, HDR, arrays, non-8-bit formats) are decoded as they are. Doesn't touch the GPU, so it can be called from any thread
+    static void LoadTexture(const std::wstring& fileName, TextureUsage textureUsage, DirectX::TexMetadata& metadata, DirectX::ScratchImage& scratchImage, bool& isTransparent);
+
+    // Where cooked files are written, next to the executable
+    static std::wstring GetCookedDirectory();
+
+protected:
+    // What a cooked file was made from
+    struct SourceStamp
+    {
+        uint64_t Size = 0;
+        int64_t WriteTime = 0;
+        uint64_t Hash = 0;
+        // Packed files have no write time, but the pack stores their hash
+        bool Packed = false;
+    };
+
+    static bool CanCook(const std::wstring& fileName, TextureUsage textureUsage);
+    static bool CanCook(const DirectX::TexMetadata& metadata);
+    // Path to the cooked file without an extension. The DDS and the sidecar share it
+    static std::wstring GetCookedPath(const std::wstring& fileName, TextureUsage textureUsage);
+    // Size and write time of the source, or the hash of a packed one. Returns false if the file can't be found
+    static bool GetSourceStamp(const std::wstring& fileName, SourceStamp& stamp);
+    // FNV-1a over the file's contents
+    static uint64_t HashFile(const std::wstring& fileName);
+
+    static DXGI_FORMAT GetCompressedFormat(TextureUsage textureUsage, bool isTransparent);
+    // Generates mips and compresses the source in place
+    static void Cook(TextureUsage textureUsage, DirectX::TexMetadata& metadata, DirectX::ScratchImage& scratchImage, bool isTransparent);
+
+    // The sidecar stores what would otherwise need a scan of the decoded image
+    static bool ReadSidecar(const std::wstring& path, SourceStamp& stamp, bool& isTransparent);
+    static void WriteSidecar(const std::wstring& path, const std::wstring& sourceFileName, const SourceStamp& stamp, bool isTransparent);
+};
@@ -0,0 +1,162 @@
+#include "TextureResidency.h"
+#include "Application.h"
+#include "CommandList.h"
+#include "Helpers.h"
+#include "Profiling.h"
+#include "ResourceStateTracker.h"
+#include "Texture.h"
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+void TextureResidency::Touch(Texture& texture)
+{
+    texture.lastUsedFrame = Application::GetGlobalFrameCounter();
+}
+
+void TextureResidency::Update()
+{
+    if (!Enabled)
+        return;
+
+    ScopedTimer _prof(L"Texture Residency");
+
+    struct ResidentResource
+    {
+        size_t Bytes = 0;
+        uint64_t LastUsedFrame = 0;
+        // References held by the cache entries themselves
+        ULONG CacheReferences = 0;
+        bool Pinned = false;
+    };
+
+    // Released after the locks are dropped
+    std::vector<std::shared_ptr<Texture>> evictedTextures;
+    std::vector<ComPtr<ID3D12Resource>> evictedResources;
+
+    std::scoped_lock lock(Texture::textureCacheMutex, CommandList::textureCacheMutex);
+
+    // Both caches can hold the same resource, so account by resource
+    std::unordered_map<ID3D12Resource*, ResidentResource> resources;
+    for (auto& [name, texture] : Texture::textureCache)
+    {
+        ID3D12Resource* resource = texture->d3d12Resource.Get();
+        if (resource == nullptr)
+            continue;
+
+        ResidentResource& resident = resources[resource];
+        resident.Bytes = texture->GetSizeInBytes();
+        resident.LastUsedFrame = std::max(resident.LastUsedFrame, texture->lastUsedFrame);
+        resident.CacheReferences++;
+        // A texture held by anything but the cache belongs to a live material (or is mid-stream)
+        if (!texture->isEvictable || texture->IsStreaming() || texture.use_count() > 1)
+            resident.Pinned = true;
+    }
+    for (auto& [name, cachedTexture] : CommandList::textureCache)
+    {
+        ID3D12Resource* resource = cachedTexture.Resource.Get();
+        if (resource == nullptr)
+            continue;
+
+        ResidentResource& resident = resources[resource];
+        resident.Bytes = cachedTexture.SizeInBytes;
+        resident.LastUsedFrame = std::max(resident.LastUsedFrame, cachedTexture.LastUsedFrame);
+        resident.CacheReferences++;
+    }
+
+    TextureResidencyStatistics frameStatistics{};
+    std::vector<std::pair<uint64_t, ID3D12Resource*>> candidates;
+    for (auto& [resource, resident] : resources)
+    {
+        frameStatistics.TextureCount++;
+        frameStatistics.ResidentBytes += resident.Bytes;
+
+        // Textures and in-flight command lists hold their own references, so an unpinned resource with any others is still in use
+        if (resident.Pinned || GetReferenceCount(resource) != resident.CacheReferences)
+            continue;
+
+        frameStatistics.EvictableCount++;
+        frameStatistics.EvictableBytes += resident.Bytes;
+        candidates.emplace_back(resident.LastUsedFrame, resource);
+    }
+
+    std::unordered_set<ID3D12Resource*> toEvict;
+    size_t residentBytes = frameStatistics.ResidentBytes;
+    if (residentBytes > BudgetBytes)
+    {
+        std::sort(candidates.begin(), candidates.end());
+        for (auto& [lastUsedFrame, resource] : candidates)
+        {
+            if (residentBytes <= BudgetBytes)
+                break;
+
+            size_t bytes = resources[resource].Bytes;
+            residentBytes -= bytes;
+            toEvict.insert(resource);
+
+            frameStatistics.EvictableCount--;
+            frameStatistics.EvictableBytes -= bytes;
+            frameStatistics.EvictedCount++;
+            frameStatistics.EvictedBytes += bytes;
+        }
+    }
+
+    if (!toEvict.empty())
+    {
+        for (auto iter = Texture::textureCache.begin(); iter != Texture::textureCache.end();)
+        {
+            if (toEvict.contains(iter->second->d3d12Resource.Get()))
+            {
+                evictedTextures.push_back(iter->second);
+                iter = Texture::textureCache.erase(iter);
+            }
+            else
+                ++iter;
+        }
+        for (auto iter = CommandList::textureCache.begin(); iter != CommandList::textureCache.end();)
+        {
+            if (toEvict.contains(iter->second.Resource.Get()))
+            {
+                evictedResources.push_back(iter->second.Resource);
+                iter = CommandList::textureCache.erase(iter);
+            }
+            else
+                ++iter;
+        }
+
+        // Nothing references these anymore, so the address could be reused by the next resource created
+        for (ID3D12Resource* resource : toEvict)
+            ResourceStateTracker::RemoveGlobalResourceState(resource);
+
+        OutputDebugStringWFormatted(L"Evicted %zu textures to fit the texture budget\n", toEvict.size());
+    }
+
+    frameStatistics.TextureCount -= toEvict.size();
+    frameStatistics.ResidentBytes = residentBytes;
+
+    std::lock_guard<std::mutex> statisticsLock(statisticsMutex);
+    frameStatistics.EvictedCount += statistics.EvictedCount;
+    frameStatistics.EvictedBytes += statistics.EvictedBytes;
+    statistics = frameStatistics;
+}
+
+TextureResidencyStatistics TextureResidency::GetStatistics()
+{
+    std::lock_guard<std::mutex> lock(statisticsMutex);
+    return statistics;
+}
+
+size_t TextureResidency::GetResourceSize(ID3D12Resource* resource)
+{
+    if (resource == nullptr)
+        return 0;
+
+    D3D12_RESOURCE_DESC desc = resource->GetDesc();
+    return Application::GetD3D12Device()->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+}
+
+ULONG TextureResidency::GetReferenceCount(ID3D12Resource* resource)
+{
+    resource->AddRef();
+    return resource->Release();
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include "Common.h"
+
+class Texture;
+
+struct TextureResidencyStatistics
+{
+    // Unique resources held by Texture's and CommandList's caches
+    size_t TextureCount = 0;
+    size_t ResidentBytes = 0;
+    // Resources nothing outside the caches is using, which can be evicted
+    size_t EvictableCount = 0;
+    size_t EvictableBytes = 0;
+    // Totals since startup
+    uint64_t EvictedCount = 0;
+    uint64_t EvictedBytes = 0;
+};
+
+// Keeps the texture caches under a video memory budget
+// Textures are evicted least recently bound first, and only when nothing outside the caches holds them, so anything used by a live material stays resident
+// Only textures added to Texture's cache as evictable (imported with models) are considered, along with CommandList cache entries nothing uses
+class TextureResidency
+{
+public:
+    inline static bool Enabled = true;
+    inline static size_t BudgetBytes = 1024ull * 1024 * 1024;
+
+    // Stamp the texture as used this frame. Called by Shader::BindTexture
+    static void Touch(Texture& texture);
+
+    // Evict textures until the caches fit the budget. Called once a frame on the render thread
+    static void Update();
+
+    static TextureResidencyStatistics GetStatistics();
+
+    // Size of the resource's allocation in video memory
+    static size_t GetResourceSize(ID3D12Resource* resource);
+
+protected:
+    // Current COM reference count of the resource
+    static ULONG GetReferenceCount(ID3D12Resource* resource);
+
+    inline static TextureResidencyStatistics statistics{};
+    inline static std::mutex statisticsMutex;
+};
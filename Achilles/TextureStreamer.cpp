@@ -0,0 +1,242 @@
+#include "TextureStreamer.h"
+#include "Application.h"
+#include "CommandList.h"
+#include "CommandQueue.h"
+#include "Helpers.h"
+#include "Profiling.h"
+#include "Texture.h"
+#include "TextureCooker.h"
+#include <DirectXTex.h>
+#include <objbase.h>
+
+using namespace DirectX;
+
+struct TextureStreamer::DecodedTexture
+{
+    std::wstring FileName;
+    TextureUsage Usage;
+    TexMetadata Metadata;
+    ScratchImage Image;
+    bool IsTransparent = false;
+};
+
+bool TextureStreamer::LoadTextureFromFile(std::shared_ptr<Texture> texture, const std::wstring& fileName, TextureUsage textureUsage)
+{
+    if (!Enabled)
+        return false;
+
+    std::shared_ptr<Texture> placeholder = Texture::GetCachedTexture(L"White");
+    if (placeholder == nullptr || !placeholder->IsValid())
+        return false;
+
+    // Already loaded, no need to stream
+    if (CommandList::GetTextureFromCache(*texture, fileName, textureUsage))
+        return true;
+
+    texture->SetTextureUsage(textureUsage);
+    texture->SetPlaceholder(placeholder);
+
+    {
+        std::lock_guard<std::mutex> lock(streamerMutex);
+
+        std::vector<std::shared_ptr<Texture>>& waiting = waitingTextures[{ fileName, textureUsage }];
+        waiting.push_back(texture);
+        if (waiting.size() > 1)
+            return true;
+
+        requests.push(StreamRequest{ fileName, textureUsage });
+    }
+
+    StartWorkers();
+    requestCV.notify_one();
+    return true;
+}
+
+void TextureStreamer::StartWorkers()
+{
+    std::lock_guard<std::mutex> lock(streamerMutex);
+    if (!workers.empty())
+        return;
+
+    stopWorkers = false;
+
+    uint32_t count = WorkerCount;
+    if (count == 0)
+        count = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+    for (uint32_t i = 0; i < count; i++)
+        workers.emplace_back(&TextureStreamer::WorkerLoop);
+}
+
+void TextureStreamer::WorkerLoop()
+{
+    // WIC decoding needs COM on this thread
+    HRESULT comResult = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+    while (true)
+    {
+        StreamRequest request;
+        {
+            std::unique_lock<std::mutex> lock(streamerMutex);
+            requestCV.wait(lock, [] { return stopWorkers || !requests.empty(); });
+            if (stopWorkers)
+                break;
+
+            request = requests.front();
+            requests.pop();
+        }
+
+        std::shared_ptr<DecodedTexture> decoded = std::make_shared<DecodedTexture>();
+        decoded->FileName = request.FileName;
+        decoded->Usage = request.Usage;
+
+        try
+        {
+            TextureCooker::LoadTexture(request.FileName, request.Usage, decoded->Metadata, decoded->Image, decoded->IsTransparent);
+        }
+        catch (const std::exception& e)
+        {
+            OutputDebugStringWFormatted(L"Failed to stream texture %s: %S\n", request.FileName.c_str(), e.what());
+            decoded = nullptr;
+        }
+
+        std::lock_guard<std::mutex> lock(streamerMutex);
+        if (decoded != nullptr)
+            decodedTextures.push(decoded);
+        else
+            failedFiles.push_back(request);
+    }
+
+    if (SUCCEEDED(comResult))
+        CoUninitialize();
+}
+
+void TextureStreamer::FinishFile(const std::wstring& fileName, TextureUsage textureUsage, std::shared_ptr<Texture> loadedTexture)
+{
+    std::vector<std::shared_ptr<Texture>> waiting;
+    {
+        std::lock_guard<std::mutex> lock(streamerMutex);
+        auto iter = waitingTextures.find({ fileName, textureUsage });
+        if (iter == waitingTextures.end())
+            return;
+        waiting = std::move(iter->second);
+        waitingTextures.erase(iter);
+    }
+
+    if (loadedTexture == nullptr)
+    {
+        for (std::shared_ptr<Texture> texture : waiting)
+            texture->FinishStreaming(nullptr, false);
+        return;
+    }
+
+    // Cache it now rather than when it was recorded, so other queues can't pick it up before the upload is done
+    CommandList::AddTextureToCache(fileName, textureUsage, loadedTexture->GetD3D12Resource(), loadedTexture->IsTransparent());
+
+    for (std::shared_ptr<Texture> texture : waiting)
+    {
+        texture->FinishStreaming(loadedTexture->GetD3D12Resource(), loadedTexture->IsTransparent());
+        texture->SetName(fileName);
+    }
+}
+
+void TextureStreamer::Update()
+{
+    ScopedTimer _prof(L"Texture Streaming");
+
+    std::shared_ptr<CommandQueue> copyQueue = Application::GetCommandQueue(D3D12_COMMAND_LIST_TYPE_COPY);
+    std::shared_ptr<CommandQueue> computeQueue = Application::GetCommandQueue(D3D12_COMMAND_LIST_TYPE_COMPUTE);
+    if (copyQueue == nullptr || computeQueue == nullptr)
+        return;
+
+    // Swap in the batches the GPU has finished with. This is on the render thread, so nothing is mid-draw with the old views
+    for (auto iter = uploadBatches.begin(); iter != uploadBatches.end();)
+    {
+        bool copied = copyQueue->IsFenceComplete(iter->CopyFenceValue);
+        bool mipsGenerated = iter->ComputeFenceValue == 0 || computeQueue->IsFenceComplete(iter->ComputeFenceValue);
+        if (!copied || !mipsGenerated)
+        {
+            ++iter;
+            continue;
+        }
+
+        for (auto& [request, loadedTexture] : iter->Textures)
+            FinishFile(request.FileName, request.Usage, loadedTexture);
+        iter = uploadBatches.erase(iter);
+    }
+
+    std::vector<StreamRequest> failed;
+    std::vector<std::shared_ptr<DecodedTexture>> toUpload;
+    {
+        std::lock_guard<std::mutex> lock(streamerMutex);
+        failed.swap(failedFiles);
+
+        size_t uploadBytes = 0;
+        while (!decodedTextures.empty() && (toUpload.empty() || uploadBytes + decodedTextures.front()->Image.GetPixelsSize() <= MaxUploadBytesPerFrame))
+        {
+            uploadBytes += decodedTextures.front()->Image.GetPixelsSize();
+            toUpload.push_back(decodedTextures.front());
+            decodedTextures.pop();
+        }
+    }
+
+    for (const StreamRequest& request : failed)
+        FinishFile(request.FileName, request.Usage, nullptr);
+
+    if (toUpload.empty())
+        return;
+
+    // All of this frame's textures go in one copy command list
+    std::shared_ptr<CommandList> commandList = copyQueue->GetCommandList();
+    UploadBatch batch{};
+    for (std::shared_ptr<DecodedTexture> decoded : toUpload)
+    {
+        std::shared_ptr<Texture> loadedTexture = std::make_shared<Texture>(decoded->Usage, decoded->FileName);
+        try
+        {
+            commandList->UploadDecodedTexture(*loadedTexture, decoded->FileName, decoded->Metadata, decoded->Image, decoded->IsTransparent, decoded->Usage);
+            batch.Textures.emplace_back(StreamRequest{ decoded->FileName, decoded->Usage }, loadedTexture);
+        }
+        catch (const std::exception& e)
+        {
+            OutputDebugStringWFormatted(L"Failed to stream texture %s: %S\n", decoded->FileName.c_str(), e.what());
+            FinishFile(decoded->FileName, decoded->Usage, nullptr);
+        }
+    }
+
+    bool generatesMips = commandList->GetGenerateMipsCommandList() != nullptr;
+    batch.CopyFenceValue = copyQueue->ExecuteCommandList(commandList);
+    if (generatesMips)
+        batch.ComputeFenceValue = computeQueue->Signal();
+
+    uploadBatches.push_back(std::move(batch));
+}
+
+void TextureStreamer::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(streamerMutex);
+        stopWorkers = true;
+    }
+    requestCV.notify_all();
+
+    for (std::thread& worker : workers)
+    {
+        if (worker.joinable())
+            worker.join();
+    }
+
+    std::lock_guard<std::mutex> lock(streamerMutex);
+    workers.clear();
+    requests = {};
+    decodedTextures = {};
+    failedFiles.clear();
+    uploadBatches.clear();
+    waitingTextures.clear();
+}
+
+size_t TextureStreamer::GetPendingCount()
+{
+    std::lock_guard<std::mutex> lock(streamerMutex);
+    return waitingTextures.size();
+}
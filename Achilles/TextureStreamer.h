@@ -0,0 +1,74 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TextureUsage.h"
+
+class Texture;
+
+// Loads texture files without blocking the caller. Files are decoded (and cooked, see TextureCooker) on worker threads and uploaded on the copy queue
+// Textures show the "White" cached texture until their upload has finished
+class TextureStreamer
+{
+public:
+    inline static bool Enabled = true;
+    // 0 uses one less than the number of hardware threads
+    inline static uint32_t WorkerCount = 0;
+    // Decoded bytes submitted to the copy queue per frame. At least one texture is submitted each frame regardless
+    inline static size_t MaxUploadBytesPerFrame = 64 * 1024 * 1024;
+
+    // Binds the placeholder to texture and queues the file. Returns false without doing anything when streaming is disabled
+    // or there's no placeholder yet, so the caller can load the file directly
+    static bool LoadTextureFromFile(std::shared_ptr<Texture> texture, const std::wstring& fileName, TextureUsage textureUsage = TextureUsage::Generic);
+
+    // Submits decoded textures and swaps in the ones that have finished uploading. Called once a frame on the render thread
+    static void Update();
+
+    // Stops the workers. Textures that haven't finished keep their placeholder
+    static void Shutdown();
+
+    // Files waiting to be decoded, uploaded or swapped in
+    static size_t GetPendingCount();
+
+protected:
+    struct StreamRequest
+    {
+        std::wstring FileName;
+        TextureUsage Usage;
+    };
+
+    // Defined in the source file so DirectXTex stays out of this header
+    struct DecodedTexture;
+
+    struct UploadBatch
+    {
+        uint64_t CopyFenceValue = 0;
+        // Mips are generated on the compute queue after the copy. 0 if none of the batch needed them
+        uint64_t ComputeFenceValue = 0;
+        // Textures the data was uploaded into, by file and usage
+        std::vector<std::pair<StreamRequest, std::shared_ptr<Texture>>> Textures;
+    };
+
+    static void StartWorkers();
+    static void WorkerLoop();
+    // Moves the loaded resource into every texture waiting on the file with that usage. loadedTexture is nullptr if the file failed to load
+    static void FinishFile(const std::wstring& fileName, TextureUsage textureUsage, std::shared_ptr<Texture> loadedTexture);
+
+    inline static std::vector<std::thread> workers;
+    inline static std::queue<StreamRequest> requests;
+    inline static std::queue<std::shared_ptr<DecodedTexture>> decodedTextures;
+    inline static std::vector<StreamRequest> failedFiles;
+    inline static std::vector<UploadBatch> uploadBatches;
+    // Textures waiting on each file and usage, so a file requested several times is only loaded once per format
+    inline static std::map<std::pair<std::wstring, TextureUsage>, std::vector<std::shared_ptr<Texture>>> waitingTextures;
+    inline static std::mutex streamerMutex;
+    inline static std::condition_variable requestCV;
+    inline static bool stopWorkers = false;
+};
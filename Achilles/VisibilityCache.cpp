@@ -0,0 +1,174 @@
+#include "VisibilityCache.h"
+#include "Object.h"
+#include "Camera.h"
+#include "Application.h"
+#include <algorithm>
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+bool VisibilityCache::IsVisible(std::shared_ptr<Camera> camera, std::shared_ptr<Object> object)
+{
+    if (camera == nullptr || object == nullptr)
+        return false;
+    if (!Enabled)
+        return object->Object::ShouldDraw(camera->GetFrustum());
+
+    uint64_t frame = Application::GetGlobalFrameCounter();
+    if (statisticsFrame != frame)
+    {
+        lastStatistics = statisticsFrame + 1 == frame ? statistics : Statistics{};
+        statistics = Statistics{};
+        statisticsFrame = frame;
+    }
+    statistics.Queries++;
+
+    CameraCache& cache = GetCameraCache(camera);
+    if (cache.LastFrame != frame)
+        BeginFrame(cache, camera, frame);
+
+    Entry& entry = cache.entries[object.get()];
+    entry.LastQueried = frame;
+
+    // A new object may have the address of one that's gone
+    uint64_t boundsVersion = object->GetBoundsVersion();
+    bool sameObject = entry.Object.lock() == object;
+    if (sameObject && entry.BoundsVersion == boundsVersion)
+    {
+        if (entry.CameraVersion == cache.CameraVersion)
+        {
+            statistics.Reused++;
+            return entry.Visible;
+        }
+
+        // The sphere is still fully inside or outside if it was far enough from every plane for how far they could have moved
+        if (entry.Epoch == cache.Epoch)
+        {
+            float centerLength = XMVectorGetX(XMVector3Length(XMLoadFloat3(&entry.Center)));
+            bool inside = true, outside = false;
+            for (int i = 0; i < 6; i++)
+            {
+                float drift = cache.NormalDrift[i] * centerLength + cache.OffsetDrift[i];
+                inside &= entry.Distances[i] - drift >= entry.Radius;
+                outside |= entry.Distances[i] + drift < -entry.Radius;
+            }
+
+            if (inside || outside)
+            {
+                entry.Visible = inside;
+                entry.CameraVersion = cache.CameraVersion;
+                statistics.Classified++;
+                return entry.Visible;
+            }
+        }
+    }
+
+    // Only objects left near the boundary count towards moving the reference planes, not ones being measured again
+    if (!sameObject || entry.BoundsVersion != boundsVersion || entry.Epoch != cache.Epoch)
+    {
+        entry.Object = object;
+        entry.BoundsVersion = boundsVersion;
+        MeasureDistances(cache, entry, object);
+    }
+    else
+    {
+        cache.TestedThisFrame++;
+    }
+
+    entry.Visible = object->Object::ShouldDraw(cache.Frustum);
+    entry.CameraVersion = cache.CameraVersion;
+    statistics.Tested++;
+    return entry.Visible;
+}
+
+VisibilityCache::CameraCache& VisibilityCache::GetCameraCache(std::shared_ptr<Camera> camera)
+{
+    auto iter = cameraCaches.find(camera.get());
+    if (iter != cameraCaches.end() && iter->second.Camera.lock() == camera)
+        return iter->second;
+
+    // Cameras that are gone, one of which may have had this camera's address
+    std::erase_if(cameraCaches, [](const auto& entry) { return entry.second.Camera.expired(); });
+
+    CameraCache& cache = cameraCaches[camera.get()];
+    cache = CameraCache{};
+    cache.Camera = camera;
+    return cache;
+}
+
+void VisibilityCache::BeginFrame(CameraCache& cache, std::shared_ptr<Camera> camera, uint64_t frame)
+{
+    cache.LastFrame = frame;
+    cache.TestedLastFrame = cache.TestedThisFrame;
+    cache.TestedThisFrame = 0;
+
+    if (frame % std::max<uint32_t>(EvictAfterFrames, 1) == 0)
+        std::erase_if(cache.entries, [&](const auto& entry) { return frame - entry.second.LastQueried > EvictAfterFrames || entry.second.Object.expired(); });
+
+    Matrix viewProjection = camera->GetViewProj();
+    if (cache.CameraVersion != 0 && viewProjection == cache.ViewProjection)
+        return;
+
+    cache.ViewProjection = viewProjection;
+    cache.Frustum = camera->GetFrustum();
+    cache.CameraVersion++;
+
+    XMFLOAT4 planes[6];
+    GetPlanes(cache.Frustum, planes);
+
+    // Too much was tested again last frame, so the planes have drifted too far to be useful
+    bool rebase = cache.Epoch == 0 || cache.TestedLastFrame > RebaseFraction * cache.entries.size();
+    if (rebase)
+    {
+        std::copy(std::begin(planes), std::end(planes), std::begin(cache.ReferencePlanes));
+        cache.Epoch++;
+    }
+
+    for (int i = 0; i < 6; i++)
+    {
+        XMVECTOR plane = XMLoadFloat4(&planes[i]);
+        XMVECTOR reference = XMLoadFloat4(&cache.ReferencePlanes[i]);
+        cache.NormalDrift[i] = XMVectorGetX(XMVector3Length(XMVectorSubtract(plane, reference)));
+        cache.OffsetDrift[i] = fabsf(planes[i].w - cache.ReferencePlanes[i].w);
+    }
+}
+
+void VisibilityCache::GetPlanes(const BoundingFrustum& frustum, XMFLOAT4 planes[6])
+{
+    XMVECTOR nearPlane, farPlane, rightPlane, leftPlane, topPlane, bottomPlane;
+    frustum.GetPlanes(&nearPlane, &farPlane, &rightPlane, &leftPlane, &topPlane, &bottomPlane);
+    XMStoreFloat4(&planes[0], nearPlane);
+    XMStoreFloat4(&planes[1], farPlane);
+    XMStoreFloat4(&planes[2], rightPlane);
+    XMStoreFloat4(&planes[3], leftPlane);
+    XMStoreFloat4(&planes[4], topPlane);
+    XMStoreFloat4(&planes[5], bottomPlane);
+}
+
+void VisibilityCache::MeasureDistances(const CameraCache& cache, Entry& entry, std::shared_ptr<Object> object)
+{
+    BoundingSphere sphere;
+    BoundingSphere::CreateFromBoundingBox(sphere, object->GetWorldBoundingBox());
+    entry.Center = sphere.Center;
+    entry.Radius = sphere.Radius;
+    entry.Epoch = cache.Epoch;
+
+    // The planes face outwards, so distances are flipped to be positive inside
+    XMVECTOR center = XMVectorSetW(XMLoadFloat3(&entry.Center), 1.0f);
+    for (int i = 0; i < 6; i++)
+        entry.Distances[i] = -XMVectorGetX(XMVector4Dot(XMLoadFloat4(&cache.ReferencePlanes[i]), center));
+}
+
+VisibilityCache::Statistics VisibilityCache::GetStatistics()
+{
+    if (statisticsFrame + 1 == Application::GetGlobalFrameCounter())
+        return statistics;
+    if (statisticsFrame == Application::GetGlobalFrameCounter())
+        return lastStatistics;
+    return Statistics{};
+}
+
+void VisibilityCache::Release()
+{
+    cameraCaches.clear();
+}
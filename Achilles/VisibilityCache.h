@@ -0,0 +1,85 @@
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <directxtk12/SimpleMath.h>
+
+using DirectX::SimpleMath::Matrix;
+
+class Camera;
+class Object;
+
+// Keeps each camera's frustum culling results between frames so unchanged objects aren't tested again
+// Results are reused while neither the camera nor the object's bounds have changed. When the camera moves, each object's distance
+// from the frustum planes is checked against how far the planes could have moved, and only objects near the boundary are tested again
+// Only tests bounds, the same as Object::ShouldDraw, so overrides like SpriteObject's aren't applied
+class VisibilityCache
+{
+public:
+    inline static bool Enabled = true;
+    // Once more than this fraction of a camera's objects are tested again in a frame, the distances are measured from the camera's current planes
+    inline static float RebaseFraction = 0.25f;
+    // Objects that haven't been checked for this many frames are forgotten
+    inline static uint32_t EvictAfterFrames = 120;
+
+    struct Statistics
+    {
+        uint32_t Queries = 0;
+        uint32_t Reused = 0; // Neither the camera nor the object changed
+        uint32_t Classified = 0; // Decided from the distances to the planes
+        uint32_t Tested = 0; // Tested against the frustum again
+    };
+
+    // Whether the object's bounds are in the camera's frustum
+    static bool IsVisible(std::shared_ptr<Camera> camera, std::shared_ptr<Object> object);
+    // Counts for the last whole frame, summed over every camera
+    static Statistics GetStatistics();
+    static void Release();
+
+protected:
+    struct Entry
+    {
+        std::weak_ptr<Object> Object;
+        uint64_t BoundsVersion = 0;
+        uint64_t CameraVersion = 0;
+        uint64_t Epoch = 0;
+        uint64_t LastQueried = 0;
+        bool Visible = false;
+        // Bounding sphere and its distance inside each reference plane, negative when outside
+        DirectX::XMFLOAT3 Center;
+        float Radius = 0.0f;
+        float Distances[6] = {};
+    };
+
+    struct CameraCache
+    {
+        std::weak_ptr<Camera> Camera;
+        Matrix ViewProjection;
+        DirectX::BoundingFrustum Frustum;
+        uint64_t CameraVersion = 0;
+        uint64_t LastFrame = UINT64_MAX;
+        // Planes the entry distances are measured from, outward facing
+        DirectX::XMFLOAT4 ReferencePlanes[6];
+        uint64_t Epoch = 0;
+        // How far each plane's normal and offset have moved from the reference
+        float NormalDrift[6] = {};
+        float OffsetDrift[6] = {};
+        // Objects near the boundary that had to be tested again
+        uint32_t TestedThisFrame = 0;
+        uint32_t TestedLastFrame = 0;
+        std::unordered_map<const Object*, Entry> entries;
+    };
+
+    static CameraCache& GetCameraCache(std::shared_ptr<Camera> camera);
+    static void BeginFrame(CameraCache& cache, std::shared_ptr<Camera> camera, uint64_t frame);
+    static void GetPlanes(const DirectX::BoundingFrustum& frustum, DirectX::XMFLOAT4 planes[6]);
+    static void MeasureDistances(const CameraCache& cache, Entry& entry, std::shared_ptr<Object> object);
+
+    inline static std::unordered_map<const Camera*, CameraCache> cameraCaches;
+    inline static Statistics statistics;
+    inline static Statistics lastStatistics;
+    inline static uint64_t statisticsFrame = 0;
+};
@@ -7,6 +7,35 @@
 #include "CommonShader.hlsli"
 #include "Lighting.hlsli"
 
+// Permutations compile features in or out (see BlinnPhong::PermutationFeatures), the uber shader decides per pixel from the material
+#ifdef PERMUTATION
+    #ifdef DIFFUSE_TEXTURE
+        #define HAS_DIFFUSE_TEXTURE true
+    #else
+        #define HAS_DIFFUSE_TEXTURE false
+    #endif
+    #ifdef NORMAL_TEXTURE
+        #define HAS_NORMAL_TEXTURE true
+    #else
+        #define HAS_NORMAL_TEXTURE false
+    #endif
+    #ifdef EMISSION_TEXTURE
+        #define HAS_EMISSION_TEXTURE true
+    #else
+        #define HAS_EMISSION_TEXTURE false
+    #endif
+    #ifdef RECEIVE_SHADOWS
+        #define HAS_RECEIVE_SHADOWS true
+    #else
+        #define HAS_RECEIVE_SHADOWS false
+    #endif
+#else
+    #define HAS_DIFFUSE_TEXTURE true // Samples the white texture when there isn't one
+    #define HAS_NORMAL_TEXTURE ((MaterialPropertiesCB.TextureFlags & TEXTUREFLAGS_NORMAL) != 0)
+    #define HAS_EMISSION_TEXTURE ((MaterialPropertiesCB.TextureFlags & TEXTUREFLAGS_EMISSION) != 0)
+    #define HAS_RECEIVE_SHADOWS (MaterialPropertiesCB.ReceivesShadows > 0.5f)
+#endif
+
 struct Matrices
 {
     matrix MVP; // Model * View * Projection, used for SV_Position
@@ -40,16 +69,30 @@ struct PixelInfo
     float ShadingType;
 };
 
+struct ObjectLightInfo
+{
+    uint Offset;
+    uint Count;
+    uint Enabled;
+    uint Padding;
+};
+
 ConstantBuffer<Matrices> MatricesCB : register(b0);
 ConstantBuffer<PixelInfo> PixelInfoCB : register(b1);
 ConstantBuffer<MaterialProperties> MaterialPropertiesCB : register(b2);
 ConstantBuffer<LightProperties> LightPropertiesCB : register(b3);
 ConstantBuffer<AmbientLight> AmbientLightCB : register(b4);
+ConstantBuffer<ClusterInfo> ClusterInfoCB : register(b5);
+ConstantBuffer<ObjectLightInfo> ObjectLightInfoCB : register(b6);
 
 StructuredBuffer<PointLight> PointLights : register(t0);
 StructuredBuffer<SpotLight> SpotLights : register(t1);
 StructuredBuffer<DirectionalLight> DirectionalLights : register(t2);
 StructuredBuffer<CascadeInfo> CascadeInfos : register(t3);
+StructuredBuffer<PointShadowInfo> PointShadowInfos : register(t4);
+StructuredBuffer<uint2> ClusterGrid : register(t5); // Offset and count into ClusterLightIndices
+StructuredBuffer<uint> ClusterLightIndices : register(t6); // Point lights, then spot lights offset by the point light count
+StructuredBuffer<uint> ObjectLightIndices : register(t7); // Same as ClusterLightIndices
 
 Texture2D DiffuseTexture : register(t0, space1);
 Texture2D NormalTexture : register(t1, space1);
@@ -58,26 +101,8 @@ Texture2D EmissionTexture : register(t2, space1);
 SamplerState TextureSampler : register(s0);
 SamplerState TrilinearSampler : register(s1);
 
-Texture2D SpotShadowMap0 : register(t0, space2);
-Texture2D SpotShadowMap1 : register(t1, space2);
-Texture2D SpotShadowMap2 : register(t2, space2);
-Texture2D SpotShadowMap3 : register(t3, space2);
-Texture2D SpotShadowMap4 : register(t4, space2);
-Texture2D SpotShadowMap5 : register(t5, space2);
-Texture2D SpotShadowMap6 : register(t6, space2);
-Texture2D SpotShadowMap7 : register(t7, space2);
-
-Texture2D CascadedShadowMap0[MAX_NUM_CASCADES] : register(t0, space3);
-Texture2D CascadedShadowMap1[MAX_NUM_CASCADES] : register(t6, space3);
-Texture2D CascadedShadowMap2[MAX_NUM_CASCADES] : register(t12, space3);
-Texture2D CascadedShadowMap3[MAX_NUM_CASCADES] : register(t18, space3);
-
-TextureCube PointShadowMap0 : register(t0, space4);
-TextureCube PointShadowMap1 : register(t1, space4);
-TextureCube PointShadowMap2 : register(t2, space4);
-TextureCube PointShadowMap3 : register(t3, space4);
-TextureCube PointShadowMap4 : register(t4, space4);
-TextureCube PointShadowMap5 : register(t5, space4);
+// Every light's shadow views are tiles of this, see ShadowAtlas
+Texture2D ShadowAtlas : register(t0, space2);
 
 struct PS_IN
 {
@@ -113,6 +138,7 @@ PS_IN VS(CommonShaderVertex v)
     
     o.Depth = mul(MatricesCB.View, o.PositionWS).z;
     
+#if !defined(PERMUTATION) || defined(RECEIVE_SHADOWS)
     uint spotShadowCount = LightPropertiesCB.SpotShadowCount;
     uint cascadeShadowCount = LightPropertiesCB.CascadeShadowCount;
     
@@ -132,18 +158,77 @@ PS_IN VS(CommonShaderVertex v)
         o.SpotShadowPosH6 = mul(o.PositionWS, SpotLights[6].LightInfo.ShadowMatrix);
     if (spotShadowCount > 7)
         o.SpotShadowPosH7 = mul(o.PositionWS, SpotLights[7].LightInfo.ShadowMatrix);
+#endif
     
     return o;
 }
 
-LightResult DoLighting(float3 screenPos, float3 worldPos, float3 normal, float3 viewPos, float specularPower, float spotShadowFactors[MAX_SPOT_SHADOW_MAPS], float cascadedShadowFactors[MAX_CASCADED_SHADOW_MAPS], float pointShadowFactors[MAX_POINT_SHADOW_MAPS])
+// index is a point light below the point light count, otherwise a spot light offset by it
+LightResult DoIndexedLighting(uint index, float3 worldPos, float3 normal, float3 viewDir, float specularPower, float spotShadowFactors[MAX_SPOT_SHADOW_MAPS], float pointShadowFactors[MAX_POINT_SHADOW_MAPS])
+{
+    LightResult lightResult;
+    if (index < LightPropertiesCB.PointLightCount)
+    {
+        lightResult = DoPointLighting(PointLights[index], worldPos, normal, viewDir, specularPower);
+        if (index < MAX_POINT_SHADOW_MAPS)
+        {
+            lightResult.Diffuse *= pointShadowFactors[index];
+            lightResult.Specular *= pointShadowFactors[index];
+        }
+    }
+    else
+    {
+        index -= LightPropertiesCB.PointLightCount;
+        lightResult = DoSpotLighting(SpotLights[index], worldPos, normal, viewDir, specularPower);
+        if (index < MAX_SPOT_SHADOW_MAPS)
+        {
+            lightResult.Diffuse *= spotShadowFactors[index];
+            lightResult.Specular *= spotShadowFactors[index];
+        }
+    }
+    return lightResult;
+}
+
+LightResult DoLighting(float3 screenPos, float viewDepth, float3 worldPos, float3 normal, float3 viewPos, float specularPower, float spotShadowFactors[MAX_SPOT_SHADOW_MAPS], float cascadedShadowFactors[MAX_CASCADED_SHADOW_MAPS], float pointShadowFactors[MAX_POINT_SHADOW_MAPS])
 {
     LightResult result = (LightResult) 0;
     float3 viewDir = normalize(viewPos - worldPos);
     
     LightResult lightResult;
     uint i = 0;
-    for (i = 0; i < LightPropertiesCB.PointLightCount; i++)
+    uint pointLightCount = LightPropertiesCB.PointLightCount;
+    uint spotLightCount = LightPropertiesCB.SpotLightCount;
+    if (ObjectLightInfoCB.Enabled)
+    {
+        // Only the point and spot lights that reach this object
+        for (uint o = 0; o < ObjectLightInfoCB.Count; o++)
+        {
+            lightResult = DoIndexedLighting(ObjectLightIndices[ObjectLightInfoCB.Offset + o], worldPos, normal, viewDir, specularPower, spotShadowFactors, pointShadowFactors);
+            result.Diffuse += lightResult.Diffuse;
+            result.Specular += lightResult.Specular;
+        }
+        
+        // Skip the loops over every light below
+        pointLightCount = 0;
+        spotLightCount = 0;
+    }
+    else if (ClusterInfoCB.Enabled)
+    {
+        // Only the point and spot lights that reach this pixel's cluster
+        uint2 cluster = ClusterGrid[GetClusterIndex(ClusterInfoCB, screenPos.xy, viewDepth)];
+        for (uint c = 0; c < cluster.y; c++)
+        {
+            lightResult = DoIndexedLighting(ClusterLightIndices[cluster.x + c], worldPos, normal, viewDir, specularPower, spotShadowFactors, pointShadowFactors);
+            result.Diffuse += lightResult.Diffuse;
+            result.Specular += lightResult.Specular;
+        }
+        
+        // Skip the loops over every light below
+        pointLightCount = 0;
+        spotLightCount = 0;
+    }
+    
+    for (i = 0; i < pointLightCount; i++)
     {
         lightResult = DoPointLighting(PointLights[i], worldPos, normal, viewDir, specularPower);
         if (i < MAX_POINT_SHADOW_MAPS)
@@ -154,7 +239,7 @@ LightResult DoLighting(float3 screenPos, float3 worldPos, float3 normal, float3
         result.Diffuse += lightResult.Diffuse;
         result.Specular += lightResult.Specular;
     }
-    for (i = 0; i < LightPropertiesCB.SpotLightCount; i++)
+    for (i = 0; i < spotLightCount; i++)
     {
         lightResult = DoSpotLighting(SpotLights[i], worldPos, normal, viewDir, specularPower);
         if (i < MAX_SPOT_SHADOW_MAPS)
@@ -188,12 +273,14 @@ float4 PS(PS_IN i) : SV_Target
     float2 uv = i.UV;
     uv.xy = (uv.xy * MaterialPropertiesCB.UVScaleOffset.xy) + MaterialPropertiesCB.UVScaleOffset.zw;
     
-    float4 col = DiffuseTexture.Sample(TextureSampler, uv);
+    float4 col = float4(1, 1, 1, 1);
+    if (HAS_DIFFUSE_TEXTURE)
+        col = DiffuseTexture.Sample(TextureSampler, uv);
     col *= MaterialPropertiesCB.Color;
     
     float3 normal = normalize(i.NormalWS);
     
-    if ((MaterialPropertiesCB.TextureFlags & TEXTUREFLAGS_NORMAL) != 0)
+    if (HAS_NORMAL_TEXTURE)
     {
         float3 tangent = normalize(i.TangentWS);
         float3 bitangent = normalize(i.BitangentWS);
@@ -209,18 +296,23 @@ float4 PS(PS_IN i) : SV_Target
         float pointShadowFactors[MAX_POINT_SHADOW_MAPS];
         
         [branch]
-        if (MaterialPropertiesCB.ReceivesShadows > 0.5f) // receives shadows so calculate shadowFactors for the lights
+        if (HAS_RECEIVE_SHADOWS) // receives shadows so calculate shadowFactors for the lights
         {
             // Calc SpotLight shadow factors
             float4 SpotShadowPos[MAX_SPOT_SHADOW_MAPS] =
             {
                 i.SpotShadowPosH0, i.SpotShadowPosH1, i.SpotShadowPosH2, i.SpotShadowPosH3, i.SpotShadowPosH4, i.SpotShadowPosH5, i.SpotShadowPosH6, i.SpotShadowPosH7
             };
-            Texture2D SpotShadowMaps[MAX_SPOT_SHADOW_MAPS] =
+            float4 SpotAtlasRects[MAX_SPOT_SHADOW_MAPS];
+            [unroll]
+            for (uint r = 0; r < MAX_SPOT_SHADOW_MAPS; r++)
             {
-                SpotShadowMap0, SpotShadowMap1, SpotShadowMap2, SpotShadowMap3, SpotShadowMap4, SpotShadowMap5, SpotShadowMap6, SpotShadowMap7
-            };
-            CalcShadowSpotFactors(LightPropertiesCB.SpotShadowCount, SpotShadowPos, SpotShadowMaps, spotShadowFactors);
+                if (r < LightPropertiesCB.SpotShadowCount)
+                    SpotAtlasRects[r] = SpotLights[r].LightInfo.AtlasRect;
+                else
+                    SpotAtlasRects[r] = float4(0, 0, 0, 0);
+            }
+            CalcShadowSpotFactors(LightPropertiesCB.SpotShadowCount, SpotShadowPos, SpotAtlasRects, ShadowAtlas, spotShadowFactors);
             
             // Calculate DirectionalLight shadow factors
             uint NumCascades[MAX_CASCADED_SHADOW_MAPS];
@@ -235,12 +327,12 @@ float4 PS(PS_IN i) : SV_Target
             CascadeInfo CInfos[MAX_CASCADED_SHADOW_MAPS * MAX_NUM_CASCADES];
             
             [unroll]
-            for (uint m = 0; m < MAX_NUM_CASCADES; m++)
+            for (uint m = 0; m < MAX_CASCADED_SHADOW_MAPS; m++)
             {
                 if (m < LightPropertiesCB.CascadeShadowCount)
                 {
                     [unroll]
-                    for (uint n = 0; n < MAX_CASCADED_SHADOW_MAPS; n++)
+                    for (uint n = 0; n < MAX_NUM_CASCADES; n++)
                     {
                         uint o = (m * MAX_NUM_CASCADES) + n;
                         if (n < NumCascades[m])
@@ -262,10 +354,10 @@ float4 PS(PS_IN i) : SV_Target
             }
             else
             {
-                CalcShadowCascadedFactors(cascadeShadowCount, i.PositionWS, i.Depth, CInfos, NumCascades, CascadedShadowMap0, 0, cascadedShadowFactors);
-                CalcShadowCascadedFactors(cascadeShadowCount, i.PositionWS, i.Depth, CInfos, NumCascades, CascadedShadowMap1, 1, cascadedShadowFactors);
-                CalcShadowCascadedFactors(cascadeShadowCount, i.PositionWS, i.Depth, CInfos, NumCascades, CascadedShadowMap2, 2, cascadedShadowFactors);
-                CalcShadowCascadedFactors(cascadeShadowCount, i.PositionWS, i.Depth, CInfos, NumCascades, CascadedShadowMap3, 3, cascadedShadowFactors);
+                CalcShadowCascadedFactors(cascadeShadowCount, i.PositionWS, i.Depth, CInfos, NumCascades, ShadowAtlas, 0, cascadedShadowFactors);
+                CalcShadowCascadedFactors(cascadeShadowCount, i.PositionWS, i.Depth, CInfos, NumCascades, ShadowAtlas, 1, cascadedShadowFactors);
+                CalcShadowCascadedFactors(cascadeShadowCount, i.PositionWS, i.Depth, CInfos, NumCascades, ShadowAtlas, 2, cascadedShadowFactors);
+                CalcShadowCascadedFactors(cascadeShadowCount, i.PositionWS, i.Depth, CInfos, NumCascades, ShadowAtlas, 3, cascadedShadowFactors);
                 
                 if (PixelInfoCB.ShadingType >= 2.5 && PixelInfoCB.ShadingType <= 3.5) // shading type of 3 means cascade debug
                 {
@@ -279,12 +371,8 @@ float4 PS(PS_IN i) : SV_Target
             {
                 lights[l] = PointLights[l];
             }
-            TextureCube textures[MAX_POINT_SHADOW_MAPS] =
-            {
-                PointShadowMap0, PointShadowMap1, PointShadowMap2, PointShadowMap3, PointShadowMap4, PointShadowMap5
-            };
             
-            CalcPointShadowFactors(LightPropertiesCB.PointShadowCount, i.PositionWS.xyz, PixelInfoCB.CameraPosition.xyz, lights, textures, pointShadowFactors);
+            CalcPointShadowFactors(LightPropertiesCB.PointShadowCount, i.PositionWS.xyz, PixelInfoCB.CameraPosition.xyz, lights, PointShadowInfos, ShadowAtlas, pointShadowFactors);
 
         }
         else // If no shadows received then populate
@@ -308,14 +396,14 @@ float4 PS(PS_IN i) : SV_Target
             }
         }
         
-        LightResult result = DoLighting(i.Position.xyz, i.PositionWS.xyz, normal, PixelInfoCB.CameraPosition, MaterialPropertiesCB.SpecularPower, spotShadowFactors, cascadedShadowFactors, pointShadowFactors);
+        LightResult result = DoLighting(i.Position.xyz, i.Depth, i.PositionWS.xyz, normal, PixelInfoCB.CameraPosition, MaterialPropertiesCB.SpecularPower, spotShadowFactors, cascadedShadowFactors, pointShadowFactors);
         float3 diffuse = result.Diffuse * MaterialPropertiesCB.Diffuse;
         float3 specular = result.Specular * MaterialPropertiesCB.Specular;
         float3 ambient = result.Ambient;
         float3 light = diffuse + specular + ambient;
         float4 emission = float4(0, 0, 0, 1);
         
-        if ((MaterialPropertiesCB.TextureFlags & TEXTUREFLAGS_EMISSION) != 0)
+        if (HAS_EMISSION_TEXTURE)
         {
             emission = EmissionTexture.Sample(TextureSampler, uv);
             float emissionStrength = MaterialPropertiesCB.EmissionStrength * emission.a;
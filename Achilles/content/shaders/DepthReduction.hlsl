@@ -0,0 +1,76 @@
+// Reduces the depth buffer to the nearest and furthest depth of each 32x32 tile, ignoring pixels left at the clear depth
+// The tiles are read back and reduced the rest of the way on the CPU, see DepthReduction::ReduceTileRanges
+
+#ifdef MULTISAMPLED
+Texture2DMS<float> Depth : register(t0);
+#else
+Texture2D<float> Depth : register(t0);
+#endif
+RWStructuredBuffer<float2> TileRanges : register(u0);
+
+cbuffer CB0 : register(b0)
+{
+    uint2 DepthDimensions;
+    uint TileCountX;
+    uint SampleCount;
+}
+
+#define GROUP_SIZE 16
+#define TILE_SIZE (GROUP_SIZE * 2) // Each thread reduces a 2x2 block
+
+// x is the nearest depth, y the furthest. Empty ranges have x > y
+static const float2 EmptyRange = float2(1.0f, 0.0f);
+
+groupshared float2 SharedRanges[GROUP_SIZE * GROUP_SIZE];
+
+float2 CombineRanges(float2 a, float2 b)
+{
+    return float2(min(a.x, b.x), max(a.y, b.y));
+}
+
+float2 LoadRange(uint2 pixel)
+{
+    float2 range = EmptyRange;
+    if (any(pixel >= DepthDimensions))
+        return range;
+
+#ifdef MULTISAMPLED
+    for (uint s = 0; s < SampleCount; s++)
+    {
+        float depth = Depth.Load(pixel, s);
+        if (depth < 1.0f)
+            range = CombineRanges(range, float2(depth, depth));
+    }
+#else
+    float depth = Depth.Load(uint3(pixel, 0));
+    if (depth < 1.0f)
+        range = float2(depth, depth);
+#endif
+    return range;
+}
+
+[numthreads(GROUP_SIZE, GROUP_SIZE, 1)]
+void CS(uint3 Gid : SV_GroupID, uint GI : SV_GroupIndex, uint3 GTid : SV_GroupThreadID)
+{
+    uint2 pixel = Gid.xy * TILE_SIZE + GTid.xy * 2;
+
+    float2 range = LoadRange(pixel);
+    range = CombineRanges(range, LoadRange(pixel + uint2(1, 0)));
+    range = CombineRanges(range, LoadRange(pixel + uint2(0, 1)));
+    range = CombineRanges(range, LoadRange(pixel + uint2(1, 1)));
+    SharedRanges[GI] = range;
+
+    GroupMemoryBarrierWithGroupSync();
+
+    [unroll]
+    for (uint stride = (GROUP_SIZE * GROUP_SIZE) / 2; stride > 0; stride >>= 1)
+    {
+        if (GI < stride)
+            SharedRanges[GI] = CombineRanges(SharedRanges[GI], SharedRanges[GI + stride]);
+
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    if (GI == 0)
+        TileRanges[Gid.y * TileCountX + Gid.x] = SharedRanges[0];
+}
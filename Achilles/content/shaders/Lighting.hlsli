@@ -19,6 +19,7 @@
 struct LightInfo
 {
     matrix ShadowMatrix;
+    float4 AtlasRect;
     uint IsShadowCaster;
     float3 Padding;
 };
@@ -96,6 +97,12 @@ struct LightProperties
     float2 Padding;
 };
 
+struct PointShadowInfo
+{
+    matrix FaceMatrices[6];
+    float4 FaceRects[6];
+};
+
 struct LightResult
 {
     float3 Diffuse;
@@ -106,12 +113,39 @@ struct LightResult
 struct CascadeInfo
 {
     matrix CascadeMatrix;
+    float4 AtlasRect;
     float DepthStart;
     float MinBorderPadding;
     float MaxBorderPadding;
     float Padding;
 };
 
+// Matches LightClusters::ClusterInfo
+struct ClusterInfo
+{
+    uint ClusterCountX;
+    uint ClusterCountY;
+    uint ClusterCountZ;
+    uint Enabled;
+    
+    float2 ViewportOrigin;
+    float2 ClustersPerPixel;
+    
+    float SliceScale;
+    float SliceBias;
+    uint LinearSlices;
+    float Padding;
+};
+
+// Cluster a pixel is in from its SV_Position and view space depth, the same as LightClusters::GetClusterIndex and GetSlice
+uint GetClusterIndex(ClusterInfo info, float2 screenPos, float viewDepth)
+{
+    uint2 tile = (uint2) clamp((screenPos - info.ViewportOrigin) * info.ClustersPerPixel, 0, float2(info.ClusterCountX - 1, info.ClusterCountY - 1));
+    float depth = info.LinearSlices ? viewDepth : log2(max(viewDepth, 0.0001));
+    uint slice = (uint) clamp(floor(depth * info.SliceScale + info.SliceBias), 0, info.ClusterCountZ - 1);
+    return (slice * info.ClusterCountY + tile.y) * info.ClusterCountX + tile.x;
+}
+
 float LinearizeDepth(float d, float zNear, float zFar)
 {
     return zNear * zFar / (zFar + d * (zFar - zNear));
@@ -194,17 +228,31 @@ LightResult DoDirectionalLighting(DirectionalLight light, float3 normal, float3
 SamplerComparisonState ShadowComparisonSampler : register(s0, space1);
 SamplerState ShadowSampler : register(s1, space1);
 
-float CalcShadowFactor(float4 shadowPos, Texture2D shadowMap)
+// Every shadow is a tile of one atlas. atlasRect is the tile's offset (xy) and scale (zw) in atlas UVs, see ShadowAtlas::GetUVRect
+// Lights that didn't get a tile have an empty rect, they and positions outside the tile are lit
+float2 GetShadowAtlasUV(float2 tileUV, float4 atlasRect, float texelSize)
+{
+    // Keep filtering inside the tile so it doesn't read the neighbouring shadow
+    float2 uv = atlasRect.xy + tileUV * atlasRect.zw;
+    return clamp(uv, atlasRect.xy + texelSize * 0.5f, atlasRect.xy + atlasRect.zw - texelSize * 0.5f);
+}
+
+float CalcShadowFactor(float4 shadowPos, float4 atlasRect, Texture2D shadowAtlas)
 {
+    if (atlasRect.z <= 0.0f)
+        return 1.0f;
+    if (any(shadowPos.xy < 0.0f) || any(shadowPos.xy > 1.0f))
+        return 1.0f;
+    
     // Depth in NDC space
     float depth = shadowPos.z;
     
     uint width, height, numMips;
-    shadowMap.GetDimensions(0, width, height, numMips);
+    shadowAtlas.GetDimensions(0, width, height, numMips);
     float dx = 1.0f / (float) width; // Texel size
     
 #if DISABLE_PCF
-    return shadowMap.SampleCmpLevelZero(ShadowComparisonSampler, shadowPos.xy, depth).r;
+    return shadowAtlas.SampleCmpLevelZero(ShadowComparisonSampler, GetShadowAtlasUV(shadowPos.xy, atlasRect, dx), depth).r;
 #else
     float percentLit = 0.0f;
     const float2 offsets[9] =
@@ -213,24 +261,28 @@ float CalcShadowFactor(float4 shadowPos, Texture2D shadowMap)
         float2(-dx, 0.0f), float2(0.0f, 0.0f), float2(dx, 0.0f),
         float2(-dx, dx), float2(0.0f, dx), float2(dx, dx)
     };
+    
+    float2 uv = atlasRect.xy + shadowPos.xy * atlasRect.zw;
+    float2 tileMin = atlasRect.xy + dx * 0.5f;
+    float2 tileMax = atlasRect.xy + atlasRect.zw - dx * 0.5f;
 
     [unroll]
     for (int i = 0; i < 9; i++)
     {
-        percentLit += shadowMap.SampleCmpLevelZero(ShadowComparisonSampler, shadowPos.xy + offsets[i], depth).r;
+        percentLit += shadowAtlas.SampleCmpLevelZero(ShadowComparisonSampler, clamp(uv + offsets[i], tileMin, tileMax), depth).r;
     }
     
     return percentLit / 9.0f;
 #endif
 }
 
-float CalcShadowFactorDivision(float4 shadowPosH, Texture2D shadowMap)
+float CalcShadowFactorDivision(float4 shadowPosH, float4 atlasRect, Texture2D shadowAtlas)
 {
     shadowPosH.xyz /= shadowPosH.w; // Complete projection by doing division by w
-    return CalcShadowFactor(shadowPosH, shadowMap);
+    return CalcShadowFactor(shadowPosH, atlasRect, shadowAtlas);
 }
 
-void CalcShadowSpotFactors(in uint shadowCount, in float4 ShadowPos[MAX_SPOT_SHADOW_MAPS], in Texture2D ShadowMaps[MAX_SPOT_SHADOW_MAPS], out float shadowFactors[MAX_SPOT_SHADOW_MAPS])
+void CalcShadowSpotFactors(in uint shadowCount, in float4 ShadowPos[MAX_SPOT_SHADOW_MAPS], in float4 AtlasRects[MAX_SPOT_SHADOW_MAPS], in Texture2D ShadowAtlas, out float shadowFactors[MAX_SPOT_SHADOW_MAPS])
 {
     if (shadowCount <= 0) // No shadows
     {
@@ -247,7 +299,7 @@ void CalcShadowSpotFactors(in uint shadowCount, in float4 ShadowPos[MAX_SPOT_SHA
     {
         [branch]
         if (s < shadowCount)
-            shadowFactors[s] = CalcShadowFactorDivision(ShadowPos[s], ShadowMaps[s]);
+            shadowFactors[s] = CalcShadowFactorDivision(ShadowPos[s], AtlasRects[s], ShadowAtlas);
         else
             shadowFactors[s] = 1.0f;
     }
@@ -255,7 +307,7 @@ void CalcShadowSpotFactors(in uint shadowCount, in float4 ShadowPos[MAX_SPOT_SHA
     return;
 }
 
-void CalcShadowCascadedFactors(in uint shadowCount, in float4 PositionWS, in float PixelDepth, in CascadeInfo CascadeInfos[MAX_CASCADED_SHADOW_MAPS * MAX_NUM_CASCADES], in uint NumCascades[MAX_CASCADED_SHADOW_MAPS], in Texture2D ShadowMaps[MAX_NUM_CASCADES], in uint MapOffset, out float shadowFactors[MAX_CASCADED_SHADOW_MAPS])
+void CalcShadowCascadedFactors(in uint shadowCount, in float4 PositionWS, in float PixelDepth, in CascadeInfo CascadeInfos[MAX_CASCADED_SHADOW_MAPS * MAX_NUM_CASCADES], in uint NumCascades[MAX_CASCADED_SHADOW_MAPS], in Texture2D ShadowAtlas, in uint MapOffset, out float shadowFactors[MAX_CASCADED_SHADOW_MAPS])
 {
     [branch]
     if (MapOffset < shadowCount)
@@ -299,7 +351,7 @@ void CalcShadowCascadedFactors(in uint shadowCount, in float4 PositionWS, in flo
         // float4 shadowPos = mul(PositionWS, ci.CascadeMatrix);
         [branch]
         if (cascadeFound)
-            shadowFactors[MapOffset] = CalcShadowFactorDivision(shadowPos, ShadowMaps[cascade]);
+            shadowFactors[MapOffset] = CalcShadowFactorDivision(shadowPos, ci.AtlasRect, ShadowAtlas);
         else
             shadowFactors[MapOffset] = 1.0f;
     }
@@ -373,21 +425,33 @@ static const float3 PointShadowOffsets[POINT_SHADOW_OFFSETS] =
 	float3(0, 1, 1), float3(0, -1, 1), float3(0, -1, -1), float3(0, 1, -1)
 };
 
-float CalcPointShadowFactor(float3 positionWS, float3 lightPos, float3 cameraPos, TextureCube shadowMap, float4 lightPerspectiveValues)
+// Which face ShadowCamera::GetPointDirectionShadowMatrix renders the direction into: +x, -x, +y, -y, +z, -z
+uint GetPointShadowFace(float3 direction)
+{
+    float3 a = abs(direction);
+    if (a.x >= a.y && a.x >= a.z)
+        return direction.x >= 0.0f ? 0 : 1;
+    if (a.y >= a.z)
+        return direction.y >= 0.0f ? 2 : 3;
+    return direction.z >= 0.0f ? 4 : 5;
+}
+
+// Point shadows store distance / MaxDistance rather than projected depth (see ShadowMappingPoint.hlsl), so this returns the distance to the closest occluder
+// Lit (a very large distance) when the face has no tile
+float SamplePointShadowDistance(float3 lightPos, float3 direction, PointShadowInfo shadowInfo, Texture2D shadowAtlas, float texelSize, float zRange)
+{
+    uint face = GetPointShadowFace(direction);
+    float4 atlasRect = shadowInfo.FaceRects[face];
+    if (atlasRect.z <= 0.0f)
+        return 1e30f;
+    
+    float4 shadowPos = mul(float4(lightPos + direction, 1.0f), shadowInfo.FaceMatrices[face]);
+    float2 uv = GetShadowAtlasUV(saturate(shadowPos.xy / shadowPos.w), atlasRect, texelSize);
+    return shadowAtlas.SampleLevel(ShadowSampler, uv, 0).r * zRange;
+}
+
+float CalcPointShadowFactor(float3 positionWS, float3 lightPos, float3 cameraPos, PointShadowInfo shadowInfo, Texture2D shadowAtlas, float4 lightPerspectiveValues)
 {
-    /*
-    const float bias = 0.005;
-    
-    float3 shadowPos = normalize(positionWS - lightPos);
-    
-    float3 shadowPosAbs = abs(shadowPos);
-    // float z = max(shadowPosAbs.x, max(shadowPosAbs.y, shadowPosAbs.z));
-    float z = length(shadowPosAbs);
-    float depth = (lightPerspectiveValues.x * z + lightPerspectiveValues.y) / z;
-    
-    return shadowMap.SampleCmpLevelZero(ShadowComparisonSampler, shadowPos, depth - bias).r;
-    */
-    
     float offsetBias = 0.05;
     
     float zNear = lightPerspectiveValues.w;
@@ -397,10 +461,14 @@ float CalcPointShadowFactor(float3 positionWS, float3 lightPos, float3 cameraPos
     float3 shadowPos = positionWS - lightPos;
     float currentDepth = length(shadowPos);
     
+    uint width, height, numMips;
+    shadowAtlas.GetDimensions(0, width, height, numMips);
+    float texelSize = 1.0f / (float) width;
+    
     float shadowFactor = 0.0f;
     
 #if DISABLE_PCF
-    float closestDepth = shadowMap.SampleLevel(ShadowSampler, shadowPos, 0).r * zRange;
+    float closestDepth = SamplePointShadowDistance(lightPos, shadowPos, shadowInfo, shadowAtlas, texelSize, zRange);
     
     if ((currentDepth - offsetBias) < closestDepth)
     {
@@ -411,17 +479,14 @@ float CalcPointShadowFactor(float3 positionWS, float3 lightPos, float3 cameraPos
     float viewDistance = length(cameraPos - positionWS);
     float diskRadius = (1.0 + (viewDistance / zFar)) / 25.0;
 #else
-    // float width, height;
-    // shadowMap.GetDimensions(width, height);
-    
-    // float diskRadius = (10.0 / width);
     float diskRadius = 0.05;
 #endif
     
+    // Each offset picks its own face so the filter carries across the cube's edges
     for (int s = 0; s < POINT_SHADOW_OFFSETS; s++)
     {
         float3 texel = shadowPos + PointShadowOffsets[s] * diskRadius;
-        float closestDepth = shadowMap.SampleLevel(ShadowSampler, texel, 0).r * zRange;
+        float closestDepth = SamplePointShadowDistance(lightPos, texel, shadowInfo, shadowAtlas, texelSize, zRange);
         
         if ((currentDepth - offsetBias) < closestDepth)
         {
@@ -443,7 +508,7 @@ float4 CalculatePointLightPerspectiveValues(float dist, float radius)
     return float4(x, y, dist, radius);
 }
 
-void CalcPointShadowFactors(in uint shadowCount, in float3 positionWS, in float3 cameraPos, in PointLight Lights[MAX_POINT_SHADOW_MAPS], in TextureCube ShadowMaps[MAX_POINT_SHADOW_MAPS], out float shadowFactors[MAX_POINT_SHADOW_MAPS])
+void CalcPointShadowFactors(in uint shadowCount, in float3 positionWS, in float3 cameraPos, in PointLight Lights[MAX_POINT_SHADOW_MAPS], in StructuredBuffer<PointShadowInfo> ShadowInfos, in Texture2D ShadowAtlas, out float shadowFactors[MAX_POINT_SHADOW_MAPS])
 {
     if (shadowCount <= 0) // No shadows
     {
@@ -465,7 +530,7 @@ void CalcPointShadowFactors(in uint shadowCount, in float3 positionWS, in float3
             float radius = 0.005f; // Lights[s].Light.Radius
             float4 lightPerspectiveValues = CalculatePointLightPerspectiveValues(dist, radius);
             
-            shadowFactors[s] = CalcPointShadowFactor(positionWS, Lights[s].Light.PositionWorldSpace.xyz, cameraPos, ShadowMaps[s], lightPerspectiveValues);
+            shadowFactors[s] = CalcPointShadowFactor(positionWS, Lights[s].Light.PositionWorldSpace.xyz, cameraPos, ShadowInfos[s], ShadowAtlas, lightPerspectiveValues);
         }
         else
             shadowFactors[s] = 1.0f;
@@ -487,6 +552,8 @@ float3 DoNormalMapping(float3x3 TBN, float2 uv, Texture2D tex, SamplerState s)
     float3 N = tex.Sample(s, uv).xyz;
     
     N = ExpandNormal(N);
+    // Cooked normal maps are two channel (BC5), so rebuild z from x and y
+    N.z = sqrt(saturate(1.0f - dot(N.xy, N.xy)));
     N = mul(N, TBN);
     return normalize(N);
 }
\ No newline at end of file
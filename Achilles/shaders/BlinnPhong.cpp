@@ -1,5 +1,7 @@
 #include "BlinnPhong.h"
 #include "../ShadowMap.h"
+#include "../LightClusters.h"
+#include "../ObjectLightLists.h"
 #include "../Application.h"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -61,8 +63,11 @@ bool BlinnPhong::BlinnPhongShaderRender(std::shared_ptr<CommandList> commandList
     commandList->SetGraphicsDynamicStructuredBuffer<SpotLight>(RootParameters::RootParameterSpotLights, lightData.SpotLights);
     commandList->SetGraphicsDynamicStructuredBuffer<DirectionalLight>(RootParameters::RootParameterDirectionalLights, lightData.DirectionalLights);
 
+    // The same key picked the permutation this draw is using, so anything it compiles out doesn't need binding
+    ShaderPermutationKey permutationKey = BlinnPhongPermutationKey(object, knitIndex, mesh, material);
+
     std::shared_ptr<Texture> mainTexture = material.GetTexture(L"MainTexture");
-    if (mainTexture != nullptr && mainTexture->IsValid())
+    if (permutationKey.Has(PermutationFeatures::DiffuseTexture))
     {
         material.shader->BindTexture(*commandList, RootParameters::RootParameterTextures, 0, mainTexture);
         materialProperties.TextureFlags |= TextureFlags::Diffuse;
@@ -73,7 +78,7 @@ bool BlinnPhong::BlinnPhongShaderRender(std::shared_ptr<CommandList> commandList
     }
 
     std::shared_ptr<Texture> normalTexture = material.GetTexture(L"NormalTexture");
-    if (normalTexture != nullptr && normalTexture->IsValid())
+    if (permutationKey.Has(PermutationFeatures::NormalTexture))
     {
         material.shader->BindTexture(*commandList, RootParameters::RootParameterTextures, 1, normalTexture);
         materialProperties.TextureFlags |= TextureFlags::Normal;
@@ -84,7 +89,7 @@ bool BlinnPhong::BlinnPhongShaderRender(std::shared_ptr<CommandList> commandList
     }
 
     std::shared_ptr<Texture> emissionTexture = material.GetTexture(L"EmissionTexture");
-    if (emissionTexture != nullptr && emissionTexture->IsValid())
+    if (permutationKey.Has(PermutationFeatures::EmissionTexture))
     {
         material.shader->BindTexture(*commandList, RootParameters::RootParameterTextures, 2, emissionTexture);
         materialProperties.TextureFlags |= TextureFlags::Emission;
@@ -97,34 +102,17 @@ bool BlinnPhong::BlinnPhongShaderRender(std::shared_ptr<CommandList> commandList
     // Pass material properties now that we have the textue information
     commandList->SetGraphicsDynamicConstantBuffer<MaterialProperties>(RootParameters::RootParameterMaterialProperties, materialProperties);
 
-    // Pass shadow maps to the shader for Shadow Factor
-
+    // Pass the shadow atlas and where each light's shadows are in it to the shader for Shadow Factor
     D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = ShadowMap::GetShadowMapR32SRV();
 
-    for (int i = 0; i < MAX_SPOT_SHADOW_MAPS; i++)
-    {
-        std::shared_ptr<Texture> shadowMap = nullptr;
-        if (i < lightData.SortedSpotShadowMaps.size())
-            shadowMap = lightData.SortedSpotShadowMaps[i];
+    // The slot still needs a descriptor, but knits that don't receive shadows never sample it so get the padding SRV
+    // rather than transitioning and tracking the atlas
+    bool receivesShadows = permutationKey.Has(PermutationFeatures::ReceiveShadows);
 
-        if (shadowMap == nullptr)
-            material.shader->BindTexture(*commandList, RootParameters::RootParameterSpotShadowMaps, i, nullptr);
-        else
-            commandList->SetShaderResourceView(RootParameters::RootParameterSpotShadowMaps, i, *shadowMap, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE, 0, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, &srvDesc);
-    }
-
-    // We multiply max num cascades by max cascades to fill all texture slots
-    for (int i = 0; i < MAX_CASCADED_SHADOW_MAPS * MAX_NUM_CASCADES; i++)
-    {
-        std::shared_ptr<Texture> shadowMap = nullptr;
-        if (i < lightData.SortedCascadeShadowMaps.size())
-            shadowMap = lightData.SortedCascadeShadowMaps[i];
-
-        if (shadowMap == nullptr)
-            material.shader->BindTexture(*commandList, RootParameters::RootParameterCascadeShadowMaps, i, nullptr);
-        else
-            commandList->SetShaderResourceView(RootParameters::RootParameterCascadeShadowMaps, i, *shadowMap, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE, 0, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, &srvDesc);
-    }
+    if (receivesShadows && lightData.ShadowAtlasMap != nullptr)
+        commandList->SetShaderResourceView(RootParameters::RootParameterShadowAtlas, 0, *lightData.ShadowAtlasMap, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE, 0, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, &srvDesc);
+    else
+        material.shader->BindTexture(*commandList, RootParameters::RootParameterShadowAtlas, 0, nullptr);
 
     std::vector<CascadeInfo> cascadeInfos;
     for (int i = 0; i < MAX_CASCADED_SHADOW_MAPS * MAX_NUM_CASCADES; i++)
@@ -136,37 +124,95 @@ bool BlinnPhong::BlinnPhongShaderRender(std::shared_ptr<CommandList> commandList
     }
     commandList->SetGraphicsDynamicStructuredBuffer<CascadeInfo>(RootParameters::RootParameterCascadeInfos, cascadeInfos);
 
+    std::vector<PointShadowInfo> pointShadowInfos;
+    for (int i = 0; i < MAX_POINT_SHADOW_MAPS; i++)
+    {
+        if (i < lightData.SortedPointShadowInfos.size())
+            pointShadowInfos.push_back(lightData.SortedPointShadowInfos[i]);
+        else
+            pointShadowInfos.push_back(PointShadowInfo());
+    }
+    commandList->SetGraphicsDynamicStructuredBuffer<PointShadowInfo>(RootParameters::RootParameterPointShadowInfos, pointShadowInfos);
+
+    BindLightClusters(commandList, camera, lightData);
+    BindObjectLights(commandList, object, lightData);
 
-    D3D12_SHADER_RESOURCE_VIEW_DESC cubeSRVDesc = ShadowMap::GetCubeShadowMapR32SRV();
-    static std::shared_ptr<ShaderResourceView> defaultCubeSRV;
+    return true;
+}
 
-    if (defaultCubeSRV == nullptr)
+void BlinnPhong::BindLightClusters(std::shared_ptr<CommandList> commandList, std::shared_ptr<Camera> camera, LightData& lightData)
+{
+    // The clusters only hold the main camera's view, other cameras fall back to looping over every light
+    std::shared_ptr<LightClusters> clusters = lightData.Clusters;
+    if (clusters == nullptr || clusters->GetCamera() != camera.get() || clusters->GetGrid().empty())
     {
-        // Create an SRV that can be used to pad unused texture slots.
-        D3D12_SHADER_RESOURCE_VIEW_DESC SRV;
-        SRV.Format = DXGI_FORMAT_R32_FLOAT;
-        SRV.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBE;
-        SRV.TextureCube.MostDetailedMip = 0;
-        SRV.TextureCube.MipLevels = 1;
-        SRV.TextureCube.ResourceMinLODClamp = 0;
-        SRV.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-
-        defaultCubeSRV = std::make_shared<ShaderResourceView>(nullptr, &SRV);
+        LightClusters::ClusterInfo disabled{};
+        commandList->SetGraphicsDynamicConstantBuffer<LightClusters::ClusterInfo>(RootParameters::RootParameterClusterInfo, disabled);
+        commandList->SetGraphicsDynamicStructuredBuffer<LightClusters::ClusterRange>(RootParameters::RootParameterClusterGrid, { LightClusters::ClusterRange{} });
+        commandList->SetGraphicsDynamicStructuredBuffer<uint32_t>(RootParameters::RootParameterClusterLightIndices, { 0 });
+        return;
     }
 
-    for (int i = 0; i < MAX_POINT_SHADOW_MAPS; i++)
+    // The grid and index list are the same for every draw in a frame, so they're only uploaded once per recording of a command list
+    static struct
     {
-        std::shared_ptr<Texture> shadowMap = nullptr;
-        if (i < lightData.SortedPointShadowMaps.size())
-            shadowMap = lightData.SortedPointShadowMaps[i];
+        uint64_t RecordingId = 0;
+        std::weak_ptr<LightClusters> Clusters;
+        D3D12_GPU_VIRTUAL_ADDRESS Grid = 0;
+        D3D12_GPU_VIRTUAL_ADDRESS LightIndices = 0;
+    } uploaded;
 
-        if (shadowMap == nullptr)
-            commandList->SetShaderResourceView(RootParameters::RootParameterPointShadowMaps, i, defaultCubeSRV, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-        else
-            commandList->SetShaderResourceView(RootParameters::RootParameterPointShadowMaps, i, *shadowMap, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE, 0, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, &cubeSRVDesc);
+    if (uploaded.RecordingId != commandList->GetRecordingId() || uploaded.Clusters.lock() != clusters)
+    {
+        const std::vector<uint32_t>& lightIndices = clusters->GetLightIndices();
+        uploaded.RecordingId = commandList->GetRecordingId();
+        uploaded.Clusters = clusters;
+        uploaded.Grid = commandList->CopyDynamicStructuredBuffer<LightClusters::ClusterRange>(clusters->GetGrid());
+        uploaded.LightIndices = lightIndices.empty() ? commandList->CopyDynamicStructuredBuffer<uint32_t>({ 0 }) : commandList->CopyDynamicStructuredBuffer<uint32_t>(lightIndices);
     }
 
-    return true;
+    commandList->SetGraphicsDynamicConstantBuffer<LightClusters::ClusterInfo>(RootParameters::RootParameterClusterInfo, clusters->GetClusterInfo());
+    commandList->SetGraphicsShaderResourceView(RootParameters::RootParameterClusterGrid, uploaded.Grid);
+    commandList->SetGraphicsShaderResourceView(RootParameters::RootParameterClusterLightIndices, uploaded.LightIndices);
+}
+
+void BlinnPhong::BindObjectLights(std::shared_ptr<CommandList> commandList, std::shared_ptr<Object> object, LightData& lightData)
+{
+    std::shared_ptr<ObjectLightLists> objectLights = lightData.ObjectLights;
+    if (objectLights == nullptr)
+    {
+        commandList->SetGraphics32BitConstants<ObjectLightInfo>(RootParameters::RootParameterObjectLightInfo, ObjectLightInfo{});
+        commandList->SetGraphicsDynamicStructuredBuffer<uint32_t>(RootParameters::RootParameterObjectLightIndices, { 0 });
+        return;
+    }
+
+    // Every object's list is in the one index list, uploaded once per recording of a command list
+    static struct
+    {
+        uint64_t RecordingId = 0;
+        std::weak_ptr<ObjectLightLists> ObjectLights;
+        D3D12_GPU_VIRTUAL_ADDRESS LightIndices = 0;
+    } uploaded;
+
+    if (uploaded.RecordingId != commandList->GetRecordingId() || uploaded.ObjectLights.lock() != objectLights)
+    {
+        const std::vector<uint32_t>& lightIndices = objectLights->GetLightIndices();
+        uploaded.RecordingId = commandList->GetRecordingId();
+        uploaded.ObjectLights = objectLights;
+        uploaded.LightIndices = lightIndices.empty() ? commandList->CopyDynamicStructuredBuffer<uint32_t>({ 0 }) : commandList->CopyDynamicStructuredBuffer<uint32_t>(lightIndices);
+    }
+
+    // Objects drawn outside the queues don't have a list, so loop over every light like when lists are off
+    ObjectLightLists::LightRange range{};
+    ObjectLightInfo info{};
+    if (objectLights->GetLightRange(object.get(), range))
+    {
+        info.Offset = range.Offset;
+        info.Count = range.Count;
+        info.Enabled = 1;
+    }
+    commandList->SetGraphics32BitConstants<ObjectLightInfo>(RootParameters::RootParameterObjectLightInfo, info);
+    commandList->SetGraphicsShaderResourceView(RootParameters::RootParameterObjectLightIndices, uploaded.LightIndices);
 }
 
 std::shared_ptr<Mesh> BlinnPhong::BlinnPhongMeshCreation(aiScene* scene, aiNode* node, aiMesh* inMesh, std::shared_ptr<Shader> shader, Material& material, std::wstring meshPath)
@@ -223,7 +269,7 @@ std::shared_ptr<Mesh> BlinnPhong::BlinnPhongMeshCreation(aiScene* scene, aiNode*
             else // Texture is just a filename
             {
                 std::wstring basePath = std::filesystem::path(meshPath).remove_filename();
-                std::shared_ptr<Texture> texture = Texture::GetTextureFromPath(Object::GetCreationCommandList(), std::filesystem::path(texturePath.C_Str()), basePath);
+                std::shared_ptr<Texture> texture = Texture::GetTextureFromPath(Object::GetCreationCommandList(), std::filesystem::path(texturePath.C_Str()), basePath, TextureUsage::Normalmap);
                 material.SetTexture(L"NormalTexture", texture);
             }
         }
@@ -311,6 +357,25 @@ bool BlinnPhong::BlinnPhongIsKnitTransparent(std::shared_ptr<Object> object, uin
     return texture->IsTransparent() || color.w < 0.99f;
 }
 
+ShaderPermutationKey BlinnPhong::BlinnPhongPermutationKey(std::shared_ptr<Object> object, uint32_t knitIndex, std::shared_ptr<Mesh> mesh, Material& material)
+{
+    ShaderPermutationKey key;
+
+    std::shared_ptr<Texture> mainTexture = material.GetTexture(L"MainTexture");
+    key = key.With(PermutationFeatures::DiffuseTexture, mainTexture != nullptr && mainTexture->IsValid());
+
+    // The streaming placeholder is white, which is fine for colour but not for normals or emission
+    std::shared_ptr<Texture> normalTexture = material.GetTexture(L"NormalTexture");
+    key = key.With(PermutationFeatures::NormalTexture, normalTexture != nullptr && normalTexture->IsValid() && !normalTexture->IsStreaming());
+
+    std::shared_ptr<Texture> emissionTexture = material.GetTexture(L"EmissionTexture");
+    key = key.With(PermutationFeatures::EmissionTexture, emissionTexture != nullptr && emissionTexture->IsValid() && !emissionTexture->IsStreaming());
+
+    key = key.With(PermutationFeatures::ReceiveShadows, object->ReceivesShadows());
+
+    return key;
+}
+
 static std::shared_ptr<Shader> BlinnPhongShader{};
 static CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC BlinnPhongRootSignature{};
 std::shared_ptr<Shader> BlinnPhong::GetBlinnPhongShader(ComPtr<ID3D12Device2> device)
@@ -330,9 +395,7 @@ std::shared_ptr<Shader> BlinnPhong::GetBlinnPhongShader(ComPtr<ID3D12Device2> de
 
     // Texture descriptor ranges
     CD3DX12_DESCRIPTOR_RANGE1 textureDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 3, 0, 1); // 3 textures, offset at 0, in space 1
-    CD3DX12_DESCRIPTOR_RANGE1 spotShadowDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, MAX_SPOT_SHADOW_MAPS, 0, 2); // MAX_SPOT_SHADOW_MAPS textures, offset at 0, in space 2
-    CD3DX12_DESCRIPTOR_RANGE1 cascadeShadowDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, MAX_CASCADED_SHADOW_MAPS * MAX_NUM_CASCADES, 0, 3); // MAX_CASCADED_SHADOW_MAPS * MAX_NUM_CASCADES textures, offset at 0, in space 3
-    CD3DX12_DESCRIPTOR_RANGE1 pointShadowDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, MAX_POINT_SHADOW_MAPS, 0, 4); // MAX_POINT_SHADOW_MAPS textures, offset at 0, in space 4
+    CD3DX12_DESCRIPTOR_RANGE1 shadowAtlasDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 2); // 1 texture, offset at 0, in space 2
 
     // Root parameters
     CD3DX12_ROOT_PARAMETER1 rootParameters[RootParameters::RootParameterCount]{};
@@ -347,11 +410,16 @@ std::shared_ptr<Shader> BlinnPhong::GetBlinnPhongShader(ComPtr<ID3D12Device2> de
     rootParameters[RootParameters::RootParameterSpotLights].InitAsShaderResourceView(1, 0, D3D12_ROOT_DESCRIPTOR_FLAG_NONE, D3D12_SHADER_VISIBILITY_ALL);
     rootParameters[RootParameters::RootParameterDirectionalLights].InitAsShaderResourceView(2, 0, D3D12_ROOT_DESCRIPTOR_FLAG_NONE, D3D12_SHADER_VISIBILITY_ALL);
     rootParameters[RootParameters::RootParameterCascadeInfos].InitAsShaderResourceView(3, 0, D3D12_ROOT_DESCRIPTOR_FLAG_NONE, D3D12_SHADER_VISIBILITY_PIXEL);
+    rootParameters[RootParameters::RootParameterPointShadowInfos].InitAsShaderResourceView(4, 0, D3D12_ROOT_DESCRIPTOR_FLAG_NONE, D3D12_SHADER_VISIBILITY_PIXEL);
 
     rootParameters[RootParameters::RootParameterTextures].InitAsDescriptorTable(1, &textureDescriptorRange, D3D12_SHADER_VISIBILITY_PIXEL);
-    rootParameters[RootParameters::RootParameterSpotShadowMaps].InitAsDescriptorTable(1, &spotShadowDescriptorRange, D3D12_SHADER_VISIBILITY_PIXEL);
-    rootParameters[RootParameters::RootParameterCascadeShadowMaps].InitAsDescriptorTable(1, &cascadeShadowDescriptorRange, D3D12_SHADER_VISIBILITY_PIXEL);
-    rootParameters[RootParameters::RootParameterPointShadowMaps].InitAsDescriptorTable(1, &pointShadowDescriptorRange, D3D12_SHADER_VISIBILITY_PIXEL);
+    rootParameters[RootParameters::RootParameterShadowAtlas].InitAsDescriptorTable(1, &shadowAtlasDescriptorRange, D3D12_SHADER_VISIBILITY_PIXEL);
+
+    rootParameters[RootParameters::RootParameterClusterInfo].InitAsConstantBufferView(5, 0, D3D12_ROOT_DESCRIPTOR_FLAG_NONE, D3D12_SHADER_VISIBILITY_PIXEL);
+    rootParameters[RootParameters::RootParameterClusterGrid].InitAsShaderResourceView(5, 0, D3D12_ROOT_DESCRIPTOR_FLAG_NONE, D3D12_SHADER_VISIBILITY_PIXEL);
+    rootParameters[RootParameters::RootParameterClusterLightIndices].InitAsShaderResourceView(6, 0, D3D12_ROOT_DESCRIPTOR_FLAG_NONE, D3D12_SHADER_VISIBILITY_PIXEL);
+    rootParameters[RootParameters::RootParameterObjectLightInfo].InitAsConstants(sizeof(ObjectLightInfo) / 4, 6, 0, D3D12_SHADER_VISIBILITY_PIXEL);
+    rootParameters[RootParameters::RootParameterObjectLightIndices].InitAsShaderResourceView(7, 0, D3D12_ROOT_DESCRIPTOR_FLAG_NONE, D3D12_SHADER_VISIBILITY_PIXEL);
 
     // Sampler(s)
     std::vector<CD3DX12_STATIC_SAMPLER_DESC> samplers;
@@ -379,8 +447,20 @@ std::shared_ptr<Shader> BlinnPhong::GetBlinnPhongShader(ComPtr<ID3D12Device2> de
     BlinnPhongShader = Shader::ShaderVSPS(device, CommonShaderInputLayout, _countof(CommonShaderInputLayout), sizeof(CommonShaderVertex), rootSignature, BlinnPhongShaderRender, L"BlinnPhong", D3D12_CULL_MODE_BACK, true);
     BlinnPhongShader->meshCreateCallback = BlinnPhongMeshCreation;
     BlinnPhongShader->knitTransparencyCallback = BlinnPhongIsKnitTransparent;
+    BlinnPhongShader->permutationKeyCallback = BlinnPhongPermutationKey;
+    BlinnPhongShader->permutationCreateCallback = BlinnPhongPermutationCreation;
+    BlinnPhongShader->permutationDefines = { L"DIFFUSE_TEXTURE", L"NORMAL_TEXTURE", L"EMISSION_TEXTURE", L"RECEIVE_SHADOWS" };
 
     whitePixelTexture = Texture::GetCachedTexture(L"White");
 
     return BlinnPhongShader;
 }
+
+std::shared_ptr<Shader> BlinnPhong::BlinnPhongPermutationCreation(ShaderPermutationKey key)
+{
+    std::shared_ptr<Shader> shader = GetBlinnPhongShader();
+    std::shared_ptr<Shader> permutation = Shader::ShaderVSPS(Application::GetD3D12Device(), CommonShaderInputLayout, _countof(CommonShaderInputLayout), sizeof(CommonShaderVertex), shader->rootSignature, BlinnPhongShaderRender, L"BlinnPhong", D3D12_CULL_MODE_BACK, true, DXGI_FORMAT_R16G16B16A16_FLOAT, shader->GetPermutationDefines(key));
+    permutation->meshCreateCallback = BlinnPhongMeshCreation;
+    permutation->knitTransparencyCallback = BlinnPhongIsKnitTransparent;
+    return permutation;
+}
\ No newline at end of file
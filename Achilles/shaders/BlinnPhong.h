@@ -42,6 +42,17 @@ namespace BlinnPhong
         PixelInfo();
     };
 
+    // Where the drawn object's lights are in the object light index list
+    struct ObjectLightInfo
+    {
+        // 0 bytes
+        uint32_t Offset = 0;
+        uint32_t Count = 0;
+        uint32_t Enabled = 0;
+        uint32_t Padding = 0;
+        // 16 bytes
+    };
+
     enum RootParameters
     {
         //// Vertex shader parameter ////
@@ -56,18 +67,41 @@ namespace BlinnPhong
         RootParameterSpotLights, // StructuredBuffer<SpotLight> SpotLights : register( t1 );
         RootParameterDirectionalLights, // StructuredBuffer<DirectionalLight> DirectionalLights : register( t2 );
         RootParameterCascadeInfos, // StructuredBuffer<CascadeInfo> CascadeInfos : register( t3 );
+        RootParameterPointShadowInfos, // StructuredBuffer<PointShadowInfo> PointShadowInfos : register( t4 );
         RootParameterTextures, // Texture2D DiffuseTexture : register( t0, space1 );
-        RootParameterSpotShadowMaps, // Texture2D SpotShadowMap0 : register(t0, space2);
-        RootParameterCascadeShadowMaps, // Texture2D CascadedShadowMap0[8] : register(t0, space3);
-        RootParameterPointShadowMaps, // TextureCube PointShadowMap0 : register(t0, space4);
+        RootParameterShadowAtlas, // Texture2D ShadowAtlas : register( t0, space2 );
+        RootParameterClusterInfo, // ConstantBuffer<ClusterInfo> ClusterInfoCB : register(b5);
+        RootParameterClusterGrid, // StructuredBuffer<uint2> ClusterGrid : register( t5 );
+        RootParameterClusterLightIndices, // StructuredBuffer<uint> ClusterLightIndices : register( t6 );
+        RootParameterObjectLightInfo, // ConstantBuffer<ObjectLightInfo> ObjectLightInfoCB : register(b6);
+        RootParameterObjectLightIndices, // StructuredBuffer<uint> ObjectLightIndices : register( t7 );
 
         RootParameterCount
     };
 
+    // Features compiled into BlinnPhong permutations, the #defines are in the same order
+    namespace PermutationFeatures
+    {
+        enum
+        {
+            None = 0,
+            DiffuseTexture = 1,
+            NormalTexture = 2,
+            EmissionTexture = 4,
+            ReceiveShadows = 8,
+        };
+    }
+
     inline static std::shared_ptr<Texture> whitePixelTexture = nullptr;
 
     bool BlinnPhongShaderRender(std::shared_ptr<CommandList> commandList, std::shared_ptr<Object> object, uint32_t knitIndex, std::shared_ptr<Mesh> mesh, Material material, std::shared_ptr<Camera> camera, LightData& lightData);
+    // Binds the light clusters for draws from the camera they were built for, otherwise turns them off
+    void BindLightClusters(std::shared_ptr<CommandList> commandList, std::shared_ptr<Camera> camera, LightData& lightData);
+    // Binds the object's own light list when lights are assigned per object, otherwise turns it off
+    void BindObjectLights(std::shared_ptr<CommandList> commandList, std::shared_ptr<Object> object, LightData& lightData);
     std::shared_ptr<Mesh> BlinnPhongMeshCreation(aiScene* scene, aiNode* node, aiMesh* inMesh, std::shared_ptr<Shader> shader, Material& material, std::wstring meshPath);
     bool BlinnPhongIsKnitTransparent(std::shared_ptr<Object> object, uint32_t knitIndex, std::shared_ptr<Mesh> mesh, Material material);
+    ShaderPermutationKey BlinnPhongPermutationKey(std::shared_ptr<Object> object, uint32_t knitIndex, std::shared_ptr<Mesh> mesh, Material& material);
+    std::shared_ptr<Shader> BlinnPhongPermutationCreation(ShaderPermutationKey key);
     std::shared_ptr<Shader> GetBlinnPhongShader(ComPtr<ID3D12Device2> device = nullptr);
 }
\ No newline at end of file
@@ -10,7 +10,7 @@ CommonShader::CommonShaderVertex::CommonShaderVertex() : Position(0,0,0), Normal
     
 }
 
-std::shared_ptr<Mesh> CommonShader::CommonShaderMeshCreation(aiScene* scene, aiNode* node, aiMesh* inMesh, std::shared_ptr<Shader> shader, Material& material, std::wstring meshPath)
+static std::shared_ptr<Mesh> ConvertCommonShaderMesh(aiMesh* inMesh, std::shared_ptr<Shader> shader)
 {
     uint32_t vertCount = inMesh->mNumVertices;
     std::vector<CommonShaderVertex> verts{};
@@ -46,7 +46,7 @@ std::shared_ptr<Mesh> CommonShader::CommonShaderMeshCreation(aiScene* scene, aiN
     }
 
     uint32_t faceCount = inMesh->mNumFaces;
-    std::vector<uint16_t> tris{};
+    std::vector<uint32_t> tris{};
     tris.reserve(faceCount);
     uint32_t index = 0;
     for (uint32_t f = 0; f < faceCount; f++)
@@ -62,6 +62,10 @@ std::shared_ptr<Mesh> CommonShader::CommonShaderMeshCreation(aiScene* scene, aiN
 
     if (verts.size() <= 0 || tris.size() <= 0)
         return nullptr;
+
+    if (Object::OptimizeMeshes)
+        verts.resize(MeshOptimizer::OptimizeMesh(verts.data(), verts.size(), sizeof(CommonShaderVertex), tris));
+
     std::shared_ptr<Mesh> mesh = SHADER_MESH_MAKE_SHARED_VECTORS(StringToWString(inMesh->mName.C_Str()), verts, tris, CommonShaderVertex, shader);
 
     // Get the DirectX bounding box from points
@@ -70,6 +74,33 @@ std::shared_ptr<Mesh> CommonShader::CommonShaderMeshCreation(aiScene* scene, aiN
     aabb.Extents = Vector3::Max(aabb.Extents, Vector3(0.05f)) * 1.05f; // avoid tiny numbers for objects like planes and scale it up a little bit
     mesh->SetBoundingBox(aabb);
 
+    if (Object::GenerateLODs)
+        mesh->GenerateLODs(Object::GetCreationCommandList(), verts.data(), (UINT)verts.size(), sizeof(CommonShaderVertex), tris);
+
+    return mesh;
+}
+
+std::shared_ptr<Mesh> CommonShader::CommonShaderMeshCreation(aiScene* scene, aiNode* node, aiMesh* inMesh, std::shared_ptr<Shader> shader, Material& material, std::wstring meshPath)
+{
+    std::shared_ptr<Mesh> mesh;
+    if (meshPath.empty())
+    {
+        mesh = ConvertCommonShaderMesh(inMesh, shader);
+    }
+    else
+    {
+        uint32_t meshIndex = 0;
+        while (meshIndex < scene->mNumMeshes && scene->mMeshes[meshIndex] != inMesh)
+            meshIndex++;
+
+        // Importing a file again, or on two threads at once, shares its meshes. The import settings change the result, so they're part of the key
+        std::wstring variant = L"Mesh " + std::to_wstring(meshIndex) + L" " + shader->name + L" " + std::to_wstring(Object::SplitLargeMeshes) + std::to_wstring(Object::OptimizeMeshes) + std::to_wstring(Object::GenerateLODs);
+        mesh = Mesh::importCache.GetOrLoad(AssetKey(meshPath, variant), [&]() { return ConvertCommonShaderMesh(inMesh, shader); });
+    }
+
+    if (mesh == nullptr)
+        return nullptr;
+
     material.SetVector(L"UVScaleOffset", Vector4(1.0f, 1.0f, 0.0f, 0.0f));
 
     return mesh;
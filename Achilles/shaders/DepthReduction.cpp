@@ -0,0 +1,213 @@
+#include "DepthReduction.h"
+#include "../Application.h"
+#include <algorithm>
+
+using namespace DepthReduction;
+
+static std::shared_ptr<Shader> DepthReductionShader = nullptr;
+static std::shared_ptr<Shader> DepthReductionMSShader = nullptr;
+static CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC DepthReductionSignature{};
+std::shared_ptr<Shader> DepthReduction::GetDepthReductionShader(ComPtr<ID3D12Device2> device, bool multisampled)
+{
+    std::shared_ptr<Shader>& shader = multisampled ? DepthReductionMSShader : DepthReductionShader;
+    if (shader.use_count() >= 1)
+        return shader;
+
+    if (device == nullptr)
+        throw std::exception("Cannot create a shader without a device");
+
+    D3D12_ROOT_SIGNATURE_FLAGS rootSignatureFlags = D3D12_ROOT_SIGNATURE_FLAG_NONE;
+
+    CD3DX12_DESCRIPTOR_RANGE1 srvs(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 0);
+    CD3DX12_DESCRIPTOR_RANGE1 uavs(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 0);
+
+    CD3DX12_ROOT_PARAMETER1 rootParameters[RootParameters::RootParameterCount]{};
+    rootParameters[RootParameters::RootParameterCB0].InitAsConstants(sizeof(DepthReductionCB0) / 4, 0);
+    rootParameters[RootParameters::RootParameterDepth].InitAsDescriptorTable(1, &srvs);
+    rootParameters[RootParameters::RootParameterTileRanges].InitAsDescriptorTable(1, &uavs);
+
+    DepthReductionSignature.Init_1_1(_countof(rootParameters), rootParameters, 0, nullptr, rootSignatureFlags);
+    std::shared_ptr rootSignature = std::make_shared<RootSignature>(DepthReductionSignature.Desc_1_1, D3D_ROOT_SIGNATURE_VERSION_1_1);
+
+    std::vector<std::wstring> defines;
+    if (multisampled)
+        defines.push_back(L"MULTISAMPLED");
+
+    shader = Shader::ShaderCS(device, rootSignature, L"DepthReduction", defines);
+
+    return shader;
+}
+
+// Written by the shader, then copied to the readback buffer
+static std::shared_ptr<StructuredBuffer> tileRangesBuffer = nullptr;
+static ComPtr<ID3D12Resource> readbackBuffer = nullptr;
+static size_t tileRangesCapacity = 0;
+
+// What the last recorded reduction was drawn with, needed to turn its depths back into view space
+struct PendingReduction
+{
+    const Camera* camera = nullptr;
+    float nearZ = 0.0f;
+    float farZ = 0.0f;
+    bool orthographic = false;
+    size_t tileCount = 0;
+    uint64_t frame = 0;
+};
+static PendingReduction pendingReduction{};
+
+void DepthReduction::ReduceDepth(std::shared_ptr<CommandList> commandList, std::shared_ptr<Texture> depthTexture, std::shared_ptr<Camera> camera)
+{
+    if (depthTexture == nullptr || !depthTexture->IsValid() || camera == nullptr)
+        return;
+
+    ScopedTimer _prof(L"DepthReduction");
+
+    auto device = Application::GetD3D12Device();
+
+    D3D12_RESOURCE_DESC depthDesc = depthTexture->GetD3D12ResourceDesc();
+    uint32_t width = (uint32_t)depthDesc.Width;
+    uint32_t height = depthDesc.Height;
+    uint32_t sampleCount = depthDesc.SampleDesc.Count;
+    bool multisampled = sampleCount > 1;
+
+    uint32_t tileCountX = (width + TileSize - 1) / TileSize;
+    uint32_t tileCountY = (height + TileSize - 1) / TileSize;
+    size_t tileCount = (size_t)tileCountX * tileCountY;
+    if (tileCount == 0)
+        return;
+
+    if (tileRangesBuffer == nullptr || tileRangesCapacity < tileCount)
+    {
+        tileRangesBuffer = std::make_shared<StructuredBuffer>(L"Depth Reduction Tile Ranges");
+        commandList->CopyStructuredBuffer(*tileRangesBuffer, tileCount, sizeof(Vector2), nullptr);
+
+        CD3DX12_HEAP_PROPERTIES heapProperties(D3D12_HEAP_TYPE_READBACK);
+        CD3DX12_RESOURCE_DESC resourceDesc = CD3DX12_RESOURCE_DESC::Buffer(tileCount * sizeof(Vector2));
+        ThrowIfFailed(device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &resourceDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&readbackBuffer)));
+        readbackBuffer->SetName(L"Depth Reduction Readback");
+
+        tileRangesCapacity = tileCount;
+    }
+
+    // Read the D32 depth buffer as R32
+    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+    srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    if (multisampled)
+    {
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DMS;
+    }
+    else
+    {
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+        srvDesc.Texture2D.MipLevels = 1;
+    }
+
+    DepthReductionCB0 depthReductionCB0{};
+    depthReductionCB0.Width = width;
+    depthReductionCB0.Height = height;
+    depthReductionCB0.TileCountX = tileCountX;
+    depthReductionCB0.SampleCount = sampleCount;
+
+    commandList->SetShader(GetDepthReductionShader(device, multisampled));
+    commandList->SetCompute32BitConstants<DepthReductionCB0>(RootParameters::RootParameterCB0, depthReductionCB0);
+    commandList->SetShaderResourceView(RootParameters::RootParameterDepth, 0, *depthTexture, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, 0, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, &srvDesc);
+    commandList->SetUnorderedAccessView(RootParameters::RootParameterTileRanges, 0, *tileRangesBuffer);
+
+    commandList->Dispatch(tileCountX, tileCountY);
+
+    commandList->CopyBufferToReadback(readbackBuffer, *tileRangesBuffer, tileCount * sizeof(Vector2));
+
+    pendingReduction.camera = camera.get();
+    pendingReduction.nearZ = camera->nearZ;
+    pendingReduction.farZ = camera->farZ;
+    pendingReduction.orthographic = camera->IsOrthographic();
+    pendingReduction.tileCount = tileCount;
+    pendingReduction.frame = Application::GetGlobalFrameCounter();
+}
+
+bool DepthReduction::GetViewDepthRange(std::shared_ptr<Camera> camera, float& nearDepth, float& farDepth)
+{
+    if (camera == nullptr || readbackBuffer == nullptr || pendingReduction.camera != camera.get())
+        return false;
+
+    // Recorded this frame, so it hasn't been executed yet
+    if (pendingReduction.frame >= Application::GetGlobalFrameCounter())
+        return false;
+
+    size_t numBytes = pendingReduction.tileCount * sizeof(Vector2);
+    D3D12_RANGE readRange{ 0, numBytes };
+    void* data = nullptr;
+    if (FAILED(readbackBuffer->Map(0, &readRange, &data)))
+        return false;
+
+    float minDepth, maxDepth;
+    bool hasRange = ReduceTileRanges((const Vector2*)data, pendingReduction.tileCount, minDepth, maxDepth);
+
+    D3D12_RANGE writtenRange{ 0, 0 };
+    readbackBuffer->Unmap(0, &writtenRange);
+
+    if (!hasRange)
+        return false;
+
+    nearDepth = DepthToViewDepth(minDepth, pendingReduction.nearZ, pendingReduction.farZ, pendingReduction.orthographic);
+    farDepth = DepthToViewDepth(maxDepth, pendingReduction.nearZ, pendingReduction.farZ, pendingReduction.orthographic);
+    return true;
+}
+
+bool DepthReduction::ReduceDepthCPU(const float* depths, uint32_t width, uint32_t height, float& minDepth, float& maxDepth)
+{
+    // Mirrors the shader, a range per tile and then the tiles combined
+    uint32_t tileCountX = (width + TileSize - 1) / TileSize;
+    uint32_t tileCountY = (height + TileSize - 1) / TileSize;
+    std::vector<Vector2> tileRanges((size_t)tileCountX * tileCountY, Vector2(1.0f, 0.0f));
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            float depth = depths[(size_t)y * width + x];
+            if (depth >= 1.0f)
+                continue;
+
+            Vector2& range = tileRanges[(size_t)(y / TileSize) * tileCountX + (x / TileSize)];
+            range.x = std::min<float>(range.x, depth);
+            range.y = std::max<float>(range.y, depth);
+        }
+    }
+
+    return ReduceTileRanges(tileRanges.data(), tileRanges.size(), minDepth, maxDepth);
+}
+
+bool DepthReduction::ReduceTileRanges(const Vector2* tileRanges, size_t tileCount, float& minDepth, float& maxDepth)
+{
+    minDepth = 1.0f;
+    maxDepth = 0.0f;
+    for (size_t i = 0; i < tileCount; i++)
+    {
+        // Tiles with nothing drawn are left with x > y
+        if (tileRanges[i].x > tileRanges[i].y)
+            continue;
+
+        minDepth = std::min<float>(minDepth, tileRanges[i].x);
+        maxDepth = std::max<float>(maxDepth, tileRanges[i].y);
+    }
+    return minDepth <= maxDepth;
+}
+
+float DepthReduction::DepthToViewDepth(float depth, float nearZ, float farZ, bool orthographic)
+{
+    // Orthographic depth is (z - n) / (f - n) and perspective depth is f (z - n) / (z (f - n))
+    float zRange = farZ - nearZ;
+    if (orthographic)
+        return nearZ + depth * zRange;
+    return farZ * nearZ / (farZ - depth * zRange);
+}
+
+void DepthReduction::Release()
+{
+    tileRangesBuffer.reset();
+    readbackBuffer.Reset();
+    tileRangesCapacity = 0;
+    pendingReduction = PendingReduction{};
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "../ShaderInclude.h"
+
+using DirectX::SimpleMath::Vector2;
+using DirectX::SimpleMath::Matrix;
+
+// Reduces the Z-prepass depth buffer to the nearest and furthest depth drawn. The result is read back a frame later
+// so directional shadow cascades can be fitted to the depth range that's actually visible
+namespace DepthReduction
+{
+    enum RootParameters
+    {
+        RootParameterCB0,
+        RootParameterDepth,
+        RootParameterTileRanges,
+        RootParameterCount
+    };
+
+    struct DepthReductionCB0
+    {
+        uint32_t Width;
+        uint32_t Height;
+        uint32_t TileCountX;
+        uint32_t SampleCount;
+    };
+
+    // Pixels each thread group reduces along each axis, matches TILE_SIZE in DepthReduction.hlsl
+    constexpr uint32_t TileSize = 32;
+
+    std::shared_ptr<Shader> GetDepthReductionShader(ComPtr<ID3D12Device2> device, bool multisampled);
+
+    // Reduces the depth buffer drawn from camera into one range per tile, and copies the tiles for readback
+    void ReduceDepth(std::shared_ptr<CommandList> commandList, std::shared_ptr<Texture> depthTexture, std::shared_ptr<Camera> camera);
+    // View space depth range of the last reduction of camera's depth buffer. Returns false before one has finished or if nothing was drawn
+    // Present waits for the GPU every frame, so a reduction recorded in one frame can be read in the next
+    bool GetViewDepthRange(std::shared_ptr<Camera> camera, float& nearDepth, float& farDepth);
+
+    // CPU reference of the whole reduction, depths are in the same [0, 1] range as the depth buffer
+    // Returns false if every depth is the clear depth
+    bool ReduceDepthCPU(const float* depths, uint32_t width, uint32_t height, float& minDepth, float& maxDepth);
+    // Combines per tile ranges as written by the shader, skipping tiles that had nothing drawn in them
+    bool ReduceTileRanges(const Vector2* tileRanges, size_t tileCount, float& minDepth, float& maxDepth);
+    // Converts a depth buffer value back to view space depth with the near and far planes it was drawn with
+    // Orthographic projections are stored transposed, so this inverts the [nearZ, farZ] to [0, 1] mapping both projections share rather than reading the matrix
+    float DepthToViewDepth(float depth, float nearZ, float farZ, bool orthographic);
+
+    void Release();
+}
@@ -94,146 +94,58 @@ std::shared_ptr<Shader> PPBloom::GetPPBloomApplyShader(ComPtr<ID3D12Device2> dev
 }
 
 
-static bool hasCreatedUAVs = false;
-void PPBloom::CreateUAVs(float width, float height)
+void PPBloom::GetBloomSize(uint32_t width, uint32_t height, uint32_t& bloomWidth, uint32_t& bloomHeight)
 {
-    if (hasCreatedUAVs)
-    {
-        ResizeUAVs((uint32_t)width, (uint32_t)height);
-        return;
-    }
-
-    uint32_t bloomWidth = width > 2560 ? 1280 : 640;
-    uint32_t bloomHeight = height > 1440 ? 768 : 384;
-
-    DXGI_SAMPLE_DESC sampleDesc = { 1,0 };
-
-    CD3DX12_RESOURCE_DESC resDesc{};
-    resDesc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R16G16B16A16_FLOAT, bloomWidth, bloomHeight, 1, 1, sampleDesc.Count, sampleDesc.Quality, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-
-    bloomBuffer1[0] = std::make_shared<Texture>(resDesc, nullptr, TextureUsage::Albedo, L"Bloom Buffer 1a");
-    bloomBuffer1[1] = std::make_shared<Texture>(resDesc, nullptr, TextureUsage::Albedo, L"Bloom Buffer 1b");
-
-    resDesc.Width /= 2;
-    resDesc.Height /= 2;
-    bloomBuffer2[0] = std::make_shared<Texture>(resDesc, nullptr, TextureUsage::Albedo, L"Bloom Buffer 2a");
-    bloomBuffer2[1] = std::make_shared<Texture>(resDesc, nullptr, TextureUsage::Albedo, L"Bloom Buffer 2b");
-
-    resDesc.Width /= 2;
-    resDesc.Height /= 2;
-    bloomBuffer3[0] = std::make_shared<Texture>(resDesc, nullptr, TextureUsage::Albedo, L"Bloom Buffer 3a");
-    bloomBuffer3[1] = std::make_shared<Texture>(resDesc, nullptr, TextureUsage::Albedo, L"Bloom Buffer 3b");
-
-    resDesc.Width /= 2;
-    resDesc.Height /= 2;
-    bloomBuffer4[0] = std::make_shared<Texture>(resDesc, nullptr, TextureUsage::Albedo, L"Bloom Buffer 4a");
-    bloomBuffer4[1] = std::make_shared<Texture>(resDesc, nullptr, TextureUsage::Albedo, L"Bloom Buffer 4b");
-
-    resDesc.Width /= 2;
-    resDesc.Height /= 2;
-    bloomBuffer5[0] = std::make_shared<Texture>(resDesc, nullptr, TextureUsage::Albedo, L"Bloom Buffer 5a");
-    bloomBuffer5[1] = std::make_shared<Texture>(resDesc, nullptr, TextureUsage::Albedo, L"Bloom Buffer 5b");
-
-    CD3DX12_RESOURCE_DESC lumaDesc{};
-    lumaDesc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8_UNORM, (UINT64)bloomWidth, (UINT)bloomHeight, 1, 1, sampleDesc.Count, sampleDesc.Quality, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-    bloomLumaBuffer = std::make_shared<Texture>(lumaDesc, nullptr, TextureUsage::Linear, L"Bloom Luma Buffer");
-
-    CD3DX12_RESOURCE_DESC intermediaryDesc{};
-    intermediaryDesc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R16G16B16A16_FLOAT, (UINT64)width, (UINT)height, 1, 1, sampleDesc.Count, sampleDesc.Quality, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-    bloomIntermediaryTexture = std::make_shared<Texture>(intermediaryDesc, nullptr, TextureUsage::Albedo, L"Bloom Intermediary Texture");
-
-    hasCreatedUAVs = true;
+    bloomWidth = width > 2560 ? 1280 : 640;
+    bloomHeight = height > 1440 ? 768 : 384;
 }
 
-void PPBloom::ResizeUAVs(uint32_t width, uint32_t height)
+void PPBloom::ExtractBloom(std::shared_ptr<CommandList> commandList, std::shared_ptr<Texture> texture, std::shared_ptr<Texture> bloomBuffer, float bloomThreshold)
 {
-    uint32_t bloomWidth = width > 2560 ? 1280 : 640;
-    uint32_t bloomHeight = height > 1440 ? 768 : 384;
-
-    bloomLumaBuffer->Resize(bloomWidth, bloomHeight);
-
-    bloomBuffer1[0]->Resize(bloomWidth, bloomHeight);
-    bloomBuffer1[1]->Resize(bloomWidth, bloomHeight);
-
-    bloomWidth /= 2;
-    bloomHeight /= 2;
-    bloomBuffer2[0]->Resize(bloomWidth, bloomHeight);
-    bloomBuffer2[1]->Resize(bloomWidth, bloomHeight);
-
-    bloomWidth /= 2;
-    bloomHeight /= 2;
-    bloomBuffer3[0]->Resize(bloomWidth, bloomHeight);
-    bloomBuffer3[1]->Resize(bloomWidth, bloomHeight);
-
-    bloomWidth /= 2;
-    bloomHeight /= 2;
-    bloomBuffer4[0]->Resize(bloomWidth, bloomHeight);
-    bloomBuffer4[1]->Resize(bloomWidth, bloomHeight);
+    std::shared_ptr<Shader> bloomExtract = GetPPBloomExtractShader(Application::GetD3D12Device());
 
-    bloomWidth /= 2;
-    bloomHeight /= 2;
-    bloomBuffer5[0]->Resize(bloomWidth, bloomHeight);
-    bloomBuffer5[1]->Resize(bloomWidth, bloomHeight);
-
-    bloomIntermediaryTexture->Resize(width, height);
-}
-
-void PPBloom::ApplyBloom(std::shared_ptr<CommandList> commandList, std::shared_ptr<Texture> texture, float bloomThreshold, float upsampleBlendFactor, float bloomStrength)
-{
-    auto device = Application::GetD3D12Device();
-    std::shared_ptr<Shader> bloomExtract = GetPPBloomExtractShader(device);
-    std::shared_ptr<Shader> bloomDownsample = GetPPBloomDownsampleShader(device);
-    std::shared_ptr<Shader> bloomApply = GetPPBloomApplyShader(device);
-
-    // Get size of bloom buffer 1
     float width = 0.0f;
     float height = 0.0f;
-    bloomLumaBuffer->GetSize(width, height);
-
-    uint32_t bloomWidth = (uint32_t)width;
-    uint32_t bloomHeight = (uint32_t)height;
+    bloomBuffer->GetSize(width, height);
 
-    // Extract bloom from texture into bloomBuffer1[0]
     ExtractCB0 extractCB0;
-    extractCB0.g_inverseOutputSize = Vector2(1.0f / width, 1.0f/ height);
+    extractCB0.g_inverseOutputSize = Vector2(1.0f / width, 1.0f / height);
     extractCB0.g_bloomThreshold = bloomThreshold;
 
     commandList->SetShader(bloomExtract);
 
     commandList->SetCompute32BitConstants<ExtractCB0>(RootParameters::RootParameterCB0, extractCB0);
-    commandList->SetUnorderedAccessView(RootParameters::RootParameterUAVs, 0, *bloomBuffer1[0], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    commandList->SetUnorderedAccessView(RootParameters::RootParameterUAVs, 0, *bloomBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
     commandList->SetShaderResourceView(RootParameters::RootParameterSRVs, 0, *texture, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 
-    commandList->Dispatch2D(bloomWidth, bloomHeight);
+    commandList->Dispatch2D((uint32_t)width, (uint32_t)height);
+}
 
-    commandList->FlushResourceBarriers();
+void PPBloom::DownsampleBloom(std::shared_ptr<CommandList> commandList, std::shared_ptr<Texture> bloomBuffer, std::shared_ptr<Texture> downsampledBuffers[4])
+{
+    std::shared_ptr<Shader> bloomDownsample = GetPPBloomDownsampleShader(Application::GetD3D12Device());
 
-    // Downsample bloom buffer
+    float width = 0.0f;
+    float height = 0.0f;
+    bloomBuffer->GetSize(width, height);
 
     DownsampleCB0 downsampleCB0;
-    downsampleCB0.g_inverseDimensions = extractCB0.g_inverseOutputSize;
+    downsampleCB0.g_inverseDimensions = Vector2(1.0f / width, 1.0f / height);
 
     commandList->SetShader(bloomDownsample);
 
     commandList->SetCompute32BitConstants<DownsampleCB0>(RootParameters::RootParameterCB0, downsampleCB0);
-    commandList->SetShaderResourceView(RootParameters::RootParameterSRVs, 0, *bloomBuffer1[0], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-    commandList->SetUnorderedAccessView(RootParameters::RootParameterUAVs, 0, *bloomBuffer2[0], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-    commandList->SetUnorderedAccessView(RootParameters::RootParameterUAVs, 1, *bloomBuffer3[0], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-    commandList->SetUnorderedAccessView(RootParameters::RootParameterUAVs, 2, *bloomBuffer4[0], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-    commandList->SetUnorderedAccessView(RootParameters::RootParameterUAVs, 3, *bloomBuffer5[0], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    commandList->SetShaderResourceView(RootParameters::RootParameterSRVs, 0, *bloomBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    for (uint32_t i = 0; i < 4; i++)
+        commandList->SetUnorderedAccessView(RootParameters::RootParameterUAVs, i, *downsampledBuffers[i], D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 
-    commandList->Dispatch2D(bloomWidth / 2, bloomHeight / 2);
-
-    commandList->FlushResourceBarriers();
+    commandList->Dispatch2D((uint32_t)width / 2, (uint32_t)height / 2);
+}
 
-    // Blur then then upsame + blur 4 times
-    PPBlur::BlurTexture(commandList, bloomBuffer5, bloomBuffer5[0], 1.0f); // normal blur
-    PPBlur::BlurTexture(commandList, bloomBuffer4, bloomBuffer5[1], upsampleBlendFactor); // upsample blur
-    PPBlur::BlurTexture(commandList, bloomBuffer3, bloomBuffer4[1], upsampleBlendFactor);
-    PPBlur::BlurTexture(commandList, bloomBuffer2, bloomBuffer3[1], upsampleBlendFactor);
-    PPBlur::BlurTexture(commandList, bloomBuffer1, bloomBuffer2[1], upsampleBlendFactor);
+void PPBloom::ApplyBloom(std::shared_ptr<CommandList> commandList, std::shared_ptr<Texture> bloom, std::shared_ptr<Texture> texture, std::shared_ptr<Texture> output, std::shared_ptr<Texture> lumaBuffer, float bloomStrength)
+{
+    std::shared_ptr<Shader> bloomApply = GetPPBloomApplyShader(Application::GetD3D12Device());
 
-    // Apply the bloom to the texture
     float textureWidth = 0.0f;
     float textureHeight = 0.0f;
     texture->GetSize(textureWidth, textureHeight);
@@ -245,15 +157,10 @@ void PPBloom::ApplyBloom(std::shared_ptr<CommandList> commandList, std::shared_p
     commandList->SetShader(bloomApply);
 
     commandList->SetCompute32BitConstants<ApplyCB0>(RootParameters::RootParameterCB0, applyCB0);
-    commandList->SetShaderResourceView(RootParameters::RootParameterSRVs, 0, *bloomBuffer1[0], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    commandList->SetShaderResourceView(RootParameters::RootParameterSRVs, 0, *bloom, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
     commandList->SetShaderResourceView(RootParameters::RootParameterSRVs, 1, *texture, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-    commandList->SetUnorderedAccessView(RootParameters::RootParameterUAVs, 0, *bloomIntermediaryTexture, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-    commandList->SetUnorderedAccessView(RootParameters::RootParameterUAVs, 1, *bloomLumaBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    commandList->SetUnorderedAccessView(RootParameters::RootParameterUAVs, 0, *output, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    commandList->SetUnorderedAccessView(RootParameters::RootParameterUAVs, 1, *lumaBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 
     commandList->Dispatch2D((uint32_t)textureWidth, (uint32_t)textureHeight);
-
-    commandList->FlushResourceBarriers();
-
-    // Copy the intermediary texture to the input texture
-    commandList->CopyResource(*texture, *bloomIntermediaryTexture);
 }
@@ -32,20 +32,16 @@ namespace PPBloom
         float g_BloomStrength;
     };
 
-    static std::shared_ptr<Texture> bloomBuffer1[2]; // bloomWidth
-    static std::shared_ptr<Texture> bloomBuffer2[2]; // bloomWidth / 2
-    static std::shared_ptr<Texture> bloomBuffer3[2]; // bloomWidth / 4
-    static std::shared_ptr<Texture> bloomBuffer4[2]; // bloomWidth / 8
-    static std::shared_ptr<Texture> bloomBuffer5[2]; // bloomWidth / 16
-
-    static std::shared_ptr<Texture> bloomLumaBuffer; // bloomWidth
-
-    static std::shared_ptr<Texture> bloomIntermediaryTexture; // Used as the output for the bloom apply stage, copied into the original texture
-
     std::shared_ptr<Shader> GetPPBloomExtractShader(ComPtr<ID3D12Device2> device);
     std::shared_ptr<Shader> GetPPBloomDownsampleShader(ComPtr<ID3D12Device2> device);
     std::shared_ptr<Shader> GetPPBloomApplyShader(ComPtr<ID3D12Device2> device);
-    void CreateUAVs(float width, float height);
-    void ResizeUAVs(uint32_t width, uint32_t height);
-    void ApplyBloom(std::shared_ptr<CommandList> commandList, std::shared_ptr<Texture> texture, float bloomThreshold, float upsampleBlendFactor, float bloomStrength);
+
+    // Size of the first bloom buffer for a texture of this size. Each buffer after it in the blur chain is half the size of the one before
+    void GetBloomSize(uint32_t width, uint32_t height, uint32_t& bloomWidth, uint32_t& bloomHeight);
+    // Extracts the parts of texture above the threshold into bloomBuffer
+    void ExtractBloom(std::shared_ptr<CommandList> commandList, std::shared_ptr<Texture> texture, std::shared_ptr<Texture> bloomBuffer, float bloomThreshold);
+    // Downsamples bloomBuffer into the next four buffers of the blur chain
+    void DownsampleBloom(std::shared_ptr<CommandList> commandList, std::shared_ptr<Texture> bloomBuffer, std::shared_ptr<Texture> downsampledBuffers[4]);
+    // Adds the blurred bloom to texture, writing the result to output and its luminance to lumaBuffer
+    void ApplyBloom(std::shared_ptr<CommandList> commandList, std::shared_ptr<Texture> bloom, std::shared_ptr<Texture> texture, std::shared_ptr<Texture> output, std::shared_ptr<Texture> lumaBuffer, float bloomStrength);
 }
\ No newline at end of file
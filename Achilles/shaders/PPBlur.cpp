@@ -80,7 +80,7 @@ void PPBlur::BlurTexture(std::shared_ptr<CommandList> commandList, std::shared_p
         blurCB0.g_inverseDimensions = Vector2(1.0f / bufferWidth, 1.0f / bufferHeight);
         commandList->SetCompute32BitConstants<BlurCB0>(RootParameters::RootParameterCB0, blurCB0);
         // Set the input textures and output UAV
-        commandList->SetUnorderedAccessView(RootParameters::RootParameterUAVs, 0, *textures[1], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+        commandList->SetUnorderedAccessView(RootParameters::RootParameterUAVs, 0, *textures[1], D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
         commandList->SetShaderResourceView(RootParameters::RootParameterSRVs, 0, *textures[0], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 
         commandList->SetShader(shader);
@@ -98,7 +98,7 @@ void PPBlur::BlurTexture(std::shared_ptr<CommandList> commandList, std::shared_p
         blurCB0.g_upsampleBlendFactor = upsampleBlendFactor;
         commandList->SetCompute32BitConstants<BlurUpsampleCB0>(RootParameters::RootParameterCB0, blurCB0);
         // Set the input textures and output UAV
-        commandList->SetUnorderedAccessView(RootParameters::RootParameterUAVs, 0, *textures[1], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+        commandList->SetUnorderedAccessView(RootParameters::RootParameterUAVs, 0, *textures[1], D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
         commandList->SetShaderResourceView(RootParameters::RootParameterSRVs, 0, *textures[0], D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
         commandList->SetShaderResourceView(RootParameters::RootParameterSRVs, 1, *lowerResBuf, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 
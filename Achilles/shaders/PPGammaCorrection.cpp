@@ -47,7 +47,7 @@ void PPGammaCorrection::ApplyGammaCorrection(std::shared_ptr<CommandList> comman
     commandList->SetShader(gammaCorrectionShader);
 
     commandList->SetCompute32BitConstants<GammaCorrectionCB0>(RootParameters::RootParameterCB0, gammaCorrectionCB0);
-    commandList->SetUnorderedAccessView(RootParameters::RootParameterUAVs, 0, *presentTexture, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    commandList->SetUnorderedAccessView(RootParameters::RootParameterUAVs, 0, *presentTexture, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 
     commandList->Dispatch2D(width, height);
     commandList->FlushResourceBarriers();
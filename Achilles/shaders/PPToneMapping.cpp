@@ -50,7 +50,7 @@ void PPToneMapping::ApplyToneMapping(std::shared_ptr<CommandList> commandList, s
 
     commandList->SetCompute32BitConstants<ToneMappingCB0>(RootParameters::RootParameterCB0, toneMappingCB0);
     commandList->SetShaderResourceView(RootParameters::RootParameterSRVs, 0, *texture, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-    commandList->SetUnorderedAccessView(RootParameters::RootParameterUAVs, 0, *presentTexture, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    commandList->SetUnorderedAccessView(RootParameters::RootParameterUAVs, 0, *presentTexture, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 
     commandList->Dispatch2D(width, height);
     commandList->FlushResourceBarriers();
@@ -39,7 +39,7 @@ std::shared_ptr<Mesh> PosColMeshCreation(aiScene* scene, aiNode* node, aiMesh* i
     }
 
     uint32_t faceCount = inMesh->mNumFaces;
-    std::vector<uint16_t> tris{};
+    std::vector<uint32_t> tris{};
     tris.reserve(faceCount);
     uint32_t index = 0;
     for (uint32_t f = 0; f < faceCount; f++)
@@ -55,7 +55,13 @@ std::shared_ptr<Mesh> PosColMeshCreation(aiScene* scene, aiNode* node, aiMesh* i
 
     if (verts.size() <= 0 || tris.size() <= 0)
         return nullptr;
+
+    if (Object::OptimizeMeshes)
+        verts.resize(MeshOptimizer::OptimizeMesh(verts.data(), verts.size(), sizeof(PosColVertex), tris));
+
     std::shared_ptr<Mesh> mesh = SHADER_MESH_MAKE_SHARED_VECTORS(StringToWString(inMesh->mName.C_Str()), verts, tris, PosColVertex, shader);
+    if (Object::GenerateLODs)
+        mesh->GenerateLODs(Object::GetCreationCommandList(), verts.data(), (UINT)verts.size(), sizeof(PosColVertex), tris);
     return mesh;
 }
 
@@ -1,5 +1,6 @@
 #include "ShadowMapping.h"
 #include "../LightObject.h"
+#include "../Helpers.h"
 
 using namespace ShadowMapping;
 using namespace CommonShader;
@@ -116,6 +117,8 @@ void ShadowMapping::DrawObjectShadowDirectional(std::shared_ptr<CommandList> com
 {
     if (!object->ShouldDraw(shadowCamera->GetFrustum()))
         return;
+    if (Camera::contributionCulling && !Camera::PassesScreenSize(object->GetProjectedScreenSize(shadowCamera), shadowCamera->minScreenSize, Camera::contributionCounters.Shadow))
+        return;
 
     ScopedTimer _prof(L"DrawObjectShadowDirectional");
 
@@ -126,8 +129,10 @@ void ShadowMapping::DrawObjectShadowDirectional(std::shared_ptr<CommandList> com
     for (uint32_t i = 0; i < object->GetKnitCount(); i++)
     {
         Knit knit = object->GetKnit(i);
-        std::shared_ptr<Mesh> mesh = knit.mesh;
+        std::shared_ptr<Mesh> mesh = object->GetLODMesh(i, Camera::mainCamera, Object::ShadowLODBias);
         Material material = knit.material;
+        if (mesh == nullptr)
+            continue;
         commandList->SetMesh(mesh);
 
         std::shared_ptr<Texture> mainTexture = material.GetTexture(L"MainTexture");
@@ -140,10 +145,13 @@ void ShadowMapping::DrawObjectShadowDirectional(std::shared_ptr<CommandList> com
     }
 }
 
-void ShadowMapping::DrawObjectShadowDirectionalCascaded(std::shared_ptr<CommandList> commandList, std::shared_ptr<Object> object, std::shared_ptr<ShadowCamera> shadowCamera, LightObject* lightObject, DirectionalLight directionalLight, std::shared_ptr<Shader> shader, Matrix cascadeMatrix)
+void ShadowMapping::DrawObjectShadowDirectionalCascaded(std::shared_ptr<CommandList> commandList, std::shared_ptr<Object> object, std::shared_ptr<ShadowCamera> shadowCamera, LightObject* lightObject, DirectionalLight directionalLight, std::shared_ptr<Shader> shader, Matrix cascadeMatrix, Matrix cascadeProjection)
 {
     if (!object->ShouldDraw(shadowCamera->GetFrustum()))
         return;
+    // Measured against the cascade's own projection, so the same caster can be dropped from the wider cascades
+    if (Camera::contributionCulling && !Camera::PassesScreenSize(object->GetProjectedScreenSize(cascadeProjection, shadowCamera->GetPosition(), true), shadowCamera->minScreenSize, Camera::contributionCounters.Shadow))
+        return;
 
     ScopedTimer _prof(L"DrawObjectShadowDirectionalCascaded");
 
@@ -154,8 +162,10 @@ void ShadowMapping::DrawObjectShadowDirectionalCascaded(std::shared_ptr<CommandL
     for (uint32_t i = 0; i < object->GetKnitCount(); i++)
     {
         Knit knit = object->GetKnit(i);
-        std::shared_ptr<Mesh> mesh = knit.mesh;
+        std::shared_ptr<Mesh> mesh = object->GetLODMesh(i, Camera::mainCamera, Object::ShadowLODBias);
         Material material = knit.material;
+        if (mesh == nullptr)
+            continue;
         commandList->SetMesh(mesh);
 
         std::shared_ptr<Texture> mainTexture = material.GetTexture(L"MainTexture");
@@ -172,6 +182,8 @@ void ShadowMapping::DrawObjectShadowSpot(std::shared_ptr<CommandList> commandLis
 {
     if (!object->ShouldDraw(shadowCamera->GetFrustum()))
         return;
+    if (Camera::contributionCulling && !Camera::PassesScreenSize(object->GetProjectedScreenSize(shadowCamera), shadowCamera->minScreenSize, Camera::contributionCounters.Shadow))
+        return;
 
     ScopedTimer _prof(L"DrawObjectShadowSpot");
 
@@ -182,8 +194,10 @@ void ShadowMapping::DrawObjectShadowSpot(std::shared_ptr<CommandList> commandLis
     for (uint32_t i = 0; i < object->GetKnitCount(); i++)
     {
         Knit knit = object->GetKnit(i);
-        std::shared_ptr<Mesh> mesh = knit.mesh;
+        std::shared_ptr<Mesh> mesh = object->GetLODMesh(i, Camera::mainCamera, Object::ShadowLODBias);
         Material material = knit.material;
+        if (mesh == nullptr)
+            continue;
         commandList->SetMesh(mesh);
 
         std::shared_ptr<Texture> mainTexture = material.GetTexture(L"MainTexture");
@@ -199,6 +213,8 @@ void ShadowMapping::DrawObjectShadowPoint(std::shared_ptr<CommandList> commandLi
 {
     // if (!object->ShouldDraw(frustum))
     //    return;
+    if (Camera::contributionCulling && !Camera::PassesScreenSize(object->GetProjectedScreenSize(shadowCamera), shadowCamera->minScreenSize, Camera::contributionCounters.Shadow))
+        return;
 
     ScopedTimer _prof(L"DrawObjectShadowPoint");
 
@@ -212,8 +228,10 @@ void ShadowMapping::DrawObjectShadowPoint(std::shared_ptr<CommandList> commandLi
     for (uint32_t i = 0; i < object->GetKnitCount(); i++)
     {
         Knit knit = object->GetKnit(i);
-        std::shared_ptr<Mesh> mesh = knit.mesh;
+        std::shared_ptr<Mesh> mesh = object->GetLODMesh(i, Camera::mainCamera, Object::ShadowLODBias);
         Material material = knit.material;
+        if (mesh == nullptr)
+            continue;
         commandList->SetMesh(mesh);
 
         std::shared_ptr<Texture> mainTexture = material.GetTexture(L"MainTexture");
@@ -225,44 +243,63 @@ void ShadowMapping::DrawObjectShadowPoint(std::shared_ptr<CommandList> commandLi
     }
 }
 
-void ShadowMapping::DrawShadowDirectionalCascaded(std::shared_ptr<CommandList> commandList, std::vector<std::shared_ptr<Object>> shadowCastingObjects, std::shared_ptr<ShadowCamera> shadowCamera, LightObject* lightObject, DirectionalLight directionalLight, std::shared_ptr<Shader> shader)
+// Points the viewport and scissor at the view's tile of the target and clears it
+static void BeginShadowAtlasTile(std::shared_ptr<CommandList> commandList, std::shared_ptr<ShadowMap> target, std::shared_ptr<ShadowCamera> shadowCamera, uint32_t view, bool clearTile)
 {
+    const ShadowAtlasRect& tile = shadowCamera->GetAtlasTile(view);
+    D3D12_RECT tileRect = ShadowAtlas::GetScissorRect(tile);
+
+    if (clearTile)
+        commandList->ClearDepthStencilTexture(*target, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, &tileRect);
+    commandList->SetViewport(ShadowAtlas::GetViewport(tile));
+    commandList->SetScissorRect(tileRect);
+}
+
+void ShadowMapping::DrawShadowDirectionalCascaded(std::shared_ptr<CommandList> commandList, std::vector<std::shared_ptr<Object>> shadowCastingObjects, std::shared_ptr<ShadowCamera> shadowCamera, LightObject* lightObject, DirectionalLight directionalLight, std::shared_ptr<Shader> shader, std::shared_ptr<ShadowMap> target, bool clearTiles, uint32_t viewMask)
+{
+    if (target == nullptr)
+        target = ShadowAtlas::GetAtlas();
+
+    std::vector<Matrix> cascadeProjections = shadowCamera->GetCascadeProjections();
     for (uint32_t cascade = 0; cascade < shadowCamera->GetNumCascades(); cascade++)
     {
-        std::shared_ptr<ShadowMap> shadowMap = shadowCamera->GetShadowMap(cascade);
-        LightObject* lightObject = shadowCamera->GetLightObject();
+        if ((viewMask & (1u << cascade)) == 0)
+            continue;
 
-        commandList->TransitionBarrier(*shadowMap, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+        BeginShadowAtlasTile(commandList, target, shadowCamera, cascade, clearTiles);
 
-        commandList->ClearDepthStencilTexture(*shadowMap, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0);
-        std::shared_ptr<RenderTarget> rt = std::make_shared<RenderTarget>();
-        rt->AttachTexture(AttachmentPoint::DepthStencil, shadowMap);
-        commandList->SetRenderTargetDepthOnly(*rt);
-
-        Matrix cascadeProj = shadowCamera->GetCascadeProjections()[cascade];
-        Matrix cascadeMatrix = shadowCamera->GetView() * cascadeProj;
+        Matrix cascadeMatrix = shadowCamera->GetViewProjection(cascade);
+        Matrix cascadeProjection = cascade < cascadeProjections.size() ? cascadeProjections[cascade] : shadowCamera->GetProj();
 
         for (std::shared_ptr<Object> object : shadowCastingObjects)
         {
-            DrawObjectShadowDirectionalCascaded(commandList, object, shadowCamera, lightObject, directionalLight, shader, cascadeMatrix);
+            DrawObjectShadowDirectionalCascaded(commandList, object, shadowCamera, lightObject, directionalLight, shader, cascadeMatrix, cascadeProjection);
         }
     }
 }
 
-void ShadowMapping::RenderShadowScene(std::shared_ptr<CommandList> commandList, std::shared_ptr<ShadowCamera> shadowCamera, std::vector<std::shared_ptr<Object>> shadowCastingObjects)
+static std::shared_ptr<RenderTarget> ShadowAtlasRenderTarget{};
+void ShadowMapping::RenderShadowScene(std::shared_ptr<CommandList> commandList, std::shared_ptr<ShadowCamera> shadowCamera, std::vector<std::shared_ptr<Object>> shadowCastingObjects, std::shared_ptr<ShadowMap> target, bool clearTiles, uint32_t viewMask)
 {
     ScopedTimer _prof(L"RenderShadowScene");
-    std::shared_ptr<RenderTarget> rt = shadowCamera->GetShadowMapRenderTarget();
-    std::shared_ptr<ShadowMap> shadowMap = shadowCamera->GetShadowMap();
-    rt->AttachTexture(AttachmentPoint::DepthStencil, shadowMap);
 
     LightObject* lightObject = shadowCamera->GetLightObject();
 
     if (lightObject == nullptr)
         return;
 
-    commandList->SetScissorRect(shadowCamera->scissorRect);
-    commandList->SetViewport(shadowCamera->viewport);
+    // Didn't fit in the atlas this frame
+    if (!shadowCamera->HasAtlasTiles())
+        return;
+
+    if (ShadowAtlasRenderTarget == nullptr)
+        ShadowAtlasRenderTarget = std::make_shared<RenderTarget>();
+    if (target == nullptr)
+        target = ShadowAtlas::GetAtlas();
+    ShadowAtlasRenderTarget->AttachTexture(AttachmentPoint::DepthStencil, target);
+
+    commandList->TransitionBarrier(*target, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+    commandList->SetRenderTargetDepthOnly(*ShadowAtlasRenderTarget);
 
 #pragma warning (suppress : 26813)
     if (shadowCamera->GetLightType() == LightType::Directional)
@@ -270,9 +307,10 @@ void ShadowMapping::RenderShadowScene(std::shared_ptr<CommandList> commandList,
         commandList->SetShader(ShadowMappingHighBiasShader);
         if (shadowCamera->GetNumCascades() <= 0)
         {
-            commandList->TransitionBarrier(*shadowMap, D3D12_RESOURCE_STATE_DEPTH_WRITE);
-            commandList->ClearDepthStencilTexture(*shadowMap, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0);
-            commandList->SetRenderTargetDepthOnly(*rt);
+            if ((viewMask & 1u) == 0)
+                return;
+
+            BeginShadowAtlasTile(commandList, target, shadowCamera, 0, clearTiles);
 
             for (std::shared_ptr<Object> object : shadowCastingObjects)
             {
@@ -281,16 +319,17 @@ void ShadowMapping::RenderShadowScene(std::shared_ptr<CommandList> commandList,
         }
         else
         {
-            DrawShadowDirectionalCascaded(commandList, shadowCastingObjects, shadowCamera, lightObject, lightObject->GetDirectionalLight(), ShadowMappingHighBiasShader);
+            DrawShadowDirectionalCascaded(commandList, shadowCastingObjects, shadowCamera, lightObject, lightObject->GetDirectionalLight(), ShadowMappingHighBiasShader, target, clearTiles, viewMask);
         }
     }
     else if (shadowCamera->GetLightType() == LightType::Spot)
     {
+        if ((viewMask & 1u) == 0)
+            return;
+
         commandList->SetShader(ShadowMappingShader);
 
-        commandList->TransitionBarrier(*shadowMap, D3D12_RESOURCE_STATE_DEPTH_WRITE);
-        commandList->ClearDepthStencilTexture(*shadowMap, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0);
-        commandList->SetRenderTargetDepthOnly(*rt);
+        BeginShadowAtlasTile(commandList, target, shadowCamera, 0, clearTiles);
 
         for (std::shared_ptr<Object> object : shadowCastingObjects)
         {
@@ -302,17 +341,13 @@ void ShadowMapping::RenderShadowScene(std::shared_ptr<CommandList> commandList,
         commandList->SetShader(ShadowMappingPointShader);
         for (uint32_t dir = 0; dir < 6; dir++)
         {
+            if ((viewMask & (1u << dir)) == 0)
+                continue;
+
             Matrix viewMatrix = shadowCamera->GetPointDirectionShadowMatrix(dir);
             Matrix directionMatrix = viewMatrix * shadowCamera->GetProj();
 
-            shadowMap = shadowCamera->GetShadowMap(dir);
-            // if (shadowMap == nullptr)
-            //     continue;
-            rt->AttachTexture(AttachmentPoint::DepthStencil, shadowMap);
-
-            commandList->TransitionBarrier(*shadowMap, D3D12_RESOURCE_STATE_DEPTH_WRITE);
-            commandList->ClearDepthStencilTexture(*shadowMap, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0);
-            commandList->SetRenderTargetDepthOnly(*rt);
+            BeginShadowAtlasTile(commandList, target, shadowCamera, dir, clearTiles);
 
             DirectX::BoundingFrustum frustum{ shadowCamera->GetProj() };
             frustum.Origin = shadowCamera->GetPosition();
@@ -328,3 +363,60 @@ void ShadowMapping::RenderShadowScene(std::shared_ptr<CommandList> commandList,
         }
     }
 }
+
+static void HashMatrix(size_t& seed, const Matrix& matrix)
+{
+    const float* elements = &matrix._11;
+    for (uint32_t i = 0; i < 16; i++)
+        std::hash_combine(seed, elements[i]);
+}
+
+size_t ShadowMapping::GetStaticShadowSignature(std::shared_ptr<ShadowCamera> shadowCamera, uint32_t view, const std::vector<std::shared_ptr<Object>>& staticCasters)
+{
+    ScopedTimer _prof(L"GetStaticShadowSignature");
+
+    size_t seed = 0;
+    LightObject* lightObject = shadowCamera->GetLightObject();
+    if (lightObject == nullptr)
+        return seed;
+
+    std::hash_combine(seed, (uint32_t)shadowCamera->GetLightType());
+    HashMatrix(seed, shadowCamera->GetViewProjection(view));
+    // Changing the threshold changes which casters are drawn
+    std::hash_combine(seed, Camera::contributionCulling);
+    std::hash_combine(seed, shadowCamera->minScreenSize);
+
+    const ShadowAtlasRect& tile = shadowCamera->GetAtlasTile(view);
+    std::hash_combine(seed, tile.X);
+    std::hash_combine(seed, tile.Y);
+    std::hash_combine(seed, tile.Size);
+
+    // Point lights draw every caster within their range, the other lights cull to the camera's frustum
+    bool isPoint = shadowCamera->GetLightType() == LightType::Point;
+    BoundingSphere pointBounds{};
+    if (isPoint)
+    {
+        PointLight& pointLight = lightObject->GetPointLight();
+        pointBounds = BoundingSphere((Vector3)pointLight.Light.PositionWorldSpace, pointLight.Light.MaxDistance);
+        std::hash_combine(seed, pointLight.Light.MaxDistance);
+    }
+    DirectX::BoundingFrustum frustum = shadowCamera->GetFrustum();
+
+    for (const std::shared_ptr<Object>& object : staticCasters)
+    {
+        if (isPoint ? !object->GetWorldBoundingBox().Intersects(pointBounds) : !object->ShouldDraw(frustum))
+            continue;
+
+        std::hash_combine(seed, object.get());
+        HashMatrix(seed, object->GetWorldMatrix());
+        for (uint32_t i = 0; i < object->GetKnitCount(); i++)
+        {
+            Knit& knit = object->GetKnit(i);
+            // The LOD that's drawn follows the main camera, so a caster changing LOD has to redraw the cache
+            std::hash_combine(seed, object->GetLODMesh(i, Camera::mainCamera, Object::ShadowLODBias).get());
+            std::hash_combine(seed, knit.material.GetTexture(L"MainTexture").get());
+        }
+    }
+
+    return seed;
+}
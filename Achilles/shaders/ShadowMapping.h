@@ -3,6 +3,7 @@
 #include "../ShaderInclude.h"
 #include "CommonShader.h"
 #include "../ShadowCamera.h"
+#include "../ShadowAtlas.h"
 
 using DirectX::SimpleMath::Vector2;
 using DirectX::SimpleMath::Vector3;
@@ -44,11 +45,17 @@ namespace ShadowMapping
     std::shared_ptr<Shader> GetShadowMappingPointShader(ComPtr<ID3D12Device2> device = nullptr);
 
     void DrawObjectShadowDirectional(std::shared_ptr<CommandList> commandList, std::shared_ptr<Object> object, std::shared_ptr<ShadowCamera> shadowCamera, LightObject* lightObject, DirectionalLight directionalLight, std::shared_ptr<Shader> shader);
-    void DrawObjectShadowDirectionalCascaded(std::shared_ptr<CommandList> commandList, std::shared_ptr<Object> object, std::shared_ptr<ShadowCamera> shadowCamera, LightObject* lightObject, DirectionalLight directionalLight, std::shared_ptr<Shader> shader, Matrix cascadeMatrix);
+    void DrawObjectShadowDirectionalCascaded(std::shared_ptr<CommandList> commandList, std::shared_ptr<Object> object, std::shared_ptr<ShadowCamera> shadowCamera, LightObject* lightObject, DirectionalLight directionalLight, std::shared_ptr<Shader> shader, Matrix cascadeMatrix, Matrix cascadeProjection);
     void DrawObjectShadowSpot(std::shared_ptr<CommandList> commandList, std::shared_ptr<Object> object, std::shared_ptr<ShadowCamera> shadowCamera, LightObject* lightObject, SpotLight spotLight, std::shared_ptr<Shader> shader);
     void DrawObjectShadowPoint(std::shared_ptr<CommandList> commandList, std::shared_ptr<Object> object, std::shared_ptr<Camera> shadowCamera, LightObject* lightObject, PointLight pointLight, std::shared_ptr<Shader> shader, Matrix directionMatrix, DirectX::BoundingFrustum frustum);
     // Renders Cascaded Shadow Maps for directional lights
-    void DrawShadowDirectionalCascaded(std::shared_ptr<CommandList> commandList, std::vector<std::shared_ptr<Object>> shadowCastingObjects, std::shared_ptr<ShadowCamera> shadowCamera, LightObject* lightObject, DirectionalLight directionalLight, std::shared_ptr<Shader> shader);
+    void DrawShadowDirectionalCascaded(std::shared_ptr<CommandList> commandList, std::vector<std::shared_ptr<Object>> shadowCastingObjects, std::shared_ptr<ShadowCamera> shadowCamera, LightObject* lightObject, DirectionalLight directionalLight, std::shared_ptr<Shader> shader, std::shared_ptr<ShadowMap> target = nullptr, bool clearTiles = true, uint32_t viewMask = ~0u);
     // Assumes shaders ShadowMappingShader and ShadowMappingHighBiasShader have been loaded elsewhere before calling this
-    void RenderShadowScene(std::shared_ptr<CommandList> commandList, std::shared_ptr<ShadowCamera> shadowCamera, std::vector<std::shared_ptr<Object>> shadowCastingObjects);
+    // Renders into the camera's tiles of target, the shadow atlas when null, so ShadowAtlas::Allocate must have been called first
+    // Without clearTiles the casters are drawn over what's already in the tiles, such as dynamic casters over the copied static cache
+    // Only views with their bit set in viewMask are drawn
+    void RenderShadowScene(std::shared_ptr<CommandList> commandList, std::shared_ptr<ShadowCamera> shadowCamera, std::vector<std::shared_ptr<Object>> shadowCastingObjects, std::shared_ptr<ShadowMap> target = nullptr, bool clearTiles = true, uint32_t viewMask = ~0u);
+    // Hash of a view's matrix, its tile and every static caster the camera can see, with their transforms, meshes and textures
+    // Casters that move in or out of the light's bounds, or are deactivated, change the hash as they join or leave the set
+    size_t GetStaticShadowSignature(std::shared_ptr<ShadowCamera> shadowCamera, uint32_t view, const std::vector<std::shared_ptr<Object>>& staticCasters);
 }
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "Tests.h"
+#include "Achilles/shaders/DepthReduction.h"
+#include "Achilles/MathHelpers.h"
+#include <random>
+
+// Depth buffer value of a point at view depth z, projected as a row vector
+static float ProjectDepth(float z, const Matrix& proj)
+{
+    return (z * proj._33 + proj._43) / (z * proj._34 + proj._44);
+}
+
+static bool BruteForceRange(const std::vector<float>& depths, float& minDepth, float& maxDepth)
+{
+    minDepth = 1.0f;
+    maxDepth = 0.0f;
+    for (float depth : depths)
+    {
+        if (depth >= 1.0f)
+            continue;
+        minDepth = std::min(minDepth, depth);
+        maxDepth = std::max(maxDepth, depth);
+    }
+    return minDepth <= maxDepth;
+}
+
+TEST(DepthReductionTiles)
+{
+    // Sizes that aren't whole tiles, with some of each image cleared and some tiles left entirely clear
+    std::mt19937 random(5);
+    std::uniform_real_distribution<float> depthDistribution(0.0f, 0.999f);
+    const uint32_t sizes[][2] = { { 1, 1 }, { 31, 33 }, { 100, 70 }, { 256, 128 } };
+
+    for (const uint32_t* size : sizes)
+    {
+        uint32_t width = size[0], height = size[1];
+        for (uint32_t image = 0; image < 20; image++)
+        {
+            float clearedFraction = image / 20.0f;
+            std::vector<float> depths((size_t)width * height);
+            for (uint32_t y = 0; y < height; y++)
+            {
+                for (uint32_t x = 0; x < width; x++)
+                {
+                    bool clearTile = (x / DepthReduction::TileSize + y / DepthReduction::TileSize) % 3 == 0 && image % 2 == 0;
+                    bool cleared = clearTile || std::uniform_real_distribution<float>(0.0f, 1.0f)(random) < clearedFraction;
+                    depths[(size_t)y * width + x] = cleared ? 1.0f : depthDistribution(random);
+                }
+            }
+
+            float expectedMin, expectedMax, minDepth, maxDepth;
+            bool expected = BruteForceRange(depths, expectedMin, expectedMax);
+            CHECK(DepthReduction::ReduceDepthCPU(depths.data(), width, height, minDepth, maxDepth) == expected);
+            if (expected)
+                CHECK(minDepth == expectedMin && maxDepth == expectedMax);
+        }
+
+        // Nothing drawn at all
+        std::vector<float> cleared((size_t)width * height, 1.0f);
+        float minDepth, maxDepth;
+        CHECK(!DepthReduction::ReduceDepthCPU(cleared.data(), width, height, minDepth, maxDepth));
+    }
+
+    // Tiles with nothing drawn are left as (1, 0) by the shader and skipped
+    const Vector2 tileRanges[] = { Vector2(1.0f, 0.0f), Vector2(0.4f, 0.6f), Vector2(1.0f, 0.0f), Vector2(0.2f, 0.3f), Vector2(0.5f, 0.5f) };
+    float minDepth, maxDepth;
+    CHECK(DepthReduction::ReduceTileRanges(tileRanges, std::size(tileRanges), minDepth, maxDepth));
+    CHECK(minDepth == 0.2f && maxDepth == 0.6f);
+    CHECK(!DepthReduction::ReduceTileRanges(tileRanges, 1, minDepth, maxDepth));
+    CHECK(!DepthReduction::ReduceTileRanges(tileRanges, 0, minDepth, maxDepth));
+}
+
+TEST(DepthReductionViewDepth)
+{
+    const float planes[][2] = { { 0.1f, 100.0f }, { 1.0f, 1000.0f }, { 0.5f, 20.0f } };
+    for (const float* plane : planes)
+    {
+        float nearZ = plane[0], farZ = plane[1];
+
+        // The projections the camera makes. The orthographic one is stored transposed, so it's transposed back to project with
+        Matrix perspective = PerspectiveFovProjection(1280.0f, 720.0f, 60.0f, nearZ, farZ);
+        Matrix orthographic = OrthographicProjection(16.0f, 9.0f, nearZ, farZ).Transpose();
+
+        for (uint32_t i = 0; i <= 100; i++)
+        {
+            float z = nearZ + (farZ - nearZ) * i / 100.0f;
+
+            float perspectiveDepth = ProjectDepth(z, perspective);
+            CHECK(perspectiveDepth >= 0.0f && perspectiveDepth <= 1.0f + 1e-6f);
+            CHECK(std::abs(DepthReduction::DepthToViewDepth(perspectiveDepth, nearZ, farZ, false) - z) <= z * 1e-3f);
+
+            float orthographicDepth = ProjectDepth(z, orthographic);
+            CHECK(orthographicDepth >= -1e-6f && orthographicDepth <= 1.0f + 1e-6f);
+            CHECK(std::abs(DepthReduction::DepthToViewDepth(orthographicDepth, nearZ, farZ, true) - z) <= farZ * 1e-5f);
+        }
+
+        // The planes themselves, the far plane losing precision to the perspective divide
+        CHECK(std::abs(DepthReduction::DepthToViewDepth(0.0f, nearZ, farZ, false) - nearZ) <= nearZ * 1e-5f);
+        CHECK(std::abs(DepthReduction::DepthToViewDepth(1.0f, nearZ, farZ, false) - farZ) <= farZ * 1e-3f);
+        CHECK(std::abs(DepthReduction::DepthToViewDepth(0.0f, nearZ, farZ, true) - nearZ) <= nearZ * 1e-5f);
+        CHECK(std::abs(DepthReduction::DepthToViewDepth(1.0f, nearZ, farZ, true) - farZ) <= farZ * 1e-5f);
+    }
+}
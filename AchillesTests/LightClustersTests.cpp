@@ -0,0 +1,316 @@
+#include "Tests.h"
+#include "Achilles/LightClusters.h"
+#include "Achilles/Camera.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+// A cluster's actual volume, the piece of the frustum its tile and slice cover, and the view space box around it
+struct ClusterVolume
+{
+    float NdcX[2];
+    float NdcY[2];
+    float Depth[2];
+    Vector3 BoxMin;
+    Vector3 BoxMax;
+};
+
+// Worked out from the projection on its own rather than through LightClusters, so both have to agree
+static ClusterVolume GetClusterVolume(const Matrix& proj, float nearZ, float farZ, uint32_t x, uint32_t y, uint32_t z)
+{
+    uint32_t countX = LightClusters::ClusterCountX, countY = LightClusters::ClusterCountY, countZ = LightClusters::ClusterCountZ;
+
+    ClusterVolume volume;
+    volume.NdcX[0] = -1.0f + 2.0f * x / countX;
+    volume.NdcX[1] = -1.0f + 2.0f * (x + 1) / countX;
+    volume.NdcY[0] = 1.0f - 2.0f * (y + 1) / countY;
+    volume.NdcY[1] = 1.0f - 2.0f * y / countY;
+    // Exponential slices from the near plane to the far plane
+    volume.Depth[0] = nearZ * powf(farZ / nearZ, (float)z / countZ);
+    volume.Depth[1] = nearZ * powf(farZ / nearZ, (float)(z + 1) / countZ);
+
+    volume.BoxMin = Vector3(FLT_MAX, FLT_MAX, FLT_MAX);
+    volume.BoxMax = Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (float depth : volume.Depth)
+    {
+        for (float ndcX : volume.NdcX)
+        {
+            for (float ndcY : volume.NdcY)
+            {
+                Vector3 corner(ndcX * depth / proj._11, ndcY * depth / proj._22, depth);
+                volume.BoxMin = Vector3::Min(volume.BoxMin, corner);
+                volume.BoxMax = Vector3::Max(volume.BoxMax, corner);
+            }
+        }
+    }
+    return volume;
+}
+
+// Points spread through the cluster's volume, including its corners and faces
+static void GetClusterSamples(const Matrix& proj, const ClusterVolume& volume, std::vector<Vector3>& samples)
+{
+    const uint32_t steps = 5;
+    samples.clear();
+    for (uint32_t k = 0; k < steps; k++)
+    {
+        float depth = volume.Depth[0] + (volume.Depth[1] - volume.Depth[0]) * k / (steps - 1);
+        for (uint32_t j = 0; j < steps; j++)
+        {
+            float ndcY = volume.NdcY[0] + (volume.NdcY[1] - volume.NdcY[0]) * j / (steps - 1);
+            for (uint32_t i = 0; i < steps; i++)
+            {
+                float ndcX = volume.NdcX[0] + (volume.NdcX[1] - volume.NdcX[0]) * i / (steps - 1);
+                samples.push_back(Vector3(ndcX * depth / proj._11, ndcY * depth / proj._22, depth));
+            }
+        }
+    }
+}
+
+// A light in view space, with the cone left open for point lights
+struct TestLight
+{
+    Vector3 Center;
+    float Range;
+    Vector3 Direction;
+    float CosOuterAngle = -1.0f;
+};
+
+static void SetPosition(LightCommon& light, const Matrix& inverseView, const Vector3& viewPosition, float range)
+{
+    Vector3 world = Vector3::Transform(viewPosition, inverseView);
+    light.PositionWorldSpace = Vector4(world.x, world.y, world.z, 1.0f);
+    light.MaxDistance = range;
+}
+
+TEST(LightClustersMatchBruteForce)
+{
+    std::shared_ptr<Camera> camera = std::make_shared<Camera>(L"Test Camera", 1600, 900);
+    camera->nearZ = 0.1f;
+    camera->farZ = 100.0f;
+    camera->SetPosition(Vector3(3.0f, 2.0f, -7.0f));
+    camera->SetRotation(Vector3(0.2f, 0.6f, 0.0f));
+
+    Matrix view = camera->GetView();
+    Matrix inverseView = view.Invert();
+    Matrix proj = camera->GetProj();
+    float nearZ = camera->nearZ, farZ = camera->farZ;
+
+    // Lights are placed in view space so where they sit against the near and far planes is known, then moved into the world
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> depth(-5.0f, farZ + 10.0f);
+    std::uniform_real_distribution<float> range(0.05f, 12.0f);
+    std::uniform_real_distribution<float> angle(0.2f, 1.3f);
+    auto randomPosition = [&]()
+        {
+            float z = depth(random);
+            float spread = std::max(fabsf(z), 1.0f) * 1.2f;
+            return Vector3(unit(random) * spread / proj._11, unit(random) * spread / proj._22, z);
+        };
+
+    std::vector<TestLight> testLights;
+    std::vector<PointLight> pointLights;
+    std::vector<SpotLight> spotLights;
+    // Lights that don't reach the frustum at all, so mustn't be in any cluster
+    std::vector<uint32_t> outsideLights;
+
+    auto addPoint = [&](const Vector3& center, float lightRange)
+        {
+            PointLight light;
+            SetPosition(light.Light, inverseView, center, lightRange);
+            pointLights.push_back(light);
+            testLights.push_back({ center, lightRange, Vector3::Zero, -1.0f });
+        };
+
+    // Around the near plane: straddling it, reaching in from behind the camera, entirely behind it and entirely inside the first slice
+    addPoint(Vector3(0.0f, 0.0f, nearZ * 0.5f), 0.2f);
+    addPoint(Vector3(0.5f, -0.3f, -1.0f), 1.5f);
+    outsideLights.push_back((uint32_t)testLights.size());
+    addPoint(Vector3(0.0f, 0.0f, -1.0f), 0.5f);
+    addPoint(Vector3(0.001f, 0.001f, nearZ * 1.2f), 0.01f);
+    // Around the far plane: straddling it, just beyond it and just inside it
+    addPoint(Vector3(10.0f, 5.0f, farZ + 0.5f), 1.0f);
+    outsideLights.push_back((uint32_t)testLights.size());
+    addPoint(Vector3(0.0f, 0.0f, farZ + 2.0f), 1.0f);
+    addPoint(Vector3(-20.0f, 10.0f, farZ - 0.1f), 0.05f);
+    // Off to the side of the frustum, not reaching it
+    outsideLights.push_back((uint32_t)testLights.size());
+    addPoint(Vector3(50.0f / proj._11 + 10.0f, 0.0f, 50.0f), 2.0f);
+
+    for (uint32_t i = 0; i < 600; i++)
+        addPoint(randomPosition(), range(random));
+
+    uint32_t pointCount = (uint32_t)pointLights.size();
+    auto addSpot = [&](const Vector3& center, float lightRange, Vector3 direction, float outerAngle)
+        {
+            direction.Normalize();
+            SpotLight light;
+            SetPosition(light.Light, inverseView, center, lightRange);
+            Vector3 worldDirection = Vector3::TransformNormal(direction, inverseView);
+            worldDirection.Normalize();
+            light.DirectionWorldSpace = Vector4(worldDirection.x, worldDirection.y, worldDirection.z, 0.0f);
+            light.OuterSpotAngle = outerAngle;
+            light.InnerSpotAngle = outerAngle * 0.8f;
+            spotLights.push_back(light);
+            testLights.push_back({ center, lightRange, direction, cosf(outerAngle) });
+        };
+
+    // Spots shining into the view across the near plane and out through the far plane
+    addSpot(Vector3(0.0f, 0.0f, -0.5f), 3.0f, Vector3(0.0f, 0.0f, 1.0f), 0.5f);
+    addSpot(Vector3(0.0f, 0.0f, farZ - 1.0f), 5.0f, Vector3(0.3f, 0.0f, 1.0f), 0.4f);
+    for (uint32_t i = 0; i < 200; i++)
+        addSpot(randomPosition(), range(random), Vector3(unit(random), unit(random), unit(random)), angle(random));
+
+    LightClusters clusters;
+    clusters.Build(camera, pointLights, spotLights);
+    CHECK(clusters.GetCamera() == camera.get());
+    CHECK(clusters.GetDroppedLightIndices() == 0);
+
+    const LightClusters::ClusterInfo& info = clusters.GetClusterInfo();
+    CHECK(info.Enabled == 1);
+    CHECK(info.ClusterCountX == LightClusters::ClusterCountX && info.ClusterCountY == LightClusters::ClusterCountY && info.ClusterCountZ == LightClusters::ClusterCountZ);
+
+    // The first and last slices start and end on the near and far planes, and depths pick the slices they're in
+    CHECK(clusters.GetSlice(nearZ * 0.5f) == 0);
+    CHECK(clusters.GetSlice(nearZ * 1.001f) == 0);
+    CHECK(clusters.GetSlice(farZ * 0.999f) == info.ClusterCountZ - 1);
+    CHECK(clusters.GetSlice(farZ * 2.0f) == info.ClusterCountZ - 1);
+    for (uint32_t z = 1; z < info.ClusterCountZ; z++)
+    {
+        float boundary = GetClusterVolume(proj, nearZ, farZ, 0, 0, z).Depth[0];
+        CHECK(clusters.GetSlice(boundary * 0.999f) == z - 1);
+        CHECK(clusters.GetSlice(boundary * 1.001f) == z);
+    }
+
+    // Which lights each cluster lists. Ranges cover the index list in order without gaps and no light is listed twice
+    const std::vector<LightClusters::ClusterRange>& grid = clusters.GetGrid();
+    const std::vector<uint32_t>& indices = clusters.GetLightIndices();
+    uint32_t lightCount = (uint32_t)testLights.size();
+    CHECK(grid.size() == (size_t)info.ClusterCountX * info.ClusterCountY * info.ClusterCountZ);
+
+    std::vector<uint8_t> listed(grid.size() * lightCount, 0);
+    uint32_t expectedOffset = 0;
+    for (size_t c = 0; c < grid.size(); c++)
+    {
+        CHECK(grid[c].Offset == expectedOffset);
+        expectedOffset += grid[c].Count;
+        for (uint32_t i = grid[c].Offset; i < grid[c].Offset + grid[c].Count; i++)
+        {
+            CHECK(indices[i] < lightCount);
+            CHECK(!listed[c * lightCount + indices[i]]);
+            listed[c * lightCount + indices[i]] = 1;
+        }
+    }
+    CHECK(expectedOffset == indices.size());
+
+    for (uint32_t light : outsideLights)
+    {
+        for (size_t c = 0; c < grid.size(); c++)
+            CHECK(!listed[c * lightCount + light]);
+    }
+
+    // Every cluster a light's sphere and cone reach has to list it, and a light is only listed where its sphere reaches the cluster's box
+    // Lights within a rounding error of a cluster could go either way, so the checks leave a small margin
+    const float margin = 1e-3f * farZ;
+    std::vector<Vector3> samples;
+    uint32_t reached = 0;
+    for (uint32_t z = 0; z < info.ClusterCountZ; z++)
+    {
+        for (uint32_t y = 0; y < info.ClusterCountY; y++)
+        {
+            for (uint32_t x = 0; x < info.ClusterCountX; x++)
+            {
+                ClusterVolume volume = GetClusterVolume(proj, nearZ, farZ, x, y, z);
+                uint32_t cluster = clusters.GetClusterIndex(x, y, z);
+                bool sampled = false;
+
+                for (uint32_t l = 0; l < lightCount; l++)
+                {
+                    const TestLight& light = testLights[l];
+                    bool isListed = listed[cluster * lightCount + l];
+
+                    Vector3 closest = Vector3::Min(Vector3::Max(light.Center, volume.BoxMin), volume.BoxMax);
+                    float boxDistance = Vector3::Distance(closest, light.Center);
+                    if (boxDistance > light.Range + margin)
+                    {
+                        CHECK(!isListed);
+                        continue;
+                    }
+                    if (isListed)
+                        continue;
+
+                    if (!sampled)
+                    {
+                        GetClusterSamples(proj, volume, samples);
+                        sampled = true;
+                    }
+
+                    // Not listed, so no point of the cluster can be lit
+                    for (const Vector3& sample : samples)
+                    {
+                        Vector3 toSample = sample - light.Center;
+                        float distance = toSample.Length();
+                        if (distance >= light.Range - margin)
+                            continue;
+
+                        bool inCone = light.CosOuterAngle <= -1.0f || (distance > margin && toSample.Dot(light.Direction) / distance >= light.CosOuterAngle + 1e-3f);
+                        CHECK(!inCone);
+                    }
+                }
+
+                if (grid[cluster].Count > 0)
+                    reached++;
+            }
+        }
+    }
+
+    // Guards against nothing being binned and the checks above passing trivially
+    CHECK(reached > grid.size() / 4);
+
+    // Spot lights come after the point lights in the index list
+    bool spotListed = false;
+    for (uint32_t index : indices)
+        spotListed |= index >= pointCount;
+    CHECK(spotListed);
+}
+
+TEST(LightClustersRebuild)
+{
+    // Building again with no lights clears every cluster, and the same lights give the same lists whatever the thread count
+    std::shared_ptr<Camera> camera = std::make_shared<Camera>(L"Test Camera", 1280, 720);
+    std::mt19937 random(8);
+    std::uniform_real_distribution<float> spread(-30.0f, 30.0f);
+    std::uniform_real_distribution<float> depth(0.0f, 90.0f);
+
+    std::vector<PointLight> pointLights(1000);
+    for (PointLight& light : pointLights)
+    {
+        light.Light.PositionWorldSpace = Vector4(spread(random), spread(random) * 0.5f, depth(random), 1.0f);
+        light.Light.MaxDistance = 4.0f;
+    }
+
+    uint32_t workerCount = LightClusters::WorkerCount;
+    uint32_t minLightsPerWorker = LightClusters::MinLightsPerWorker;
+
+    LightClusters single, threaded;
+    LightClusters::WorkerCount = 1;
+    single.Build(camera, pointLights, {});
+    LightClusters::WorkerCount = 8;
+    LightClusters::MinLightsPerWorker = 1;
+    threaded.Build(camera, pointLights, {});
+    LightClusters::WorkerCount = workerCount;
+    LightClusters::MinLightsPerWorker = minLightsPerWorker;
+
+    CHECK(!single.GetLightIndices().empty());
+    CHECK(single.GetLightIndices() == threaded.GetLightIndices());
+    for (size_t c = 0; c < single.GetGrid().size(); c++)
+        CHECK(single.GetGrid()[c].Offset == threaded.GetGrid()[c].Offset && single.GetGrid()[c].Count == threaded.GetGrid()[c].Count);
+
+    single.Build(camera, {}, {});
+    CHECK(single.GetLightIndices().empty());
+    for (const LightClusters::ClusterRange& range : single.GetGrid())
+        CHECK(range.Count == 0);
+}
@@ -0,0 +1,184 @@
+#include "Tests.h"
+#include "Achilles/MeshBVH.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace DirectX;
+
+// Positions first with something after them, so the stride is exercised the way real vertex layouts do
+struct TestVertex
+{
+    XMFLOAT3 Position;
+    XMFLOAT3 Normal;
+};
+
+struct PickResult
+{
+    bool Hit = false;
+    float Distance = INFINITY;
+    uint32_t Triangle = 0;
+};
+
+// What PickObjectBruteForce does, every triangle tested in turn
+template<typename Index>
+static PickResult PickBruteForce(const std::vector<TestVertex>& vertices, const std::vector<Index>& indices, FXMVECTOR origin, FXMVECTOR direction)
+{
+    PickResult result;
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        XMVECTOR v0 = XMLoadFloat3(&vertices[indices[i + 0]].Position);
+        XMVECTOR v1 = XMLoadFloat3(&vertices[indices[i + 1]].Position);
+        XMVECTOR v2 = XMLoadFloat3(&vertices[indices[i + 2]].Position);
+
+        float distance = 0.0f;
+        if (TriangleTests::Intersects(origin, direction, v0, v1, v2, distance) && distance < result.Distance)
+        {
+            result.Hit = true;
+            result.Distance = distance;
+            result.Triangle = (uint32_t)(i / 3);
+        }
+    }
+    return result;
+}
+
+// Hit, distance and triangle must all match. Rays through a shared edge or overlapping triangles can pick either triangle, so the triangle only has to match when it's the only one at that distance
+template<typename Index>
+static void CheckPicking(const std::vector<TestVertex>& vertices, const std::vector<Index>& indices, std::mt19937& random, uint32_t rayCount, float extent)
+{
+    MeshBVH bvh((const uint8_t*)vertices.data(), vertices.size(), sizeof(TestVertex), indices.data(), indices.size(), sizeof(Index));
+    CHECK(bvh.GetTriangleCount() == indices.size() / 3);
+
+    std::uniform_real_distribution<float> position(-extent * 1.5f, extent * 1.5f);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_int_distribution<size_t> triangle(0, indices.size() / 3 - 1);
+
+    uint32_t hits = 0;
+    for (uint32_t r = 0; r < rayCount; r++)
+    {
+        XMVECTOR origin = XMVectorSet(position(random), position(random), position(random), 0.0f);
+
+        // Half the rays aim at a point on a random triangle so plenty of them hit, the rest go anywhere
+        XMVECTOR direction;
+        if (r % 2 == 0)
+        {
+            size_t t = triangle(random) * 3;
+            float u = std::abs(unit(random)), v = std::abs(unit(random)) * (1.0f - u);
+            XMVECTOR v0 = XMLoadFloat3(&vertices[indices[t + 0]].Position);
+            XMVECTOR v1 = XMLoadFloat3(&vertices[indices[t + 1]].Position);
+            XMVECTOR v2 = XMLoadFloat3(&vertices[indices[t + 2]].Position);
+            XMVECTOR target = XMVectorAdd(v0, XMVectorAdd(XMVectorScale(XMVectorSubtract(v1, v0), u), XMVectorScale(XMVectorSubtract(v2, v0), v)));
+            direction = XMVectorSubtract(target, origin);
+        }
+        else
+        {
+            direction = XMVectorSet(unit(random), unit(random), unit(random), 0.0f);
+        }
+        if (XMVectorGetX(XMVector3LengthSq(direction)) < 1e-6f)
+            continue;
+        direction = XMVector3Normalize(direction);
+
+        PickResult expected = PickBruteForce(vertices, indices, origin, direction);
+
+        PickResult picked;
+        picked.Hit = bvh.Intersects(origin, direction, picked.Distance, &picked.Triangle);
+
+        CHECK(picked.Hit == expected.Hit);
+        if (!expected.Hit)
+            continue;
+
+        hits++;
+        float tolerance = 1e-4f * std::max(1.0f, expected.Distance);
+        CHECK(std::abs(picked.Distance - expected.Distance) <= tolerance);
+        if (picked.Triangle != expected.Triangle)
+        {
+            // Only allowed when the BVH's triangle is hit at the same distance
+            XMVECTOR v0 = XMLoadFloat3(&vertices[indices[picked.Triangle * 3 + 0]].Position);
+            XMVECTOR v1 = XMLoadFloat3(&vertices[indices[picked.Triangle * 3 + 1]].Position);
+            XMVECTOR v2 = XMLoadFloat3(&vertices[indices[picked.Triangle * 3 + 2]].Position);
+            float distance = 0.0f;
+            CHECK(TriangleTests::Intersects(origin, direction, v0, v1, v2, distance));
+            CHECK(std::abs(distance - expected.Distance) <= tolerance);
+        }
+
+        // A hit further than the limit given isn't reported
+        float limit = expected.Distance * 0.5f;
+        CHECK(!bvh.Intersects(origin, direction, limit));
+    }
+
+    // Guards against the rays all missing and the test passing without checking anything
+    CHECK(hits > rayCount / 4);
+}
+
+// Disconnected triangles scattered through a cube, so the tree has overlapping leaves to sort out
+static void MakeTriangleSoup(std::mt19937& random, uint32_t triangleCount, float extent, std::vector<TestVertex>& vertices, std::vector<uint32_t>& indices)
+{
+    std::uniform_real_distribution<float> center(-extent, extent);
+    std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        XMFLOAT3 c = { center(random), center(random), center(random) };
+        for (uint32_t corner = 0; corner < 3; corner++)
+        {
+            indices.push_back((uint32_t)vertices.size());
+            vertices.push_back({ { c.x + offset(random), c.y + offset(random), c.z + offset(random) }, { 0, 1, 0 } });
+        }
+    }
+}
+
+TEST(MeshBVHTriangleSoup)
+{
+    std::mt19937 random(2);
+    for (uint32_t triangleCount : { 1u, 3u, 4u, 5u, 100u, 5000u })
+    {
+        std::vector<TestVertex> vertices;
+        std::vector<uint32_t> indices;
+        MakeTriangleSoup(random, triangleCount, 10.0f, vertices, indices);
+        CheckPicking(vertices, indices, random, 2000, 10.0f);
+    }
+}
+
+TEST(MeshBVHHeightField)
+{
+    // A bumpy grid with shared vertices and 16-bit indices, like most imported meshes
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> height(-0.5f, 0.5f);
+    const uint32_t size = 48;
+
+    std::vector<TestVertex> vertices;
+    for (uint32_t y = 0; y <= size; y++)
+    {
+        for (uint32_t x = 0; x <= size; x++)
+            vertices.push_back({ { (float)x - size * 0.5f, height(random), (float)y - size * 0.5f }, { 0, 1, 0 } });
+    }
+
+    std::vector<uint16_t> indices;
+    for (uint16_t y = 0; y < size; y++)
+    {
+        for (uint16_t x = 0; x < size; x++)
+        {
+            uint16_t i = (uint16_t)(y * (size + 1) + x);
+            indices.insert(indices.end(), { i, (uint16_t)(i + size + 1), (uint16_t)(i + 1), (uint16_t)(i + 1), (uint16_t)(i + size + 1), (uint16_t)(i + size + 2) });
+        }
+    }
+
+    CheckPicking(vertices, indices, random, 4000, size * 0.5f);
+}
+
+TEST(MeshBVHCoincidentTriangles)
+{
+    // Many triangles with the same centroid can't be split by position, the build still has to terminate with a bounded depth
+    std::vector<TestVertex> vertices;
+    std::vector<uint32_t> indices;
+    for (uint32_t t = 0; t < 500; t++)
+    {
+        for (uint32_t corner = 0; corner < 3; corner++)
+        {
+            indices.push_back((uint32_t)vertices.size());
+            vertices.push_back({ { corner == 0 ? 1.0f : 0.0f, corner == 1 ? 1.0f : 0.0f, corner == 2 ? 1.0f : 0.0f }, { 0, 1, 0 } });
+        }
+    }
+
+    std::mt19937 random(4);
+    CheckPicking(vertices, indices, random, 500, 1.0f);
+}
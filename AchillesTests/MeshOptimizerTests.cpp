@@ -0,0 +1,270 @@
+#include "Tests.h"
+#include "Achilles/MeshOptimizer.h"
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <random>
+
+struct TestVertex
+{
+    float Position[3];
+    uint32_t Id; // Which vertex this was before any reordering
+};
+
+struct TestMesh
+{
+    std::vector<TestVertex> Vertices;
+    std::vector<uint32_t> Indices;
+};
+
+// Rows of quads in row order, the order a simple importer would produce
+static TestMesh MakeGrid(uint32_t width, uint32_t height)
+{
+    TestMesh mesh;
+    for (uint32_t y = 0; y <= height; y++)
+    {
+        for (uint32_t x = 0; x <= width; x++)
+            mesh.Vertices.push_back({ { (float)x, 0.0f, (float)y }, (uint32_t)mesh.Vertices.size() });
+    }
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            uint32_t i = y * (width + 1) + x;
+            mesh.Indices.insert(mesh.Indices.end(), { i, i + width + 1, i + 1, i + 1, i + width + 1, i + width + 2 });
+        }
+    }
+    return mesh;
+}
+
+// Triangle order and vertex order randomised, the worst case for both caches
+static TestMesh Shuffle(const TestMesh& mesh, uint32_t seed)
+{
+    std::mt19937 random(seed);
+
+    std::vector<uint32_t> remap(mesh.Vertices.size());
+    for (uint32_t i = 0; i < remap.size(); i++)
+        remap[i] = i;
+    std::shuffle(remap.begin(), remap.end(), random);
+
+    TestMesh shuffled;
+    shuffled.Vertices.resize(mesh.Vertices.size());
+    for (uint32_t i = 0; i < remap.size(); i++)
+        shuffled.Vertices[remap[i]] = mesh.Vertices[i];
+
+    std::vector<uint32_t> triangles(mesh.Indices.size() / 3);
+    for (uint32_t i = 0; i < triangles.size(); i++)
+        triangles[i] = i;
+    std::shuffle(triangles.begin(), triangles.end(), random);
+
+    for (uint32_t triangle : triangles)
+    {
+        for (uint32_t corner = 0; corner < 3; corner++)
+            shuffled.Indices.push_back(remap[mesh.Indices[triangle * 3 + corner]]);
+    }
+    return shuffled;
+}
+
+// Triangles by the original ids of their vertices, rotated so the winding is kept but the starting corner doesn't matter
+static std::vector<std::array<uint32_t, 3>> GetTriangles(const TestMesh& mesh)
+{
+    std::vector<std::array<uint32_t, 3>> triangles;
+    for (size_t i = 0; i < mesh.Indices.size(); i += 3)
+    {
+        std::array<uint32_t, 3> triangle = { mesh.Vertices[mesh.Indices[i]].Id, mesh.Vertices[mesh.Indices[i + 1]].Id, mesh.Vertices[mesh.Indices[i + 2]].Id };
+        while (triangle[0] != std::min({ triangle[0], triangle[1], triangle[2] }))
+            std::rotate(triangle.begin(), triangle.begin() + 1, triangle.end());
+        triangles.push_back(triangle);
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+// Vertex fetch locality: how far on average each new vertex is from the last one fetched, 1 is sequential
+static float GetFetchDistance(const TestMesh& mesh)
+{
+    std::vector<bool> fetched(mesh.Vertices.size(), false);
+    uint64_t distance = 0;
+    uint32_t count = 0;
+    int64_t last = -1;
+    for (uint32_t index : mesh.Indices)
+    {
+        if (fetched[index])
+            continue;
+        fetched[index] = true;
+        distance += (uint64_t)std::abs((int64_t)index - last);
+        last = index;
+        count++;
+    }
+    return (float)distance / count;
+}
+
+static void CheckOptimizeMesh(const TestMesh& input)
+{
+    MeshOptimizer::VertexCacheStatistics before = MeshOptimizer::AnalyzeVertexCache(input.Indices, input.Vertices.size());
+
+    TestMesh optimized = input;
+    size_t vertexCount = MeshOptimizer::OptimizeMesh(optimized.Vertices.data(), optimized.Vertices.size(), sizeof(TestVertex), optimized.Indices);
+    optimized.Vertices.resize(vertexCount);
+
+    // Every vertex is used, so none are dropped, and no triangles are lost, added or flipped
+    CHECK(vertexCount == input.Vertices.size());
+    CHECK(optimized.Indices.size() == input.Indices.size());
+    for (uint32_t index : optimized.Indices)
+        CHECK(index < vertexCount);
+    CHECK(GetTriangles(optimized) == GetTriangles(input));
+
+    MeshOptimizer::VertexCacheStatistics after = MeshOptimizer::AnalyzeVertexCache(optimized.Indices, vertexCount);
+    CHECK(after.ACMR <= before.ACMR);
+    CHECK(after.ATVR <= before.ATVR);
+    CHECK(GetFetchDistance(optimized) <= GetFetchDistance(input));
+}
+
+TEST(MeshOptimizerGrid)
+{
+    CheckOptimizeMesh(MakeGrid(64, 64));
+}
+
+TEST(MeshOptimizerShuffledGrid)
+{
+    TestMesh shuffled = Shuffle(MakeGrid(64, 64), 1);
+    CheckOptimizeMesh(shuffled);
+
+    // From a random order there's no excuse for not getting close to the ideal
+    TestMesh optimized = shuffled;
+    MeshOptimizer::OptimizeVertexCache(optimized.Indices, optimized.Vertices.size());
+    MeshOptimizer::VertexCacheStatistics statistics = MeshOptimizer::AnalyzeVertexCache(optimized.Indices, optimized.Vertices.size());
+    CHECK(statistics.ACMR < 0.8f);
+}
+
+TEST(MeshOptimizerSmallMeshes)
+{
+    // Fewer triangles than the cache holds and a single triangle
+    CheckOptimizeMesh(MakeGrid(2, 1));
+    CheckOptimizeMesh(MakeGrid(1, 1));
+
+    TestMesh triangle;
+    triangle.Vertices = { { { 0, 0, 0 }, 0 }, { { 1, 0, 0 }, 1 }, { { 0, 1, 0 }, 2 } };
+    triangle.Indices = { 0, 1, 2 };
+    CheckOptimizeMesh(triangle);
+}
+
+// MakeGrid raised into rolling hills, so simplifying it has some error to report
+static TestMesh MakeHills(uint32_t size, float height)
+{
+    TestMesh mesh = MakeGrid(size, size);
+    for (TestVertex& vertex : mesh.Vertices)
+        vertex.Position[1] = height * sinf(vertex.Position[0] * 0.4f) * cosf(vertex.Position[2] * 0.3f);
+    return mesh;
+}
+
+// Furthest vertical distance from the full detail vertices to a simplified heightfield, relative to the mesh extents like the simplifier's error
+static float GetHeightDeviation(const TestMesh& mesh, const std::vector<uint32_t>& indices)
+{
+    float minimum[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float maximum[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (const TestVertex& vertex : mesh.Vertices)
+    {
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            minimum[c] = std::min(minimum[c], vertex.Position[c]);
+            maximum[c] = std::max(maximum[c], vertex.Position[c]);
+        }
+    }
+    float extent = std::max({ maximum[0] - minimum[0], maximum[1] - minimum[1], maximum[2] - minimum[2] });
+
+    float deviation = 0.0f;
+    for (const TestVertex& vertex : mesh.Vertices)
+    {
+        const float* p = vertex.Position;
+        float closest = FLT_MAX;
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            const float* a = mesh.Vertices[indices[i]].Position;
+            const float* b = mesh.Vertices[indices[i + 1]].Position;
+            const float* c = mesh.Vertices[indices[i + 2]].Position;
+
+            // Barycentrics of the vertex in the triangle seen from above
+            float area = (b[2] - c[2]) * (a[0] - c[0]) + (c[0] - b[0]) * (a[2] - c[2]);
+            if (std::abs(area) < 1e-9f)
+                continue;
+            float u = ((b[2] - c[2]) * (p[0] - c[0]) + (c[0] - b[0]) * (p[2] - c[2])) / area;
+            float v = ((c[2] - a[2]) * (p[0] - c[0]) + (a[0] - c[0]) * (p[2] - c[2])) / area;
+            float w = 1.0f - u - v;
+            if (u < -1e-4f || v < -1e-4f || w < -1e-4f)
+                continue;
+
+            closest = std::min(closest, std::abs(p[1] - (u * a[1] + v * b[1] + w * c[1])));
+        }
+        deviation = std::max(deviation, closest);
+    }
+    return deviation / extent;
+}
+
+TEST(MeshOptimizerLODChain)
+{
+    for (float height : { 0.5f, 2.0f, 4.0f, 8.0f })
+    {
+        TestMesh hills = MakeHills(32, height);
+        std::vector<MeshOptimizer::LODLevel> levels = MeshOptimizer::GenerateLODChain(hills.Indices, hills.Vertices.data(), hills.Vertices.size(), sizeof(TestVertex));
+        CHECK(levels.size() == MeshOptimizer::DefaultLODCount);
+
+        size_t previousIndexCount = hills.Indices.size();
+        float previousError = 0.0f;
+        float previousScreenSize = 1.0f;
+        for (const MeshOptimizer::LODLevel& level : levels)
+        {
+            // Each level drops at least a fifth of the triangles of the one before
+            CHECK(!level.Indices.empty() && level.Indices.size() % 3 == 0);
+            CHECK(level.Indices.size() <= previousIndexCount * 4 / 5);
+            for (uint32_t index : level.Indices)
+                CHECK(index < hills.Vertices.size());
+
+            // Errors compound down the chain, and each level is switched to once its error shrinks to the allowed screen error
+            CHECK(level.Error >= previousError && level.Error <= 0.25f);
+            CHECK(level.ScreenSize <= previousScreenSize);
+            CHECK(level.Error <= 0.0f || level.ScreenSize <= MeshOptimizer::DefaultLODScreenError / level.Error * 1.0001f);
+
+            // The error averages the planes merged into each vertex rather than bounding the distance, but it should stay close to it
+            CHECK(GetHeightDeviation(hills, level.Indices) <= level.Error * 3.0f + 1e-6f);
+
+            previousIndexCount = level.Indices.size();
+            previousError = level.Error;
+            previousScreenSize = level.ScreenSize;
+        }
+    }
+
+    // A flat grid simplifies without error, so every level could be used at any size
+    TestMesh grid = MakeGrid(32, 32);
+    std::vector<MeshOptimizer::LODLevel> levels = MeshOptimizer::GenerateLODChain(grid.Indices, grid.Vertices.data(), grid.Vertices.size(), sizeof(TestVertex));
+    CHECK(levels.size() == MeshOptimizer::DefaultLODCount);
+    CHECK(levels.back().Indices.size() <= grid.Indices.size() / 8);
+    for (const MeshOptimizer::LODLevel& level : levels)
+        CHECK(level.Error < 1e-5f && level.ScreenSize == 1.0f);
+
+    // Too few triangles to be worth simplifying
+    TestMesh small = MakeGrid(2, 2);
+    CHECK(MeshOptimizer::GenerateLODChain(small.Indices, small.Vertices.data(), small.Vertices.size(), sizeof(TestVertex)).empty());
+}
+
+TEST(MeshOptimizerSimplifyErrorLimit)
+{
+    // Asking for next to nothing stops once the next collapse would pass the error limit, so looser limits leave fewer triangles
+    TestMesh hills = MakeHills(32, 4.0f);
+    size_t previousIndexCount = hills.Indices.size();
+    for (float targetError : { 0.001f, 0.005f, 0.02f })
+    {
+        float error = -1.0f;
+        std::vector<uint32_t> simplified = MeshOptimizer::SimplifyMesh(hills.Indices, hills.Vertices.data(), hills.Vertices.size(), sizeof(TestVertex), 48, targetError, &error);
+        CHECK(simplified.size() > 48 && simplified.size() < previousIndexCount);
+        CHECK(error > 0.0f && error <= targetError);
+        previousIndexCount = simplified.size();
+    }
+
+    // Without a limit the target is reached
+    float error = -1.0f;
+    std::vector<uint32_t> simplified = MeshOptimizer::SimplifyMesh(hills.Indices, hills.Vertices.data(), hills.Vertices.size(), sizeof(TestVertex), 48, FLT_MAX, &error);
+    CHECK(simplified.size() <= 48 && error > 0.0f);
+}
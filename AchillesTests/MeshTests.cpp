@@ -0,0 +1,51 @@
+#include "Tests.h"
+#include "Achilles/Mesh.h"
+#include <random>
+
+TEST(MeshLODSelection)
+{
+    const std::vector<float> screenSizes = { 0.5f, 0.25f, 0.1f };
+    const float hysteresis = 0.1f;
+
+    // Well away from the switch points the level follows the size, whatever it was before
+    for (uint32_t previous = 0; previous < 4; previous++)
+    {
+        CHECK(Mesh::SelectLOD(screenSizes, 1.0f, previous, hysteresis) == 0);
+        CHECK(Mesh::SelectLOD(screenSizes, 0.4f, previous, hysteresis) == 1);
+        CHECK(Mesh::SelectLOD(screenSizes, 0.18f, previous, hysteresis) == 2);
+        CHECK(Mesh::SelectLOD(screenSizes, 0.05f, previous, hysteresis) == 3);
+    }
+
+    // Inside the band around a switch point the previous level is kept from either side
+    for (uint32_t level = 1; level < 4; level++)
+    {
+        float switchSize = screenSizes[level - 1];
+        for (int step = -9; step <= 9; step++)
+        {
+            float size = switchSize * (1.0f + hysteresis * step / 10.0f);
+            CHECK(Mesh::SelectLOD(screenSizes, size, level - 1, hysteresis) == level - 1);
+            CHECK(Mesh::SelectLOD(screenSizes, size, level, hysteresis) == level);
+        }
+    }
+
+    // An object moving away and back with the size jittering by less than the band changes level once per switch point each way
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> jitter(-hysteresis * 0.5f, hysteresis * 0.5f);
+    uint32_t level = 0;
+    uint32_t changes = 0;
+    for (int step = -1000; step <= 1000; step++)
+    {
+        float size = (0.02f + std::abs(step) / 1000.0f) * (1.0f + jitter(random));
+        uint32_t next = Mesh::SelectLOD(screenSizes, size, level, hysteresis);
+        CHECK(step < 0 ? next >= level : next <= level);
+        changes += next != level;
+        level = next;
+    }
+    CHECK(changes == 6 && level == 0);
+
+    // Previous levels past the coarsest, no LODs at all, and switching exactly at the switch points without hysteresis
+    CHECK(Mesh::SelectLOD(screenSizes, 0.01f, 10, hysteresis) == 3);
+    CHECK(Mesh::SelectLOD({}, 0.01f, 2, hysteresis) == 0);
+    CHECK(Mesh::SelectLOD(screenSizes, 0.49f, 0, 0.0f) == 1);
+    CHECK(Mesh::SelectLOD(screenSizes, 0.51f, 1, 0.0f) == 0);
+}
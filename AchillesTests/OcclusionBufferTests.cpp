@@ -0,0 +1,141 @@
+#include "Tests.h"
+#include "Achilles/OcclusionBuffer.h"
+#include <random>
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+// Looking down +z from the origin, the same aspect as the buffer so pixels are square
+static Matrix GetViewProjection()
+{
+    return XMMatrixPerspectiveFovLH(XMConvertToRadians(60.0f), (float)OcclusionBuffer::Width / OcclusionBuffer::Height, 0.1f, 100.0f);
+}
+
+// Two triangles spanning a rectangle at a fixed depth
+static std::vector<XMFLOAT3> MakeQuad(float minX, float maxX, float minY, float maxY, float z)
+{
+    return { { minX, minY, z }, { minX, maxY, z }, { maxX, maxY, z }, { minX, minY, z }, { maxX, maxY, z }, { maxX, minY, z } };
+}
+
+static BoundingBox MakeBox(const Vector3& min, const Vector3& max)
+{
+    BoundingBox box;
+    BoundingBox::CreateFromPoints(box, min, max);
+    return box;
+}
+
+TEST(OcclusionBufferQuad)
+{
+    std::vector<XMFLOAT3> quad = MakeQuad(-2.0f, 2.0f, -2.0f, 2.0f, 10.0f);
+    OcclusionBuffer buffer;
+
+    // Nothing is occluded before anything is drawn
+    BoundingBox behind = MakeBox(Vector3(-0.5f, -0.5f, 19.5f), Vector3(0.5f, 0.5f, 20.5f));
+    CHECK(!buffer.IsOccluded(behind));
+
+    buffer.Render(GetViewProjection(), { { Matrix::Identity, &quad } });
+    CHECK(buffer.GetStatistics().TriangleCount == 2);
+
+    // Entirely behind the quad, including boxes right up against it
+    CHECK(buffer.IsOccluded(behind));
+    CHECK(buffer.IsOccluded(MakeBox(Vector3(-1.0f, -1.0f, 10.5f), Vector3(1.0f, 1.0f, 11.0f))));
+    CHECK(buffer.IsOccluded(MakeBox(Vector3(2.0f, 2.0f, 30.0f), Vector3(4.0f, 4.0f, 35.0f))));
+
+    // Partly out from behind the quad's edge on each side
+    CHECK(!buffer.IsOccluded(MakeBox(Vector3(3.3f, -0.5f, 19.5f), Vector3(4.5f, 0.5f, 20.5f))));
+    CHECK(!buffer.IsOccluded(MakeBox(Vector3(-4.5f, -0.5f, 19.5f), Vector3(-3.3f, 0.5f, 20.5f))));
+    CHECK(!buffer.IsOccluded(MakeBox(Vector3(-0.5f, 3.3f, 19.5f), Vector3(0.5f, 4.5f, 20.5f))));
+    CHECK(!buffer.IsOccluded(MakeBox(Vector3(-0.5f, -4.5f, 19.5f), Vector3(0.5f, -3.3f, 20.5f))));
+
+    // Bigger on screen than the quad, beside it, in front of it and passing through it
+    CHECK(!buffer.IsOccluded(MakeBox(Vector3(-6.0f, -6.0f, 20.0f), Vector3(6.0f, 6.0f, 21.0f))));
+    CHECK(!buffer.IsOccluded(MakeBox(Vector3(6.0f, -0.5f, 19.5f), Vector3(7.0f, 0.5f, 20.5f))));
+    CHECK(!buffer.IsOccluded(MakeBox(Vector3(-0.5f, -0.5f, 5.0f), Vector3(0.5f, 0.5f, 6.0f))));
+    CHECK(!buffer.IsOccluded(MakeBox(Vector3(-0.5f, -0.5f, 9.0f), Vector3(0.5f, 0.5f, 11.0f))));
+
+    // Behind the camera
+    CHECK(!buffer.IsOccluded(MakeBox(Vector3(-0.5f, -0.5f, -20.5f), Vector3(0.5f, 0.5f, -19.5f))));
+
+    OcclusionBuffer::Statistics statistics = buffer.GetStatistics();
+    CHECK(statistics.OccluderCount == 1);
+    CHECK(statistics.TestedCount == 12);
+    CHECK(statistics.OccludedCount == 3);
+
+    buffer.Clear();
+    CHECK(!buffer.IsOccluded(behind));
+}
+
+TEST(OcclusionBufferNearPlane)
+{
+    // Covers the whole view
+    std::vector<XMFLOAT3> wall = MakeQuad(-1000.0f, 1000.0f, -1000.0f, 1000.0f, 10.0f);
+    OcclusionBuffer buffer;
+    buffer.Render(GetViewProjection(), { { Matrix::Identity, &wall } });
+    CHECK(buffer.IsOccluded(MakeBox(Vector3(-0.5f, -0.5f, 19.5f), Vector3(0.5f, 0.5f, 20.5f))));
+
+    // Around the camera
+    CHECK(!buffer.IsOccluded(MakeBox(Vector3(-1.0f, -1.0f, -1.0f), Vector3(1.0f, 1.0f, 1.0f))));
+    // From behind the camera to behind the wall, with everything in front of the wall off to the side of the view
+    // Its corners behind the camera would project onto the wall, but a box crossing the near plane is never culled
+    CHECK(!buffer.IsOccluded(MakeBox(Vector3(30.0f, -1.0f, -5.0f), Vector3(31.0f, 1.0f, 50.0f))));
+    CHECK(!buffer.IsOccluded(MakeBox(Vector3(-31.0f, -1.0f, -5.0f), Vector3(-30.0f, 1.0f, 50.0f))));
+    // Starting just in front of the near plane
+    CHECK(!buffer.IsOccluded(MakeBox(Vector3(-0.5f, -0.5f, 0.05f), Vector3(0.5f, 0.5f, 20.0f))));
+}
+
+TEST(OcclusionBufferClippedOccluder)
+{
+    // A floor running from behind the camera into the distance, so it has to be clipped to the near plane
+    std::vector<XMFLOAT3> floor = { { -100, -1, -10 }, { -100, -1, 100 }, { 100, -1, 100 }, { -100, -1, -10 }, { 100, -1, 100 }, { 100, -1, -10 } };
+    OcclusionBuffer buffer;
+    buffer.Render(GetViewProjection(), { { Matrix::Identity, &floor } });
+
+    // Below the floor is hidden, above it isn't
+    CHECK(buffer.IsOccluded(MakeBox(Vector3(-0.5f, -3.0f, 19.5f), Vector3(0.5f, -2.5f, 20.5f))));
+    CHECK(!buffer.IsOccluded(MakeBox(Vector3(-0.5f, -0.5f, 19.5f), Vector3(0.5f, 0.5f, 20.5f))));
+    // Poking up through it
+    CHECK(!buffer.IsOccluded(MakeBox(Vector3(-0.5f, -3.0f, 19.5f), Vector3(0.5f, -0.5f, 20.5f))));
+}
+
+TEST(OcclusionBufferWorkers)
+{
+    // Many overlapping occluders give the same depth whatever the thread count
+    std::vector<XMFLOAT3> quad = MakeQuad(-1.0f, 1.0f, -1.0f, 1.0f, 0.0f);
+    std::mt19937 random(9);
+    std::uniform_real_distribution<float> spread(-20.0f, 20.0f);
+    std::uniform_real_distribution<float> depth(5.0f, 60.0f);
+    std::uniform_real_distribution<float> rotation(-1.5f, 1.5f);
+
+    std::vector<OcclusionBuffer::Occluder> occluders(2000);
+    for (OcclusionBuffer::Occluder& occluder : occluders)
+    {
+        occluder.World = Matrix::CreateFromYawPitchRoll(rotation(random), rotation(random), 0.0f) * Matrix::CreateTranslation(spread(random), spread(random) * 0.5f, depth(random));
+        occluder.Triangles = &quad;
+    }
+
+    uint32_t workerCount = OcclusionBuffer::WorkerCount;
+    uint32_t minTrianglesPerWorker = OcclusionBuffer::MinTrianglesPerWorker;
+
+    OcclusionBuffer single, threaded;
+    OcclusionBuffer::WorkerCount = 1;
+    single.Render(GetViewProjection(), occluders);
+    OcclusionBuffer::WorkerCount = 8;
+    OcclusionBuffer::MinTrianglesPerWorker = 1;
+    threaded.Render(GetViewProjection(), occluders);
+    OcclusionBuffer::WorkerCount = workerCount;
+    OcclusionBuffer::MinTrianglesPerWorker = minTrianglesPerWorker;
+
+    CHECK(single.GetLevelCount() == threaded.GetLevelCount());
+    for (uint32_t level = 0; level < single.GetLevelCount(); level++)
+        CHECK(single.GetDepth(level) == threaded.GetDepth(level));
+
+    // Each level holds the farthest depth of the texels under it
+    const std::vector<float>& top = single.GetDepth(0);
+    const std::vector<float>& next = single.GetDepth(1);
+    uint32_t width = (OcclusionBuffer::Width + 3) & ~3u;
+    for (uint32_t y = 0; y < OcclusionBuffer::Height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+            CHECK(next[(size_t)(y / 2) * ((width + 1) / 2) + x / 2] >= top[(size_t)y * width + x]);
+    }
+}
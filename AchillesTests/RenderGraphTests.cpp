@@ -0,0 +1,556 @@
+#include "Tests.h"
+#include "Achilles/RenderGraph.h"
+#include "Achilles/Texture.h"
+#include <d3dx12.h>
+#include <random>
+
+constexpr uint64_t TestAlignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+
+// Declares into a graph and keeps its own copy of what was declared, so the compiled graph can be checked against it
+struct TestGraph
+{
+    struct DeclaredAccess
+    {
+        uint32_t Resource;
+        D3D12_RESOURCE_STATES State;
+    };
+
+    struct DeclaredResource
+    {
+        RenderGraph::ResourceHandle Handle;
+        bool Transient = false;
+        bool Target = false;
+        uint64_t Size = 0;
+    };
+
+    RenderGraph Graph;
+    std::vector<D3D12_COMMAND_LIST_TYPE> SegmentTypes;
+    std::vector<uint32_t> PassSegments;
+    std::vector<std::vector<DeclaredAccess>> PassAccesses;
+    std::vector<DeclaredResource> Resources;
+
+    uint32_t AddSegment(D3D12_COMMAND_LIST_TYPE type)
+    {
+        SegmentTypes.push_back(type);
+        return Graph.AddSegment(type);
+    }
+
+    uint32_t AddPass(uint32_t segment)
+    {
+        PassSegments.push_back(segment);
+        PassAccesses.emplace_back();
+        return Graph.AddPass(L"Test Pass " + std::to_wstring(PassSegments.size() - 1), segment, nullptr);
+    }
+
+    RenderGraph::ResourceHandle Import()
+    {
+        RenderGraph::ResourceHandle handle = Graph.ImportTexture(L"Imported", std::make_shared<Texture>());
+        Resources.push_back({ handle, false, false, 0 });
+        return handle;
+    }
+
+    // Sizes are whole placement alignments, so a heap without aliasing is exactly the sum of them
+    RenderGraph::ResourceHandle CreateTransient(bool target, uint32_t sizeInAlignments)
+    {
+        D3D12_RESOURCE_FLAGS flags = target ? D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET : D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+        D3D12_RESOURCE_DESC desc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R16G16B16A16_FLOAT, 256, 256, 1, 1, 1, 0, flags);
+        uint64_t size = sizeInAlignments * TestAlignment;
+
+        RenderGraph::ResourceHandle handle = Graph.CreateTransient(L"Transient " + std::to_wstring(Resources.size()), desc, size, TestAlignment);
+        Resources.push_back({ handle, true, target, size });
+        return handle;
+    }
+
+    void Read(uint32_t pass, RenderGraph::ResourceHandle resource, D3D12_RESOURCE_STATES state)
+    {
+        Graph.Read(pass, resource, state);
+        AddAccess(pass, resource, state);
+    }
+
+    void Write(uint32_t pass, RenderGraph::ResourceHandle resource, D3D12_RESOURCE_STATES state)
+    {
+        Graph.Write(pass, resource, state);
+        AddAccess(pass, resource, state);
+    }
+
+    void AddAccess(uint32_t pass, RenderGraph::ResourceHandle resource, D3D12_RESOURCE_STATES state)
+    {
+        for (const DeclaredAccess& access : PassAccesses[pass])
+        {
+            if (access.Resource == resource.Index)
+                return;
+        }
+        PassAccesses[pass].push_back({ resource.Index, state });
+    }
+};
+
+// Every resource's lifetime spans the first to the last pass left after culling that uses it
+static void CheckLifetimes(TestGraph& test)
+{
+    const std::vector<uint32_t>& order = test.Graph.GetPassOrder();
+    for (uint32_t r = 0; r < test.Resources.size(); r++)
+    {
+        uint32_t expectedFirst = UINT32_MAX, expectedLast = 0;
+        for (uint32_t position = 0; position < order.size(); position++)
+        {
+            for (const TestGraph::DeclaredAccess& access : test.PassAccesses[order[position]])
+            {
+                if (access.Resource != r)
+                    continue;
+                expectedFirst = std::min(expectedFirst, position);
+                expectedLast = position;
+            }
+        }
+
+        uint32_t first = 0, last = 0;
+        bool used = test.Graph.GetLifetime(test.Resources[r].Handle, first, last);
+        CHECK(used == (expectedFirst != UINT32_MAX));
+        if (used)
+            CHECK(first == expectedFirst && last == expectedLast);
+    }
+}
+
+// Transients in the same heap that are alive at the same time never share memory, and one that does share memory gets an aliasing barrier before it's first used
+static void CheckAliasing(TestGraph& test)
+{
+    for (uint32_t a = 0; a < test.Resources.size(); a++)
+    {
+        const TestGraph::DeclaredResource& resourceA = test.Resources[a];
+        uint32_t firstA = 0, lastA = 0;
+        if (!resourceA.Transient || !test.Graph.GetLifetime(resourceA.Handle, firstA, lastA))
+            continue;
+
+        uint64_t offsetA = test.Graph.GetHeapOffset(resourceA.Handle);
+        CHECK(offsetA % TestAlignment == 0);
+
+        bool sharesMemory = false;
+        for (uint32_t b = 0; b < test.Resources.size(); b++)
+        {
+            const TestGraph::DeclaredResource& resourceB = test.Resources[b];
+            uint32_t firstB = 0, lastB = 0;
+            if (a == b || !resourceB.Transient || resourceB.Target != resourceA.Target || !test.Graph.GetLifetime(resourceB.Handle, firstB, lastB))
+                continue;
+
+            uint64_t offsetB = test.Graph.GetHeapOffset(resourceB.Handle);
+            bool memoryOverlaps = offsetA < offsetB + resourceB.Size && offsetB < offsetA + resourceA.Size;
+            bool aliveTogether = firstA <= lastB && firstB <= lastA;
+            CHECK(!(memoryOverlaps && aliveTogether));
+            if (memoryOverlaps)
+                CHECK(RenderGraph::AliasTransients);
+            sharesMemory |= memoryOverlaps;
+        }
+
+        // The aliasing barrier comes before the first use's transition, in the first pass to use it
+        uint32_t firstPass = test.Graph.GetPassOrder()[firstA];
+        bool aliasingBarrier = false, firstUse = false;
+        for (const RenderGraph::Barrier& barrier : test.Graph.GetBarriersBefore(firstPass))
+        {
+            if (barrier.Resource != resourceA.Handle.Index)
+                continue;
+            if (barrier.Type == RenderGraph::BarrierType::Aliasing)
+            {
+                CHECK(!firstUse);
+                aliasingBarrier = true;
+            }
+            firstUse |= barrier.FirstUse;
+        }
+        CHECK(firstUse);
+        CHECK(aliasingBarrier == sharesMemory);
+    }
+}
+
+// Steps through the passes applying their barriers, checking every resource is in the state each pass uses it in
+// Split barriers have to begin and end in the same segment with nothing using the resource in between, and transitions recorded on a queue have to be valid on it
+static void CheckBarriers(TestGraph& test)
+{
+    struct ResourceState
+    {
+        bool Known = false;
+        D3D12_RESOURCE_STATES State = D3D12_RESOURCE_STATE_COMMON;
+        bool SplitPending = false;
+        RenderGraph::Barrier Split;
+        uint32_t SplitPosition = 0;
+        bool NeedsUAVBarrier = false;
+    };
+    std::vector<ResourceState> states(test.Resources.size());
+    uint32_t position = 0;
+
+    auto apply = [&](const RenderGraph::Barrier& barrier, D3D12_COMMAND_LIST_TYPE queue)
+        {
+            ResourceState& state = states[barrier.Resource];
+            switch (barrier.Type)
+            {
+            case RenderGraph::BarrierType::Aliasing:
+                CHECK(!state.Known);
+                break;
+            case RenderGraph::BarrierType::UAV:
+                CHECK(state.Known && (state.State & D3D12_RESOURCE_STATE_UNORDERED_ACCESS) != 0);
+                state.NeedsUAVBarrier = false;
+                break;
+            case RenderGraph::BarrierType::Transition:
+                CHECK(!state.SplitPending);
+                CHECK(barrier.FirstUse == !state.Known);
+                if (!barrier.FirstUse)
+                    CHECK(state.State == barrier.StateBefore && RenderGraph::IsStateValidOnQueue(barrier.StateBefore, queue));
+                CHECK(RenderGraph::IsStateValidOnQueue(barrier.StateAfter, queue));
+                state.Known = true;
+                state.State = barrier.StateAfter;
+                state.NeedsUAVBarrier = false;
+                break;
+            case RenderGraph::BarrierType::SplitBegin:
+                CHECK(state.Known && !state.SplitPending && state.State == barrier.StateBefore);
+                CHECK(RenderGraph::IsStateValidOnQueue(barrier.StateBefore, queue) && RenderGraph::IsStateValidOnQueue(barrier.StateAfter, queue));
+                state.SplitPending = true;
+                state.Split = barrier;
+                state.SplitPosition = position;
+                break;
+            case RenderGraph::BarrierType::SplitEnd:
+                CHECK(state.SplitPending && state.Split.StateBefore == barrier.StateBefore && state.Split.StateAfter == barrier.StateAfter);
+                // Ending in the pass it began in gains nothing over a plain transition
+                CHECK(state.SplitPosition < position);
+                state.SplitPending = false;
+                state.State = barrier.StateAfter;
+                state.NeedsUAVBarrier = false;
+                break;
+            }
+        };
+
+    // A split begun in one segment can't end in another's command list
+    auto endSegment = [&](uint32_t segment)
+        {
+            for (const ResourceState& state : states)
+                CHECK(!state.SplitPending);
+            for (const RenderGraph::Barrier& barrier : test.Graph.GetSegmentEndBarriers(segment))
+            {
+                CHECK(barrier.Type == RenderGraph::BarrierType::Transition);
+                apply(barrier, test.SegmentTypes[segment]);
+            }
+        };
+
+    uint32_t segment = 0;
+    for (; position < test.Graph.GetPassOrder().size(); position++)
+    {
+        uint32_t pass = test.Graph.GetPassOrder()[position];
+        while (segment < test.PassSegments[pass])
+            endSegment(segment++);
+
+        for (const RenderGraph::Barrier& barrier : test.Graph.GetBarriersBefore(pass))
+            apply(barrier, test.SegmentTypes[segment]);
+
+        for (const TestGraph::DeclaredAccess& access : test.PassAccesses[pass])
+        {
+            ResourceState& state = states[access.Resource];
+            CHECK(state.Known && !state.SplitPending);
+            CHECK((state.State & access.State) == access.State);
+
+            // Back to back UAV use needs a barrier between
+            if (access.State & D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+            {
+                CHECK(!state.NeedsUAVBarrier);
+                state.NeedsUAVBarrier = true;
+            }
+        }
+    }
+    while (segment < test.SegmentTypes.size())
+        endSegment(segment++);
+
+    // Nothing is left waiting on the other side of a segment
+    for (uint32_t s = 0; s < test.SegmentTypes.size(); s++)
+    {
+        bool hasPass = false;
+        for (uint32_t pass : test.Graph.GetPassOrder())
+            hasPass |= test.PassSegments[pass] == s;
+        if (!hasPass)
+            CHECK(test.Graph.GetSegmentEndBarriers(s).empty());
+    }
+}
+
+static void CheckGraph(TestGraph& test)
+{
+    CheckLifetimes(test);
+    CheckAliasing(test);
+    CheckBarriers(test);
+}
+
+TEST(RenderGraphCulling)
+{
+    TestGraph test;
+    uint32_t segment = test.AddSegment(D3D12_COMMAND_LIST_TYPE_DIRECT);
+    RenderGraph::ResourceHandle backBuffer = test.Import();
+    RenderGraph::ResourceHandle lit = test.CreateTransient(true, 4);
+    RenderGraph::ResourceHandle unused = test.CreateTransient(true, 4);
+    RenderGraph::ResourceHandle unusedChain = test.CreateTransient(false, 2);
+
+    uint32_t draw = test.AddPass(segment);
+    test.Write(draw, lit, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+    // Nothing reads what these write, the first only feeding the second
+    uint32_t unusedDraw = test.AddPass(segment);
+    test.Write(unusedDraw, unused, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    uint32_t unusedBlur = test.AddPass(segment);
+    test.Read(unusedBlur, unused, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    test.Write(unusedBlur, unusedChain, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+    // Writes an imported texture, so is always kept
+    uint32_t composite = test.AddPass(segment);
+    test.Read(composite, lit, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    test.Write(composite, backBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+    // Writes nothing, so is assumed to have side effects
+    uint32_t readback = test.AddPass(segment);
+    test.Read(readback, lit, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+
+    test.Graph.Compile();
+    CHECK(!test.Graph.IsCulled(draw));
+    CHECK(test.Graph.IsCulled(unusedDraw));
+    CHECK(test.Graph.IsCulled(unusedBlur));
+    CHECK(!test.Graph.IsCulled(composite));
+    CHECK(!test.Graph.IsCulled(readback));
+    CHECK(test.Graph.GetPassOrder() == std::vector<uint32_t>({ draw, composite, readback }));
+
+    RenderGraph::Statistics statistics = test.Graph.GetStatistics();
+    CHECK(statistics.Passes == 3 && statistics.CulledPasses == 2);
+
+    // Only culled passes used these, so they take no memory
+    uint32_t first = 0, last = 0;
+    CHECK(!test.Graph.GetLifetime(unused, first, last));
+    CHECK(!test.Graph.GetLifetime(unusedChain, first, last));
+    CHECK(statistics.TransientBytes == 4 * TestAlignment);
+
+    // Used by the readback pass, so still alive at the end
+    CHECK(test.Graph.GetLifetime(lit, first, last) && first == 0 && last == 2);
+    CheckGraph(test);
+}
+
+TEST(RenderGraphAliasing)
+{
+    // A chain where each transient is only needed by the next pass, so alternate ones can share memory
+    TestGraph test;
+    uint32_t segment = test.AddSegment(D3D12_COMMAND_LIST_TYPE_DIRECT);
+    RenderGraph::ResourceHandle backBuffer = test.Import();
+
+    std::vector<RenderGraph::ResourceHandle> chain;
+    for (uint32_t i = 0; i < 6; i++)
+        chain.push_back(test.CreateTransient(true, 4));
+
+    for (uint32_t i = 0; i < chain.size(); i++)
+    {
+        uint32_t pass = test.AddPass(segment);
+        if (i > 0)
+            test.Read(pass, chain[i - 1], D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+        test.Write(pass, chain[i], D3D12_RESOURCE_STATE_RENDER_TARGET);
+    }
+    uint32_t present = test.AddPass(segment);
+    test.Read(present, chain.back(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    test.Write(present, backBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+    bool aliasTransients = RenderGraph::AliasTransients;
+    RenderGraph::AliasTransients = true;
+    test.Graph.Compile();
+    RenderGraph::Statistics aliased = test.Graph.GetStatistics();
+    CheckGraph(test);
+
+    RenderGraph::AliasTransients = false;
+    test.Graph.Compile();
+    RenderGraph::Statistics separate = test.Graph.GetStatistics();
+    CheckGraph(test);
+    RenderGraph::AliasTransients = aliasTransients;
+
+    // Two alive at a time at most, so two transients' worth of memory covers the chain
+    CHECK(aliased.TransientBytes == 6 * 4 * TestAlignment);
+    CHECK(aliased.HeapBytes == 2 * 4 * TestAlignment);
+    CHECK(aliased.AliasingBarriers == 6);
+    CHECK(separate.HeapBytes == separate.TransientBytes);
+    CHECK(separate.AliasingBarriers == 0);
+}
+
+TEST(RenderGraphSplitBarriers)
+{
+    TestGraph test;
+    uint32_t scene = test.AddSegment(D3D12_COMMAND_LIST_TYPE_DIRECT);
+    uint32_t compute = test.AddSegment(D3D12_COMMAND_LIST_TYPE_COMPUTE);
+    uint32_t post = test.AddSegment(D3D12_COMMAND_LIST_TYPE_DIRECT);
+    RenderGraph::ResourceHandle backBuffer = test.Import();
+    RenderGraph::ResourceHandle a = test.CreateTransient(true, 1);
+    RenderGraph::ResourceHandle b = test.CreateTransient(true, 1);
+    RenderGraph::ResourceHandle c = test.CreateTransient(true, 1);
+    RenderGraph::ResourceHandle d = test.CreateTransient(true, 1);
+    RenderGraph::ResourceHandle e = test.CreateTransient(false, 1);
+
+    uint32_t writeA = test.AddPass(scene);
+    test.Write(writeA, a, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    uint32_t writeB = test.AddPass(scene);
+    test.Write(writeB, b, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    uint32_t writeC = test.AddPass(scene);
+    test.Write(writeC, c, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    // Two passes after a's producer, so its transition can be split over them
+    uint32_t readA = test.AddPass(scene);
+    test.Read(readA, a, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    test.Write(readA, d, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+    // d is left ready for compute at the end of the scene, a compute list can't see a render target
+    uint32_t blur = test.AddPass(compute);
+    test.Read(blur, d, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    test.Write(blur, e, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+    // e can't be moved to a pixel shader state on compute, so that waits for the post segment
+    uint32_t composite = test.AddPass(post);
+    test.Read(composite, e, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    test.Read(composite, b, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    test.Read(composite, c, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    test.Write(composite, backBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+    bool splitBarriers = RenderGraph::SplitBarriers;
+    RenderGraph::SplitBarriers = true;
+    test.Graph.Compile();
+    CheckGraph(test);
+
+    auto countBarriers = [&](const std::vector<RenderGraph::Barrier>& barriers, RenderGraph::ResourceHandle resource, RenderGraph::BarrierType type)
+        {
+            uint32_t count = 0;
+            for (const RenderGraph::Barrier& barrier : barriers)
+                count += barrier.Resource == resource.Index && barrier.Type == type;
+            return count;
+        };
+
+    // Begins straight after a's producer and ends before its consumer
+    CHECK(countBarriers(test.Graph.GetBarriersBefore(writeB), a, RenderGraph::BarrierType::SplitBegin) == 1);
+    CHECK(countBarriers(test.Graph.GetBarriersBefore(readA), a, RenderGraph::BarrierType::SplitEnd) == 1);
+    // Across segments nothing is split
+    CHECK(countBarriers(test.Graph.GetSegmentEndBarriers(scene), d, RenderGraph::BarrierType::Transition) == 1);
+    CHECK(countBarriers(test.Graph.GetSegmentEndBarriers(scene), b, RenderGraph::BarrierType::Transition) == 1);
+    CHECK(countBarriers(test.Graph.GetSegmentEndBarriers(scene), c, RenderGraph::BarrierType::Transition) == 1);
+    CHECK(countBarriers(test.Graph.GetBarriersBefore(composite), e, RenderGraph::BarrierType::Transition) == 1);
+    CHECK(test.Graph.GetStatistics().SplitBarriers == 1);
+
+    RenderGraph::SplitBarriers = false;
+    test.Graph.Compile();
+    CheckGraph(test);
+    RenderGraph::SplitBarriers = splitBarriers;
+
+    CHECK(countBarriers(test.Graph.GetBarriersBefore(readA), a, RenderGraph::BarrierType::Transition) == 1);
+    CHECK(test.Graph.GetStatistics().SplitBarriers == 0);
+}
+
+TEST(RenderGraphRandom)
+{
+    // Random graphs across direct and compute segments, with every combination of aliasing and split barriers
+    bool aliasTransients = RenderGraph::AliasTransients;
+    bool splitBarriers = RenderGraph::SplitBarriers;
+
+    for (uint32_t seed = 0; seed < 200; seed++)
+    {
+        std::mt19937 random(seed);
+        TestGraph test;
+
+        const D3D12_COMMAND_LIST_TYPE types[] = { D3D12_COMMAND_LIST_TYPE_DIRECT, D3D12_COMMAND_LIST_TYPE_COMPUTE, D3D12_COMMAND_LIST_TYPE_DIRECT, D3D12_COMMAND_LIST_TYPE_COMPUTE, D3D12_COMMAND_LIST_TYPE_DIRECT };
+        for (D3D12_COMMAND_LIST_TYPE type : types)
+            test.AddSegment(type);
+
+        RenderGraph::ResourceHandle backBuffer = test.Import();
+        RenderGraph::ResourceHandle history = test.Import();
+
+        // Transients that have been written so far and what they can be used as
+        std::vector<RenderGraph::ResourceHandle> written;
+        std::vector<RenderGraph::ResourceHandle> writtenUAV;
+
+        uint32_t segment = 0;
+        uint32_t passCount = 8 + random() % 24;
+        for (uint32_t p = 0; p < passCount; p++)
+        {
+            if (random() % 4 == 0 && segment + 1 < std::size(types))
+                segment++;
+            bool isCompute = types[segment] == D3D12_COMMAND_LIST_TYPE_COMPUTE;
+            uint32_t pass = test.AddPass(segment);
+
+            std::vector<uint32_t> used;
+            auto isUsed = [&](RenderGraph::ResourceHandle handle) { return std::find(used.begin(), used.end(), handle.Index) != used.end(); };
+
+            uint32_t readCount = written.empty() ? 0 : random() % 3;
+            for (uint32_t i = 0; i < readCount; i++)
+            {
+                RenderGraph::ResourceHandle resource = written[random() % written.size()];
+                if (isUsed(resource))
+                    continue;
+                D3D12_RESOURCE_STATES state = isCompute || random() % 2 ? D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE : D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+                test.Read(pass, resource, state);
+                used.push_back(resource.Index);
+            }
+            if (random() % 8 == 0)
+                test.Read(pass, history, isCompute ? D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE : D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+
+            // Read modify write of an earlier UAV
+            if (!writtenUAV.empty() && random() % 4 == 0)
+            {
+                RenderGraph::ResourceHandle resource = writtenUAV[random() % writtenUAV.size()];
+                if (!isUsed(resource))
+                {
+                    test.Read(pass, resource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+                    test.Write(pass, resource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+                    used.push_back(resource.Index);
+                }
+            }
+
+            bool target = !isCompute && random() % 2;
+            RenderGraph::ResourceHandle output = test.CreateTransient(target, 1 + random() % 8);
+            test.Write(pass, output, target ? D3D12_RESOURCE_STATE_RENDER_TARGET : D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+            written.push_back(output);
+            if (!target)
+                writtenUAV.push_back(output);
+        }
+
+        // The last pass reads some of what was made, anything else it didn't need is culled
+        uint32_t present = test.AddPass((uint32_t)std::size(types) - 1);
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            RenderGraph::ResourceHandle resource = written[random() % written.size()];
+            test.Read(present, resource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+        }
+        test.Write(present, backBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+        for (uint32_t mode = 0; mode < 4; mode++)
+        {
+            RenderGraph::AliasTransients = (mode & 1) != 0;
+            RenderGraph::SplitBarriers = (mode & 2) != 0;
+            test.Graph.Compile();
+            CheckGraph(test);
+
+            RenderGraph::Statistics statistics = test.Graph.GetStatistics();
+            CHECK(statistics.HeapBytes <= statistics.TransientBytes);
+            if (!RenderGraph::AliasTransients)
+                CHECK(statistics.HeapBytes == statistics.TransientBytes);
+        }
+    }
+
+    RenderGraph::AliasTransients = aliasTransients;
+    RenderGraph::SplitBarriers = splitBarriers;
+}
+
+TEST(RenderGraphErrors)
+{
+    TestGraph test;
+    uint32_t direct = test.AddSegment(D3D12_COMMAND_LIST_TYPE_DIRECT);
+    uint32_t compute = test.AddSegment(D3D12_COMMAND_LIST_TYPE_COMPUTE);
+    RenderGraph::ResourceHandle transient = test.CreateTransient(true, 1);
+    uint32_t computePass = test.AddPass(compute);
+
+    auto throws = [](const std::function<void()>& function)
+        {
+            try
+            {
+                function();
+            }
+            catch (const std::exception&)
+            {
+                return true;
+            }
+            return false;
+        };
+
+    // Out of segment order, a state the queue can't use, two states in one pass and reading a transient nothing wrote
+    CHECK(throws([&]() { test.Graph.AddPass(L"Earlier Segment", direct, nullptr); }));
+    CHECK(throws([&]() { test.Graph.Write(computePass, transient, D3D12_RESOURCE_STATE_RENDER_TARGET); }));
+    test.Read(computePass, transient, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    CHECK(throws([&]() { test.Graph.Write(computePass, transient, D3D12_RESOURCE_STATE_UNORDERED_ACCESS); }));
+    CHECK(throws([&]() { test.Graph.Compile(); }));
+}
@@ -0,0 +1,214 @@
+#include "Tests.h"
+#include "Achilles/ShaderCache.h"
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <atomic>
+
+static std::filesystem::path GetTestDirectory()
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "AchillesTests" / "ShaderCache";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    return directory;
+}
+
+static std::vector<uint8_t> ReadFile(const std::filesystem::path& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void WriteFile(const std::filesystem::path& path, const std::vector<uint8_t>& data)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+static std::vector<uint8_t> MakeBlob(size_t size, uint8_t seed)
+{
+    std::vector<uint8_t> blob(size);
+    for (size_t i = 0; i < size; i++)
+        blob[i] = (uint8_t)(i * 31 + seed);
+    return blob;
+}
+
+static size_t CountTemporaryFiles(const std::filesystem::path& directory)
+{
+    size_t count = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(directory))
+        count += entry.path().wstring().find(L".tmp") != std::wstring::npos;
+    return count;
+}
+
+TEST(ShaderCacheKey)
+{
+    std::filesystem::path directory = GetTestDirectory();
+    std::wstring shaderPath = (directory / "Test.hlsl").wstring();
+    std::filesystem::path includePath = directory / "TestCommon.hlsl";
+    std::string shaderSource = "#include \"TestCommon.hlsl\"\nfloat4 PS() : SV_Target { return Value * SCALE; }\n";
+    WriteFile(shaderPath, std::vector<uint8_t>(shaderSource.begin(), shaderSource.end()));
+    std::string includeSource = "static const float4 Value = 1;\n";
+    WriteFile(includePath, std::vector<uint8_t>(includeSource.begin(), includeSource.end()));
+
+    ComPtr<IDxcUtils> utils;
+    ComPtr<IDxcCompiler3> compiler;
+    ComPtr<IDxcIncludeHandler> includeHandler;
+    CHECK(SUCCEEDED(DxcCreateInstance(CLSID_DxcUtils, IID_PPV_ARGS(&utils))));
+    CHECK(SUCCEEDED(DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&compiler))));
+    CHECK(SUCCEEDED(utils->CreateDefaultIncludeHandler(&includeHandler)));
+
+    // Keyed the way CompileShader does it, re-reading the source each time
+    auto getCachePath = [&](const std::vector<LPCWSTR>& extraArguments)
+        {
+            ComPtr<IDxcBlobEncoding> source;
+            CHECK(SUCCEEDED(utils->LoadFile(shaderPath.c_str(), nullptr, &source)));
+            DxcBuffer sourceBuffer{ source->GetBufferPointer(), source->GetBufferSize(), DXC_CP_ACP };
+
+            std::vector<LPCWSTR> arguments = { shaderPath.c_str(), L"-E", L"PS", L"-T", L"ps_6_4" };
+            arguments.insert(arguments.end(), extraArguments.begin(), extraArguments.end());
+            std::wstring cachePath = ShaderCache::GetCachePath(compiler.Get(), includeHandler.Get(), sourceBuffer, shaderPath, L"PS", arguments);
+            CHECK(!cachePath.empty());
+            return cachePath;
+        };
+
+    std::wstring key = getCachePath({ L"-D", L"SCALE=1" });
+    CHECK(getCachePath({ L"-D", L"SCALE=1" }) == key);
+
+    // Defines and other arguments
+    CHECK(getCachePath({ L"-D", L"SCALE=2" }) != key);
+    CHECK(getCachePath({ L"-D", L"SCALE=1", L"-Zi" }) != key);
+    CHECK(getCachePath({ L"-D", L"SCALE=1", DXC_ARG_OPTIMIZATION_LEVEL3 }) != key);
+
+    // Only the included file changes
+    includeSource = "static const float4 Value = 2;\n";
+    WriteFile(includePath, std::vector<uint8_t>(includeSource.begin(), includeSource.end()));
+    std::wstring includeChangedKey = getCachePath({ L"-D", L"SCALE=1" });
+    CHECK(includeChangedKey != key);
+
+    // Source that doesn't preprocess isn't cached
+    std::filesystem::remove(includePath);
+    ComPtr<IDxcBlobEncoding> source;
+    CHECK(SUCCEEDED(utils->LoadFile(shaderPath.c_str(), nullptr, &source)));
+    DxcBuffer sourceBuffer{ source->GetBufferPointer(), source->GetBufferSize(), DXC_CP_ACP };
+    std::vector<LPCWSTR> arguments = { shaderPath.c_str(), L"-E", L"PS", L"-T", L"ps_6_4", L"-D", L"SCALE=1" };
+    CHECK(ShaderCache::GetCachePath(compiler.Get(), includeHandler.Get(), sourceBuffer, shaderPath, L"PS", arguments).empty());
+
+    // The compiler version, which can't be changed for real here. Arguments are kept apart, so moving text between them changes the key too
+    uint64_t version = ShaderCache::HashCompilerVersion(compiler.Get());
+    std::wstring preprocessedKey = ShaderCache::GetCachePath("float4 PS() : SV_Target { return 1; }", shaderPath, L"PS", { L"-E", L"PS" }, version);
+    CHECK(ShaderCache::GetCachePath("float4 PS() : SV_Target { return 1; }", shaderPath, L"PS", { L"-E", L"PS" }, version) == preprocessedKey);
+    CHECK(ShaderCache::GetCachePath("float4 PS() : SV_Target { return 1; }", shaderPath, L"PS", { L"-E", L"PS" }, version + 1) != preprocessedKey);
+    CHECK(ShaderCache::GetCachePath("float4 PS() : SV_Target { return 2; }", shaderPath, L"PS", { L"-E", L"PS" }, version) != preprocessedKey);
+    CHECK(ShaderCache::GetCachePath("float4 PS() : SV_Target { return 1; }", shaderPath, L"PS", { L"-EP", L"S" }, version) != preprocessedKey);
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(ShaderCacheCorruptFiles)
+{
+    std::filesystem::path directory = GetTestDirectory();
+    std::wstring cachePath = (directory / "Test_PS.dxil").wstring();
+    std::vector<uint8_t> blob = MakeBlob(1000, 1);
+
+    CHECK(ShaderCache::WriteBlob(cachePath, blob.data(), blob.size()));
+    std::vector<uint8_t> data;
+    CHECK(ShaderCache::ReadBlob(cachePath, data) && data == blob);
+    const std::vector<uint8_t> file = ReadFile(cachePath);
+    CHECK(file.size() == sizeof(ShaderCache::Header) + blob.size());
+
+    // Each of these must be rejected, and leave the output alone
+    std::vector<std::vector<uint8_t>> corruptFiles;
+    corruptFiles.push_back({});
+    corruptFiles.push_back(std::vector<uint8_t>(file.begin(), file.begin() + sizeof(ShaderCache::Header) / 2));
+    corruptFiles.push_back(std::vector<uint8_t>(file.begin(), file.begin() + sizeof(ShaderCache::Header)));
+    corruptFiles.push_back(std::vector<uint8_t>(file.begin(), file.end() - 1));
+    corruptFiles.push_back(blob);
+    for (size_t offset : { (size_t)0, offsetof(ShaderCache::Header, Version), offsetof(ShaderCache::Header, Size), offsetof(ShaderCache::Header, Hash), sizeof(ShaderCache::Header), file.size() - 1 })
+    {
+        corruptFiles.push_back(file);
+        corruptFiles.back()[offset] ^= 0x10;
+    }
+    corruptFiles.push_back(file);
+    corruptFiles.back().push_back(0);
+
+    for (const std::vector<uint8_t>& corruptFile : corruptFiles)
+    {
+        WriteFile(cachePath, corruptFile);
+        std::vector<uint8_t> output = { 7 };
+        CHECK(!ShaderCache::ReadBlob(cachePath, output));
+        CHECK(output.size() == 1 && output[0] == 7);
+    }
+
+    std::filesystem::remove(cachePath);
+    CHECK(!ShaderCache::ReadBlob(cachePath, data));
+    CHECK(!ShaderCache::WriteBlob(cachePath, blob.data(), 0));
+    CHECK(!std::filesystem::exists(cachePath));
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(ShaderCacheStore)
+{
+    std::filesystem::path directory = GetTestDirectory();
+    std::wstring cachePath = (directory / "Nested" / "Test_PS.dxil").wstring();
+
+    // Missing directories are made, and a temporary file left by a crash doesn't get in the way
+    std::vector<uint8_t> first = MakeBlob(500, 1);
+    CHECK(ShaderCache::WriteBlob(cachePath, first.data(), first.size()));
+    WriteFile(cachePath + L".tmp1234", MakeBlob(20, 3));
+
+    // Storing again replaces the blob, and each store cleans up after itself
+    std::vector<uint8_t> second = MakeBlob(700, 2);
+    CHECK(ShaderCache::WriteBlob(cachePath, second.data(), second.size()));
+    std::vector<uint8_t> data;
+    CHECK(ShaderCache::ReadBlob(cachePath, data) && data == second);
+    std::filesystem::remove(cachePath + L".tmp1234");
+    CHECK(CountTemporaryFiles(directory / "Nested") == 0);
+
+    // Threads storing the same key while others load it. A store can fail while the file is open, but once there's a blob
+    // a load always finds a whole one, never a missing or partial file
+    std::vector<std::vector<uint8_t>> blobs;
+    for (uint8_t i = 0; i < 4; i++)
+        blobs.push_back(MakeBlob(4096 * (i + 1), i));
+    CHECK(ShaderCache::WriteBlob(cachePath, blobs[0].data(), blobs[0].size()));
+
+    std::atomic<bool> stop = false;
+    std::atomic<uint32_t> badLoads = 0;
+    std::vector<std::thread> loaders;
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        loaders.emplace_back([&]()
+            {
+                std::vector<uint8_t> loaded;
+                while (!stop)
+                {
+                    if (!ShaderCache::ReadBlob(cachePath, loaded) || std::find(blobs.begin(), blobs.end(), loaded) == blobs.end())
+                        badLoads++;
+                }
+            });
+    }
+
+    std::vector<std::thread> storers;
+    for (size_t i = 0; i < blobs.size(); i++)
+    {
+        storers.emplace_back([&, i]()
+            {
+                for (uint32_t store = 0; store < 50; store++)
+                    ShaderCache::WriteBlob(cachePath, blobs[i].data(), blobs[i].size());
+            });
+    }
+    for (std::thread& storer : storers)
+        storer.join();
+    stop = true;
+    for (std::thread& loader : loaders)
+        loader.join();
+
+    CHECK(badLoads == 0);
+    CHECK(ShaderCache::ReadBlob(cachePath, data) && std::find(blobs.begin(), blobs.end(), data) != blobs.end());
+    CHECK(CountTemporaryFiles(directory / "Nested") == 0);
+
+    std::filesystem::remove_all(directory);
+}
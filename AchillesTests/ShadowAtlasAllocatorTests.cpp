@@ -0,0 +1,154 @@
+#include "Tests.h"
+#include "Achilles/ShadowAtlasAllocator.h"
+#include <algorithm>
+#include <random>
+
+// Exposes the free lists so merging can be checked
+class TestAtlasAllocator : public ShadowAtlasAllocator
+{
+public:
+    using ShadowAtlasAllocator::ShadowAtlasAllocator;
+
+    // Everything has merged back into the one tile covering the whole atlas
+    bool IsSingleRoot() const
+    {
+        if (freeTiles.empty() || freeTiles[0].size() != 1)
+            return false;
+        for (size_t level = 1; level < freeTiles.size(); level++)
+        {
+            if (!freeTiles[level].empty())
+                return false;
+        }
+        return true;
+    }
+};
+
+static bool Overlaps(const ShadowAtlasRect& a, const ShadowAtlasRect& b)
+{
+    return a.X < b.X + b.Size && b.X < a.X + a.Size && a.Y < b.Y + b.Size && b.Y < a.Y + a.Size;
+}
+
+// Tiles are inside the atlas, aligned to their size, don't overlap each other and add up to the allocated area
+static void CheckTiles(const ShadowAtlasAllocator& allocator, const std::vector<ShadowAtlasRect>& tiles)
+{
+    uint64_t area = 0;
+    for (size_t i = 0; i < tiles.size(); i++)
+    {
+        const ShadowAtlasRect& tile = tiles[i];
+        CHECK(tile.X + tile.Size <= allocator.GetAtlasSize());
+        CHECK(tile.Y + tile.Size <= allocator.GetAtlasSize());
+        CHECK(tile.X % tile.Size == 0 && tile.Y % tile.Size == 0);
+        area += (uint64_t)tile.Size * tile.Size;
+
+        for (size_t j = i + 1; j < tiles.size(); j++)
+            CHECK(!Overlaps(tile, tiles[j]));
+    }
+    CHECK(area == allocator.GetAllocatedArea());
+}
+
+TEST(ShadowAtlasFillAndMerge)
+{
+    std::mt19937 random(5);
+    std::uniform_int_distribution<uint32_t> size(1, 2048);
+    TestAtlasAllocator allocator(8192, 128);
+    CHECK(allocator.IsSingleRoot());
+
+    // Random sizes until nothing fits, then the smallest tiles until those don't fit either
+    std::vector<ShadowAtlasRect> tiles;
+    ShadowAtlasRect rect;
+    uint32_t failures = 0;
+    while (failures < 16)
+    {
+        uint32_t requested = size(random);
+        if (allocator.Allocate(requested, rect))
+        {
+            CHECK(rect.Size == std::max(ShadowAtlasAllocator::RoundUpToPowerOfTwo(requested), 128u));
+            tiles.push_back(rect);
+        }
+        else
+        {
+            failures++;
+        }
+    }
+    while (allocator.Allocate(128, rect))
+        tiles.push_back(rect);
+
+    // Any free area would hold at least a minimum size tile, so the atlas is exactly full
+    CheckTiles(allocator, tiles);
+    CHECK(allocator.GetAllocatedArea() == 8192ull * 8192ull);
+
+    std::shuffle(tiles.begin(), tiles.end(), random);
+    for (const ShadowAtlasRect& tile : tiles)
+        allocator.Free(tile);
+
+    CHECK(allocator.GetAllocatedArea() == 0);
+    CHECK(allocator.IsSingleRoot());
+    CHECK(allocator.Allocate(8192, rect) && rect.X == 0 && rect.Y == 0);
+}
+
+TEST(ShadowAtlasChurn)
+{
+    // Lights coming and going, the way tiles are handed out frame to frame
+    std::mt19937 random(6);
+    std::uniform_int_distribution<uint32_t> size(64, 4096);
+    TestAtlasAllocator allocator(8192, 128);
+
+    std::vector<ShadowAtlasRect> tiles;
+    for (uint32_t step = 0; step < 4000; step++)
+    {
+        if (!tiles.empty() && random() % 3 == 0)
+        {
+            size_t index = random() % tiles.size();
+            allocator.Free(tiles[index]);
+            tiles.erase(tiles.begin() + index);
+        }
+        else
+        {
+            ShadowAtlasRect rect;
+            if (allocator.Allocate(size(random), rect))
+                tiles.push_back(rect);
+        }
+
+        if (step % 50 == 0)
+            CheckTiles(allocator, tiles);
+    }
+    CheckTiles(allocator, tiles);
+
+    for (const ShadowAtlasRect& tile : tiles)
+        allocator.Free(tile);
+    CHECK(allocator.GetAllocatedArea() == 0);
+    CHECK(allocator.IsSingleRoot());
+}
+
+TEST(ShadowAtlasSizes)
+{
+    TestAtlasAllocator allocator(8192, 128);
+    ShadowAtlasRect rect;
+
+    // Too big never fits, sizes round up to a power of two no smaller than the minimum
+    CHECK(!allocator.Allocate(8193, rect));
+    CHECK(allocator.Allocate(100, rect) && rect.Size == 128);
+    CHECK(allocator.Allocate(3000, rect) && rect.Size == 4096);
+    CHECK(!allocator.Allocate(8192, rect));
+
+    // Four quadrants fill the atlas exactly
+    allocator.Reset(8192, 128);
+    std::vector<ShadowAtlasRect> tiles(4);
+    for (ShadowAtlasRect& tile : tiles)
+        CHECK(allocator.Allocate(4096, tile));
+    CHECK(!allocator.Allocate(128, rect));
+    CheckTiles(allocator, tiles);
+
+    // Freeing three isn't enough to merge
+    for (uint32_t i = 0; i < 3; i++)
+        allocator.Free(tiles[i]);
+    CHECK(!allocator.IsSingleRoot());
+    CHECK(!allocator.Allocate(8192, rect));
+    allocator.Free(tiles[3]);
+    CHECK(allocator.IsSingleRoot());
+
+    // Non power of two sizes are rounded up on reset
+    allocator.Reset(3000, 100);
+    CHECK(allocator.GetAtlasSize() == 4096 && allocator.GetMinTileSize() == 128);
+    CHECK(allocator.IsSingleRoot());
+}
@@ -0,0 +1,169 @@
+#include "Tests.h"
+#include "Achilles/ShadowScheduler.h"
+#include "Achilles/ShadowCamera.h"
+#include "Achilles/LightObject.h"
+#include "Achilles/Camera.h"
+#include <algorithm>
+#include <cmath>
+
+using DirectX::SimpleMath::Vector3;
+
+static std::shared_ptr<LightObject> MakeSpotLight(Vector3 position, float strength)
+{
+    std::shared_ptr<LightObject> light = std::make_shared<LightObject>(L"Test Spot Light");
+    SpotLight spotLight;
+    spotLight.Light.Strength = strength;
+    spotLight.Light.MaxDistance = 5.0f;
+    light->AddLight(spotLight);
+    light->SetIsShadowCaster(true);
+    light->SetWorldPosition(position);
+    return light;
+}
+
+// Gathered each update the way Achilles::Render does
+static std::vector<CombinedLight> GatherLights(const std::vector<std::shared_ptr<LightObject>>& lightObjects)
+{
+    std::vector<CombinedLight> lights;
+    for (const std::shared_ptr<LightObject>& lightObject : lightObjects)
+    {
+        SpotLight& light = lightObject->GetSpotLight();
+        lights.push_back(CombinedLight{ .Rank = light.Light.Rank, .LightObject = lightObject.get(), .LightType = LightType::Spot, .IsShadowCaster = lightObject->IsShadowCaster(), .SpotLight = light });
+    }
+    return lights;
+}
+
+static const ShadowScheduler::ScheduledShadow* FindScheduled(const std::vector<ShadowScheduler::ScheduledShadow>& scheduled, const std::shared_ptr<LightObject>& lightObject)
+{
+    for (const ShadowScheduler::ScheduledShadow& shadow : scheduled)
+    {
+        if (shadow.LightObject == lightObject.get())
+            return &shadow;
+    }
+    return nullptr;
+}
+
+static uint64_t GetCost(const ShadowScheduler::ScheduledShadow& shadow)
+{
+    return (uint64_t)shadow.TileSize * shadow.TileSize * shadow.ShadowCamera->GetViewCount();
+}
+
+TEST(ShadowSchedulerHysteresis)
+{
+    ShadowScheduler::Release();
+    std::shared_ptr<Camera> camera = std::make_shared<Camera>(L"Test Camera", 1280, 720);
+
+    // Bright lights filling all but the last slot, and two dim ones the same distance away competing for it
+    std::vector<std::shared_ptr<LightObject>> lightObjects;
+    for (uint32_t i = 0; i < MAX_SPOT_SHADOW_MAPS - 1; i++)
+        lightObjects.push_back(MakeSpotLight(Vector3(-8.0f + i * 2.0f, 3.0f, 20.0f), 10.0f));
+    std::shared_ptr<LightObject> holder = MakeSpotLight(Vector3(-2.0f, 0.0f, 20.0f), 1.0f);
+    std::shared_ptr<LightObject> challenger = MakeSpotLight(Vector3(2.0f, 0.0f, 20.0f), 0.5f);
+    lightObjects.push_back(holder);
+    lightObjects.push_back(challenger);
+
+    std::vector<CombinedLight> lights = GatherLights(lightObjects);
+    std::vector<ShadowScheduler::ScheduledShadow> scheduled = ShadowScheduler::Schedule(lights, camera);
+    CHECK(scheduled.size() == MAX_SPOT_SHADOW_MAPS);
+    CHECK(FindScheduled(scheduled, holder) != nullptr && FindScheduled(scheduled, challenger) == nullptr);
+
+    // The challenger wanders either side of the holder without beating it by the hysteresis fraction, then overtakes it and wanders again
+    std::shared_ptr<LightObject> owner = holder;
+    uint32_t ownerChanges = 0;
+    for (uint32_t update = 0; update < 120; update++)
+    {
+        float wander = 1.0f + ShadowScheduler::Hysteresis * 0.6f * sinf(update * 0.7f);
+        float strength = update < 60 ? wander : (update < 61 ? 1.0f + ShadowScheduler::Hysteresis * 1.5f : wander);
+        challenger->GetSpotLight().Light.Strength = strength;
+
+        lights = GatherLights(lightObjects);
+        scheduled = ShadowScheduler::Schedule(lights, camera);
+        CHECK(scheduled.size() == MAX_SPOT_SHADOW_MAPS);
+
+        bool holderSlotted = FindScheduled(scheduled, holder) != nullptr;
+        bool challengerSlotted = FindScheduled(scheduled, challenger) != nullptr;
+        CHECK(holderSlotted != challengerSlotted);
+
+        std::shared_ptr<LightObject> newOwner = holderSlotted ? holder : challenger;
+        ownerChanges += newOwner != owner;
+        owner = newOwner;
+
+        // Shadowed lights are moved to the front
+        for (size_t i = 0; i < scheduled.size(); i++)
+            CHECK(lights[i].LightObject == scheduled[i].LightObject);
+    }
+    CHECK(ownerChanges == 1 && owner == challenger);
+
+    ShadowScheduler::Release();
+}
+
+TEST(ShadowSchedulerBudget)
+{
+    ShadowScheduler::Release();
+    uint64_t texelBudget = ShadowScheduler::TexelBudget;
+    uint32_t maxUpdateInterval = ShadowScheduler::MaxUpdateInterval;
+    std::shared_ptr<Camera> camera = std::make_shared<Camera>(L"Test Camera", 1280, 720);
+
+    // Lights at a spread of distances and strengths, so their tiles and scores differ
+    std::vector<std::shared_ptr<LightObject>> lightObjects;
+    for (uint32_t i = 0; i < MAX_SPOT_SHADOW_MAPS; i++)
+        lightObjects.push_back(MakeSpotLight(Vector3(-7.0f + i * 2.0f, 0.0f, 8.0f + i * 5.0f), 1.0f + (i % 3) * 2.0f));
+
+    // Everything is new on the first update, so it's all drawn whatever the budget
+    std::vector<CombinedLight> lights = GatherLights(lightObjects);
+    std::vector<ShadowScheduler::ScheduledShadow> scheduled = ShadowScheduler::Schedule(lights, camera);
+    CHECK(scheduled.size() == MAX_SPOT_SHADOW_MAPS);
+    uint64_t totalCost = 0, maxCost = 0;
+    for (const ShadowScheduler::ScheduledShadow& shadow : scheduled)
+    {
+        CHECK(shadow.UpdateDue);
+        totalCost += GetCost(shadow);
+        maxCost = std::max(maxCost, GetCost(shadow));
+    }
+
+    // Roughly a third of the lights fit each update, then next to nothing
+    std::vector<uint32_t> updatesSinceDrawn(lightObjects.size(), 0);
+    for (uint64_t budget : { std::max(totalCost / 3, maxCost), (uint64_t)1 })
+    {
+        ShadowScheduler::TexelBudget = budget;
+        for (uint32_t interval : { 4u, 8u })
+        {
+            ShadowScheduler::MaxUpdateInterval = interval;
+
+            for (uint32_t update = 0; update < 100; update++)
+            {
+                lights = GatherLights(lightObjects);
+                scheduled = ShadowScheduler::Schedule(lights, camera);
+                CHECK(scheduled.size() == MAX_SPOT_SHADOW_MAPS);
+
+                uint64_t texelsDrawn = 0;
+                uint32_t drawn = 0, forced = 0;
+                for (size_t i = 0; i < lightObjects.size(); i++)
+                {
+                    const ShadowScheduler::ScheduledShadow* shadow = FindScheduled(scheduled, lightObjects[i]);
+                    CHECK(shadow != nullptr);
+
+                    // Redrawn at least every interval updates
+                    forced += updatesSinceDrawn[i] + 1 >= interval;
+                    updatesSinceDrawn[i]++;
+                    CHECK(shadow->UpdateDue || updatesSinceDrawn[i] < interval);
+                    if (shadow->UpdateDue)
+                    {
+                        texelsDrawn += GetCost(*shadow);
+                        drawn++;
+                        updatesSinceDrawn[i] = 0;
+                    }
+                }
+
+                // Nothing moves, so only lights that reached the interval can take it over budget, and one light is always drawn
+                CHECK(drawn > 0);
+                CHECK(texelsDrawn <= budget || drawn <= std::max(forced, 1u));
+                if (budget > 1)
+                    CHECK(texelsDrawn <= budget);
+            }
+        }
+    }
+
+    ShadowScheduler::TexelBudget = texelBudget;
+    ShadowScheduler::MaxUpdateInterval = maxUpdateInterval;
+    ShadowScheduler::Release();
+}
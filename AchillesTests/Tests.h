@@ -0,0 +1,32 @@
+#pragma once
+
+#include <exception>
+#include <string>
+#include <vector>
+
+// Every test registers itself here and main runs them all, so each file only needs to define its tests
+struct Test
+{
+    const char* Name;
+    void (*Run)();
+};
+
+std::vector<Test>& GetTests();
+
+struct TestRegistration
+{
+    TestRegistration(const char* name, void (*run)())
+    {
+        GetTests().push_back({ name, run });
+    }
+};
+
+#define TEST(name) \
+    static void name(); \
+    static TestRegistration name##Registration(#name, name); \
+    static void name()
+
+// Throws so the failing test is reported and the rest still run
+#define CHECK(condition) \
+    if (!(condition)) \
+        throw std::exception((std::string(__FILE__) + "(" + std::to_string(__LINE__) + "): " + #condition).c_str())
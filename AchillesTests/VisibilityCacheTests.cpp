@@ -0,0 +1,82 @@
+#include "Tests.h"
+#include "Achilles/VisibilityCache.h"
+#include "Achilles/Application.h"
+#include "Achilles/Camera.h"
+#include "Achilles/Object.h"
+#include <cmath>
+#include <random>
+#include <set>
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+// Reads the camera's reference plane epoch, so the test can tell the planes were rebased
+class VisibilityCacheInspector : public VisibilityCache
+{
+public:
+    static uint64_t GetEpoch(std::shared_ptr<Camera> camera)
+    {
+        return GetCameraCache(camera).Epoch;
+    }
+};
+
+TEST(VisibilityCacheMatchesFrustum)
+{
+    VisibilityCache::Release();
+    std::mt19937 random(11);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    // Boxes of different sizes and orientations scattered around the camera's path
+    std::vector<std::shared_ptr<Object>> objects;
+    for (uint32_t i = 0; i < 400; i++)
+    {
+        std::shared_ptr<Object> object = std::make_shared<Object>(L"Test Object");
+        object->SetBoundingBox(BoundingOrientedBox(Vector3::Zero, Vector3(0.2f + unit(random) * 3.0f, 0.2f + unit(random) * 3.0f, 0.2f + unit(random) * 3.0f), Quaternion::Identity));
+        object->SetWorldPosition(Vector3(unit(random) * 120.0f - 60.0f, unit(random) * 20.0f - 10.0f, unit(random) * 120.0f - 60.0f));
+        object->SetWorldRotation(Quaternion::CreateFromYawPitchRoll(unit(random) * 6.0f, unit(random) * 6.0f, 0.0f));
+        objects.push_back(object);
+    }
+
+    std::shared_ptr<Camera> camera = std::make_shared<Camera>(L"Test Camera", 1280, 720);
+    camera->farZ = 50.0f;
+
+    // The camera circles the scene in small steps, turning and looking up and down as it goes, and sometimes holds still
+    VisibilityCache::Statistics total;
+    std::set<uint64_t> epochs;
+    for (uint32_t frame = 0; frame < 1500; frame++)
+    {
+        Application::IncrementGlobalFrameCounter();
+        VisibilityCache::Statistics statistics = VisibilityCache::GetStatistics();
+        total.Queries += statistics.Queries;
+        total.Reused += statistics.Reused;
+        total.Classified += statistics.Classified;
+        total.Tested += statistics.Tested;
+
+        if (frame % 10 != 0)
+        {
+            float angle = frame * 0.005f;
+            camera->SetPosition(Vector3(cosf(angle) * 40.0f, sinf(frame * 0.02f) * 3.0f, sinf(angle) * 40.0f));
+            camera->SetRotation(Vector3(sinf(frame * 0.013f) * 0.4f, -angle + sinf(frame * 0.007f) * 1.5f, 0.0f));
+        }
+
+        // A few objects move each frame, so their bounds change while the camera does too
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            std::shared_ptr<Object> object = objects[random() % objects.size()];
+            object->SetWorldPosition(object->GetWorldPosition() + Vector3(unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f));
+        }
+
+        camera->GetViewProj();
+        BoundingFrustum frustum = camera->GetFrustum();
+        for (const std::shared_ptr<Object>& object : objects)
+            CHECK(VisibilityCache::IsVisible(camera, object) == object->Object::ShouldDraw(frustum));
+        epochs.insert(VisibilityCacheInspector::GetEpoch(camera));
+    }
+
+    // Every path was taken, and the reference planes were moved more than once
+    CHECK(total.Reused > 0 && total.Classified > 0 && total.Tested > 0);
+    CHECK(total.Classified > total.Tested);
+    CHECK(epochs.size() > 2);
+
+    VisibilityCache::Release();
+}
@@ -0,0 +1,39 @@
+#include "Tests.h"
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+std::vector<Test>& GetTests()
+{
+    static std::vector<Test> tests;
+    return tests;
+}
+
+// Runs the CPU side of the engine that can be checked without a device
+// Usage: AchillesTests [name filter]
+int main(int argc, char* argv[])
+{
+    const char* filter = argc > 1 ? argv[1] : nullptr;
+    uint32_t run = 0, failed = 0;
+
+    for (const Test& test : GetTests())
+    {
+        if (filter && !strstr(test.Name, filter))
+            continue;
+
+        run++;
+        try
+        {
+            test.Run();
+            printf("passed %s\n", test.Name);
+        }
+        catch (const std::exception& e)
+        {
+            failed++;
+            printf("FAILED %s: %s\n", test.Name, e.what());
+        }
+    }
+
+    printf("%u of %u tests passed\n", run - failed, run);
+    return failed == 0 ? 0 : 1;
+}
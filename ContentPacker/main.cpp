@@ -0,0 +1,30 @@
+#include "Achilles/ContentPack.h"
+#include "Achilles/Helpers.h"
+#include <cstdio>
+#include <exception>
+
+// Packs a content directory into a content pack, see ContentPack
+// Usage: ContentPacker <content directory> <pack path> [--no-compress]
+int wmain(int argc, wchar_t* argv[])
+{
+    if (argc < 3)
+    {
+        fwprintf(stderr, L"Usage: ContentPacker <content directory> <pack path> [--no-compress]\n");
+        return 1;
+    }
+
+    bool compress = !(argc > 3 && std::wstring(argv[3]) == L"--no-compress");
+
+    try
+    {
+        ContentPack::Build(argv[1], argv[2], compress);
+    }
+    catch (const std::exception& e)
+    {
+        fprintf(stderr, "ContentPacker: %s\n", e.what());
+        return 1;
+    }
+
+    wprintf(L"ContentPacker: wrote %s\n", argv[2]);
+    return 0;
+}
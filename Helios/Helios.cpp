@@ -168,7 +168,7 @@ void Helios::LoadContent()
     Texture::AddCachedTexture(L"Skymap", skymapCubemap);
 
     // Create post processing class
-    postProcessing = std::make_shared<PostProcessing>((float)clientWidth, (float)clientHeight);
+    postProcessing = std::make_shared<PostProcessing>();
 
     ACHILLES_IF_DESTROYING_RETURN();
 
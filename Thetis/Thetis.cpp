@@ -18,13 +18,21 @@ if (postProcessing->ToneMapper == PPToneMapping::ToneMappers:: Name) \
 #define THETIS_SHADOWMAP_COMBO(Size) \
 if (ImGui::Selectable(std::to_string(Size).c_str(), shadowMapSize == Size)) \
 { \
-    postPresentFunctions.push_back([=]() { shadowCamera->ResizeShadowMaps(Size, Size); }); \
+    shadowCamera->SetMaxResolution(Size); \
 } \
 if (shadowMapSize == Size) \
 { \
     ImGui::SetItemDefaultFocus(); \
 }
 
+// Shows one of the camera's views from the shadow atlas
+static void ShadowAtlasTileImage(std::shared_ptr<ShadowCamera> shadowCamera, uint32_t view)
+{
+    Vector4 uvRect = ShadowAtlas::GetUVRect(shadowCamera->GetAtlasTile(view));
+    ImGui::Text("Atlas Tile Size: %u", shadowCamera->GetTileSize());
+    AchillesImGui::Image(ShadowAtlas::GetAtlas(), ImVec2(256.0f, 256.0f), ImVec2(uvRect.x, uvRect.y), ImVec2(uvRect.x + uvRect.z, uvRect.y + uvRect.w));
+}
+
 Thetis::Thetis(std::wstring _name, uint32_t width, uint32_t height) : Achilles(_name, width, height)
 {
 
@@ -185,6 +193,67 @@ void Thetis::DrawImGuiPerformance()
                 }
                 ImGui::EndTabItem();
             }
+            if (ImGui::BeginTabItem("Lights"))
+            {
+                int assignment = (int)lightAssignment;
+                if (ImGui::Combo("Assignment", &assignment, "All Lights\0Clustered\0Per Object\0"))
+                    lightAssignment = (LightAssignment)assignment;
+
+                if (lightData.ObjectLights != nullptr)
+                    ImGui::Text("Objects: %zu, Light Indices: %zu", lightData.ObjectLights->GetObjectCount(), lightData.ObjectLights->GetLightIndices().size());
+                if (lightData.Clusters != nullptr)
+                {
+                    const LightClusters::ClusterInfo& info = lightData.Clusters->GetClusterInfo();
+                    ImGui::Text("Clusters: %u x %u x %u", info.ClusterCountX, info.ClusterCountY, info.ClusterCountZ);
+                    ImGui::Text("Light Indices: %zu (%u dropped)", lightData.Clusters->GetLightIndices().size(), lightData.Clusters->GetDroppedLightIndices());
+                }
+
+                static double benchmarkMilliseconds = 0.0;
+                if (ImGui::Button("Benchmark 1024 Lights"))
+                    benchmarkMilliseconds = LightClusters::Benchmark(1024);
+                if (benchmarkMilliseconds > 0.0)
+                    ImGui::Text("Build: %.3f ms", benchmarkMilliseconds);
+                ImGui::EndTabItem();
+            }
+            if (ImGui::BeginTabItem("Culling"))
+            {
+                ImGui::Checkbox("Frustum Culling", &frustumCulling);
+                ImGui::Checkbox("Occlusion Culling", &occlusionCulling);
+                ImGui::Checkbox("Visibility Cache", &VisibilityCache::Enabled);
+                ImGui::Checkbox("Contribution Culling", &Camera::contributionCulling);
+
+                VisibilityCache::Statistics visibility = VisibilityCache::GetStatistics();
+                ImGui::Text("Visibility: %u reused, %u classified, %u tested", visibility.Reused, visibility.Classified, visibility.Tested);
+
+                // Too small on screen for each pass's thresholds
+                Camera::ContributionCounters contribution = Camera::lastContributionCounters;
+                ImGui::Text("Main: %u of %u objects culled", contribution.Main.Culled, contribution.Main.Tested);
+                ImGui::Text("Z-Prepass: %u of %u draws culled", contribution.PrePass.Culled, contribution.PrePass.Tested);
+                ImGui::Text("Shadows: %u of %u draws culled", contribution.Shadow.Culled, contribution.Shadow.Tested);
+
+                OcclusionBuffer::Statistics statistics = occlusionBuffer.GetStatistics();
+                ImGui::Text("Occluders: %u (%u triangles)", statistics.OccluderCount, statistics.TriangleCount);
+                ImGui::Text("Occluded: %u of %u", statistics.OccludedCount, statistics.TestedCount);
+
+                static double benchmarkMilliseconds = 0.0;
+                if (ImGui::Button("Benchmark 256 Occluders"))
+                    benchmarkMilliseconds = OcclusionBuffer::Benchmark(256);
+                if (benchmarkMilliseconds > 0.0)
+                    ImGui::Text("Render: %.3f ms", benchmarkMilliseconds);
+                ImGui::EndTabItem();
+            }
+            if (ImGui::BeginTabItem("Render Graph"))
+            {
+                ImGui::Checkbox("Alias Transients", &RenderGraph::AliasTransients);
+                ImGui::Checkbox("Split Barriers", &RenderGraph::SplitBarriers);
+
+                const RenderGraph::Statistics& statistics = renderGraphStatistics;
+                ImGui::Text("Passes: %u (%u culled)", statistics.Passes, statistics.CulledPasses);
+                ImGui::Text("Barriers: %u transitions, %u split, %u UAV, %u aliasing", statistics.Transitions, statistics.SplitBarriers, statistics.UAVBarriers, statistics.AliasingBarriers);
+                ImGui::Text("Barrier Batches: %u", statistics.Batches);
+                ImGui::Text("Transients: %.2f MB in %.2f MB of heaps", statistics.TransientBytes / (1024.0 * 1024.0), statistics.HeapBytes / (1024.0 * 1024.0));
+                ImGui::EndTabItem();
+            }
             ImGui::EndTabBar();
         }
     }
@@ -733,6 +802,12 @@ void Thetis::DrawImGuiProperties()
                     {
                         object->SetReceiveShadows(receivesShadows);
                     }
+
+                    bool isStatic = object->IsStatic();
+                    if (ImGui::Checkbox("Static", &isStatic))
+                    {
+                        object->SetStatic(isStatic);
+                    }
                 }
 
                 // Light properties
@@ -791,52 +866,58 @@ void Thetis::DrawImGuiProperties()
                             ImGui::DragFloat("Quadratic Attenuation", &pointLight.Light.QuadraticAttenuation, 0.00025f, 0.0f, 2.0f, "%.7f");
                             ImGui::Separator();
                             ImGui::DragFloat("Rank", &pointLight.Light.Rank, 0.25f, -25.0f, 25.0f, "%.0f");
+                            ImGui::Text("Shadow Score: %.3f", ShadowScheduler::GetScore(lightObject.get(), LightType::Point));
 
                             ImGui::Separator();
                             std::shared_ptr<ShadowCamera> shadowCamera = lightObject->GetShadowCamera(LightType::Point, nullptr);
-                            if (shadowCamera && shadowCamera->GetShadowMap() != nullptr)
+                            if (shadowCamera)
                             {
-                                static uint32_t selectedPointCubeDirection = 0;
-
-                                std::string selectedPointCubeDirectionStr = std::to_string(selectedPointCubeDirection);
-                                if (ImGui::BeginCombo("View Direction", selectedPointCubeDirectionStr.c_str()))
-                                {
-                                    for (uint32_t c = 0; c < 6; c++)
-                                    {
-                                        if (ImGui::Selectable(std::to_string(c).c_str(), selectedPointCubeDirection == c))
-                                        {
-                                            selectedPointCubeDirection = c;
-                                        }
-                                        if (selectedPointCubeDirection == c)
-                                        {
-                                            ImGui::SetItemDefaultFocus();
-                                        }
-                                    }
-
-                                    ImGui::EndCombo();
-                                }
-
-                                std::shared_ptr<ShadowMap> shadowMap = shadowCamera->GetShadowMap(selectedPointCubeDirection);
-
-                                uint32_t shadowMapSize = shadowCamera->cameraWidth;
+                                uint32_t shadowMapSize = shadowCamera->GetMaxResolution();
                                 std::string shadowMapSizeStr = std::to_string(shadowMapSize);
-                                if (ImGui::BeginCombo("Shadow Map Size", shadowMapSizeStr.c_str()))
+                                if (ImGui::BeginCombo("Max Shadow Map Size", shadowMapSizeStr.c_str()))
                                 {
                                     THETIS_SHADOWMAP_COMBO(128);
                                     THETIS_SHADOWMAP_COMBO(256);
                                     THETIS_SHADOWMAP_COMBO(512);
                                     THETIS_SHADOWMAP_COMBO(1024);
-                                    THETIS_SHADOWMAP_COMBO(2048);
                                     ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 0.25f, 0.25f, 1.0f));
-                                    THETIS_SHADOWMAP_COMBO(4096);
-                                    THETIS_SHADOWMAP_COMBO(8192);
-                                    // THETIS_SHADOWMAP_COMBO(16384);
+                                    THETIS_SHADOWMAP_COMBO(2048);
                                     ImGui::PopStyleColor();
 
                                     ImGui::EndCombo();
                                 }
 
-                                AchillesImGui::Image(shadowMap, ImVec2(256.0f, 256.0f));
+                                ImGui::DragFloat("Min Caster Screen Size", &shadowCamera->minScreenSize, 0.0005f, 0.0f, 1.0f, "%.4f");
+
+                                // Lights the scheduler left out this frame have no tiles to show
+                                if (shadowCamera->HasAtlasTiles())
+                                {
+                                    static uint32_t selectedPointCubeDirection = 0;
+
+                                    std::string selectedPointCubeDirectionStr = std::to_string(selectedPointCubeDirection);
+                                    if (ImGui::BeginCombo("View Direction", selectedPointCubeDirectionStr.c_str()))
+                                    {
+                                        for (uint32_t c = 0; c < 6; c++)
+                                        {
+                                            if (ImGui::Selectable(std::to_string(c).c_str(), selectedPointCubeDirection == c))
+                                            {
+                                                selectedPointCubeDirection = c;
+                                            }
+                                            if (selectedPointCubeDirection == c)
+                                            {
+                                                ImGui::SetItemDefaultFocus();
+                                            }
+                                        }
+
+                                        ImGui::EndCombo();
+                                    }
+
+                                    ShadowAtlasTileImage(shadowCamera, selectedPointCubeDirection);
+                                }
+                                else
+                                {
+                                    ImGui::TextDisabled("(no atlas tiles)");
+                                }
                             }
 
                             ImGui::TreePop();
@@ -879,6 +960,7 @@ void Thetis::DrawImGuiProperties()
 
                             ImGui::Separator();
                             ImGui::DragFloat("Rank", &spotLight.Light.Rank, 0.25f, -25.0f, 25.0f, "%.0f");
+                            ImGui::Text("Shadow Score: %.3f", ShadowScheduler::GetScore(lightObject.get(), LightType::Spot));
 
                             // Debug
                             ImGui::Separator();
@@ -894,29 +976,25 @@ void Thetis::DrawImGuiProperties()
 
                             ImGui::Separator();
                             std::shared_ptr<ShadowCamera> shadowCamera = lightObject->GetShadowCamera(LightType::Spot, nullptr);
-                            if (shadowCamera && shadowCamera->GetShadowMap() != nullptr)
+                            if (shadowCamera)
                             {
-                                std::shared_ptr<ShadowMap> shadowMap = shadowCamera->GetShadowMap();
-
-                                uint32_t shadowMapSize = shadowCamera->cameraWidth;
+                                uint32_t shadowMapSize = shadowCamera->GetMaxResolution();
                                 std::string shadowMapSizeStr = std::to_string(shadowMapSize);
-                                if (ImGui::BeginCombo("Shadow Map Size", shadowMapSizeStr.c_str()))
+                                if (ImGui::BeginCombo("Max Shadow Map Size", shadowMapSizeStr.c_str()))
                                 {
                                     THETIS_SHADOWMAP_COMBO(128);
                                     THETIS_SHADOWMAP_COMBO(256);
                                     THETIS_SHADOWMAP_COMBO(512);
                                     THETIS_SHADOWMAP_COMBO(1024);
                                     THETIS_SHADOWMAP_COMBO(2048);
-                                    THETIS_SHADOWMAP_COMBO(4096);
-                                    ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 0.25f, 0.25f, 1.0f));
-                                    THETIS_SHADOWMAP_COMBO(8192);
-                                    THETIS_SHADOWMAP_COMBO(16384);
-                                    ImGui::PopStyleColor();
-
                                     ImGui::EndCombo();
                                 }
 
-                                AchillesImGui::Image(shadowMap, ImVec2(256.0f, 256.0f));
+                                ImGui::DragFloat("Min Caster Screen Size", &shadowCamera->minScreenSize, 0.0005f, 0.0f, 1.0f, "%.4f");
+                                if (shadowCamera->HasAtlasTiles())
+                                    ShadowAtlasTileImage(shadowCamera, 0);
+                                else
+                                    ImGui::TextDisabled("(no atlas tile)");
                             }
 
                             ImGui::TreePop();
@@ -945,6 +1023,7 @@ void Thetis::DrawImGuiProperties()
                             ImGui::DragFloat("Strength", &directionalLight.Strength, 0.025f, 0.0f, 100.0f, "%.3f");
                             ImGui::Separator();
                             ImGui::DragFloat("Rank", &directionalLight.Rank, 0.25f, -25.0f, 25.0f, "%.0f");
+                            ImGui::Text("Shadow Score: %.3f", ShadowScheduler::GetScore(lightObject.get(), LightType::Directional));
 
                             ImGui::Separator();
 
@@ -1025,8 +1104,16 @@ void Thetis::DrawImGuiProperties()
 
                                 if (numCascades > 0)
                                 {
+                                    bool sampleDistribution = shadowCamera->GetSampleDistribution();
+                                    if (ImGui::Checkbox("Fit To Depth Range", &sampleDistribution))
+                                        shadowCamera->SetSampleDistribution(sampleDistribution);
+                                    if (sampleDistribution && !shadowCamera->IsUsingSampleDistribution())
+                                    {
+                                        ImGui::SameLine();
+                                        ImGui::TextDisabled("(no depth range)");
+                                    }
+
                                     float intervals[2] = { 0 };
-                                    float cameraZRange = Camera::mainCamera->farZ - Camera::mainCamera->nearZ;
 
                                     if (selectedCascade == 0)
                                         intervals[0] = 0.0f;
@@ -1038,47 +1125,51 @@ void Thetis::DrawImGuiProperties()
                                     ImGui::BeginDisabled(true);
                                     ImGui::InputFloat2("Partitions", intervals, "%.2f");
 
-                                    intervals[0] *= cameraZRange;
-                                    intervals[1] *= cameraZRange;
+                                    // What the cascade was last fitted to, from either the partitions or the depth range
+                                    const std::vector<Vector2>& cascadeIntervals = shadowCamera->GetCascadeIntervals();
+                                    if (selectedCascade < cascadeIntervals.size())
+                                    {
+                                        intervals[0] = cascadeIntervals[selectedCascade].x;
+                                        intervals[1] = cascadeIntervals[selectedCascade].y;
+                                    }
 
                                     ImGui::InputFloat2("Partition Intervals", intervals, "%.2f");
                                     ImGui::EndDisabled();
+
+                                    // How many shadow updates apart the viewed cascade is redrawn
+                                    int updateInterval = (int)shadowCamera->GetCascadeUpdateInterval(selectedCascade);
+                                    if (ImGui::DragInt("Update Interval", &updateInterval, 0.05f, 1, 16, "%i"))
+                                        shadowCamera->SetCascadeUpdateInterval(selectedCascade, (uint32_t)updateInterval);
                                 }
 
-                                if (shadowCamera->GetShadowMap())
-                                {
-                                    ImGui::Separator();
+                                ImGui::Separator();
 
-                                    if (selectedCascade >= shadowCamera->GetNumCascades())
-                                        selectedCascade = std::max<uint32_t>(1, shadowCamera->GetNumCascades()) - 1;
-                                    if (shadowCamera->GetNumCascades() == 0)
-                                        selectedCascade = 0;
+                                if (selectedCascade >= shadowCamera->GetNumCascades())
+                                    selectedCascade = std::max<uint32_t>(1, shadowCamera->GetNumCascades()) - 1;
+                                if (shadowCamera->GetNumCascades() == 0)
+                                    selectedCascade = 0;
 
-                                    std::shared_ptr<ShadowMap> shadowMap = shadowCamera->GetShadowMap(selectedCascade);
+                                uint32_t shadowMapSize = shadowCamera->GetMaxResolution();
+                                std::string shadowMapSizeStr = std::to_string(shadowMapSize);
+                                if (ImGui::BeginCombo("Max Shadow Map Size", shadowMapSizeStr.c_str()))
+                                {
+                                    THETIS_SHADOWMAP_COMBO(128);
+                                    THETIS_SHADOWMAP_COMBO(256);
+                                    THETIS_SHADOWMAP_COMBO(512);
+                                    THETIS_SHADOWMAP_COMBO(1024);
+                                    THETIS_SHADOWMAP_COMBO(2048);
 
-                                    uint32_t shadowMapSize = shadowCamera->cameraWidth;
-                                    std::string shadowMapSizeStr = std::to_string(shadowMapSize);
-                                    if (ImGui::BeginCombo("Shadow Map Size", shadowMapSizeStr.c_str()))
-                                    {
-                                        THETIS_SHADOWMAP_COMBO(128);
-                                        THETIS_SHADOWMAP_COMBO(256);
-                                        THETIS_SHADOWMAP_COMBO(512);
-                                        THETIS_SHADOWMAP_COMBO(1024);
-                                        THETIS_SHADOWMAP_COMBO(2048);
-                                        ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 0.25f, 0.25f, 1.0f));
-                                        THETIS_SHADOWMAP_COMBO(4096);
-                                        THETIS_SHADOWMAP_COMBO(8192);
-                                        THETIS_SHADOWMAP_COMBO(16384);
-
-                                        ImGui::PopStyleColor();
+                                    ImGui::EndCombo();
+                                }
 
-                                        ImGui::EndCombo();
-                                    }
+                                ImGui::DragFloat("Min Caster Screen Size", &shadowCamera->minScreenSize, 0.0005f, 0.0f, 1.0f, "%.4f");
 
-                                    ImGui::Separator();
+                                ImGui::Separator();
 
-                                    AchillesImGui::Image(shadowMap, ImVec2(256.0f, 256.0f));
-                                }
+                                if (shadowCamera->HasAtlasTiles())
+                                    ShadowAtlasTileImage(shadowCamera, selectedCascade);
+                                else
+                                    ImGui::TextDisabled("(no atlas tiles)");
                             }
 
                             ImGui::TreePop();
@@ -1141,6 +1232,10 @@ void Thetis::DrawImGuiCameraProperties()
                 camera->ConstructProjection();
             }
 
+            // Fractions of the view height an object has to cover to be drawn, and to be drawn into the Z-prepass
+            ImGui::DragFloat("Min Screen Size", &camera->minScreenSize, 0.0005f, 0.0f, 1.0f, "%.4f");
+            ImGui::DragFloat("Min Pre-Pass Screen Size", &camera->minPrePassScreenSize, 0.001f, 0.0f, 1.0f, "%.3f");
+
             ImGui::Separator();
             if (camera->IsOrthographic())
             {
@@ -1217,6 +1312,20 @@ void Thetis::DrawTextureSelection()
 
         auto textureNames = Texture::GetCachedTextureNames();
 
+        if (ImGui::CollapsingHeader("Cache"))
+        {
+            constexpr float megabyte = 1024.0f * 1024.0f;
+            TextureResidencyStatistics statistics = TextureResidency::GetStatistics();
+            ImGui::Text("Resident: %zu textures, %.1f MB", statistics.TextureCount, statistics.ResidentBytes / megabyte);
+            ImGui::Text("Evictable: %zu textures, %.1f MB", statistics.EvictableCount, statistics.EvictableBytes / megabyte);
+            ImGui::Text("Evicted: %llu textures, %.1f MB", statistics.EvictedCount, statistics.EvictedBytes / megabyte);
+
+            ImGui::Checkbox("Evict Over Budget", &TextureResidency::Enabled);
+            int budgetMegabytes = (int)(TextureResidency::BudgetBytes / (1024 * 1024));
+            if (ImGui::DragInt("Budget (MB)", &budgetMegabytes, 16.0f, 64, 16384))
+                TextureResidency::BudgetBytes = (size_t)budgetMegabytes * 1024 * 1024;
+        }
+
         static char textureSelectFilter[64];
         ImGui::SetNextItemWidth(-1);
         ImGui::InputTextWithHint("##Filter", "Filter", textureSelectFilter, 64);
@@ -1482,6 +1591,9 @@ void Thetis::LoadContent()
     // camera->SetRotation(EulerToRadians(Vector3(0, 0, 0)));
 
     // Create shaders
+    ShaderCompiler::Precompile(L"PosCol", ShaderType::VSPS);
+    ShaderCompiler::Precompile(L"PosTextured", ShaderType::VSPS);
+    ShaderCompiler::Precompile(L"Water", ShaderType::VSPS);
     std::shared_ptr<Shader> posColShader = GetPosColShader(device);
     std::shared_ptr<Shader> posTexturedShader = PosTextured::GetPosTexturedShader(device);
     std::shared_ptr<Shader> blinnPhongShader = BlinnPhong::GetBlinnPhongShader(device);
@@ -1595,7 +1707,7 @@ void Thetis::LoadContent()
     Texture::AddCachedTexture(L"Outdoor HDRI 64 Cubemap", outdoorCubemap);
 
     // Create post processing class
-    postProcessing = std::make_shared<PostProcessing>((float)clientWidth, (float)clientHeight);
+    postProcessing = std::make_shared<PostProcessing>();
 
 
     // Create debug wireframe bounding box
@@ -1862,6 +1974,16 @@ void Thetis::PopulateMeshNames()
 {
     meshNames.clear();
     meshNamesWide.clear();
+    if (ContentPack::IsMounted())
+    {
+        for (const std::wstring& name : ContentPack::ListDirectory(L"models/"))
+        {
+            meshNames.push_back(WStringToString(name));
+            meshNamesWide.push_back(name);
+        }
+        return;
+    }
+
     for (const auto& file : std::filesystem::directory_iterator(GetContentDirectoryW() + L"models/"))
     {
         if (file.is_directory())